@@ -51,6 +51,26 @@ nvolumes=%1%
 # Default value is 4GB (if value is not set).
 volume_size=4GB
 
+# Rollup tiers, comma separated list of durations (e.g. 1m,1h,1d).
+# Group-aggregate results for every tier are computed at ingestion
+# time and used by `group-aggregate` queries when the step is a
+# multiple of the tier (parts of the range that are not aligned to
+# the tier are read from the raw data). Every tier is stored as a
+# separate series, so N tiers multiply the number of series stored
+# (and the memory used by them) by N+1. Tiers are saved into the
+# database on first start, changing this value later has no effect.
+# rollup_tiers=1m,1h,1d
+
+# Series are loaded into memory lazily on first write or query. This
+# value limits the memory used by the loaded series, the ones that are
+# not written for a while are unloaded when the limit is exceeded.
+# You can use MB or GB suffix. Unlimited by default.
+# max_tree_memory=4GB
+
+# Number of the most recently written series that are loaded into
+# memory in background on startup. Disabled by default.
+# warmup_series=100000
+
 
 # HTTP API endpoint configuration
 
@@ -73,8 +93,10 @@ pool_size=0
 [UDP]
 # port number
 port=8383
-# worker pool size
+# worker pool size (every worker reads from its own socket)
 pool_size=1
+# max number of datagrams read from the socket at once
+batch_size=16
 
 # OpenTSDB telnet-style data connection enabled (remove this section to disable).
 
@@ -82,6 +104,12 @@ pool_size=1
 # port number
 port=4242
 
+# Binary columnar data connection (uncomment to enable).
+
+#[Binary]
+# port number
+#port=8484
+
 
 # Logging configuration
 # This is just a log4cxx configuration without any modifications
@@ -196,6 +224,10 @@ struct ConfigFile {
         return conf.get<i32>("nvolumes");
     }
 
+    static std::string get_rollup_tiers(PTree conf) {
+        return conf.get<std::string>("rollup_tiers", "");
+    }
+
     static u64 get_memory_size(std::string strsize) {
         u64 result = 0;
         try {
@@ -234,6 +266,14 @@ struct ConfigFile {
 
     }
 
+    static u64 get_max_tree_memory(PTree conf) {
+        return get_memory_size(conf.get<std::string>("max_tree_memory", "0"));
+    }
+
+    static u32 get_warmup_series(PTree conf) {
+        return conf.get<u32>("warmup_series", 0u);
+    }
+
     static u64 get_volume_size(PTree conf) {
         auto strsize = conf.get<std::string>("volume_size", "4GB");
         return get_memory_size(strsize);
@@ -271,6 +311,7 @@ struct ConfigFile {
         settings.name = "UDP";
         settings.protocols.push_back({ "UDP", conf.get<int>("UDP.port")});
         settings.nworkers = conf.get<int>("UDP.pool_size");
+        settings.batch_size = conf.get<int>("UDP.batch_size", 0);
         return settings;
     }
 
@@ -281,6 +322,9 @@ struct ConfigFile {
         if (conf.count("OpenTSDB")) {
             settings.protocols.push_back({ "OpenTSDB", conf.get<int>("OpenTSDB.port")});
         }
+        if (conf.count("Binary")) {
+            settings.protocols.push_back({ "Binary", conf.get<int>("Binary.port")});
+        }
         settings.nworkers = conf.get<int>("TCP.pool_size");
         return settings;
     }
@@ -455,6 +499,9 @@ void cmd_run_server() {
     auto path                   = ConfigFile::get_path(config);
     auto ingestion_servers      = ConfigFile::get_server_settings(config);
     auto wal_config             = ConfigFile::get_wal_settings(config);
+    auto rollup_tiers           = ConfigFile::get_rollup_tiers(config);
+    auto max_tree_memory        = ConfigFile::get_max_tree_memory(config);
+    auto warmup_series          = ConfigFile::get_warmup_series(config);
     auto full_path              = boost::filesystem::path(path) / "db.akumuli";
 
     if (!boost::filesystem::exists(full_path)) {
@@ -463,6 +510,11 @@ void cmd_run_server() {
         std::cout << cli_format(fmt.str()) << std::endl;
     } else {
         aku_FineTuneParams params = {};
+        if (!rollup_tiers.empty()) {
+            params.rollup_tiers = rollup_tiers.c_str();
+        }
+        params.max_tree_memory = max_tree_memory;
+        params.warmup_series   = warmup_series;
         if (!wal_config.path.empty() && wal_config.nvolumes != 0 && wal_config.volume_size_bytes != 0) {
             unsigned log_ccr = 0;
             for (auto settings: ingestion_servers) {
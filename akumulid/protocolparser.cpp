@@ -1,13 +1,89 @@
 #include "protocolparser.h"
 #include <sstream>
 #include <cassert>
+#include <cstring>
+#include <exception>
 #include <boost/algorithm/string.hpp>
+#include <boost/exception/diagnostic_information.hpp>
 
 #include "resp.h"
 #include "storage_api.h"
+#include "lz4.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define AKU_PARSER_SIMD_KERNELS
+#include <immintrin.h>
+#endif
 
 namespace Akumuli {
 
+// Delimiter scanner //
+
+/** Return offset of the first occurrence of `c1` or `c2` in the buffer
+  * or `len` if the buffer doesn't contain any of them. Kernels never
+  * read past the end of the buffer.
+  */
+typedef int (*find_delim_kernel_t)(const Byte* p, int len, Byte c1, Byte c2);
+
+static int find_delim_scalar(const Byte* p, int len, Byte c1, Byte c2) {
+    for (int i = 0; i < len; i++) {
+        if (p[i] == c1 || p[i] == c2) {
+            return i;
+        }
+    }
+    return len;
+}
+
+#ifdef AKU_PARSER_SIMD_KERNELS
+
+//! SSE2 is always available on x86_64
+static int find_delim_sse2(const Byte* p, int len, Byte c1, Byte c2) {
+    const __m128i v1 = _mm_set1_epi8(c1);
+    const __m128i v2 = _mm_set1_epi8(c2);
+    int i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(x, v1), _mm_cmpeq_epi8(x, v2));
+        int mask = _mm_movemask_epi8(m);
+        if (mask) {
+            return i + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+    return i + find_delim_scalar(p + i, len - i, c1, c2);
+}
+
+__attribute__((target("avx2")))
+static int find_delim_avx2(const Byte* p, int len, Byte c1, Byte c2) {
+    const __m256i v1 = _mm256_set1_epi8(c1);
+    const __m256i v2 = _mm256_set1_epi8(c2);
+    int i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(x, v1), _mm256_cmpeq_epi8(x, v2));
+        int mask = _mm256_movemask_epi8(m);
+        if (mask) {
+            return i + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+    return i + find_delim_sse2(p + i, len - i, c1, c2);
+}
+
+#endif
+
+static find_delim_kernel_t choose_find_delim_kernel() {
+#ifdef AKU_PARSER_SIMD_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &find_delim_avx2;
+    }
+    return &find_delim_sse2;
+#else
+    return &find_delim_scalar;
+#endif
+}
+
+static const find_delim_kernel_t find_delim = choose_find_delim_kernel();
+
 
 ProtocolParserError::ProtocolParserError(std::string line, size_t pos)
     : StreamError(line, pos)
@@ -25,6 +101,165 @@ const char* DatabaseError::what() const noexcept {
 }
 
 
+// SeriesNameCache class //
+
+SeriesNameCache::SeriesNameCache()
+    : size_(0)
+    , hand_(0)
+{
+}
+
+u64 SeriesNameCache::hash(const Byte* begin, const Byte* end) {
+    // Process the name by 8-byte words, names are usually long enough
+    const u64 mul = 0x9E3779B97F4A7C15ull;
+    u64 h = static_cast<u64>(end - begin) * mul;
+    const Byte* it = begin;
+    for (; it + 8 <= end; it += 8) {
+        u64 word;
+        memcpy(&word, it, 8);
+        h = (h ^ word) * mul;
+        h ^= h >> 29;
+    }
+    u64 tail = 0;
+    memcpy(&tail, it, static_cast<size_t>(end - it));
+    h = (h ^ tail) * mul;
+    h ^= h >> 32;
+    return h;
+}
+
+int SeriesNameCache::lookup(u64 hash, const Byte* begin, const Byte* end, aku_ParamId* ids, int cap) {
+    if (table_.empty()) {
+        return 0;
+    }
+    const size_t mask = table_.size() - 1;
+    const auto len = static_cast<u32>(end - begin);
+    for (size_t ix = hash & mask;; ix = (ix + 1) & mask) {
+        Entry& e = table_[ix];
+        if (e.nids == 0) {
+            return 0;
+        }
+        if (e.hash == hash && e.name_size == len && std::equal(begin, end, names_.data() + e.name_offset)) {
+            if (static_cast<int>(e.nids) > cap) {
+                return 0;
+            }
+            e.referenced = 1;
+            std::copy(ids_.data() + e.ids_offset, ids_.data() + e.ids_offset + e.nids, ids);
+            return static_cast<int>(e.nids);
+        }
+    }
+}
+
+void SeriesNameCache::rehash(size_t new_capacity) {
+    std::vector<Entry> table(new_capacity, Entry{0, 0, 0, 0, 0, 0});
+    const size_t mask = new_capacity - 1;
+    for (const auto& e: table_) {
+        if (e.nids == 0) {
+            continue;
+        }
+        size_t ix = e.hash & mask;
+        while (table[ix].nids != 0) {
+            ix = (ix + 1) & mask;
+        }
+        table[ix] = e;
+    }
+    table_.swap(table);
+}
+
+void SeriesNameCache::insert(u64 hash, const Byte* begin, const Byte* end, const aku_ParamId* ids, int nids) {
+    const auto len = static_cast<u32>(end - begin);
+    if (nids <= 0 || len > MAX_NAMES_SIZE / 4 || nids > MAX_IDS / 4) {
+        return;
+    }
+    if (size_ >= MAX_ENTRIES || names_.size() + len > MAX_NAMES_SIZE || ids_.size() + nids > MAX_IDS) {
+        evict();
+    }
+    if (table_.empty()) {
+        rehash(INITIAL_CAPACITY);
+    } else if ((size_ + 1) * 2 > table_.size()) {
+        // Keep load factor below 0.5
+        rehash(table_.size() * 2);
+    }
+    const size_t mask = table_.size() - 1;
+    size_t ix = hash & mask;
+    while (table_[ix].nids != 0) {
+        const Entry& e = table_[ix];
+        if (e.hash == hash && e.name_size == len && std::equal(begin, end, names_.data() + e.name_offset)) {
+            // Already cached
+            return;
+        }
+        ix = (ix + 1) & mask;
+    }
+    Entry& e = table_[ix];
+    e.hash = hash;
+    e.name_offset = static_cast<u32>(names_.size());
+    e.name_size = len;
+    e.ids_offset = static_cast<u32>(ids_.size());
+    e.nids = static_cast<u32>(nids);
+    e.referenced = 0;
+    names_.insert(names_.end(), begin, end);
+    ids_.insert(ids_.end(), ids, ids + nids);
+    size_++;
+}
+
+void SeriesNameCache::evict() {
+    const size_t max_entries = MAX_ENTRIES - MAX_ENTRIES / 4;
+    const size_t max_names = MAX_NAMES_SIZE - MAX_NAMES_SIZE / 4;
+    const size_t max_ids = MAX_IDS - MAX_IDS / 4;
+    size_t nnames = names_.size();
+    size_t nids = ids_.size();
+    const size_t mask = table_.size() - 1;
+    // Terminates after two turns of the hand at most, the first turn clears all flags
+    while (size_ > max_entries || nnames > max_names || nids > max_ids) {
+        Entry& e = table_[hand_];
+        hand_ = (hand_ + 1) & mask;
+        if (e.nids == 0) {
+            continue;
+        }
+        if (e.referenced) {
+            // Second chance
+            e.referenced = 0;
+            continue;
+        }
+        nnames -= e.name_size;
+        nids   -= e.nids;
+        e.nids  = 0;
+        size_--;
+    }
+    // Compact the arrays, offsets of the remaining entries are updated
+    std::vector<Byte> names;
+    std::vector<aku_ParamId> ids;
+    names.reserve(names_.capacity());
+    ids.reserve(ids_.capacity());
+    for (auto& e: table_) {
+        if (e.nids == 0) {
+            continue;
+        }
+        auto name_offset = static_cast<u32>(names.size());
+        auto ids_offset = static_cast<u32>(ids.size());
+        names.insert(names.end(), names_.data() + e.name_offset, names_.data() + e.name_offset + e.name_size);
+        ids.insert(ids.end(), ids_.data() + e.ids_offset, ids_.data() + e.ids_offset + e.nids);
+        e.name_offset = name_offset;
+        e.ids_offset = ids_offset;
+    }
+    names_.swap(names);
+    ids_.swap(ids);
+    // Evicted slots break the probe sequences
+    rehash(table_.size());
+}
+
+size_t SeriesNameCache::size() const {
+    return size_;
+}
+
+void SeriesNameCache::clear() {
+    table_.clear();
+    names_.clear();
+    ids_.clear();
+    size_ = 0;
+    hand_ = 0;
+}
+
+
 // ReadBuffer class //
 
 ReadBuffer::ReadBuffer(const size_t buffer_size)
@@ -70,17 +305,16 @@ int ReadBuffer::read_line(Byte* buffer, size_t quota) {
     assert(quota < 0x100000000ul);
     u32 available = wpos_ - rpos_;
     auto to_read = std::min(static_cast<u32>(quota), available);
-    for (u32 i = 0; i < to_read; i++) {
-        Byte c = buffer_[rpos_ + i];
-        buffer[i] = c;
-        if (c == '\n') {
-            // Stop iteration
-            u32 bytes_copied = i + 1;
-            rpos_ += bytes_copied;
-            return static_cast<int>(bytes_copied);
-        }
+    const Byte* origin = buffer_.data() + rpos_;
+    auto nlpos = static_cast<u32>(find_delim(origin, static_cast<int>(to_read), '\n', '\n'));
+    if (nlpos < to_read) {
+        u32 bytes_copied = nlpos + 1;
+        std::copy(origin, origin + bytes_copied, buffer);
+        rpos_ += bytes_copied;
+        return static_cast<int>(bytes_copied);
     }
     // No end of line found
+    std::copy(origin, origin + to_read, buffer);
     return -1*static_cast<int>(to_read);
 }
 
@@ -151,12 +385,18 @@ void ReadBuffer::push(ReadBuffer::BufferT, u32 size) {
 
 // ProtocolParser class //
 
-RESPProtocolParser::RESPProtocolParser(std::shared_ptr<DbSession> consumer)
+RESPProtocolParser::RESPProtocolParser(std::shared_ptr<DbSession> consumer,
+                                       std::shared_ptr<SeriesNameCache> cache)
     : done_(false)
     , rdbuf_(RDBUF_SIZE)
     , consumer_(consumer)
     , logger_("resp-protocol-parser")
+    , name_cache_(cache)
+    , autoflush_(true)
 {
+    if (!name_cache_) {
+        name_cache_ = std::make_shared<SeriesNameCache>();
+    }
 }
 
 void RESPProtocolParser::start() {
@@ -336,7 +576,16 @@ int RESPProtocolParser::parse_ids(RESPStream& stream, aku_ParamId* ids, int nval
             rdbuf_.discard();
             return -1;
         }
-        rowwidth = consumer_->name_to_param_id_list(buffer, buffer + bytes_read, ids, static_cast<u32>(nvalues));
+        {
+            // Clients tend to send the same names over and over again, cache lookup
+            // is done before any normalization.
+            u64 hash = SeriesNameCache::hash(buffer, buffer + bytes_read);
+            rowwidth = name_cache_->lookup(hash, buffer, buffer + bytes_read, ids, nvalues);
+            if (rowwidth == 0) {
+                rowwidth = consumer_->name_to_param_id_list(buffer, buffer + bytes_read, ids, static_cast<u32>(nvalues));
+                name_cache_->insert(hash, buffer, buffer + bytes_read, ids, rowwidth);
+            }
+        }
         if (rowwidth <= 0) {
             std::string msg;
             size_t pos;
@@ -505,7 +754,6 @@ void RESPProtocolParser::worker() {
     int rowwidth = 0;
     // Data to read
     aku_Sample sample;
-    aku_Status status = AKU_SUCCESS;
     //
     RESPStream stream(&rdbuf_);
     // try to read dict
@@ -517,40 +765,64 @@ void RESPProtocolParser::worker() {
         if (ok) break;
         else   return;
     }
-    while(true) {
-        bool success;
-        // read id
-        rowwidth = parse_ids(stream, paramids, AKU_LIMITS_MAX_ROW_WIDTH);
-        if (rowwidth < 0) {
-            rdbuf_.discard();
-            return;
-        }
-        // read ts
-        success = parse_timestamp(stream, sample);
-        if (!success) {
-            rdbuf_.discard();
-            return;
-        }
-        success = parse_values(stream, values, rowwidth);
-        if (!success) {
-            rdbuf_.discard();
-            return;
-        }
+    try {
+        while(true) {
+            bool success;
+            // read id
+            rowwidth = parse_ids(stream, paramids, AKU_LIMITS_MAX_ROW_WIDTH);
+            if (rowwidth < 0) {
+                rdbuf_.discard();
+                break;
+            }
+            // read ts
+            success = parse_timestamp(stream, sample);
+            if (!success) {
+                rdbuf_.discard();
+                break;
+            }
+            success = parse_values(stream, values, rowwidth);
+            if (!success) {
+                rdbuf_.discard();
+                break;
+            }
 
-        rdbuf_.consume();
+            rdbuf_.consume();
 
-        sample.payload.type = AKU_PAYLOAD_FLOAT;
-        sample.payload.size = sizeof(aku_Sample);
-        // Timestamp is initialized once and for all
-        for (int i = 0; i < rowwidth; i++) {
-            sample.paramid = paramids[i];
-            sample.payload.float64 = values[i];
-            status = consumer_->write(sample);
-            // Message processed and frame can be removed (if possible)
-            if (status != AKU_SUCCESS) {
-                BOOST_THROW_EXCEPTION(DatabaseError(status));
+            if (batch_ids_.size() + static_cast<size_t>(rowwidth) > BATCH_SIZE) {
+                flush_batch();
             }
+            // Timestamp is the same for all values in the row
+            batch_ids_.insert(batch_ids_.end(), paramids, paramids + rowwidth);
+            batch_tss_.insert(batch_tss_.end(), static_cast<size_t>(rowwidth), sample.timestamp);
+            batch_xss_.insert(batch_xss_.end(), values, values + rowwidth);
         }
+    } catch (...) {
+        // Values parsed before the error should be written, write error
+        // shouldn't mask the original one
+        auto err = std::current_exception();
+        try {
+            flush_batch();
+        } catch (...) {
+            logger_.error() << "Can't write values parsed before the error: "
+                            << boost::current_exception_diagnostic_information();
+        }
+        std::rethrow_exception(err);
+    }
+    if (autoflush_) {
+        flush_batch();
+    }
+}
+
+void RESPProtocolParser::flush_batch() {
+    if (batch_ids_.empty()) {
+        return;
+    }
+    auto status = consumer_->write_batch(batch_ids_.data(), batch_tss_.data(), batch_xss_.data(), batch_ids_.size());
+    batch_ids_.clear();
+    batch_tss_.clear();
+    batch_xss_.clear();
+    if (status != AKU_SUCCESS) {
+        BOOST_THROW_EXCEPTION(DatabaseError(status));
     }
 }
 
@@ -569,6 +841,14 @@ void RESPProtocolParser::close() {
     done_ = true;
 }
 
+void RESPProtocolParser::set_autoflush(bool enabled) {
+    autoflush_ = enabled;
+}
+
+void RESPProtocolParser::flush() {
+    flush_batch();
+}
+
 std::string RESPProtocolParser::error_repr(int kind, std::string const& err) const {
     switch (kind) {
     case ERR:
@@ -685,17 +965,10 @@ static OpenTSDBMessageType message_dispatch(Byte* p, int len) {
  * @invariant quota >= ntrailing, ntrailing >= 1
  */
 static std::tuple<Byte*, int, int> skip_element(Byte* buffer, int len) {
-    int quota = len;
-    Byte* p = buffer;
     // Skip element
-    while(quota) {
-        Byte c = *p;
-        if (c == ' ' || c == '\n') {
-            break;
-        }
-        p++;
-        quota--;
-    }
+    int nskip = find_delim(buffer, len, ' ', '\n');
+    int quota = len - nskip;
+    Byte* p = buffer + nskip;
     // Skip space
     int ntrailing = 0;
     while(quota) {
@@ -746,12 +1019,9 @@ OpenTSDBResponse OpenTSDBProtocolParser::worker() {
                 len--;
             }  // Skip redundant space characters
 
-            // Convert 'cpu.real 20141210T074343 3.12 host=machine1 region=NW'
-            // to 'cpu.real host=machine1 region=NW 20141210T074343 3.12'
-            // using std::rotate:
-            //  std::rotate(a, b, pend)
-            //  where a = '20141210T074343 3.12 host=machine1 region=NW'
-            //    and b = 'host=machine1 region=NW'
+            // Split 'cpu.real 20141210T074343 3.12 host=machine1 region=NW'
+            // into metric name, a = '20141210T074343 3.12 host=machine1 region=NW'
+            // and b = 'host=machine1 region=NW'
 
             // Skip metric name
             Byte* a;
@@ -800,19 +1070,8 @@ OpenTSDBResponse OpenTSDBProtocolParser::worker() {
                 tags_trailing++;
             }
 
-            // Rotate
-            std::rotate(a, b, pend);
-
-            // Buffer contains only one data point
-            status = consumer_->series_to_param_id(pbuf, static_cast<u32>(name_size - tags_trailing), &sample);  // -1 because name_size includes space
-            if (status != AKU_SUCCESS) {
-                std::string msg;
-                size_t pos;
-                std::tie(msg, pos) = rdbuf_.get_error_context("put: invalid series name format");
-                BOOST_THROW_EXCEPTION(ProtocolParserError(msg, pos));
-            }
-
-            pbuf += name_size;
+            Byte* pmetric = pbuf;
+            pbuf = a;
             // try to parse as Unix timestamp first
             {
                 bool err = false;
@@ -864,6 +1123,21 @@ OpenTSDBResponse OpenTSDBProtocolParser::worker() {
                 BOOST_THROW_EXCEPTION(ProtocolParserError(msg, pos));
             }
 
+            // Timestamp and value are parsed, move the metric name next to the tags
+            // to get contiguous series name without rotating the whole line
+            // (only metric name and its trailing spaces are copied).
+            Byte* pseries = b - metric_size;
+            std::memmove(pseries, pmetric, static_cast<size_t>(metric_size));
+
+            // Buffer contains only one data point
+            status = consumer_->series_to_param_id(pseries, static_cast<u32>(name_size - tags_trailing), &sample);
+            if (status != AKU_SUCCESS) {
+                std::string msg;
+                size_t pos;
+                std::tie(msg, pos) = rdbuf_.get_error_context("put: invalid series name format");
+                BOOST_THROW_EXCEPTION(ProtocolParserError(msg, pos));
+            }
+
             sample.payload.float64 = value;
             sample.payload.type = AKU_PAYLOAD_FLOAT;
 
@@ -911,4 +1185,178 @@ std::string OpenTSDBProtocolParser::error_repr(int kind, std::string const& err)
     return err + "\n";
 }
 
+
+//     Binary protocol      //
+
+BinaryProtocolParser::BinaryProtocolParser(std::shared_ptr<DbSession> consumer)
+    : done_(false)
+    , rdbuf_(RDBUF_SIZE)
+    , consumer_(consumer)
+    , logger_("binary-protocol-parser")
+{
+}
+
+void BinaryProtocolParser::start() {
+    logger_.info() << "Starting protocol parser";
+}
+
+Byte* BinaryProtocolParser::get_next_buffer() {
+    return rdbuf_.pull();
+}
+
+void BinaryProtocolParser::close() {
+    done_ = true;
+}
+
+template<class T>
+static T read_le(const Byte* p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+NullResponse BinaryProtocolParser::parse_next(Byte* buffer, u32 sz) {
+    static NullResponse response;
+    rdbuf_.push(buffer, sz);
+    while (true) {
+        Byte header[HEADER_SIZE];
+        if (rdbuf_.read(header, HEADER_SIZE) < HEADER_SIZE) {
+            // Frame is incomplete
+            rdbuf_.discard();
+            break;
+        }
+        auto magic     = read_le<u32>(header);
+        auto version   = read_le<u8>(header + 4);
+        auto flags     = read_le<u8>(header + 5);
+        auto reserved  = read_le<u16>(header + 6);
+        auto body_size = read_le<u32>(header + 8);
+        auto raw_size  = read_le<u32>(header + 12);
+        if (magic != MAGIC) {
+            BOOST_THROW_EXCEPTION(ProtocolParserError("binary frame: bad magic", 0));
+        }
+        if (version != VERSION) {
+            BOOST_THROW_EXCEPTION(ProtocolParserError("binary frame: unsupported version", 0));
+        }
+        if (reserved != 0) {
+            BOOST_THROW_EXCEPTION(ProtocolParserError("binary frame: reserved field is not zero", 0));
+        }
+        if (body_size > MAX_FRAME_SIZE || raw_size > MAX_FRAME_SIZE) {
+            BOOST_THROW_EXCEPTION(ProtocolParserError("binary frame: frame is too large", 0));
+        }
+        if ((flags & FLAG_LZ4) == 0 && raw_size != body_size) {
+            BOOST_THROW_EXCEPTION(ProtocolParserError("binary frame: bad frame size", 0));
+        }
+        body_.resize(body_size);
+        if (rdbuf_.read(body_.data(), body_size) < static_cast<int>(body_size)) {
+            rdbuf_.discard();
+            break;
+        }
+        rdbuf_.consume();
+        if (flags & FLAG_LZ4) {
+            raw_.resize(raw_size);
+            int nbytes = LZ4_decompress_safe(body_.data(), raw_.data(),
+                                             static_cast<int>(body_size), static_cast<int>(raw_size));
+            if (nbytes != static_cast<int>(raw_size)) {
+                BOOST_THROW_EXCEPTION(ProtocolParserError("binary frame: can't decompress frame", 0));
+            }
+            decode_frame(raw_.data(), raw_size);
+        } else {
+            decode_frame(body_.data(), body_size);
+        }
+    }
+    return response;
+}
+
+void BinaryProtocolParser::decode_frame(const Byte* body, u32 size) {
+    const Byte* it  = body;
+    const Byte* end = body + size;
+    auto check_size = [&it, end](size_t nbytes) {
+        if (static_cast<size_t>(end - it) < nbytes) {
+            BOOST_THROW_EXCEPTION(ProtocolParserError("binary frame: unexpected end of frame", 0));
+        }
+    };
+    check_size(8);
+    auto ndict   = read_le<u32>(it);
+    auto npoints = read_le<u32>(it + 4);
+    it += 8;
+
+    // Update dictionary
+    for (u32 i = 0; i < ndict; i++) {
+        check_size(6);
+        auto local_id = read_le<u32>(it);
+        auto len      = read_le<u16>(it + 4);
+        it += 6;
+        check_size(len);
+        if (local_id >= DENSE_DICT_SIZE && sparse_dict_.size() >= MAX_SPARSE_DICT_SIZE && sparse_dict_.count(local_id) == 0) {
+            // Memory used by the connection should be bounded
+            BOOST_THROW_EXCEPTION(ProtocolParserError("binary frame: too many dictionary entries", 0));
+        }
+        aku_Sample sample;
+        auto status = consumer_->series_to_param_id(it, len, &sample);
+        if (status != AKU_SUCCESS) {
+            BOOST_THROW_EXCEPTION(ProtocolParserError("binary frame: invalid series name format", 0));
+        }
+        if (local_id < DENSE_DICT_SIZE) {
+            if (dict_.size() <= local_id) {
+                dict_.resize(local_id + 1, 0);
+            }
+            dict_[local_id] = sample.paramid;
+        } else {
+            sparse_dict_[local_id] = sample.paramid;
+        }
+        it += len;
+    }
+
+    // Decode columns
+    if (static_cast<size_t>(end - it) != static_cast<size_t>(npoints) * 24) {
+        BOOST_THROW_EXCEPTION(ProtocolParserError("binary frame: bad frame size", 0));
+    }
+    if (npoints == 0) {
+        return;
+    }
+    const Byte* id_deltas = it;
+    const Byte* ts_deltas = it + static_cast<size_t>(npoints) * 8;
+    const Byte* values    = it + static_cast<size_t>(npoints) * 16;
+    ids_.resize(npoints);
+    tss_.resize(npoints);
+    xss_.resize(npoints);
+    u64 local_id = 0;
+    u64 ts = 0;
+    for (u32 i = 0; i < npoints; i++) {
+        // Deltas are two's complement, unsigned arithmetic wraps around
+        local_id += read_le<u64>(id_deltas + i * 8);
+        ts       += read_le<u64>(ts_deltas + i * 8);
+        aku_ParamId id = 0;
+        if (local_id < dict_.size()) {
+            id = dict_[local_id];
+        } else if (!sparse_dict_.empty()) {
+            auto entry = sparse_dict_.find(local_id);
+            id = entry != sparse_dict_.end() ? entry->second : 0;
+        }
+        if (id == 0) {
+            BOOST_THROW_EXCEPTION(ProtocolParserError("binary frame: unknown local id " + std::to_string(local_id), 0));
+        }
+        ids_[i] = id;
+        tss_[i] = ts;
+    }
+    memcpy(xss_.data(), values, static_cast<size_t>(npoints) * sizeof(double));
+
+    auto status = consumer_->write_batch(ids_.data(), tss_.data(), xss_.data(), npoints);
+    if (status != AKU_SUCCESS) {
+        BOOST_THROW_EXCEPTION(DatabaseError(status));
+    }
+}
+
+std::string BinaryProtocolParser::error_repr(int kind, std::string const& err) const {
+    switch (kind) {
+    case ERR:
+        return "-ERR " + err + "\r\n";
+    case DB:
+        return "-DB " + err + "\r\n";
+    case PARSE:
+        return "-PARSER " + err + "\r\n";
+    };
+    return "-UNKNOWN " + err + "\r\n";
+}
+
 }
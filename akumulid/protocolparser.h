@@ -49,6 +49,61 @@ struct DatabaseError : std::exception {
 };
 
 
+/** Connection-local cache of the series names.
+  * Maps raw series name (as received from the client, before normalization)
+  * to the list of series ids. Series ids never change, so entries are never
+  * invalidated. When the cache is full, a quarter of the entries is evicted
+  * using the CLOCK (second chance) algorithm and the name and id arrays are
+  * compacted. Every connection has its own cache so the limits are kept
+  * small (about 3MB per connection, enough for 16K names of 96 bytes).
+  */
+class SeriesNameCache {
+    struct Entry {
+        u64 hash;
+        u32 name_offset;
+        u32 name_size;
+        u32 ids_offset;
+        u32 nids;       //< 0 - empty slot
+        u32 referenced; //< Set by `lookup`, cleared by the clock hand
+    };
+    std::vector<Entry>       table_;  //< Open addressing table, size is a power of two
+    std::vector<Byte>        names_;
+    std::vector<aku_ParamId> ids_;
+    size_t                   size_;
+    size_t                   hand_;   //< Clock hand, index in `table_`
+
+    void rehash(size_t new_capacity);
+
+    //! Evict entries until the cache is filled by 3/4, compact `names_` and `ids_`
+    void evict();
+public:
+    enum {
+        INITIAL_CAPACITY = 64,
+        MAX_ENTRIES      = 0x4000,
+        MAX_NAMES_SIZE   = 0x180000,   // 1.5MB
+        MAX_IDS          = 0x8000,     // 256KB
+    };
+
+    SeriesNameCache();
+
+    //! Hash function, should be used to compute `hash` argument of other methods
+    static u64 hash(const Byte* begin, const Byte* end);
+
+    /** Find series ids by name. Marks the entry as recently used.
+      * @return number of ids or 0 if name is not cached or `ids` array is too small
+      */
+    int lookup(u64 hash, const Byte* begin, const Byte* end, aku_ParamId* ids, int cap);
+
+    //! Add name to cache, evicts some entries if the cache is full
+    void insert(u64 hash, const Byte* begin, const Byte* end, const aku_ParamId* ids, int nids);
+
+    //! Return number of cached names
+    size_t size() const;
+
+    void clear();
+};
+
+
 /** Protocol parser response.
  */
 struct ProtocolParserResponse {
@@ -219,10 +274,21 @@ class RESPProtocolParser {
     std::shared_ptr<DbSession>         consumer_;
     Logger                             logger_;
     SeriesIdMap                        idmap_;
+    //! Series name cache (can be shared by parsers that use the same consumer)
+    std::shared_ptr<SeriesNameCache>   name_cache_;
+    //! Write parsed values at the end of every `parse_next` call
+    bool                               autoflush_;
+    //! Values parsed from the current buffer
+    std::vector<aku_ParamId>           batch_ids_;
+    std::vector<aku_Timestamp>         batch_tss_;
+    std::vector<double>                batch_xss_;
 
     //! Process frames from queue
     void worker();
 
+    //! Write parsed values to the database
+    void flush_batch();
+
     //! Generate error message
     std::tuple<std::string, size_t> get_error_from_pdu(PDU const& pdu) const;
 
@@ -242,13 +308,27 @@ class RESPProtocolParser {
 public:
     enum {
         RDBUF_SIZE = 0x1000,  // 4KB
+        BATCH_SIZE = 0x1000,  // max number of values written at once
     };
-    RESPProtocolParser(std::shared_ptr<DbSession> consumer);
+    /** C-tor.
+      * @param consumer is a database session
+      * @param cache is a series name cache, the parser creates its own cache if null
+      */
+    RESPProtocolParser(std::shared_ptr<DbSession> consumer,
+                       std::shared_ptr<SeriesNameCache> cache = std::shared_ptr<SeriesNameCache>());
     void start();
     NullResponse parse_next(Byte *buffer, u32 sz);
     void close();
     Byte* get_next_buffer();
 
+    /** Enable or disable autoflush (enabled by default). If autoflush is disabled
+      * parsed values are accumulated until `flush` is called or the batch is full.
+      */
+    void set_autoflush(bool enabled);
+
+    //! Write accumulated values to the database
+    void flush();
+
     // Error representation
     enum {
         DB,
@@ -330,4 +410,83 @@ public:
     std::string error_repr(int kind, std::string const& err) const;
 };
 
+
+/**
+ * @brief Binary columnar protocol parser
+ * The stream consists of length-prefixed frames. All integers are little-endian.
+ *
+ * Frame header (16 bytes):
+ *     u32 magic      - 'AKUB' (0x42554B41)
+ *     u8  version    - protocol version (1)
+ *     u8  flags      - bit 0 is set if the body is LZ4 compressed
+ *     u16 reserved   - should be 0, frames with non-zero value are rejected
+ *     u32 body_size  - size of the body that follows the header
+ *     u32 raw_size   - size of the decompressed body (equals `body_size` if not compressed)
+ *
+ * Frame body:
+ *     u32 ndict      - number of dictionary entries
+ *     u32 npoints    - number of data points
+ *     ndict entries:
+ *         u32 local_id  - client side series id
+ *         u16 length    - length of the series name
+ *         series name
+ *     i64 id_deltas[npoints]  - deltas between consecutive local ids
+ *     i64 ts_deltas[npoints]  - deltas between consecutive timestamps (nanoseconds)
+ *     f64 values[npoints]
+ *
+ * Delta decoding starts from zero in every frame, so the first deltas are absolute
+ * values. Dictionary entries are kept for the whole connection, the frame can
+ * reference series defined by the previous frames. Small local ids are stored in
+ * the array, large ones in the hash table, so memory use depends on the number
+ * of entries and not on the largest local id.
+ */
+class BinaryProtocolParser {
+    bool                               done_;
+    ReadBuffer                         rdbuf_;
+    std::shared_ptr<DbSession>         consumer_;
+    Logger                             logger_;
+    //! Local id to series id mapping for local ids below DENSE_DICT_SIZE (0 - not defined)
+    std::vector<aku_ParamId>           dict_;
+    //! Local id to series id mapping for all other local ids
+    std::unordered_map<u64, aku_ParamId> sparse_dict_;
+    //! Frame body (compressed or not)
+    std::vector<Byte>                  body_;
+    //! Decompressed frame body
+    std::vector<Byte>                  raw_;
+    // Decoded data points
+    std::vector<aku_ParamId>           ids_;
+    std::vector<aku_Timestamp>         tss_;
+    std::vector<double>                xss_;
+
+    //! Decode frame body and write data points to the database
+    void decode_frame(const Byte* body, u32 size);
+public:
+    enum {
+        RDBUF_SIZE = 0x10000,          // 64KB
+        HEADER_SIZE = 16,
+        MAGIC = 0x42554B41,            // 'AKUB'
+        VERSION = 1,
+        FLAG_LZ4 = 1,
+        MAX_FRAME_SIZE = 0x1000000,    // 16MB
+        DENSE_DICT_SIZE = 0x10000,     // 512KB
+        MAX_SPARSE_DICT_SIZE = 0x10000,
+    };
+
+    BinaryProtocolParser(std::shared_ptr<DbSession> consumer);
+
+    void start();
+    NullResponse parse_next(Byte *buffer, u32 sz);
+    void close();
+    Byte* get_next_buffer();
+
+    // Error representation
+    enum {
+        DB,
+        ERR,
+        PARSE,
+    };
+
+    std::string error_repr(int kind, std::string const& err) const;
+};
+
 }  // namespace
@@ -1,6 +1,7 @@
 #include "query_results_pooler.h"
 #include "logger.h"
 #include <cstdio>
+#include <sstream>
 #include <thread>
 #include <inttypes.h>
 #include <stdint.h>
@@ -562,7 +563,20 @@ ReadOperation *QueryProcessor::create(ApiEndpoint endpoint) {
 std::string QueryProcessor::get_all_stats() {
     auto con = con_.lock();
     if (con) {
-        return con->get_all_stats();
+        auto dbstats = con->get_all_stats();
+        boost::property_tree::ptree tree;
+        try {
+            std::stringstream input(dbstats);
+            boost::property_tree::json_parser::read_json(input, tree);
+        } catch (boost::property_tree::json_parser_error const&) {
+            // Not a json, most likely an error message
+            return dbstats;
+        }
+        // Add counters maintained by the servers
+        ServerStats::instance().report(&tree);
+        std::stringstream out;
+        boost::property_tree::json_parser::write_json(out, tree, true);
+        return out.str();
     }
     std::runtime_error err("Database connection was closed");
     BOOST_THROW_EXCEPTION(err);
@@ -4,10 +4,13 @@
 #include "signal_handler.h"
 
 #include <map>
+#include <mutex>
 #include <string>
 #include <tuple>
 #include <tuple>
 
+#include <boost/property_tree/ptree.hpp>
+
 namespace Akumuli {
 
 struct ProtocolSettings {
@@ -19,6 +22,7 @@ struct ServerSettings {
     std::string                   name;
     std::vector<ProtocolSettings> protocols;
     int                           nworkers;
+    int                           batch_size = 0;  //< number of datagrams read at once (UDP), 0 - default
 };
 
 struct WALSettings {
@@ -91,6 +95,39 @@ struct Server {
     virtual void start(SignalHandler* sig_handler, int id) = 0;
 };
 
+/** Registry of the server counters. Every registered reporter
+  * adds its counters to the output of the stats endpoint.
+  */
+struct ServerStats {
+
+    typedef std::function<void(boost::property_tree::ptree*)> Reporter;
+
+    std::mutex                      lock_;
+    std::map<std::string, Reporter> reporters_;
+
+    void register_reporter(std::string name, Reporter rep) {
+        std::lock_guard<std::mutex> guard(lock_);
+        reporters_[name] = rep;
+    }
+
+    void remove_reporter(std::string name) {
+        std::lock_guard<std::mutex> guard(lock_);
+        reporters_.erase(name);
+    }
+
+    void report(boost::property_tree::ptree* tree) {
+        std::lock_guard<std::mutex> guard(lock_);
+        for (auto& kv: reporters_) {
+            kv.second(tree);
+        }
+    }
+
+    static ServerStats& instance() {
+        static ServerStats stats;
+        return stats;
+    }
+};
+
 struct ServerFactory {
 
     typedef std::function<std::shared_ptr<Server>(std::shared_ptr<AkumuliConnection>,
@@ -56,6 +56,10 @@ aku_Status AkumuliSession::write(const aku_Sample &sample) {
     return aku_write(session_, &sample);
 }
 
+aku_Status AkumuliSession::write_batch(const aku_ParamId* ids, const aku_Timestamp* tss, const double* xss, size_t size) {
+    return aku_write_batch(session_, ids, tss, xss, size);
+}
+
 std::shared_ptr<DbCursor> AkumuliSession::query(std::string query) {
     aku_Cursor* cursor = aku_query(session_, query.c_str());
     return std::make_shared<AkumuliCursor>(cursor);
@@ -106,6 +110,11 @@ std::string AkumuliConnection::get_all_stats() {
     std::vector<char> buffer;
     buffer.resize(0x1000);
     int nbytes = aku_json_stats(db_, buffer.data(), buffer.size());
+    if (nbytes < -1) {
+        // Buffer is too small, negative value is a required size
+        buffer.resize(static_cast<size_t>(-nbytes) + 1);
+        nbytes = aku_json_stats(db_, buffer.data(), buffer.size());
+    }
     if (nbytes > 0) {
         return std::string(buffer.data(), buffer.data() + nbytes);
     }
@@ -57,6 +57,24 @@ struct DbSession {
     //! Write value to DB
     virtual aku_Status write(const aku_Sample& sample) = 0;
 
+    //! Write batch of values to DB (returns error if some values were rejected)
+    virtual aku_Status write_batch(const aku_ParamId* ids, const aku_Timestamp* tss, const double* xss, size_t size) {
+        aku_Status result = AKU_SUCCESS;
+        aku_Sample sample = {};
+        sample.payload.type = AKU_PAYLOAD_FLOAT;
+        sample.payload.size = sizeof(aku_Sample);
+        for (size_t i = 0; i < size; i++) {
+            sample.paramid = ids[i];
+            sample.timestamp = tss[i];
+            sample.payload.float64 = xss[i];
+            auto status = write(sample);
+            if (status != AKU_SUCCESS && result == AKU_SUCCESS) {
+                result = status;
+            }
+        }
+        return result;
+    }
+
     //! Execute database query
     virtual std::shared_ptr<DbCursor> query(std::string query) = 0;
 
@@ -92,6 +110,7 @@ public:
     AkumuliSession(aku_Session* session);
     virtual ~AkumuliSession() override;
     virtual aku_Status write(const aku_Sample &sample) override;
+    virtual aku_Status write_batch(const aku_ParamId* ids, const aku_Timestamp* tss, const double* xss, size_t size) override;
     virtual std::shared_ptr<DbCursor> query(std::string query) override;
     virtual std::shared_ptr<DbCursor> suggest(std::string query) override;
     virtual std::shared_ptr<DbCursor> search(std::string query) override;
@@ -200,6 +200,7 @@ private:
 
 typedef TelnetSession<RESPProtocolParser> RESPSession;
 typedef TelnetSession<OpenTSDBProtocolParser> OpenTSDBSession;
+typedef TelnetSession<BinaryProtocolParser> BinarySession;
 
 //                           //
 //     Protocol builders     //
@@ -244,6 +245,26 @@ struct OpenTSDBSessionBuilder : ProtocolSessionBuilder {
     }
 };
 
+
+struct BinarySessionBuilder : ProtocolSessionBuilder {
+    bool parallel_;
+
+    BinarySessionBuilder(bool parallel=true)
+        : parallel_(parallel)
+    {
+    }
+
+    virtual std::shared_ptr<ProtocolSession> create(IOServiceT *io, std::shared_ptr<DbSession> session) {
+        std::shared_ptr<ProtocolSession> result;
+        result.reset(new BinarySession(io, session, parallel_));
+        return result;
+    }
+
+    virtual std::string name() const {
+        return "Binary";
+    }
+};
+
 std::unique_ptr<ProtocolSessionBuilder> ProtocolSessionBuilder::create_resp_builder(bool parallel) {
     std::unique_ptr<ProtocolSessionBuilder> res;
     res.reset(new RESPSessionBuilder(parallel));
@@ -256,6 +277,12 @@ std::unique_ptr<ProtocolSessionBuilder> ProtocolSessionBuilder::create_opentsdb_
     return res;
 }
 
+std::unique_ptr<ProtocolSessionBuilder> ProtocolSessionBuilder::create_binary_builder(bool parallel) {
+    std::unique_ptr<ProtocolSessionBuilder> res;
+    res.reset(new BinarySessionBuilder(parallel));
+    return res;
+}
+
 //                      //
 //     Tcp Acceptor     //
 //                      //
@@ -573,6 +600,8 @@ struct TcpServerBuilder {
                 inst = ProtocolSessionBuilder::create_resp_builder(true);
             } else if (protocol.name == "OpenTSDB") {
                 inst = ProtocolSessionBuilder::create_opentsdb_builder(true);
+            } else if (protocol.name == "Binary") {
+                inst = ProtocolSessionBuilder::create_binary_builder(true);
             } else {
                 s_logger_.error() << "Unknown protocol " << protocol.name;
             }
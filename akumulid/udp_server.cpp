@@ -9,71 +9,132 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <boost/bind.hpp>
 #include <boost/exception/diagnostic_information.hpp>
 
 namespace Akumuli {
 
-UdpServer::UdpServer(std::shared_ptr<DbConnection> db, int nworkers, int port)
+UdpServer::UdpServer(std::shared_ptr<DbConnection> db, int nworkers, int port, int batch_size)
     : db_(db)
     , start_barrier_(static_cast<u32>(nworkers + 1))
     , stop_barrier_(static_cast<u32>(nworkers + 1))
     , stop_{0}
     , port_(port)
     , nworkers_(nworkers)
-    , sockfd_(-1)
+#ifndef __APPLE__
+    , batch_size_(batch_size > 0 ? batch_size : NPACKETS)
+#else
+    , batch_size_(NPACKETS)
+#endif
     , logger_("UdpServer")
 {
 }
 
+int UdpServer::create_socket() {
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd == -1) {
+        const char* msg = strerror(errno);
+        std::stringstream fmt;
+        fmt << "can't create socket: " << msg;
+        std::runtime_error err(fmt.str());
+        BOOST_THROW_EXCEPTION(err);
+    }
+
+    // Every worker binds its own socket to the same port, the kernel
+    // distributes incoming datagrams between them.
+    int optval = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) == -1) {
+        const char* msg = strerror(errno);
+        close(sockfd);
+        std::stringstream fmt;
+        fmt << "can't set socket options: " << msg;
+        std::runtime_error err(fmt.str());
+        BOOST_THROW_EXCEPTION(err);
+    }
+
+    // Datagram that wakes up the worker can't be delivered to the specific
+    // socket, so the workers check the stop flag on timeout instead.
+    timeval tv{};
+    tv.tv_sec  = 0;
+    tv.tv_usec = RECV_TIMEOUT_MS * 1000;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1) {
+        const char* msg = strerror(errno);
+        close(sockfd);
+        std::stringstream fmt;
+        fmt << "can't set socket timeout: " << msg;
+        std::runtime_error err(fmt.str());
+        BOOST_THROW_EXCEPTION(err);
+    }
+
+    // Bind socket to port
+    sockaddr_in sa{};
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_ANY);
+    sa.sin_port = htons(port_);
+
+    if (bind(sockfd, (sockaddr *) &sa, sizeof(sa)) == -1) {
+        const char* msg = strerror(errno);
+        close(sockfd);
+        std::stringstream fmt;
+        fmt << "can't bind socket: " << msg;
+        std::runtime_error err(fmt.str());
+        BOOST_THROW_EXCEPTION(err);
+    }
+    return sockfd;
+}
+
 void UdpServer::start(SignalHandler *sig, int id) {
     auto self = shared_from_this();
     sig->add_handler(boost::bind(&UdpServer::stop, std::move(self)), id);
 
+    // Create sockets first, so the error is reported before any worker is started
+    for (int i = 0; i < nworkers_; i++) {
+        sockets_.push_back(create_socket());
+        stats_.emplace_back(new WorkerStats());
+    }
+    std::weak_ptr<UdpServer> weak = shared_from_this();
+    ServerStats::instance().register_reporter("udp_server", [weak](boost::property_tree::ptree* tree) {
+        auto server = weak.lock();
+        if (server) {
+            server->report_stats(tree);
+        }
+    });
+
     // Create workers
     for (int i = 0; i < nworkers_; i++) {
         auto session = db_->create_session();
-        std::thread thread(std::bind(&UdpServer::worker, shared_from_this(), std::move(session)));
+        std::thread thread(std::bind(&UdpServer::worker, shared_from_this(), std::move(session),
+                                     sockets_.at(static_cast<size_t>(i)), stats_.at(static_cast<size_t>(i)).get()));
         thread.detach();
     }
     start_barrier_.wait();
 }
 
-static void sendByteToLocalhost(int port) {
-    Logger logger("UdpServer");
-    int fd;
-    struct sockaddr_in addr;
-    const char* ip = "127.0.0.1";
-
-    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-        // We can't send the message to the socket thus, we wouldn't be able
-        // to stop the program normally anyway.
-        logger.error() << "Can't create the socket";
-        std::terminate();
-    }
-
-    addr.sin_family = AF_INET;
-    inet_aton(ip, &addr.sin_addr);
-    addr.sin_port = htons(port);
-    char payload = 0;
-
-    if (sendto(fd, &payload, 1, 0, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
-        // Same reasoning as previously
-        logger.error() << "Can't send the data through the socket";
-        std::terminate();
+void UdpServer::report_stats(boost::property_tree::ptree* tree) const {
+    for (size_t i = 0; i < stats_.size(); i++) {
+        std::string path = "udp_server.worker_" + std::to_string(i);
+        tree->put(path + ".packets", stats_[i]->packets.load());
+        tree->put(path + ".bytes", stats_[i]->bytes.load());
+        tree->put(path + ".batches", stats_[i]->batches.load());
     }
 }
 
 void UdpServer::stop() {
-    // Set the flag and then send the 1-byte payload to wake up the
-    // worker thread. The socket descriptor can be closed afterwards.
+    // Set the flag and wait until all workers will notice it
+    // (the receive timeout is set for every socket). The socket
+    // descriptors can be closed afterwards.
     stop_.store(1, std::memory_order_relaxed);
-    sendByteToLocalhost(port_);
     stop_barrier_.wait();
+    ServerStats::instance().remove_reporter("udp_server");
     logger_.info() << "UDP server stopped";
-    close(sockfd_);
+    for (auto sockfd: sockets_) {
+        close(sockfd);
+    }
+    sockets_.clear();
 }
 
 #ifdef __APPLE__
@@ -88,7 +149,7 @@ int UdpServer::recvmsg_(int fd, UdpServer::mmsghdr* hdr, unsigned, int) {
 }
 #endif
 
-void UdpServer::worker(std::shared_ptr<DbSession> spout) {
+void UdpServer::worker(std::shared_ptr<DbSession> spout, int sockfd, WorkerStats* stats) {
 #ifdef __gnu_linux__
         // Name the thread
         auto thread = pthread_self();
@@ -97,53 +158,27 @@ void UdpServer::worker(std::shared_ptr<DbSession> spout) {
     start_barrier_.wait();
 
     int retval;
-    sockaddr_in sa{};
 
     try {
-        // Create socket
-        sockfd_ = socket(AF_INET, SOCK_DGRAM, 0);
-        if (sockfd_ == -1) {
-            const char* msg = strerror(errno);
-            std::stringstream fmt;
-            fmt << "can't create socket: " << msg;
-            std::runtime_error err(fmt.str());
-            BOOST_THROW_EXCEPTION(err);
-        }
-
-        // Set socket options
-        int optval = 1;
-        if (setsockopt(sockfd_, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) == -1) {
-            const char* msg = strerror(errno);
-            std::stringstream fmt;
-            fmt << "can't set socket options: " << msg;
-            std::runtime_error err(fmt.str());
-            BOOST_THROW_EXCEPTION(err);
-        }
-
-        // Bind socket to port
-        sa.sin_family = AF_INET;
-        sa.sin_addr.s_addr = htonl(INADDR_ANY);
-        sa.sin_port = htons(port_);
-
-        if (bind(sockfd_, (sockaddr *) &sa, sizeof(sa)) == -1) {
-            const char* msg = strerror(errno);
-            std::stringstream fmt;
-            fmt << "can't bind socket: " << msg;
-            std::runtime_error err(fmt.str());
-            BOOST_THROW_EXCEPTION(err);
-        }
-
-        auto iobuf = std::make_shared<IOBuf>();
+        // Buffers are reused, the parser copies every datagram
+        IOBuf iobuf(batch_size_);
+        auto npackets = static_cast<unsigned int>(batch_size_);
+        // Parser is created for every packet group but the name cache is
+        // shared, all parsers use the same session.
+        auto name_cache = std::make_shared<SeriesNameCache>();
 
         while(true) {
 
 #ifdef __APPLE__
-            retval = recvmsg_(sockfd_, iobuf->msgs, NPACKETS, MSG_WAITALL);
+            retval = recvmsg_(sockfd, iobuf.msgs.data(), npackets, MSG_WAITALL);
 #else
-            retval = recvmmsg(sockfd_, iobuf->msgs, NPACKETS, MSG_WAITFORONE, nullptr);
+            retval = recvmmsg(sockfd, iobuf.msgs.data(), npackets, MSG_WAITFORONE, nullptr);
 #endif
+            if (stop_.load(std::memory_order_seq_cst)) {
+                break;
+            }
             if (retval == -1) {
-                if (errno == EAGAIN || errno == EINTR) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
                     continue;
                 }
                 const char* msg = strerror(errno);
@@ -152,13 +187,11 @@ void UdpServer::worker(std::shared_ptr<DbSession> spout) {
                 std::runtime_error err(fmt.str());
                 BOOST_THROW_EXCEPTION(err);
             }
-            if (stop_.load(std::memory_order_seq_cst)) {
-                break;
-            }
 
-            iobuf->pps++;
+            stats->batches++;
+            stats->packets += static_cast<u64>(retval);
 
-            RESPProtocolParser parser(spout);
+            RESPProtocolParser parser(spout, name_cache);
             // Protocol parser should be created for each Udp packet
             // group. Otherwise one bad packet can corrupt the state
             // of the parser and it will be unable to process remaining
@@ -166,14 +199,16 @@ void UdpServer::worker(std::shared_ptr<DbSession> spout) {
             // Also, it's not necessary to call parser.start() since
             // it only writes to the log. This call here will polute the
             // log file.
+            // Values from the whole group are written to the database at once.
+            parser.set_autoflush(false);
             for (int i = 0; i < retval; i++) {
                 // reset buffer to receive new message
-                iobuf->bps += iobuf->msgs[i].msg_len;
-                auto mlen = iobuf->msgs[i].msg_len;
-                iobuf->msgs[i].msg_len = 0;
+                stats->bytes += iobuf.msgs[i].msg_len;
+                auto mlen = iobuf.msgs[i].msg_len;
+                iobuf.msgs[i].msg_len = 0;
 
                 auto buf = parser.get_next_buffer();
-                memcpy(buf, iobuf->bufs[i], mlen);
+                memcpy(buf, iobuf.bufs.data() + i * MSS, mlen);
                 try {
                     parser.parse_next(buf, mlen);
                 } catch (StreamError const& err) {
@@ -186,8 +221,10 @@ void UdpServer::worker(std::shared_ptr<DbSession> spout) {
                     break;
                 }
             }
-            if (retval != 0) {
-                iobuf = std::make_shared<IOBuf>();
+            try {
+                parser.flush();
+            } catch (DatabaseError const& err) {
+                logger_.error() << err.what();
             }
             parser.close();
         }
@@ -213,7 +250,8 @@ struct UdpServerBuilder {
             s_logger_.error() << "Can't initialize UDP server, more than one protocol specified";
             BOOST_THROW_EXCEPTION(std::runtime_error("invalid upd-server settings"));
         }
-        return std::make_shared<UdpServer>(con, settings.nworkers, settings.protocols.front().port);
+        return std::make_shared<UdpServer>(con, settings.nworkers, settings.protocols.front().port,
+                                           settings.batch_size);
     }
 };
 
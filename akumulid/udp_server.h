@@ -18,7 +18,11 @@
 
 #include <atomic>
 #include <memory>
+#include <vector>
 
+#include <sys/socket.h>
+
+#include <boost/property_tree/ptree.hpp>
 #include <boost/thread/barrier.hpp>
 
 #include "storage_api.h"
@@ -39,12 +43,15 @@ class UdpServer : public std::enable_shared_from_this<UdpServer>, public Server
     std::atomic<int>                   stop_;
     const int                          port_;
     const int                          nworkers_;
-    int                                sockfd_;         //< UDP socket file descriptor
+    const int                          batch_size_;     //< Max number of datagrams read at once
+    std::vector<int>                   sockets_;        //< UDP sockets (one per worker)
 
     Logger logger_;
 
     static const int MSS      = 0x10000;
-    
+    //! Receive timeout, workers check the stop flag this often
+    static const int RECV_TIMEOUT_MS = 100;
+
 #ifndef __APPLE__
     static const int NPACKETS = 16;
 #else
@@ -57,33 +64,48 @@ class UdpServer : public std::enable_shared_from_this<UdpServer>, public Server
     static int recvmsg_(int fd, mmsghdr* hdr, unsigned, int);
 #endif
     struct IOBuf {
-        // Counters
-        std::atomic<u64> pps;
-        std::atomic<u64> bps;
         // Packet recv structs
-        mmsghdr msgs[NPACKETS];
-        iovec   iovecs[NPACKETS];
-        char    bufs[NPACKETS][MSS];  // 1MB
-        IOBuf() {
-            memset(this, 0, sizeof(IOBuf));
-            for (int i = 0; i < NPACKETS; i++) {
-                iovecs[i].iov_base         = bufs[i];
+        std::vector<mmsghdr> msgs;
+        std::vector<iovec>   iovecs;
+        std::vector<char>    bufs;
+        IOBuf(int npackets)
+            : msgs(static_cast<size_t>(npackets))
+            , iovecs(static_cast<size_t>(npackets))
+            , bufs(static_cast<size_t>(npackets) * MSS)
+        {
+            memset(msgs.data(), 0, msgs.size() * sizeof(mmsghdr));
+            for (size_t i = 0; i < msgs.size(); i++) {
+                iovecs[i].iov_base         = &bufs[i * MSS];
                 iovecs[i].iov_len          = MSS;
                 msgs[i].msg_hdr.msg_iov    = &iovecs[i];
                 msgs[i].msg_hdr.msg_iovlen = 1;
             }
         }
+    };
 
+    //! Per-worker counters
+    struct WorkerStats {
+        std::atomic<u64> packets;  //< total number of received packets
+        std::atomic<u64> bytes;    //< total number of received bytes
+        std::atomic<u64> batches;  //< number of successful reads from the socket
+        WorkerStats() : packets{0}, bytes{0}, batches{0} {}
     };
+    std::vector<std::unique_ptr<WorkerStats>> stats_;
+
+    //! Create socket bound to the server port
+    int create_socket();
 
+    //! Add per-worker counters to stats
+    void report_stats(boost::property_tree::ptree* tree) const;
 
 public:
     /** C-tor.
       * @param nworker number of workers
       * @param port port number
       * @param pipeline pointer to ingestion pipeline
+      * @param batch_size max number of datagrams read from the socket at once (0 - default)
       */
-    UdpServer(std::shared_ptr<DbConnection> pipeline, int nworkers, int port);
+    UdpServer(std::shared_ptr<DbConnection> pipeline, int nworkers, int port, int batch_size = 0);
 
     //! Start processing packets
     virtual void start(SignalHandler* sig, int id);
@@ -92,7 +114,7 @@ private:
     //! Stop processing packets, close the socket
     void stop();
 
-    void worker(std::shared_ptr<DbSession> spout);
+    void worker(std::shared_ptr<DbSession> spout, int sockfd, WorkerStats* stats);
 };
 
 }  // namespace
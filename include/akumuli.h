@@ -231,6 +231,20 @@ AKU_EXPORT aku_Status aku_write_double_raw(aku_Session* session, aku_ParamId par
   */
 AKU_EXPORT aku_Status aku_write(aku_Session* ist, const aku_Sample* sample);
 
+/** Write batch of measurements to DB.
+  * Measurements are grouped by series and every group is written using
+  * single lock acquisition. Measurements that can't be written (late
+  * writes, unknown ids) are skipped, other measurements are written.
+  * @param ist is an opened ingestion stream
+  * @param ids is an array of parameter ids
+  * @param timestamps is an array of timestamps
+  * @param values is an array of values
+  * @param size is a number of elements in every array
+  * @returns AKU_SUCCESS or error code if some measurements were skipped
+  */
+AKU_EXPORT aku_Status aku_write_batch(aku_Session* ist, const aku_ParamId* ids,
+                                      const aku_Timestamp* timestamps, const double* values, size_t size);
+
 
 //---------
 // Queries
@@ -66,4 +66,23 @@ typedef struct {
     //! Path to input log root directory
     const char* input_log_path;
 
+    /** Comma separated list of rollup tiers (e.g. "1m,1h,1d"), can be null.
+      * Group-aggregate results are pre-computed for every tier at ingestion time.
+      * Every tier is stored as a separate tree, so N tiers multiply the number of
+      * trees (and their memory use) by N+1. The value is saved into the database
+      * on first open, after that the saved value is used.
+      */
+    const char* rollup_tiers;
+
+    /** Number of series to load into memory in background after open, 0 disables warm-up.
+      * Columns are opened lazily on first write or query, warm-up loads the series that
+      * were written most recently to avoid disk reads on first access.
+      */
+    u32 warmup_series;
+
+    /** Memory budget for the loaded columns in bytes, 0 means unlimited. Columns that
+      * are not written for a while are unloaded when the budget is exceeded.
+      */
+    u64 max_tree_memory;
+
 } aku_FineTuneParams;
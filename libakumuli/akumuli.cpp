@@ -222,6 +222,10 @@ public:
         return session_->write(sample);
     }
 
+    aku_Status add_batch(const aku_ParamId* ids, const aku_Timestamp* tss, const double* xss, size_t size) {
+        return session_->write_batch(ids, tss, xss, size);
+    }
+
     CursorImpl* query(const char* q) {
         auto res = new CursorImpl(session_, q);
         return res;
@@ -342,6 +346,13 @@ aku_Status aku_write(aku_Session* session, const aku_Sample* sample) {
     return ises->add_sample(*sample);
 }
 
+aku_Status aku_write_batch(aku_Session* session, const aku_ParamId* ids,
+                           const aku_Timestamp* timestamps, const double* values, size_t size)
+{
+    auto ises = reinterpret_cast<Session*>(session);
+    return ises->add_batch(ids, timestamps, values, size);
+}
+
 
 aku_Status aku_parse_duration(const char* str, int* value) {
     try {
@@ -189,6 +189,43 @@ bool ConcurrentCursor::put(aku_Sample const& result) {
     return true;
 }
 
+bool ConcurrentCursor::put_batch(SampleBatch const& batch) {
+    if (done_) {
+        return false;
+    }
+    const u32 bytes = sizeof(aku_Sample);
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::shared_ptr<BufferT> top;
+    for (size_t ix = 0; ix < batch.size(); ix++) {
+        while(true) {
+            if(queue_.empty()) {
+                top = make_empty();
+                queue_.push_back(top);
+            }
+            top = queue_.back();
+            if (top->wrpos + bytes > BUFFER_SIZE) {
+                // Overflow
+                if (queue_.size() < QUEUE_MAX) {
+                    top = make_empty();
+                    queue_.push_back(top);
+                } else {
+                    // Let the reader consume the data before waiting
+                    cond_.notify_all();
+                    cond_.wait(lock);
+                }
+                continue;
+            } else {
+                break;
+            }
+        }
+        aku_Sample sample = batch.at(ix);
+        memcpy(top->buf.data() + top->wrpos, &sample, bytes);
+        top->wrpos += bytes;
+    }
+    cond_.notify_all();
+    return true;
+}
+
 void ConcurrentCursor::complete() {
     done_ = true;
     cond_.notify_all();
@@ -86,6 +86,11 @@ struct ConcurrentCursor : Cursor {
 
     bool put(aku_Sample const& result);
 
+    /** Add all samples from the batch to the queue. Samples are stored as rows,
+      * the lock is acquired and the reader is notified once per batch.
+      */
+    bool put_batch(SampleBatch const& batch);
+
     void complete();
 
     template <class Fn_1arg_caller> void start(Fn_1arg_caller const& fn) {
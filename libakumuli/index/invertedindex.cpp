@@ -25,6 +25,8 @@
 #include "stringpool.h"
 #include "seriesparser.h"
 
+#include "roaring.hh"
+
 namespace Akumuli {
 
 //! Move pointer to the of the whitespace, return this pointer or end on error
@@ -64,8 +66,7 @@ bool write_tags(const char* begin, const char* end, Table* dest_sketch, u64 id)
         tag_end = tag_begin;
         tag_end = skip_tag(tag_end, end, &err);
         auto tagpair = std::make_pair(tag_begin, static_cast<u32>(tag_end - tag_begin));
-        u64 hash = StringTools::hash(tagpair);
-        dest_sketch->add(hash, id);
+        dest_sketch->add(tagpair, id);
         tag_begin = tag_end;
     }
     return err;
@@ -359,27 +360,40 @@ CMSketch::TVal CMSketch::extract(u64 value) const {
 // InvertedIndex //
 //               //
 
-InvertedIndex::InvertedIndex(u32) {
+InvertedIndex::InvertedIndex(u32 size_hint)
+    : table_(size_hint, &StringTools::hash, &StringTools::equal)
+{
 }
 
-void InvertedIndex::add(u64 key, u64 value) {
-    table_[key].add(value);
+InvertedIndex::~InvertedIndex() {
+}
+
+void InvertedIndex::add(StringT key, u64 value) {
+    auto& list = table_[key];
+    if (!list) {
+        list = std::make_shared<TVal>();
+    } else if (list.use_count() > 1) {
+        // Posting list is referenced by the query result, it should stay
+        // immutable (the index is locked so the count can't grow)
+        list = std::make_shared<TVal>(*list);
+    }
+    list->add(value);
 }
 
 size_t InvertedIndex::get_size_in_bytes() const {
     size_t sum = 0;
     for (auto const& row: table_) {
         auto const& list = row.second;
-        sum += list.getSizeInBytes();
+        sum += list->getSizeInBytes();
     }
     return sum;
 }
 
-InvertedIndex::TVal InvertedIndex::extract(u64 value) const {
-    auto it = table_.find(value);
+std::shared_ptr<const InvertedIndex::TVal> InvertedIndex::extract(StringT key) const {
+    static const std::shared_ptr<const TVal> empty = std::make_shared<TVal>();
+    auto it = table_.find(key);
     if (it == table_.end()) {
-        // Return empty value
-        return TVal();
+        return empty;
     }
     return it->second;
 }
@@ -479,29 +493,47 @@ bool TagValuePair::check(const char* begin, const char* end) const {
 //  IndexQueryResultsIterator  //
 //                             //
 
-IndexQueryResultsIterator::IndexQueryResultsIterator(CompressedPListConstIterator postinglist, StringPool const* spool)
-    : it_(postinglist)
-    , spool_(spool)
+IndexQueryResultsIterator::IndexQueryResultsIterator(Roaring64MapSetBitForwardIterator const& it,
+                                                     std::vector<StringT> const* names)
+    : it_(new Roaring64MapSetBitForwardIterator(it))
+    , names_(names)
 {
 }
 
+IndexQueryResultsIterator::IndexQueryResultsIterator(IndexQueryResultsIterator const& other)
+    : it_(new Roaring64MapSetBitForwardIterator(*other.it_))
+    , names_(other.names_)
+{
+}
+
+IndexQueryResultsIterator& IndexQueryResultsIterator::operator = (IndexQueryResultsIterator const& other) {
+    if (this == &other) {
+        return *this;
+    }
+    it_.reset(new Roaring64MapSetBitForwardIterator(*other.it_));
+    names_ = other.names_;
+    return *this;
+}
+
+IndexQueryResultsIterator::~IndexQueryResultsIterator() {
+}
+
 StringT IndexQueryResultsIterator::operator * () const {
-    auto id = *it_;
-    auto str = spool_->str(id);
-    return str;
+    auto id = **it_;
+    return names_->at(id);
 }
 
 IndexQueryResultsIterator& IndexQueryResultsIterator::operator ++ () {
-    ++it_;
+    ++*it_;
     return *this;
 }
 
 bool IndexQueryResultsIterator::operator == (IndexQueryResultsIterator const& other) const {
-    return it_ == other.it_;
+    return *it_ == *other.it_;
 }
 
 bool IndexQueryResultsIterator::operator != (IndexQueryResultsIterator const& other) const {
-    return it_ != other.it_;
+    return *it_ != *other.it_;
 }
 
 
@@ -510,18 +542,19 @@ bool IndexQueryResultsIterator::operator != (IndexQueryResultsIterator const& ot
 //                     //
 
 IndexQueryResults::IndexQueryResults()
-    : spool_(nullptr)
+    : postinglist_(std::make_shared<Roaring64Map>())
+    , names_(nullptr)
 {}
 
-IndexQueryResults::IndexQueryResults(CompressedPList&& plist, StringPool const* spool)
-    : postinglist_(plist)
-    , spool_(spool)
+IndexQueryResults::IndexQueryResults(std::shared_ptr<const Roaring64Map> plist, std::vector<StringT> const* names)
+    : postinglist_(std::move(plist))
+    , names_(names)
 {
 }
 
 IndexQueryResults::IndexQueryResults(IndexQueryResults const& other)
     : postinglist_(other.postinglist_)
-    , spool_(other.spool_)
+    , names_(other.names_)
 {
 }
 
@@ -530,59 +563,50 @@ IndexQueryResults& IndexQueryResults::operator = (IndexQueryResults && other) {
         return *this;
     }
     postinglist_ = std::move(other.postinglist_);
-    spool_ = other.spool_;
+    names_ = other.names_;
     return *this;
 }
 
 IndexQueryResults::IndexQueryResults(IndexQueryResults&& plist)
     : postinglist_(std::move(plist.postinglist_))
-    , spool_(plist.spool_)
+    , names_(plist.names_)
 {
 }
 
 
 IndexQueryResults IndexQueryResults::unique() const {
-    IndexQueryResults result(postinglist_.unique(), spool_);
-    return result;
+    // Posting list is a set, there is nothing to remove
+    return *this;
 }
 
 IndexQueryResults IndexQueryResults::intersection(IndexQueryResults const& other) const {
-    const StringPool *spool = spool_;
-    if (spool == nullptr) {
-        spool = other.spool_;
-    }
-    IndexQueryResults result(postinglist_ & other.postinglist_, spool);
+    auto names = names_ ? names_ : other.names_;
+    IndexQueryResults result(std::make_shared<Roaring64Map>(*postinglist_ & *other.postinglist_), names);
     return result;
 }
 
 IndexQueryResults IndexQueryResults::difference(IndexQueryResults const& other) const {
-    const StringPool *spool = spool_;
-    if (spool == nullptr) {
-        spool = other.spool_;
-    }
-    IndexQueryResults result(postinglist_ ^ other.postinglist_, spool);
+    auto names = names_ ? names_ : other.names_;
+    IndexQueryResults result(std::make_shared<Roaring64Map>(*postinglist_ - *other.postinglist_), names);
     return result;
 }
 
 IndexQueryResults IndexQueryResults::join(IndexQueryResults const& other) const {
-    const StringPool *spool = spool_;
-    if (spool == nullptr) {
-        spool = other.spool_;
-    }
-    IndexQueryResults result(postinglist_ | other.postinglist_, spool);
+    auto names = names_ ? names_ : other.names_;
+    IndexQueryResults result(std::make_shared<Roaring64Map>(*postinglist_ | *other.postinglist_), names);
     return result;
 }
 
 size_t IndexQueryResults::cardinality() const {
-    return postinglist_.cardinality();
+    return postinglist_->cardinality();
 }
 
 IndexQueryResultsIterator IndexQueryResults::begin() const {
-    return IndexQueryResultsIterator(postinglist_.begin(), spool_);
+    return IndexQueryResultsIterator(postinglist_->begin(), names_);
 }
 
 IndexQueryResultsIterator IndexQueryResults::end() const {
-    return IndexQueryResultsIterator(postinglist_.end(), spool_);
+    return IndexQueryResultsIterator(postinglist_->end(), names_);
 }
 
 
@@ -595,8 +619,11 @@ IndexQueryResults IncludeIfAllTagsMatch::query(IndexBase const& index) const {
     for(auto const& tv: pairs_) {
         auto res = index.tagvalue_query(tv);
         results = results.intersection(res);
+        if (results.cardinality() == 0) {
+            break;
+        }
     }
-    return results.filter(metric_).filter(pairs_);
+    return results;
 }
 
 //                    //
@@ -611,39 +638,35 @@ IncludeMany2Many::IncludeMany2Many(std::string mname, std::map<std::string, std:
 }
 
 IndexQueryResults IncludeMany2Many::query(IndexBase const& index) const {
-    std::vector<TagValuePair> tgv;
-    IndexQueryResults final_res;
-    bool first = true;
-    for (auto kv: tags_) {
-        if (kv.second.size() > 0) {
-            std::stringstream pair;
-            pair << kv.first << "=" << kv.second[0];
-            TagValuePair tagval(pair.str());
-            auto results = index.tagvalue_query(tagval);
-            tgv.push_back(tagval);
-            for (size_t ix = 1; ix < kv.second.size(); ix++) {
-                std::stringstream ixpair;
-                ixpair << kv.first << "=" << kv.second[ix];
-                TagValuePair ixtagval(ixpair.str());
-                tgv.push_back(ixtagval);
-                auto res = index.tagvalue_query(ixtagval);
-                results = results.join(res).unique();
-            }
-            if (first) {
-                final_res = std::move(results);
-                first = false;
-            } else {
-                final_res = final_res.intersection(results);
-            }
+    // Posting lists of all values of the tag are merged together, then merged lists
+    // are intersected with each other and with the posting list of the metric. Smallest
+    // lists are intersected first to keep intermediate results small.
+    std::vector<IndexQueryResults> lists;
+    for (auto const& kv: tags_) {
+        if (kv.second.empty()) {
+            continue;
         }
+        IndexQueryResults results;
+        for (auto const& value: kv.second) {
+            TagValuePair tagval(kv.first + "=" + value);
+            auto res = index.tagvalue_query(tagval);
+            results = results.join(res);
+        }
+        lists.push_back(std::move(results));
+    }
+    lists.push_back(index.metric_query(metric_));
+    std::vector<size_t> order(lists.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
     }
-    auto allmetric = index.metric_query(metric_);
-    if (tgv.empty()) {
-        // Select by metric only
-        return allmetric.filter(metric_);
+    std::sort(order.begin(), order.end(), [&lists](size_t lhs, size_t rhs) {
+        return lists[lhs].cardinality() < lists[rhs].cardinality();
+    });
+    IndexQueryResults final_res = std::move(lists[order.front()]);
+    for (size_t i = 1; i < order.size() && final_res.cardinality() != 0; i++) {
+        final_res = final_res.intersection(lists[order[i]]);
     }
-    final_res = final_res.intersection(allmetric);
-    return final_res.filter(metric_).filter(tgv);
+    return final_res;
 }
 
 //                   //
@@ -677,7 +700,7 @@ IndexQueryResults ExcludeTags::query(IndexBase const& index) const {
         auto res = index.tagvalue_query(tv);
         results = results.difference(res);
     }
-    return results.filter(metric_);
+    return results;
 }
 
 
@@ -691,11 +714,13 @@ IndexQueryResults JoinByTags::query(IndexBase const& index) const {
         auto res = index.metric_query(m);
         results = results.join(res);
     }
+    // Only series that have at least one of the tag-value pairs are included
+    IndexQueryResults tags;
     for(auto const& tv: pairs_) {
         auto res = index.tagvalue_query(tv);
-        results.difference(res);
+        tags = tags.join(res);
     }
-    return results.filter(metrics_).filter(pairs_);
+    return results.intersection(tags);
 }
 
 
@@ -839,38 +864,57 @@ std::tuple<aku_Status, StringT> Index::append(const char* begin, const char* end
     // Check if name is already been added
     auto name = std::make_pair(static_cast<const char*>(buffer), tags_end - buffer);
     if (table_.count(name) == 0) {
+        auto mname = skip_metric_name(buffer, tags_begin);
+        if (mname.second == 0) {
+            return std::make_tuple(AKU_EBAD_DATA, EMPTY_STRING);
+        }
         // insert value
         auto id = pool_.add(buffer, tags_end);
         if (id == 0) {
             return std::make_tuple(AKU_EBAD_DATA, EMPTY_STRING);
         }
-        write_tags(tags_begin, tags_end, &tagvalue_pairs_, id);
         name = pool_.str(id);  // name now have the same lifetime as pool
-        table_[name] = id;
-        auto mname = skip_metric_name(buffer, tags_begin);
-        if (mname.second == 0) {
-            return std::make_tuple(AKU_EBAD_DATA, EMPTY_STRING);
-        }
-        auto mhash = StringTools::hash(mname);
-        metrics_names_.add(mhash, id);
-        // update topology
-        topology_.add_name(name);
+        auto offset = name.first - static_cast<const char*>(buffer);
+        add_name(name, std::make_pair(mname.first + offset, mname.second));
         return std::make_tuple(AKU_SUCCESS, name);
     }
     auto it = table_.find(name);
     return std::make_tuple(AKU_SUCCESS, it->first);
 }
 
+aku_Status Index::insert(StringT name) {
+    if (table_.count(name) != 0) {
+        return AKU_SUCCESS;
+    }
+    auto mname = skip_metric_name(name.first, name.first + name.second);
+    if (mname.second == 0) {
+        return AKU_EBAD_DATA;
+    }
+    add_name(name, mname);
+    return AKU_SUCCESS;
+}
+
+void Index::add_name(StringT name, StringT mname) {
+    // Posting lists are keyed by the parts of the name and contain series
+    // ordinals (dense, unlike string pool ids) to keep bitmaps compact
+    u64 ordinal = names_.size();
+    names_.push_back(name);
+    table_[name] = ordinal;
+    const char* tags_begin = mname.first + mname.second;
+    write_tags(tags_begin, name.first + name.second, &tagvalue_pairs_, ordinal);
+    metrics_names_.add(mname, ordinal);
+    // update topology
+    topology_.add_name(name);
+}
+
 IndexQueryResults Index::tagvalue_query(const TagValuePair &value) const {
-    auto hash = StringTools::hash(value.get_value());
-    auto post = tagvalue_pairs_.extract(hash);
-    return IndexQueryResults(std::move(post), &pool_);
+    auto post = tagvalue_pairs_.extract(value.get_value());
+    return IndexQueryResults(std::move(post), &names_);
 }
 
 IndexQueryResults Index::metric_query(const MetricName &value) const {
-    auto hash = StringTools::hash(value.get_value());
-    auto post = metrics_names_.extract(hash);
-    return IndexQueryResults(std::move(post), &pool_);
+    auto post = metrics_names_.extract(value.get_value());
+    return IndexQueryResults(std::move(post), &names_);
 }
 
 std::vector<StringT> Index::list_metric_names() const {
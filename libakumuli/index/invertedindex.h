@@ -29,6 +29,9 @@
 #include <map>
 #include <sstream>
 
+class Roaring64Map;
+class Roaring64MapSetBitForwardIterator;
+
 namespace Akumuli {
 
 struct TwoUnivHashFnFamily {
@@ -443,17 +446,32 @@ public:
 // Inverted Index //
 //               //
 
+/**
+ * Maps exact key (metric name or tag=value pair) to the bitmap
+ * of series ordinals. Keys are not copied, they should have the
+ * same lifetime as the index (point into the string pool).
+ * Posting lists are shared with query results, list that is
+ * referenced by a query result is copied on write.
+ */
 class InvertedIndex {
-    typedef CompressedPList TVal;
-    std::unordered_map<u64, TVal> table_;
+    typedef Roaring64Map TVal;
+    typedef std::unordered_map<StringTools::StringT, std::shared_ptr<TVal>,
+                               decltype(&StringTools::hash),
+                               decltype(&StringTools::equal)> TableT;
+    TableT table_;
 public:
-    InvertedIndex(u32);
+    InvertedIndex(u32 size_hint);
 
-    void add(u64 key, u64 value);
+    ~InvertedIndex();
+
+    void add(StringT key, u64 value);
 
     size_t get_size_in_bytes() const;
 
-    TVal extract(u64 value) const;
+    /** Return posting list (empty list if key is not present). The list is
+      * shared with the index, it's not changed by subsequent `add` calls.
+      */
+    std::shared_ptr<const TVal> extract(StringT key) const;
 };
 
 //              //
@@ -507,10 +525,16 @@ public:
  * std algorithms in general.
  */
 class IndexQueryResultsIterator {
-    CompressedPListConstIterator it_;
-    StringPool const* spool_;
+    std::unique_ptr<Roaring64MapSetBitForwardIterator> it_;
+    std::vector<StringT> const* names_;
 public:
-    IndexQueryResultsIterator(CompressedPListConstIterator postinglist, StringPool const* spool);
+    IndexQueryResultsIterator(Roaring64MapSetBitForwardIterator const& it, std::vector<StringT> const* names);
+
+    IndexQueryResultsIterator(IndexQueryResultsIterator const& other);
+
+    IndexQueryResultsIterator& operator = (IndexQueryResultsIterator const& other);
+
+    ~IndexQueryResultsIterator();
 
     StringT operator * () const;
 
@@ -526,13 +550,17 @@ public:
 //  IndexQueryResults  //
 //                     //
 
+/**
+ * Set of series ordinals. Posting list is immutable and shared
+ * between copies, set operations always produce new posting list.
+ */
 class IndexQueryResults {
-    CompressedPList postinglist_;
-    StringPool const* spool_;
+    std::shared_ptr<const Roaring64Map> postinglist_;
+    std::vector<StringT> const* names_;
 public:
     IndexQueryResults();
 
-    IndexQueryResults(CompressedPList&& plist, StringPool const* spool);
+    IndexQueryResults(std::shared_ptr<const Roaring64Map> plist, std::vector<StringT> const* names);
 
     IndexQueryResults(IndexQueryResults const& other);
 
@@ -540,74 +568,6 @@ public:
 
     IndexQueryResults(IndexQueryResults&& plist);
 
-    template<class Checkable>
-    IndexQueryResults filter(std::vector<Checkable> const& values) const {
-        bool rewrite = false;
-        // Check for falce positives
-        for (auto it = postinglist_.begin(); it != postinglist_.end(); ++it) {
-            auto id = *it;
-            auto str = spool_->str(id);
-            bool success = false;
-            for (auto const& value: values) {
-                if (value.check(str.first, str.first + str.second)) {
-                    success = true;
-                    break;
-                }
-            }
-            if (!success) {
-                rewrite = true;
-                break;
-            }
-        }
-        if (rewrite) {
-            // This code only gets triggered when false positives are present
-            CompressedPList newplist;
-            for (auto it = postinglist_.begin(); it != postinglist_.end(); ++it) {
-                auto id = *it;
-                auto str = spool_->str(id);
-                for (auto const& value: values) {
-                    bool add = false;
-                    if (value.check(str.first, str.first + str.second)) {
-                        add = true;
-                        break;
-                    }
-                    if (add) {
-                        newplist.add(id);
-                    }
-                }
-            }
-            return IndexQueryResults(std::move(newplist), spool_);
-        }
-        return *this;
-    }
-
-    template<class Checkable>
-    IndexQueryResults filter(Checkable const& value) const {
-        bool rewrite = false;
-        // Check for falce positives
-        for (auto it = postinglist_.begin(); it != postinglist_.end(); ++it) {
-            auto id = *it;
-            auto str = spool_->str(id);
-            if (!value.check(str.first, str.first + str.second)) {
-                rewrite = true;
-                break;
-            }
-        }
-        if (rewrite) {
-            // This code only gets triggered when false positives are present
-            CompressedPList newplist;
-            for (auto it = postinglist_.begin(); it != postinglist_.end(); ++it) {
-                auto id = *it;
-                auto str = spool_->str(id);
-                if (value.check(str.first, str.first + str.second)) {
-                    newplist.add(id);
-                }
-            }
-            return IndexQueryResults(std::move(newplist), spool_);
-        }
-        return *this;
-    }
-
     IndexQueryResults unique() const;
 
     IndexQueryResults intersection(IndexQueryResults const& other) const;
@@ -809,12 +769,16 @@ public:
 
 class Index : public IndexBase {
     StringPool pool_;
-    StringTools::TableT table_;
+    StringTools::TableT table_;     //! Series name -> ordinal
+    std::vector<StringT> names_;    //! Ordinal -> series name
     //CMSketch metrics_names_;
     //CMSketch tagvalue_pairs_;
     InvertedIndex metrics_names_;
     InvertedIndex tagvalue_pairs_;
     SeriesNameTopology topology_;
+
+    //! Add pooled name in canonical form to the index
+    void add_name(StringT name, StringT mname);
 public:
     Index();
 
@@ -834,6 +798,13 @@ public:
      */
     std::tuple<aku_Status, StringT> append(const char* begin, const char* end);
 
+    /**
+     * @brief Add series name that is stored outside of the index
+     * @param name is a series name in canonical form, should outlive the index
+     * @return status
+     */
+    aku_Status insert(StringT name);
+
     virtual IndexQueryResults tagvalue_query(const TagValuePair &value) const;
 
     virtual IndexQueryResults metric_query(const MetricName &value) const;
@@ -19,12 +19,18 @@
 #include "util.h"
 #include "datetime.h"
 #include "status_util.h"
+#include "log_iface.h"
 
 #include <string>
 #include <map>
 #include <algorithm>
+#include <cstring>
 #include <regex>
 
+#include <apr_file_io.h>
+#include <apr_portable.h>
+#include <unistd.h>
+
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
@@ -36,30 +42,84 @@ namespace Akumuli {
 
 static const StringT EMPTY = std::make_pair(nullptr, 0);
 
+//! Shared index lock (SharedLock from util.h is exclusive)
+typedef LockGuard<RWLock, &RWLock::rdlock> IndexReadLock;
+
 SeriesMatcher::SeriesMatcher(u64 starting_id)
-    : table(StringTools::create_table(0x1000))
-    , series_id(starting_id)
+    : ids_(0x1000, SeriesNameTable::BY_ID)
+    , index_lock_(true)
+    , pending_{0}
+    , series_id{starting_id}
 {
     if (starting_id == 0u) {
         AKU_PANIC("Bad series ID");
     }
 }
 
-u64 SeriesMatcher::add(const char* begin, const char* end) {
-    std::lock_guard<std::mutex> guard(mutex);
-    auto id = series_id++;
-    aku_Status status;
-    StringT sname;
-    std::tie(status, sname) = index.append(begin, end);
+SeriesMatcher::Shard& SeriesMatcher::get_shard(StringT name) const {
+    return shards_[StringTools::hash(name) % NSHARDS];
+}
+
+std::tuple<aku_Status, u64, bool> SeriesMatcher::add_name(const char* begin, const char* end, u64 id) {
+    // Parse string value and sort tags alphabetically (outside of the lock)
+    const char* tags_begin;
+    const char* tags_end;
+    char buffer[AKU_LIMITS_MAX_SNAME];
+    auto status = SeriesParser::to_canonical_form(begin, end, buffer, buffer + AKU_LIMITS_MAX_SNAME,
+                                                  &tags_begin, &tags_end);
     if (status != AKU_SUCCESS) {
-        series_id = id;
-        return 0;
+        return std::make_tuple(status, 0ul, false);
+    }
+    auto name = std::make_pair(static_cast<const char*>(buffer), static_cast<u32>(tags_end - buffer));
+    auto& shard = get_shard(name);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto prev = shard.table.find(name);
+    if (prev != 0 && (id == 0 || id == prev)) {
+        return std::make_tuple(AKU_SUCCESS, prev, false);
+    }
+    StringT pstr;
+    if (prev != 0) {
+        // Name is mapped to another id, the pooled string can be reused
+        pstr = ids_.find(prev);
+    } else {
+        auto offset = shard.pool.add(buffer, tags_end);
+        if (offset == 0) {
+            return std::make_tuple(AKU_EBAD_DATA, 0ul, false);
+        }
+        pstr = shard.pool.str(offset);
     }
-    auto tup = std::make_tuple(std::get<0>(sname), std::get<1>(sname), id);
-    table[sname] = id;
-    inv_table[id] = sname;
-    names.push_back(tup);
-    return id;
+    bool new_id = id == 0;
+    if (new_id) {
+        id = series_id++;
+    }
+    shard.table.insert(pstr, id);
+    {
+        // Shard lock is held, every id is inserted into `ids_` before the
+        // shard is unlocked (see `write_segment`)
+        std::lock_guard<std::mutex> ids_guard(ids_lock_);
+        ids_.insert(pstr, id);
+    }
+    auto tup = std::make_tuple(pstr.first, static_cast<int>(pstr.second), id);
+    if (new_id) {
+        shard.names.push_back(tup);
+    }
+    if (prev == 0) {
+        shard.delta.push_back(tup);
+        pending_++;
+    }
+    return std::make_tuple(AKU_SUCCESS, id, true);
+}
+
+u64 SeriesMatcher::add(const char* begin, const char* end) {
+    return std::get<0>(match_or_add(begin, end));
+}
+
+std::tuple<u64, bool> SeriesMatcher::match_or_add(const char* begin, const char* end) {
+    aku_Status status;
+    u64 id;
+    bool created;
+    std::tie(status, id, created) = add_name(begin, end, 0);
+    return std::make_tuple(id, created);
 }
 
 void SeriesMatcher::_add(std::string series, u64 id) {
@@ -70,72 +130,308 @@ void SeriesMatcher::_add(std::string series, u64 id) {
 }
 
 void SeriesMatcher::_add(const char*  begin, const char* end, u64 id) {
-    std::lock_guard<std::mutex> guard(mutex);
-    aku_Status status;
-    StringT sname;
-    std::tie(status, sname) = index.append(begin, end);
+    auto status = std::get<0>(add_name(begin, end, id));
     StatusUtil::throw_on_error(status);
-    table[sname] = id;
-    inv_table[id] = sname;
 }
 
 u64 SeriesMatcher::match(const char* begin, const char* end) const {
     int len = static_cast<int>(end - begin);
     StringT str = std::make_pair(begin, len);
-
-    std::lock_guard<std::mutex> guard(mutex);
-    auto it = table.find(str);
-    if (it == table.end()) {
-        return 0ul;
-    }
-    return it->second;
+    return get_shard(str).table.find(str);
 }
 
 StringT SeriesMatcher::id2str(u64 tokenid) const {
-    std::lock_guard<std::mutex> guard(mutex);
-    auto it = inv_table.find(tokenid);
-    if (it == inv_table.end()) {
-        return EMPTY;
-    }
-    return it->second;
+    return ids_.find(tokenid);
 }
 
 void SeriesMatcher::pull_new_names(std::vector<PlainSeriesMatcher::SeriesNameT> *buffer) {
-    std::lock_guard<std::mutex> guard(mutex);
-    std::swap(names, *buffer);
+    buffer->clear();
+    // All shards are locked at once (always in the same order). Ids are allocated
+    // under the shard lock, so the batch contains every new id below the largest
+    // one. Otherwise a smaller id could miss the batch while a larger id makes it
+    // in (this would break the watermark of the index segment).
+    std::array<std::unique_lock<std::mutex>, NSHARDS> guards;
+    for (size_t ix = 0; ix < NSHARDS; ix++) {
+        guards[ix] = std::unique_lock<std::mutex>(shards_[ix].mutex);
+    }
+    for (auto& shard: shards_) {
+        std::copy(shard.names.begin(), shard.names.end(), std::back_inserter(*buffer));
+        shard.names.clear();
+    }
+    std::sort(buffer->begin(), buffer->end(), [](SeriesNameT const& lhs, SeriesNameT const& rhs) {
+        return std::get<2>(lhs) < std::get<2>(rhs);
+    });
 }
 
-std::vector<u64> SeriesMatcher::get_all_ids() const {
-    std::vector<u64> result;
+void SeriesMatcher::update_index() const {
+    if (pending_.load() == 0) {
+        return;
+    }
+    // Updates are serialized, otherwise names can be added to the index out of
+    // order by concurrent updates. Counter of pending names is decremented only
+    // after the names are added to the index, so a query that sees a non-zero
+    // counter waits for the update in progress.
+    std::lock_guard<std::mutex> update_guard(update_lock_);
+    std::vector<SeriesNameT> batch;
+    for (auto& shard: shards_) {
+        std::lock_guard<std::mutex> shard_guard(shard.mutex);
+        std::copy(shard.delta.begin(), shard.delta.end(), std::back_inserter(batch));
+        shard.delta.clear();
+    }
+    std::sort(batch.begin(), batch.end(), [](SeriesNameT const& lhs, SeriesNameT const& rhs) {
+        return std::get<2>(lhs) < std::get<2>(rhs);
+    });
+    // The batch can be large (e.g. all names from the index segment on startup),
+    // exclusive lock is released between chunks to let queries run
+    for (size_t ix = 0; ix < batch.size(); ix += INDEX_UPDATE_CHUNK) {
+        auto chunk_end = std::min(batch.size(), ix + INDEX_UPDATE_CHUNK);
+        UniqueLock guard(index_lock_);
+        for (size_t i = ix; i < chunk_end; i++) {
+            auto const& tup = batch[i];
+            auto name = std::make_pair(std::get<0>(tup), static_cast<u32>(std::get<1>(tup)));
+            auto status = index_.insert(name);
+            if (status != AKU_SUCCESS) {
+                Logger::msg(AKU_LOG_ERROR, "Can't add series " + std::string(name.first, name.first + name.second) +
+                                           " to the index: " + StatusUtil::str(status));
+            }
+        }
+    }
+    pending_ -= batch.size();
+}
+
+//! Index segment header
+struct SegmentHeader {
+    char magic[8];
+    u32  version;
+    u32  entry_size;
+    u64  count;       //! Number of entries
+    u64  watermark;   //! All series with smaller ids are present in the segment
+    u64  names_size;  //! Size of the names area
+};
+
+//! Id table entry, entries are sorted by series id
+struct SegmentEntry {
+    u64 id;
+    u64 offset;  //! Name offset inside the names area
+    u32 length;
+    u32 reserved;
+};
+
+// Segment layout: header, id table, names area
+static const char SEGMENT_MAGIC[8] = { 'A', 'K', 'U', 'S', 'I', 'D', 'X', '\0' };
+static const u32 SEGMENT_VERSION = 1;
+static const size_t SEGMENT_WRITE_BUFFER = 0x100000;
+
+static void log_apr_error(apr_status_t status, std::string const& msg) {
+    char error_message[0x100];
+    apr_strerror(status, error_message, 0x100);
+    Logger::msg(AKU_LOG_ERROR, msg + " " + error_message);
+}
+
+aku_Status SeriesMatcher::write_segment(std::string const& path) const {
+    SegmentHeader header = {};
+    std::copy(SEGMENT_MAGIC, SEGMENT_MAGIC + sizeof(SEGMENT_MAGIC), header.magic);
+    header.version = SEGMENT_VERSION;
+    header.entry_size = sizeof(SegmentEntry);
+    // Names that weren't pulled yet may be missing from the metadata storage.
+    // The watermark is the smallest of their ids, only the names below it are
+    // saved, the rest are read from the metadata storage on startup. All shards
+    // are locked at once (the same way as in `pull_new_names`). Ids are allocated
+    // and added to `ids_` under the shard lock, so every name with smaller id
+    // is in the table after that.
     {
-        std::lock_guard<std::mutex> guard(mutex);
-        for (auto const &tup: inv_table) {
-            result.push_back(tup.first);
+        std::array<std::unique_lock<std::mutex>, NSHARDS> guards;
+        for (size_t ix = 0; ix < NSHARDS; ix++) {
+            guards[ix] = std::unique_lock<std::mutex>(shards_[ix].mutex);
+        }
+        header.watermark = series_id.load();
+        for (auto const& shard: shards_) {
+            for (auto const& tup: shard.names) {
+                header.watermark = std::min(header.watermark, std::get<2>(tup));
+            }
+        }
+    }
+    std::vector<SeriesNameT> names;
+    for (auto id: ids_.get_all_ids()) {
+        if (id >= header.watermark) {
+            continue;
+        }
+        auto str = ids_.find(id);
+        names.push_back(std::make_tuple(str.first, static_cast<int>(str.second), id));
+    }
+    std::sort(names.begin(), names.end(), [](SeriesNameT const& lhs, SeriesNameT const& rhs) {
+        return std::get<2>(lhs) < std::get<2>(rhs);
+    });
+    std::vector<SegmentEntry> entries;
+    entries.reserve(names.size());
+    for (auto const& tup: names) {
+        SegmentEntry entry = {};
+        entry.id = std::get<2>(tup);
+        entry.offset = header.names_size;
+        entry.length = static_cast<u32>(std::get<1>(tup));
+        entries.push_back(entry);
+        header.names_size += entry.length;
+    }
+    header.count = entries.size();
+
+    apr_pool_t* mem_pool = nullptr;
+    apr_status_t status = apr_pool_create(&mem_pool, nullptr);
+    if (status != APR_SUCCESS) {
+        log_apr_error(status, "Can't create APR pool");
+        return AKU_EIO;
+    }
+    std::unique_ptr<apr_pool_t, void (*)(apr_pool_t*)> pool(mem_pool, &apr_pool_destroy);
+    std::string tmp_path = path + ".tmp";
+    apr_file_t* file = nullptr;
+    status = apr_file_open(&file, tmp_path.c_str(), APR_WRITE|APR_CREATE|APR_TRUNCATE|APR_BINARY,
+                           APR_OS_DEFAULT, pool.get());
+    if (status != APR_SUCCESS) {
+        log_apr_error(status, "Can't open file " + tmp_path);
+        return AKU_EIO;
+    }
+    status = apr_file_write_full(file, &header, sizeof(header), nullptr);
+    if (status == APR_SUCCESS && !entries.empty()) {
+        status = apr_file_write_full(file, entries.data(), entries.size() * sizeof(SegmentEntry), nullptr);
+    }
+    // Names are written in large chunks
+    std::vector<char> buffer;
+    buffer.reserve(SEGMENT_WRITE_BUFFER);
+    for (auto it = names.begin(); status == APR_SUCCESS && it != names.end(); it++) {
+        buffer.insert(buffer.end(), std::get<0>(*it), std::get<0>(*it) + std::get<1>(*it));
+        if (buffer.size() >= SEGMENT_WRITE_BUFFER || std::next(it) == names.end()) {
+            status = apr_file_write_full(file, buffer.data(), buffer.size(), nullptr);
+            buffer.clear();
         }
     }
+    if (status == APR_SUCCESS) {
+        status = apr_file_flush(file);
+    }
+    if (status == APR_SUCCESS) {
+        // Segment should be durable before it replaces the previous one
+        apr_os_file_t fd;
+        status = apr_os_file_get(&fd, file);
+        if (status == APR_SUCCESS && fsync(fd) != 0) {
+            status = APR_FROM_OS_ERROR(errno);
+        }
+    }
+    apr_file_close(file);
+    if (status != APR_SUCCESS) {
+        log_apr_error(status, "Can't write index segment " + tmp_path);
+        return AKU_EIO;
+    }
+    status = apr_file_rename(tmp_path.c_str(), path.c_str(), pool.get());
+    if (status != APR_SUCCESS) {
+        log_apr_error(status, "Can't rename index segment " + tmp_path);
+        return AKU_EIO;
+    }
+    // Make the rename durable
+    status = sync_parent_directory(path);
+    if (status != APR_SUCCESS) {
+        log_apr_error(status, "Can't sync directory of the index segment " + path);
+        return AKU_EIO;
+    }
+    return AKU_SUCCESS;
+}
+
+std::tuple<aku_Status, u64> SeriesMatcher::map_segment(std::string const& path) {
+    if (segment_) {
+        return std::make_tuple(AKU_EBUSY, 0ull);
+    }
+    // Segment is immutable, it's mapped read-only and can be mapped by other readers
+    std::unique_ptr<MemoryMappedFile> segment(new MemoryMappedFile(path.c_str(), false, true));
+    if (segment->is_bad()) {
+        return std::make_tuple(AKU_EIO, 0ull);
+    }
+    // Invalid segment is moved out of the way, otherwise it would be rejected on
+    // every start (names are read from the metadata storage instead)
+    auto reject = [&segment, &path]() {
+        std::string bad_path = path + ".bad";
+        Logger::msg(AKU_LOG_ERROR, "Invalid index segment " + path + ", renamed to " + bad_path);
+        segment->move_file(bad_path.c_str());
+        return std::make_tuple(AKU_EBAD_DATA, 0ull);
+    };
+    // Validate the segment before adding anything to the matcher
+    auto begin = static_cast<const char*>(segment->get_pointer());
+    auto size = segment->get_size();
+    SegmentHeader header;
+    if (size < sizeof(header)) {
+        return reject();
+    }
+    memcpy(&header, begin, sizeof(header));
+    if (!std::equal(SEGMENT_MAGIC, SEGMENT_MAGIC + sizeof(SEGMENT_MAGIC), header.magic)
+        || header.version != SEGMENT_VERSION
+        || header.entry_size != sizeof(SegmentEntry)
+        || header.count > (size - sizeof(header)) / sizeof(SegmentEntry)
+        || sizeof(header) + header.count * sizeof(SegmentEntry) + header.names_size != size)
+    {
+        return reject();
+    }
+    auto entries = reinterpret_cast<const SegmentEntry*>(begin + sizeof(header));
+    auto names = begin + sizeof(header) + header.count * sizeof(SegmentEntry);
+    std::array<std::vector<SeriesNameT>, NSHARDS> partitions;
+    u64 max_id = 0;
+    for (u64 i = 0; i < header.count; i++) {
+        auto const& entry = entries[i];
+        if (entry.id == 0 || entry.id < max_id || entry.length == 0
+            || entry.offset > header.names_size || entry.length > header.names_size - entry.offset)
+        {
+            return reject();
+        }
+        max_id = entry.id;
+        auto name = std::make_pair(names + entry.offset, entry.length);
+        auto ix = StringTools::hash(name) % NSHARDS;
+        partitions[ix].push_back(std::make_tuple(name.first, static_cast<int>(name.second), entry.id));
+    }
+    for (size_t ix = 0; ix < NSHARDS; ix++) {
+        auto& shard = shards_[ix];
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        std::lock_guard<std::mutex> ids_guard(ids_lock_);
+        for (auto const& tup: partitions[ix]) {
+            auto name = std::make_pair(std::get<0>(tup), static_cast<u32>(std::get<1>(tup)));
+            shard.table.insert(name, std::get<2>(tup));
+            ids_.insert(name, std::get<2>(tup));
+            shard.delta.push_back(tup);
+        }
+        pending_ += partitions[ix].size();
+    }
+    if (series_id.load() <= max_id) {
+        series_id = max_id + 1;
+    }
+    segment_ = std::move(segment);
+    return std::make_tuple(AKU_SUCCESS, header.watermark);
+}
+
+std::vector<u64> SeriesMatcher::get_all_ids() const {
+    auto result = ids_.get_all_ids();
     std::sort(result.begin(), result.end());
     return result;
 }
 
 std::vector<SeriesMatcher::SeriesNameT> SeriesMatcher::search(IndexQueryNodeBase const& query) const {
     std::vector<SeriesMatcher::SeriesNameT> result;
-    std::lock_guard<std::mutex> guard(mutex);
-    auto resultset = query.query(index);
+    update_index();
+    IndexReadLock guard(index_lock_);
+    auto resultset = query.query(index_);
     for (auto it = resultset.begin(); it != resultset.end(); ++it) {
         auto str = *it;
-        auto fit = table.find(str);
-        if (fit == table.end()) {
+        auto id = match(str.first, str.first + str.second);
+        if (id == 0) {
             AKU_PANIC("Invalid index state");
         }
-        result.push_back(std::make_tuple(str.first, str.second, fit->second));
+        result.push_back(std::make_tuple(str.first, str.second, id));
     }
+    // Names from different shards can be added to the index out of order
+    std::sort(result.begin(), result.end(), [](SeriesNameT const& lhs, SeriesNameT const& rhs) {
+        return std::get<2>(lhs) < std::get<2>(rhs);
+    });
     return result;
 }
 
 std::vector<StringT> SeriesMatcher::suggest_metric(std::string prefix) const {
     std::vector<StringT> results;
-    std::lock_guard<std::mutex> guard(mutex);
-    results = index.get_topology().list_metric_names();
+    update_index();
+    IndexReadLock guard(index_lock_);
+    results = index_.get_topology().list_metric_names();
     auto resit = std::remove_if(results.begin(), results.end(), [prefix](StringT val) {
         if (val.second < prefix.size()) {
             return true;
@@ -149,8 +445,9 @@ std::vector<StringT> SeriesMatcher::suggest_metric(std::string prefix) const {
 
 std::vector<StringT> SeriesMatcher::suggest_tags(std::string metric, std::string tag_prefix) const {
     std::vector<StringT> results;
-    std::lock_guard<std::mutex> guard(mutex);
-    results = index.get_topology().list_tags(tostrt(metric));
+    update_index();
+    IndexReadLock guard(index_lock_);
+    results = index_.get_topology().list_tags(tostrt(metric));
     auto resit = std::remove_if(results.begin(), results.end(), [tag_prefix](StringT val) {
         if (val.second < tag_prefix.size()) {
             return true;
@@ -164,8 +461,9 @@ std::vector<StringT> SeriesMatcher::suggest_tags(std::string metric, std::string
 
 std::vector<StringT> SeriesMatcher::suggest_tag_values(std::string metric, std::string tag, std::string value_prefix) const {
     std::vector<StringT> results;
-    std::lock_guard<std::mutex> guard(mutex);
-    results = index.get_topology().list_tag_values(tostrt(metric), tostrt(tag));
+    update_index();
+    IndexReadLock guard(index_lock_);
+    results = index_.get_topology().list_tag_values(tostrt(metric), tostrt(tag));
     auto resit = std::remove_if(results.begin(), results.end(), [value_prefix](StringT val) {
         if (val.second < value_prefix.size()) {
             return true;
@@ -178,15 +476,20 @@ std::vector<StringT> SeriesMatcher::suggest_tag_values(std::string metric, std::
 }
 
 size_t SeriesMatcher::memory_use() const {
-    return index.memory_use();
+    return index_memory_use() + pool_memory_use();
 }
 
 size_t SeriesMatcher::index_memory_use() const {
-    return index.index_memory_use();
+    IndexReadLock guard(index_lock_);
+    return index_.index_memory_use();
 }
 
 size_t SeriesMatcher::pool_memory_use() const {
-    return index.pool_memory_use();
+    size_t res = 0;
+    for (auto const& shard: shards_) {
+        res += shard.pool.mem_used();
+    }
+    return res;
 }
 //                          //
 //   LegacySeriesMatcher    //
@@ -19,11 +19,14 @@
 #include "index/stringpool.h"
 #include "index/invertedindex.h"
 
+#include <array>
+#include <atomic>
 #include <deque>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <stdint.h>
+#include <string>
 #include <tuple>
 #include <unordered_map>
 #include <unordered_set>
@@ -70,6 +73,15 @@ struct SeriesMatcherBase {
   * Implements inverted index with compression and other optimizations.
   * It's more efficient than PlainSeriesMatcher but it's costly to have
   * many instances in one application.
+  * Series names are partitioned by hash into independently locked shards,
+  * ids are allocated from the global atomic counter. Id to name mapping
+  * is global (not partitioned). `match` and `id2str` are lock-free. New
+  * names are added to the inverted index in batches (see `update_index`),
+  * queries that use the index merge pending names first and then take
+  * shared lock.
+  * Names can be saved to the index segment (see `write_segment`). On
+  * startup the segment is mapped into memory and the names are referenced
+  * from the mapped file instead of being copied into the string pool.
   */
 struct SeriesMatcher : SeriesMatcherBase {
     //! Series name descriptor - pointer to string, length, series id.
@@ -78,19 +90,52 @@ struct SeriesMatcher : SeriesMatcherBase {
     typedef StringTools::TableT TableT;
     typedef StringTools::InvT   InvT;
 
-    Index                    index;      //! Series name index and storage
-    TableT                   table;      //! Series table (name to id mapping)
-    InvT                     inv_table;  //! Ids table (id to name mapping)
-    u64                      series_id;  //! Series ID counter
-    std::vector<SeriesNameT> names;      //! List of recently added names
-    mutable std::mutex       mutex;      //! Mutex for shared data
+    enum {
+        NSHARDS = 16,
+        INDEX_UPDATE_CHUNK = 0x1000,  //! Number of names added to the index under the exclusive lock
+    };
+
+private:
+    struct Shard {
+        std::mutex               mutex;  //! Serializes inserts into the shard
+        StringPool               pool;   //! Series names storage
+        SeriesNameTable          table{0x1000, SeriesNameTable::BY_NAME};  //! Name to id mapping (lock-free reads)
+        std::vector<SeriesNameT> names;  //! List of recently added names
+        std::vector<SeriesNameT> delta;  //! Names that are not added to the index yet
+    };
+    mutable std::array<Shard, NSHARDS> shards_;
+    SeriesNameTable                    ids_;         //! Id to name mapping (lock-free reads)
+    std::mutex                         ids_lock_;    //! Serializes inserts into `ids_`
+    mutable Index                      index_;       //! Series name index
+    mutable RWLock                     index_lock_;  //! Index lock (shared by queries, exclusive by updates)
+    mutable std::mutex                 update_lock_; //! Serializes index updates
+    mutable std::atomic<size_t>        pending_;     //! Number of names that are not added to the index yet
+    std::unique_ptr<MemoryMappedFile>  segment_;     //! Mapped index segment (names are referenced from it)
+
+    Shard& get_shard(StringT name) const;
+
+    /** Add name to the shard.
+      * @param id is a series id or 0 if new id should be allocated
+      * @return status, series id and flag that indicates that the mapping was added
+      */
+    std::tuple<aku_Status, u64, bool> add_name(const char* begin, const char* end, u64 id);
+
+public:
+    std::atomic<u64>                   series_id;    //! Series ID counter
 
     SeriesMatcher(u64 starting_id=AKU_STARTING_SERIES_ID);
 
     /** Add new string to matcher.
+      * If string is already added, it's id is returned.
       */
     u64 add(const char* begin, const char* end);
 
+    /** Add new string to matcher if it's not present.
+      * @return series id (0 on error) and flag that is set
+      *         if the new series was added
+      */
+    std::tuple<u64, bool> match_or_add(const char* begin, const char* end);
+
     /** Add value to matcher. This function should be
       * used only to load data to matcher. Internal
       * `series_id` counter wouldn't be affected by this call, so
@@ -115,11 +160,39 @@ struct SeriesMatcher : SeriesMatcherBase {
       */
     StringT id2str(u64 tokenid) const;
 
-    /** Push all new elements to the buffer.
+    /** Push all new elements to the buffer (sorted by id). Every id that
+      * is smaller than the largest id in the buffer is either in the buffer
+      * or was returned by the previous call.
       * @param buffer is an output parameter that will receive new elements
       */
     void pull_new_names(std::vector<SeriesNameT>* buffer);
 
+    /** Add names from all shards to the inverted index.
+      * Called periodically from the background thread and
+      * before every query that uses the index. Names are added
+      * in chunks, queries can run between the chunks.
+      */
+    void update_index() const;
+
+    /** Write names to the index segment. The segment is immutable,
+      * it's written to the temporary file first and then renamed.
+      * Only the names below the first id that wasn't returned by
+      * `pull_new_names` are written, pulled names should be saved to
+      * the metadata storage before this call.
+      * @param path is a segment file name
+      */
+    aku_Status write_segment(std::string const& path) const;
+
+    /** Map the index segment and add all names from it to the matcher.
+      * Should be called only once before any other name is added.
+      * Names are not added to the list of recently added names since
+      * they're already saved. Invalid segment is renamed to `<path>.bad`.
+      * @param path is a segment file name
+      * @return status and watermark (all series with smaller ids are
+      *         present in the segment)
+      */
+    std::tuple<aku_Status, u64> map_segment(std::string const& path);
+
     std::vector<u64> get_all_ids() const;
 
     std::vector<SeriesNameT> search(IndexQueryNodeBase const& query) const;
@@ -234,5 +234,156 @@ StringTools::L3TableT StringTools::create_l3_table(size_t size_hint) {
     return L3TableT(size_hint, &StringTools::hash, &StringTools::equal);
 }
 
+//                     //
+//   SeriesNameTable   //
+//                     //
+
+//! Fibonacci hashing, spreads both djb2 hashes and sequential ids
+static size_t slot_index(u64 hash, u32 bits) {
+    return static_cast<size_t>((hash * 11400714819323198485ull) >> (64 - bits));
+}
+
+SeriesNameTable::Epoch::Epoch(u32 bits, int keys)
+    : bits(bits)
+    , capacity(1ull << bits)
+    , by_name((keys & BY_NAME) ? new SlotT[capacity] : nullptr)
+    , by_id((keys & BY_ID) ? new SlotT[capacity] : nullptr)
+{
+    for (size_t i = 0; i < capacity; i++) {
+        if (by_name) {
+            by_name[i].store(nullptr, std::memory_order_relaxed);
+        }
+        if (by_id) {
+            by_id[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+}
+
+SeriesNameTable::SeriesNameTable(size_t size_hint, int keys)
+    : keys_(keys)
+    , size_{0}
+{
+    u32 bits = 4;
+    while ((1ull << bits) < size_hint*2) {
+        bits++;
+    }
+    epochs_.emplace_back(new Epoch(bits, keys_));
+    current_.store(epochs_.back().get(), std::memory_order_release);
+}
+
+void SeriesNameTable::put_name(Epoch const* epoch, Entry const* entry) {
+    auto mask = epoch->capacity - 1;
+    for (auto ix = slot_index(StringTools::hash(entry->name), epoch->bits);; ix = (ix + 1) & mask) {
+        auto curr = epoch->by_name[ix].load(std::memory_order_relaxed);
+        if (curr == nullptr || StringTools::equal(curr->name, entry->name)) {
+            epoch->by_name[ix].store(entry, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+void SeriesNameTable::put_id(Epoch const* epoch, Entry const* entry) {
+    auto mask = epoch->capacity - 1;
+    for (auto ix = slot_index(entry->id, epoch->bits);; ix = (ix + 1) & mask) {
+        auto curr = epoch->by_id[ix].load(std::memory_order_relaxed);
+        if (curr == nullptr || curr->id == entry->id) {
+            epoch->by_id[ix].store(entry, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+void SeriesNameTable::grow() {
+    auto prev = current_.load(std::memory_order_relaxed);
+    std::unique_ptr<Epoch> next(new Epoch(prev->bits + 1, keys_));
+    // Only the live mappings are moved, replaced entries are dropped
+    for (size_t i = 0; i < prev->capacity; i++) {
+        if (prev->by_name) {
+            auto entry = prev->by_name[i].load(std::memory_order_relaxed);
+            if (entry != nullptr) {
+                put_name(next.get(), entry);
+            }
+        }
+        if (prev->by_id) {
+            auto entry = prev->by_id[i].load(std::memory_order_relaxed);
+            if (entry != nullptr) {
+                put_id(next.get(), entry);
+            }
+        }
+    }
+    epochs_.push_back(std::move(next));
+    current_.store(epochs_.back().get(), std::memory_order_release);
+}
+
+void SeriesNameTable::insert(StringTools::StringT name, u64 id) {
+    // Load factor is kept below 0.5, every entry occupies at most one slot in each array
+    if ((entries_.size() + 1) * 2 > current_.load(std::memory_order_relaxed)->capacity) {
+        grow();
+    }
+    entries_.push_back(Entry{name, id});
+    auto entry = &entries_.back();
+    auto epoch = current_.load(std::memory_order_relaxed);
+    if (epoch->by_name) {
+        put_name(epoch, entry);
+    }
+    if (epoch->by_id) {
+        put_id(epoch, entry);
+    }
+    size_.store(entries_.size(), std::memory_order_release);
+}
+
+u64 SeriesNameTable::find(StringTools::StringT name) const {
+    auto epoch = current_.load(std::memory_order_acquire);
+    if (!epoch->by_name) {
+        return 0;
+    }
+    auto mask = epoch->capacity - 1;
+    for (auto ix = slot_index(StringTools::hash(name), epoch->bits);; ix = (ix + 1) & mask) {
+        auto entry = epoch->by_name[ix].load(std::memory_order_acquire);
+        if (entry == nullptr) {
+            return 0;
+        }
+        if (StringTools::equal(entry->name, name)) {
+            return entry->id;
+        }
+    }
+}
+
+StringTools::StringT SeriesNameTable::find(u64 id) const {
+    auto epoch = current_.load(std::memory_order_acquire);
+    if (!epoch->by_id) {
+        return std::make_pair(nullptr, 0);
+    }
+    auto mask = epoch->capacity - 1;
+    for (auto ix = slot_index(id, epoch->bits);; ix = (ix + 1) & mask) {
+        auto entry = epoch->by_id[ix].load(std::memory_order_acquire);
+        if (entry == nullptr) {
+            return std::make_pair(nullptr, 0);
+        }
+        if (entry->id == id) {
+            return entry->name;
+        }
+    }
+}
+
+std::vector<u64> SeriesNameTable::get_all_ids() const {
+    std::vector<u64> result;
+    auto epoch = current_.load(std::memory_order_acquire);
+    if (!epoch->by_id) {
+        return result;
+    }
+    for (size_t i = 0; i < epoch->capacity; i++) {
+        auto entry = epoch->by_id[i].load(std::memory_order_acquire);
+        if (entry != nullptr) {
+            result.push_back(entry->id);
+        }
+    }
+    return result;
+}
+
+size_t SeriesNameTable::size() const {
+    return size_.load(std::memory_order_acquire);
+}
+
 }
 
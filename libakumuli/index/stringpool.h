@@ -18,6 +18,7 @@
 
 #include <atomic>
 #include <deque>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <unordered_set>
@@ -142,4 +143,85 @@ struct StringTools {
 
     static L3TableT create_l3_table(size_t size_hint);
 };
+
+//                     //
+//   SeriesNameTable   //
+//                     //
+
+/** Append-only table that maps series names to ids and ids to names.
+  * Lookups are lock-free, inserts should be serialized by the caller.
+  * Both mappings are open-addressing hash tables (linear probing) with
+  * slots that point to immutable entries. Names are not copied, they
+  * should point into the string pool. When the table grows, new slot
+  * arrays are built and published atomically (new epoch). Previous
+  * epochs are retired but kept until the table is destroyed because
+  * concurrent readers can still probe them, they take less memory
+  * than the current epoch in total.
+  * Table can maintain only one of the mappings (see `keys` c-tor
+  * parameter), lookups by the other key return nothing in this case.
+  */
+class SeriesNameTable {
+public:
+    struct Entry {
+        StringTools::StringT name;
+        u64 id;
+    };
+
+    //! Mappings maintained by the table
+    enum {
+        BY_NAME = 1,
+        BY_ID   = 2,
+    };
+
+private:
+    typedef std::atomic<Entry const*> SlotT;
+
+    struct Epoch {
+        const u32 bits;
+        const size_t capacity;
+        std::unique_ptr<SlotT[]> by_name;  //! Null if the mapping is not maintained
+        std::unique_ptr<SlotT[]> by_id;    //! Null if the mapping is not maintained
+
+        Epoch(u32 bits, int keys);
+    };
+
+    const int                           keys_;     //! Maintained mappings
+    std::atomic<Epoch const*>           current_;
+    std::vector<std::unique_ptr<Epoch>> epochs_;   //! All epochs (current and retired)
+    std::deque<Entry>                   entries_;  //! Entries storage (append-only)
+    std::atomic<size_t>                 size_;     //! Number of entries
+
+    void grow();
+
+    static void put_name(Epoch const* epoch, Entry const* entry);
+
+    static void put_id(Epoch const* epoch, Entry const* entry);
+
+public:
+    /** C-tor
+      * @param size_hint is an expected number of entries
+      * @param keys is a set of maintained mappings (BY_NAME, BY_ID or both)
+      */
+    SeriesNameTable(size_t size_hint = 0x1000, int keys = BY_NAME|BY_ID);
+
+    SeriesNameTable(SeriesNameTable const&) = delete;
+    SeriesNameTable& operator = (SeriesNameTable const&) = delete;
+
+    /** Add name to id mapping (replaces previous mappings of the name
+      * and the id). Not thread-safe, should be serialized by the caller.
+      */
+    void insert(StringTools::StringT name, u64 id);
+
+    //! Find id by name, return 0 if not found (lock-free)
+    u64 find(StringTools::StringT name) const;
+
+    //! Find name by id, return empty string if not found (lock-free)
+    StringTools::StringT find(u64 id) const;
+
+    //! Return list of all ids in unspecified order (lock-free)
+    std::vector<u64> get_all_ids() const;
+
+    //! Number of entries (includes replaced entries)
+    size_t size() const;
+};
 }
@@ -22,6 +22,7 @@
 #include <boost/version.hpp>
 
 #include "akumuli.h"
+#include "sample_batch.h"
 
 namespace Akumuli {
 
@@ -32,6 +33,15 @@ namespace Akumuli {
 struct InternalCursor {
     //! Send offset to caller
     virtual bool put(aku_Sample const& offset) = 0;
+    //! Send batch of samples to caller (default implementation sends samples one by one)
+    virtual bool put_batch(SampleBatch const& batch) {
+        for (size_t ix = 0; ix < batch.size(); ix++) {
+            if (!put(batch.at(ix))) {
+                return false;
+            }
+        }
+        return true;
+    }
     virtual void complete() = 0;
     //! Set error and stop execution
     virtual void set_error(aku_Status error_code) = 0;
@@ -98,6 +98,12 @@ MetadataStorage::MetadataStorage(const char* db)
         Logger::msg(AKU_LOG_ERROR, "Error creating prepared statement");
         AKU_PANIC(apr_dbd_error(driver_, handle_.get(), status));
     }
+    query = "INSERT OR REPLACE INTO akumuli_configuration (name, value, comment) VALUES (%s, %s, %s)";
+    status = apr_dbd_prepare(driver_, pool_.get(), handle_.get(), query, "SET_CONFIG_PARAM", &set_config_);
+    if (status != 0) {
+        Logger::msg(AKU_LOG_ERROR, "Error creating prepared statement");
+        AKU_PANIC(apr_dbd_error(driver_, handle_.get(), status));
+    }
 }
 
 void MetadataStorage::sync_with_metadata_storage(std::function<void(std::vector<SeriesT>*)> pull_new_names) {
@@ -242,6 +248,18 @@ bool MetadataStorage::get_config_param(const std::string name, std::string* resu
     return true;
 }
 
+void MetadataStorage::set_config_param(const std::string name, const std::string value, const std::string comment)
+{
+    // Parameters are bound, values can contain any characters
+    const char* args[] = { name.c_str(), value.c_str(), comment.c_str() };
+    int nrows = -1;
+    int status = apr_dbd_pquery(driver_, pool_.get(), handle_.get(), &nrows, set_config_, 3, args);
+    if (status != 0) {
+        Logger::msg(AKU_LOG_ERROR, "Error executing query");
+        AKU_PANIC(apr_dbd_error(driver_, handle_.get(), status));
+    }
+}
+
 void MetadataStorage::init_volumes(std::vector<VolumeDesc> volumes) {
     std::stringstream query;
     query << "INSERT INTO akumuli_volumes (id, path, version, nblocks, capacity, generation)" << std::endl;
@@ -387,6 +405,13 @@ aku_Status MetadataStorage::wait_for_sync_request(int timeout_us) {
 
 void MetadataStorage::add_rescue_point(aku_ParamId id, std::vector<u64>&& val) {
     std::lock_guard<std::mutex> guard(sync_lock_);
+    pending_rescue_points_[id] = std::move(val);
+    sync_cvar_.notify_one();
+}
+
+void MetadataStorage::add_rescue_point(aku_ParamId id, std::vector<u64> const& val) {
+    std::lock_guard<std::mutex> guard(sync_lock_);
+    // Assignment reuses the capacity of the pending entry if it exists
     pending_rescue_points_[id] = val;
     sync_cvar_.notify_one();
 }
@@ -546,10 +571,14 @@ boost::optional<u64> MetadataStorage::get_prev_largest_id() {
     }
 }
 
-aku_Status MetadataStorage::load_matcher_data(SeriesMatcherBase& matcher) {
-    auto query = "SELECT series_id || ' ' || keyslist, storage_id FROM akumuli_series;";
+aku_Status MetadataStorage::load_matcher_data(SeriesMatcherBase& matcher, u64 first_id) {
+    std::string query = "SELECT series_id || ' ' || keyslist, storage_id FROM akumuli_series";
+    if (first_id != 0) {
+        query += " WHERE storage_id >= " + std::to_string(first_id);
+    }
+    query += ";";
     try {
-        auto results = select_query(query);
+        auto results = select_query(query.c_str());
         for(auto row: results) {
             if (row.size() != 2) {
                 continue;
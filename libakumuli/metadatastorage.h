@@ -61,6 +61,7 @@ struct MetadataStorage : VolumeRegistry {
     DriverT         driver_;
     HandleT         handle_;
     PreparedT       insert_;
+    PreparedT       set_config_;
 
     // Synchronization
     mutable std::mutex                                sync_lock_;
@@ -112,10 +113,21 @@ struct MetadataStorage : VolumeRegistry {
      */
     bool get_config_param(const std::string param_name, std::string* value);
 
+    /**
+     * @brief Set value of the configuration parameter (existing value is replaced)
+     * @param param_name is a name of the configuration parameter
+     * @param value is a new value
+     * @param comment is a parameter description
+     */
+    void set_config_param(const std::string param_name, const std::string value, const std::string comment);
+
     /** Read larges series id */
     boost::optional<u64> get_prev_largest_id();
 
-    aku_Status load_matcher_data(SeriesMatcherBase &matcher);
+    /** Load series names into the matcher.
+      * @param first_id is a smallest series id that should be loaded
+      */
+    aku_Status load_matcher_data(SeriesMatcherBase &matcher, u64 first_id = 0);
 
     aku_Status load_rescue_points(std::unordered_map<u64, std::vector<u64>>& mapping);
 
@@ -123,6 +135,8 @@ struct MetadataStorage : VolumeRegistry {
 
     void add_rescue_point(aku_ParamId id, std::vector<u64>&& val);
 
+    void add_rescue_point(aku_ParamId id, std::vector<u64> const& val);
+
     /**
      * @brief Add/update volume metadata asynchronously
      * @param vol is a volume description
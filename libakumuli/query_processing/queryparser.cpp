@@ -7,7 +7,7 @@
 #include <boost/exception/diagnostic_information.hpp>
 
 #include <set>
-#include <regex>
+#include <algorithm>
 #include <array>
 
 #include "datetime.h"
@@ -16,6 +16,48 @@
 namespace Akumuli {
 namespace QP {
 
+/** Check that series name (in canonical form) has the metric name and one
+  * of the values of every tag.
+  * @param prefix allows metric to be a prefix of the metric name of the series
+  */
+static bool match_series_name(StringT name,
+                              std::string const& metric,
+                              std::map<std::string, std::vector<std::string>> const& tags,
+                              bool prefix)
+{
+    const char* p = name.first;
+    const char* end = name.first + name.second;
+    const char* mend = std::find(p, end, ' ');
+    auto mlen = static_cast<size_t>(mend - p);
+    if (prefix ? mlen < metric.size() : mlen != metric.size()) {
+        return false;
+    }
+    if (!std::equal(metric.begin(), metric.end(), p)) {
+        return false;
+    }
+    size_t nmatched = 0;
+    p = mend;
+    while (p < end && nmatched < tags.size()) {
+        p = std::find_if(p, end, [](char c) { return c != ' '; });
+        const char* tend = std::find(p, end, ' ');
+        const char* eq = std::find(p, tend, '=');
+        if (eq != tend) {
+            auto it = tags.find(std::string(p, eq));
+            if (it != tags.end()) {
+                auto vlen = static_cast<size_t>(tend - eq - 1);
+                for (auto const& val: it->second) {
+                    if (val.size() == vlen && std::equal(val.begin(), val.end(), eq + 1)) {
+                        nmatched++;
+                        break;
+                    }
+                }
+            }
+        }
+        p = tend;
+    }
+    return nmatched == tags.size();
+}
+
 SeriesRetreiver::SeriesRetreiver()
 {
 }
@@ -142,38 +184,11 @@ std::tuple<aku_Status, std::vector<aku_ParamId>> SeriesRetreiver::extract_ids(Pl
         // Case 1, metric not set.
         ids = matcher.get_all_ids();
     } else {
+        // Case 2 and 3, PlainSeriesMatcher doesn't have an index so all names are checked
         auto first_metric = metric_.front();
-        if (tags_.empty()) {
-            // Case 2, only metric is set
-            std::stringstream regex;
-            regex << first_metric << "(?:\\s[\\w\\.\\-]+=[\\w\\.\\-]+)*";
-            std::string expression = regex.str();
-            auto results = matcher.regex_match(expression.c_str());
-            for (auto res: results) {
-                ids.push_back(std::get<2>(res));
-            }
-        } else {
-            // Case 3, both metric and tags are set
-            std::stringstream regexp;
-            regexp << first_metric;
-            for (auto kv: tags_) {
-                auto const& key = kv.first;
-                bool first = true;
-                regexp << "(?:";
-                for (auto const& val: kv.second) {
-                    if (first) {
-                        first = false;
-                    } else {
-                        regexp << "|";
-                    }
-                    regexp << "(?:\\s[\\w\\.\\-]+=[\\w\\.\\-]+)*\\s" << key << "=" << val << "(?:\\s[\\w\\.\\-]+=[\\w\\.\\-]+)*";
-                }
-                regexp << ")";
-            }
-            std::string expression = regexp.str();
-            auto results = matcher.regex_match(expression.c_str());
-            for (auto res: results) {
-                ids.push_back(std::get<2>(res));
+        for (auto id: matcher.get_all_ids()) {
+            if (match_series_name(matcher.id2str(id), first_metric, tags_, false)) {
+                ids.push_back(id);
             }
         }
 
@@ -210,38 +225,11 @@ std::tuple<aku_Status, std::vector<aku_ParamId>> SeriesRetreiver::fuzzy_match(Pl
         // Case 1, metric not set.
         return std::make_tuple(AKU_EBAD_ARG, ids);
     } else {
+        // Case 2 and 3, metric name is used as a prefix
         auto first_metric = metric_.front();
-        if (tags_.empty()) {
-            // Case 2, only metric is set
-            std::stringstream regex;
-            regex << first_metric << "\\S*(?:\\s[\\w\\.\\-]+=[\\w\\.\\-]+)*";
-            std::string expression = regex.str();
-            auto results = matcher.regex_match(expression.c_str());
-            for (auto res: results) {
-                ids.push_back(std::get<2>(res));
-            }
-        } else {
-            // Case 3, both metric and tags are set
-            std::stringstream regexp;
-            regexp << first_metric << "\\S*";
-            for (auto kv: tags_) {
-                auto const& key = kv.first;
-                bool first = true;
-                regexp << "(?:";
-                for (auto const& val: kv.second) {
-                    if (first) {
-                        first = false;
-                    } else {
-                        regexp << "|";
-                    }
-                    regexp << "(?:\\s[\\w\\.\\-]+=[\\w\\.\\-]+)*\\s" << key << "=" << val << "(?:\\s[\\w\\.\\-]+=[\\w\\.\\-]+)*";
-                }
-                regexp << ")";
-            }
-            std::string expression = regexp.str();
-            auto results = matcher.regex_match(expression.c_str());
-            for (auto res: results) {
-                ids.push_back(std::get<2>(res));
+        for (auto id: matcher.get_all_ids()) {
+            if (match_series_name(matcher.id2str(id), first_metric, tags_, true)) {
+                ids.push_back(id);
             }
         }
 
@@ -1655,6 +1643,10 @@ struct TerminalNode : QP::Node {
         return cursor->put(sample.payload_.sample);
     }
 
+    bool put_batch(SampleBatch const& batch) {
+        return cursor->put_batch(batch);
+    }
+
     void set_error(aku_Status status) {
         cursor->set_error(status);
     }
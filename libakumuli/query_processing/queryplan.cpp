@@ -9,6 +9,9 @@
 #include "log_iface.h"
 #include "status_util.h"
 
+#include <atomic>
+#include <thread>
+
 namespace Akumuli {
 namespace QP {
 
@@ -230,6 +233,208 @@ struct GroupAggregateFilterProcessingStep : ProcessingPrelude {
 };
 
 
+/**
+ * Aggregate operator that replays precomputed results.
+ * Returns the same sequence of values as the original operator
+ * followed by the final status of the original operator.
+ */
+struct BufferedAggregateOperator : AggregateOperator {
+    std::vector<aku_Timestamp> ts_;
+    std::vector<AggregationResult> xs_;
+    aku_Status status_;
+    Direction dir_;
+    size_t pos_;
+
+    BufferedAggregateOperator(Direction dir)
+        : status_(AKU_ENO_DATA)
+        , dir_(dir)
+        , pos_(0)
+    {
+    }
+
+    //! Read all values from the `op` into the buffer
+    void fill(AggregateOperator& op) {
+        const size_t SZBUF = 1024;
+        aku_Status status = AKU_SUCCESS;
+        size_t outsz = SZBUF;
+        // Some operators signal the end of the sequence by returning
+        // AKU_SUCCESS and zero elements (instead of AKU_ENO_DATA)
+        while (status == AKU_SUCCESS && outsz != 0) {
+            size_t offset = ts_.size();
+            ts_.resize(offset + SZBUF);
+            xs_.resize(offset + SZBUF);
+            std::tie(status, outsz) = op.read(ts_.data() + offset, xs_.data() + offset, SZBUF);
+            ts_.resize(offset + outsz);
+            xs_.resize(offset + outsz);
+        }
+        ts_.shrink_to_fit();
+        xs_.shrink_to_fit();
+        status_ = status;
+    }
+
+    virtual std::tuple<aku_Status, size_t> read(aku_Timestamp *destts, AggregationResult *destval, size_t size) {
+        size_t outsz = std::min(size, ts_.size() - pos_);
+        std::copy(ts_.data() + pos_, ts_.data() + pos_ + outsz, destts);
+        std::copy(xs_.data() + pos_, xs_.data() + pos_ + outsz, destval);
+        pos_ += outsz;
+        if (pos_ == ts_.size()) {
+            return std::make_tuple(status_, outsz);
+        }
+        return std::make_tuple(AKU_SUCCESS, outsz);
+    }
+
+    virtual Direction get_direction() {
+        return dir_;
+    }
+};
+
+/**
+ * Reservation of the helper threads for ParallelProcessingStep.
+ * Number of helper threads is limited process-wide (by the number
+ * of CPUs), concurrent queries share the limit. Query that can't
+ * reserve any helper is processed by the calling thread alone.
+ */
+class HelperThreads {
+    static std::atomic<int>& available() {
+        static std::atomic<int> count(static_cast<int>(std::thread::hardware_concurrency()));
+        return count;
+    }
+
+    int reserved_;
+public:
+    //! Reserve up to `n` helper threads
+    HelperThreads(int n)
+        : reserved_(0)
+    {
+        auto& count = available();
+        auto curr = count.load();
+        while (curr > 0 && n > 0) {
+            auto nres = std::min(curr, n);
+            if (count.compare_exchange_weak(curr, curr - nres)) {
+                reserved_ = nres;
+                break;
+            }
+        }
+    }
+
+    ~HelperThreads() {
+        available() += reserved_;
+    }
+
+    HelperThreads(HelperThreads const&) = delete;
+    HelperThreads& operator = (HelperThreads const&) = delete;
+
+    //! Number of reserved helper threads
+    size_t size() const {
+        return static_cast<size_t>(reserved_);
+    }
+};
+
+/**
+ * Decorator that materializes aggregate operators of the wrapped
+ * tier-1 step in parallel. Every operator is drained into its own
+ * buffer by the pool of worker threads and then replaced with the
+ * operator that replays this buffer. Order of the operators (and the
+ * order of values inside every operator) is preserved so the tier-2
+ * step can't tell the difference.
+ * Workers pick operators from the shared counter one by one, so the
+ * expensive series don't stall other workers. Number of helper threads
+ * is limited process-wide (see HelperThreads).
+ * Nothing is returned until all operators are drained, so the step is
+ * used only by the aggregate query (one value per series). Group-aggregate
+ * output grows with the number of buckets and is processed sequentially.
+ */
+struct ParallelProcessingStep : ProcessingPrelude {
+    //! Minimal number of operators that enables parallel execution
+    enum {
+        PARALLEL_THRESHOLD = 64,
+    };
+
+    std::unique_ptr<ProcessingPrelude> prelude_;
+    std::vector<std::unique_ptr<AggregateOperator>> agglist_;
+
+    ParallelProcessingStep(std::unique_ptr<ProcessingPrelude>&& prelude)
+        : prelude_(std::move(prelude))
+    {
+    }
+
+    virtual aku_Status apply(const ColumnStore& cstore) {
+        auto status = prelude_->apply(cstore);
+        if (status != AKU_SUCCESS) {
+            return status;
+        }
+        std::vector<std::unique_ptr<AggregateOperator>> agglist;
+        status = prelude_->extract_result(&agglist);
+        if (status != AKU_SUCCESS) {
+            return status;
+        }
+        if (agglist.size() < PARALLEL_THRESHOLD) {
+            agglist_ = std::move(agglist);
+            return AKU_SUCCESS;
+        }
+        // Current thread is a worker too
+        HelperThreads helpers(static_cast<int>(std::min(static_cast<size_t>(std::thread::hardware_concurrency()),
+                                                        agglist.size())) - 1);
+        if (helpers.size() == 0) {
+            agglist_ = std::move(agglist);
+            return AKU_SUCCESS;
+        }
+        size_t nworkers = helpers.size() + 1;
+        std::vector<std::unique_ptr<BufferedAggregateOperator>> buffers(agglist.size());
+        std::vector<std::exception_ptr> errors(nworkers);
+        std::atomic<size_t> next(0);
+        auto worker = [&](size_t wid) {
+            try {
+                while (true) {
+                    size_t ix = next++;
+                    if (ix >= agglist.size()) {
+                        break;
+                    }
+                    std::unique_ptr<BufferedAggregateOperator> buf;
+                    buf.reset(new BufferedAggregateOperator(agglist[ix]->get_direction()));
+                    buf->fill(*agglist[ix]);
+                    agglist[ix].reset();
+                    buffers[ix] = std::move(buf);
+                }
+            } catch (...) {
+                errors[wid] = std::current_exception();
+                // Prevent other workers from picking up new work
+                next = agglist.size();
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t wid = 1; wid < nworkers; wid++) {
+            threads.push_back(std::thread(worker, wid));
+        }
+        worker(0);
+        for (auto& thread: threads) {
+            thread.join();
+        }
+        for (auto err: errors) {
+            if (err) {
+                std::rethrow_exception(err);
+            }
+        }
+        for (auto& buf: buffers) {
+            agglist_.push_back(std::move(buf));
+        }
+        return AKU_SUCCESS;
+    }
+
+    virtual aku_Status extract_result(std::vector<std::unique_ptr<RealValuedOperator>>* dest) {
+        return AKU_ENO_DATA;
+    }
+
+    virtual aku_Status extract_result(std::vector<std::unique_ptr<AggregateOperator>>* dest) {
+        if (agglist_.empty()) {
+            return AKU_ENO_DATA;
+        }
+        *dest = std::move(agglist_);
+        return AKU_SUCCESS;
+    }
+};
+
+
 // -------------------------------- //
 //              Tier-2              //
 // -------------------------------- //
@@ -808,6 +1013,7 @@ static std::tuple<aku_Status, std::unique_ptr<IQueryPlan>> aggregate_query_plan(
 
     std::unique_ptr<ProcessingPrelude> t1stage;
     t1stage.reset(new AggregateProcessingStep(req.select.begin, req.select.end, req.select.columns.at(0).ids));
+    t1stage.reset(new ParallelProcessingStep(std::move(t1stage)));
 
     std::unique_ptr<MaterializationStep> t2stage;
     if (req.group_by.enabled) {
@@ -944,9 +1150,13 @@ void QueryPlanExecutor::execute(const StorageEngine::ColumnStore& cstore, std::u
         qproc.set_error(status);
         return;
     }
-    const size_t dest_size = 0x1000;
+    const size_t dest_size = 0x4000;
     std::vector<u8> dest;
     dest.resize(dest_size);
+    // Scalar samples are passed to the query processor in batches,
+    // everything else is passed one by one (order is preserved).
+    SampleBatch batch;
+    batch.reserve(dest_size / sizeof(aku_Sample));
     while(status == AKU_SUCCESS) {
         size_t size;
         // This is OK because normal query (aggregate or select) will write fixed size samples with size = sizeof(aku_Sample).
@@ -959,13 +1169,29 @@ void QueryPlanExecutor::execute(const StorageEngine::ColumnStore& cstore, std::u
         }
 
         size_t pos = 0;
+        batch.clear();
         while(pos < size) {
             aku_Sample const* sample = reinterpret_cast<aku_Sample const*>(dest.data() + pos);
+            pos += sample->payload.size;
+            if (SampleBatch::is_batchable(*sample)) {
+                batch.append(*sample);
+                continue;
+            }
+            if (!batch.empty()) {
+                if (!qproc.put_batch(batch)) {
+                    Logger::msg(AKU_LOG_TRACE, "Iteration stopped by client");
+                    return;
+                }
+                batch.clear();
+            }
             if (!qproc.put(*sample)) {
                 Logger::msg(AKU_LOG_TRACE, "Iteration stopped by client");
                 return;
             }
-            pos += sample->payload.size;
+        }
+        if (!batch.empty() && !qproc.put_batch(batch)) {
+            Logger::msg(AKU_LOG_TRACE, "Iteration stopped by client");
+            return;
         }
     }
 }
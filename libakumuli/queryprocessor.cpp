@@ -66,6 +66,10 @@ bool ScanQueryProcessor::put(const aku_Sample &sample) {
     return root_node_->put(mut);
 }
 
+bool ScanQueryProcessor::put_batch(SampleBatch const& batch) {
+    return root_node_->put_batch(batch);
+}
+
 void ScanQueryProcessor::stop() {
     root_node_->complete();
 }
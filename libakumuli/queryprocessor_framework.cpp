@@ -146,4 +146,19 @@ char* MutableSample::get_payload() {
     return payload_.sample.payload.data;
 }
 
+// ----
+// Node
+// ----
+
+bool Node::put_batch(SampleBatch const& batch) {
+    for (size_t ix = 0; ix < batch.size(); ix++) {
+        aku_Sample sample = batch.at(ix);
+        MutableSample mut(&sample);
+        if (!put(mut)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 }}  // namespace
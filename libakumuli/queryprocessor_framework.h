@@ -3,6 +3,7 @@
 #include <stdexcept>
 
 #include "akumuli.h"
+#include "sample_batch.h"
 #include "util.h"
 #include "index/seriesparser.h"
 #include "storage_engine/operators/operator.h"
@@ -219,6 +220,12 @@ struct Node {
       */
     virtual bool put(MutableSample& sample) = 0;
 
+    /** Process batch of values, return false to interrupt process.
+      * Default implementation converts batch to samples and
+      * passes them to `put` one by one.
+      */
+    virtual bool put_batch(SampleBatch const& batch);
+
     virtual void set_error(aku_Status status) = 0;
 
     // Query validation
@@ -289,6 +296,16 @@ struct IStreamProcessor {
     //! Get new value
     virtual bool put(const aku_Sample& sample) = 0;
 
+    //! Get batch of new values (default implementation calls `put` for every value)
+    virtual bool put_batch(SampleBatch const& batch) {
+        for (size_t ix = 0; ix < batch.size(); ix++) {
+            if (!put(batch.at(ix))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     //! Will be called when processing completed without errors
     virtual void stop() = 0;
 
@@ -0,0 +1,89 @@
+/**
+ * PRIVATE HEADER
+ *
+ * Copyright (c) 2018 Eugene Lazin <4lazin@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "akumuli.h"
+
+namespace Akumuli {
+
+/** Block of samples in columnar (struct-of-arrays) format.
+  * Used to pass query results from the query plan to the cursor in
+  * groups. The batch doesn't reach the reader, the cursor converts it
+  * back to `aku_Sample` rows (external API is row based), so the gain
+  * is one lock acquisition and one wakeup of the reader per batch
+  * instead of per sample. Only scalar floating point samples can be
+  * stored in the batch, everything else (tuples, events, metadata)
+  * should be passed one by one.
+  */
+struct SampleBatch {
+    std::vector<aku_ParamId>   paramids;
+    std::vector<aku_Timestamp> timestamps;
+    std::vector<double>        values;
+
+    //! Check if sample can be stored in the batch without loss of information
+    static bool is_batchable(aku_Sample const& sample) {
+        return sample.payload.type == AKU_PAYLOAD_FLOAT && sample.payload.size == sizeof(aku_Sample);
+    }
+
+    size_t size() const {
+        return paramids.size();
+    }
+
+    bool empty() const {
+        return paramids.empty();
+    }
+
+    void reserve(size_t n) {
+        paramids.reserve(n);
+        timestamps.reserve(n);
+        values.reserve(n);
+    }
+
+    void clear() {
+        paramids.clear();
+        timestamps.clear();
+        values.clear();
+    }
+
+    void append(aku_ParamId id, aku_Timestamp ts, double value) {
+        paramids.push_back(id);
+        timestamps.push_back(ts);
+        values.push_back(value);
+    }
+
+    void append(aku_Sample const& sample) {
+        append(sample.paramid, sample.timestamp, sample.payload.float64);
+    }
+
+    //! Convert element of the batch to the sample
+    aku_Sample at(size_t ix) const {
+        aku_Sample sample = {};
+        sample.paramid          = paramids[ix];
+        sample.timestamp        = timestamps[ix];
+        sample.payload.type     = AKU_PAYLOAD_FLOAT;
+        sample.payload.size     = sizeof(aku_Sample);
+        sample.payload.float64  = values[ix];
+        return sample;
+    }
+};
+
+}
@@ -28,15 +28,18 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <sstream>
 #include <cassert>
 #include <functional>
+#include <numeric>
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/thread/barrier.hpp>
+#include <boost/exception/diagnostic_information.hpp>
 
 #include "fcntl_compat.h"
 #include <cstdlib>
@@ -45,6 +48,41 @@ namespace Akumuli {
 
 // Utility functions & classes //
 
+//! Series index segment is stored next to the metadata storage
+static std::string get_index_segment_path(std::string const& metadata_path) {
+    return metadata_path + ".idx";
+}
+
+/** Parse comma separated list of rollup tiers (e.g. "1m,1h,1d").
+  * @return sorted list of tiers or empty list if the string is not valid
+  */
+static std::vector<aku_Timestamp> parse_rollup_tiers(std::string const& str) {
+    std::vector<aku_Timestamp> result;
+    std::stringstream stream(str);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        item.erase(std::remove_if(item.begin(), item.end(), ::isspace), item.end());
+        if (item.empty()) {
+            continue;
+        }
+        aku_Duration tier = 0;
+        try {
+            tier = DateTimeUtil::parse_duration(item.c_str(), item.size());
+        } catch (BadDateTimeFormat const&) {
+            Logger::msg(AKU_LOG_ERROR, "Invalid rollup tier `" + item + "`, rollups disabled");
+            return std::vector<aku_Timestamp>();
+        }
+        if (tier < 1000000000ull) {
+            Logger::msg(AKU_LOG_ERROR, "Rollup tier `" + item + "` is less than 1s, rollups disabled");
+            return std::vector<aku_Timestamp>();
+        }
+        result.push_back(tier);
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
 
 // Standalone functions //
 
@@ -138,27 +176,23 @@ StorageSession::~StorageSession() {
                                        " stale ids is about to be closed");
             storage_->close_specific_columns(staleids);
         }
+        complete_pending_eviction();
     }
 }
 
 aku_Status StorageSession::write(aku_Sample const& sample) {
     using namespace StorageEngine;
-    std::vector<u64> rpoints;
-    auto status = session_->write(sample, &rpoints);
+    auto status = session_->write(sample, &rpoints_);
     switch (status) {
     case NBTreeAppendResult::OK:
         break;
     case NBTreeAppendResult::OK_FLUSH_NEEDED:
         if (slog_ != nullptr) {
-            if (ilog_ == nullptr) {
-                ilog_ = get_input_log(slog_);
-            }
-            // Copy rpoints here because it will be needed later to add new entry
+            // rpoints_ is copied because it will be needed later to add new entry
             // into the input-log.
-            auto rpoints_copy = rpoints;
-            storage_-> _update_rescue_points(sample.paramid, std::move(rpoints_copy));
+            storage_-> _update_rescue_points(sample.paramid, rpoints_);
         } else {
-            storage_-> _update_rescue_points(sample.paramid, std::move(rpoints));
+            storage_-> _update_rescue_points(sample.paramid, std::move(rpoints_));
         }
         break;
     case NBTreeAppendResult::FAIL_BAD_ID:
@@ -173,36 +207,133 @@ aku_Status StorageSession::write(aku_Sample const& sample) {
         if (ilog_ == nullptr) {
             ilog_ = get_input_log(slog_);
         }
-        std::vector<u64> staleids;
-        auto res = ilog_->append(sample.paramid, sample.timestamp, sample.payload.float64, &staleids);
+        auto res = ilog_->append(sample.paramid, sample.timestamp, sample.payload.float64, &staleids_);
         if (res == AKU_EOVERFLOW) {
-            if (!staleids.empty()) {
-                std::promise<void> barrier;
-                std::future<void> future = barrier.get_future();
-                storage_->add_metadata_sync_barrier(std::move(barrier));
-                storage_->close_specific_columns(staleids);
-                staleids.clear();
-                future.wait();
-            }
-            ilog_->rotate();
+            handle_log_overflow(&staleids_);
         }
         if (status == NBTreeAppendResult::OK_FLUSH_NEEDED) {
-            auto res = ilog_->append(sample.paramid, rpoints.data(), static_cast<u32>(rpoints.size()), &staleids);
+            auto res = ilog_->append(sample.paramid, rpoints_.data(), static_cast<u32>(rpoints_.size()), &staleids_);
             if (res == AKU_EOVERFLOW) {
-                if (!staleids.empty()) {
-                    std::promise<void> barrier;
-                    std::future<void> future = barrier.get_future();
-                    storage_->add_metadata_sync_barrier(std::move(barrier));
-                    storage_->close_specific_columns(staleids);
-                    future.wait();
-                }
-                ilog_->rotate();
+                handle_log_overflow(&staleids_);
             }
         }
     }
     return AKU_SUCCESS;
 }
 
+aku_Status StorageSession::write_batch(const aku_ParamId* ids, const aku_Timestamp* tss, const double* xss, size_t size) {
+    using namespace StorageEngine;
+    // Group samples by series, stable sort preserves order of samples inside the group
+    order_.resize(size);
+    std::iota(order_.begin(), order_.end(), 0u);
+    std::stable_sort(order_.begin(), order_.end(), [ids](u32 lhs, u32 rhs) {
+        return ids[lhs] < ids[rhs];
+    });
+    runts_.resize(size);
+    runxs_.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        runts_[i] = tss[order_[i]];
+        runxs_[i] = xss[order_[i]];
+    }
+    logids_.clear();
+    logts_.clear();
+    logxs_.clear();
+    logrpoints_.clear();
+    aku_Status result = AKU_SUCCESS;
+    size_t begin = 0;
+    while (begin < size) {
+        aku_ParamId id = ids[order_[begin]];
+        size_t end = begin + 1;
+        while (end < size && ids[order_[end]] == id) {
+            end++;
+        }
+        bool flush_needed = false;
+        size_t pos = begin;
+        while (pos < end) {
+            size_t nwritten = 0;
+            auto status = session_->write(id, runts_.data() + pos, runxs_.data() + pos, end - pos, &nwritten, &rpoints_);
+            if (status == NBTreeAppendResult::FAIL_BAD_ID) {
+                Logger::msg(AKU_LOG_ERROR, "Invalid session cache, id = " + std::to_string(id));
+                result = result == AKU_SUCCESS ? AKU_ENOT_FOUND : result;
+                break;
+            }
+            if (status == NBTreeAppendResult::OK_FLUSH_NEEDED) {
+                flush_needed = true;
+            }
+            if (slog_ != nullptr) {
+                logids_.insert(logids_.end(), nwritten, id);
+                logts_.insert(logts_.end(), runts_.begin() + pos, runts_.begin() + pos + nwritten);
+                logxs_.insert(logxs_.end(), runxs_.begin() + pos, runxs_.begin() + pos + nwritten);
+            }
+            pos += nwritten;
+            if (status == NBTreeAppendResult::FAIL_BAD_VALUE) {
+                // Skip invalid value
+                result = result == AKU_SUCCESS ? AKU_EBAD_ARG : result;
+                pos++;
+            } else if (pos < end) {
+                // Skip late write
+                result = result == AKU_SUCCESS ? AKU_ELATE_WRITE : result;
+                pos++;
+            }
+        }
+        if (flush_needed) {
+            if (slog_ != nullptr) {
+                logrpoints_.push_back(id);
+                logrpoints_.push_back(rpoints_.size());
+                logrpoints_.insert(logrpoints_.end(), rpoints_.begin(), rpoints_.end());
+            }
+            storage_->_update_rescue_points(id, std::move(rpoints_));
+        }
+        begin = end;
+    }
+    if (slog_ != nullptr && !logids_.empty()) {
+        if (ilog_ == nullptr) {
+            ilog_ = get_input_log(slog_);
+        }
+        auto res = ilog_->append(logids_.data(), logts_.data(), logxs_.data(), static_cast<u32>(logids_.size()), &staleids_);
+        if (res == AKU_EOVERFLOW) {
+            handle_log_overflow(&staleids_);
+        }
+        for (size_t ix = 0; ix < logrpoints_.size();) {
+            auto id = logrpoints_[ix];
+            auto nrpoints = static_cast<u32>(logrpoints_[ix + 1]);
+            auto res = ilog_->append(id, logrpoints_.data() + ix + 2, nrpoints, &staleids_);
+            if (res == AKU_EOVERFLOW) {
+                handle_log_overflow(&staleids_);
+            }
+            ix += 2 + nrpoints;
+        }
+    }
+    return result;
+}
+
+void StorageSession::handle_log_overflow(std::vector<u64>* staleids) {
+    // Only one volume per shard can be retired at a time, this bounds
+    // the disk space used by the input log.
+    complete_pending_eviction();
+    if (!staleids->empty()) {
+        pending_eviction_ = storage_->close_specific_columns_async(std::move(*staleids));
+        staleids->clear();
+        ilog_->rotate_deferred();
+    } else {
+        ilog_->rotate();
+    }
+}
+
+void StorageSession::complete_pending_eviction() {
+    if (pending_eviction_.valid()) {
+        if (pending_eviction_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            auto start = std::chrono::steady_clock::now();
+            pending_eviction_.wait();
+            auto stall = std::chrono::steady_clock::now() - start;
+            storage_->_report_eviction_stall(static_cast<u64>(
+                std::chrono::duration_cast<std::chrono::microseconds>(stall).count()));
+        }
+        pending_eviction_.get();
+        ilog_->release_retired();
+    }
+}
+
 aku_Status StorageSession::init_series_id(const char* begin, const char* end, aku_Sample *sample) {
     // Series name normalization procedure. Most likeley a bottleneck but
     // can be easily parallelized.
@@ -236,14 +367,7 @@ aku_Status StorageSession::init_series_id(const char* begin, const char* end, ak
                 std::vector<aku_ParamId> staleids;
                 auto res = ilog_->append(sample->paramid, ob, static_cast<u32>(ksend - ob), &staleids);
                 if (res == AKU_EOVERFLOW) {
-                    if (!staleids.empty()) {
-                        std::promise<void> barrier;
-                        std::future<void> future = barrier.get_future();
-                        storage_->add_metadata_sync_barrier(std::move(barrier));
-                        storage_->close_specific_columns(staleids);
-                        future.wait();
-                    }
-                    ilog_->rotate();
+                    handle_log_overflow(&staleids);
                 }
             }
         }
@@ -298,14 +422,7 @@ int StorageSession::get_series_ids(const char* begin, const char* end, aku_Param
                     std::vector<aku_ParamId> staleids;
                     auto res = ilog_->append(ids[0], ob, static_cast<u32>(ksend - ob), &staleids);
                     if (res == AKU_EOVERFLOW) {
-                        if (!staleids.empty()) {
-                            std::promise<void> barrier;
-                            std::future<void> future = barrier.get_future();
-                            storage_->add_metadata_sync_barrier(std::move(barrier));
-                            storage_->close_specific_columns(staleids);
-                            future.wait();
-                        }
-                        ilog_->rotate();
+                        handle_log_overflow(&staleids);
                     }
                 }
             }
@@ -367,14 +484,7 @@ int StorageSession::get_series_ids(const char* begin, const char* end, aku_Param
                         std::vector<aku_ParamId> staleids;
                         auto res = ilog_->append(ids[i], sbegin, static_cast<u32>(send - sbegin), &staleids);
                         if (res == AKU_EOVERFLOW) {
-                            if (!staleids.empty()) {
-                                std::promise<void> barrier;
-                                std::future<void> future = barrier.get_future();
-                                storage_->add_metadata_sync_barrier(std::move(barrier));
-                                storage_->close_specific_columns(staleids);
-                                future.wait();
-                            }
-                            ilog_->rotate();
+                            handle_log_overflow(&staleids);
                         }
                     }
                 }
@@ -429,9 +539,63 @@ void StorageSession::clear_series_matcher() const {
 
 //----------- Storage ----------
 
+/** Select series that should be loaded by the warm-up worker.
+  * Addresses of the blocks are growing monotonically so the series with the largest
+  * root address were written most recently.
+  */
+static std::vector<aku_ParamId> select_warmup_ids(
+        std::unordered_map<aku_ParamId, std::vector<StorageEngine::LogicAddr>> const& mapping,
+        u32 nseries)
+{
+    std::vector<std::tuple<StorageEngine::LogicAddr, aku_ParamId>> addrs;
+    for (auto const& kv: mapping) {
+        if (StorageEngine::NBTreeRollup::is_tier_id(kv.first)) {
+            continue;
+        }
+        StorageEngine::LogicAddr last = 0;
+        bool found = false;
+        for (auto addr: kv.second) {
+            if (addr != StorageEngine::EMPTY_ADDR) {
+                last = std::max(last, addr);
+                found = true;
+            }
+        }
+        if (found) {
+            addrs.push_back(std::make_tuple(last, kv.first));
+        }
+    }
+    auto n = std::min(addrs.size(), static_cast<size_t>(nseries));
+    std::partial_sort(addrs.begin(), addrs.begin() + static_cast<std::ptrdiff_t>(n), addrs.end(),
+                      std::greater<std::tuple<StorageEngine::LogicAddr, aku_ParamId>>());
+    std::vector<aku_ParamId> result;
+    for (size_t i = 0; i < n; i++) {
+        result.push_back(std::get<1>(addrs[i]));
+    }
+    return result;
+}
+
 Storage::Storage()
     : done_{0}
     , close_barrier_(2)
+    , eviction_stop_(false)
+    , eviction_queue_max_(0)
+    , eviction_requests_(0)
+    , eviction_columns_(0)
+    , eviction_stalls_{0}
+    , eviction_stall_us_{0}
+    , query_count_{0}
+    , query_parse_ns_{0}
+    , query_plan_ns_{0}
+    , query_exec_ns_{0}
+    , warmup_stop_{false}
+    , warmup_total_{0}
+    , warmup_loaded_{0}
+    , max_tree_memory_(0)
+    , columns_loaded_{0}
+    , columns_memory_{0}
+    , columns_unloaded_{0}
+    , unload_stop_(false)
+    , rollup_stop_{false}
 {
     //! In-memory SQLite database
     metadata_.reset(new MetadataStorage(":memory:"));
@@ -445,8 +609,28 @@ Storage::Storage()
 Storage::Storage(const char* path, const aku_FineTuneParams &params)
     : done_{0}
     , close_barrier_(2)
+    , eviction_stop_(false)
+    , eviction_queue_max_(0)
+    , eviction_requests_(0)
+    , eviction_columns_(0)
+    , eviction_stalls_{0}
+    , eviction_stall_us_{0}
+    , query_count_{0}
+    , query_parse_ns_{0}
+    , query_plan_ns_{0}
+    , query_exec_ns_{0}
+    , warmup_stop_{false}
+    , warmup_total_{0}
+    , warmup_loaded_{0}
+    , max_tree_memory_(params.max_tree_memory)
+    , columns_loaded_{0}
+    , columns_memory_{0}
+    , columns_unloaded_{0}
+    , unload_stop_(false)
+    , rollup_stop_{false}
 {
     metadata_.reset(new MetadataStorage(path));
+    index_path_ = get_index_segment_path(path);
 
     std::vector<std::string> volpaths;
 
@@ -469,13 +653,39 @@ Storage::Storage(const char* path, const aku_FineTuneParams &params)
         Logger::msg(AKU_LOG_ERROR, "Unknown blockstore type (" + bstore_type + ")");
         AKU_PANIC("Unknown blockstore type (" + bstore_type + ")");
     }
-    cstore_ = std::make_shared<StorageEngine::ColumnStore>(bstore_);
+    // Rollup tiers are saved on first open, the saved value can't be changed
+    // since tier columns already contain data.
+    std::string rollup_tiers;
+    if (!metadata_->get_config_param("rollup_tiers", &rollup_tiers)) {
+        if (params.rollup_tiers != nullptr) {
+            rollup_tiers = params.rollup_tiers;
+            metadata_->set_config_param("rollup_tiers", rollup_tiers, "Rollup tiers.");
+        }
+    } else if (params.rollup_tiers != nullptr && rollup_tiers != params.rollup_tiers) {
+        Logger::msg(AKU_LOG_ERROR, "Rollup tiers can't be changed, using `" + rollup_tiers + "`");
+    }
+    auto tiers = parse_rollup_tiers(rollup_tiers);
+    const bool has_tiers = !tiers.empty();
+    cstore_ = std::make_shared<StorageEngine::ColumnStore>(bstore_, std::move(tiers));
     // Update series matcher
     boost::optional<u64> baseline = metadata_->get_prev_largest_id();
     if (baseline) {
         global_matcher_.series_id = baseline.get() + 1;
     }
-    auto status = metadata_->load_matcher_data(global_matcher_);
+    // Names are mapped from the index segment written on last close, only the
+    // names that were added after that are read from the metadata storage.
+    // The inverted index is built in the background by the sync worker.
+    u64 watermark = 0;
+    if (boost::filesystem::exists(index_path_)) {
+        aku_Status status;
+        std::tie(status, watermark) = global_matcher_.map_segment(index_path_);
+        if (status != AKU_SUCCESS) {
+            Logger::msg(AKU_LOG_ERROR, "Can't map series index " + index_path_ + ", error: " +
+                                       StatusUtil::str(status));
+            watermark = 0;
+        }
+    }
+    auto status = metadata_->load_matcher_data(global_matcher_, watermark);
     if (status != AKU_SUCCESS) {
         Logger::msg(AKU_LOG_ERROR, "Can't read series names");
         AKU_PANIC("Can't read series names");
@@ -487,20 +697,27 @@ Storage::Storage(const char* path, const aku_FineTuneParams &params)
         Logger::msg(AKU_LOG_ERROR, "Can't read rescue points");
         AKU_PANIC("Can't read rescue points");
     }
-    // There are two possible configurations 1) WAL is disabled 2) WAL is enabled
-    // If WAL is disabled, Akumuli should work as usual. This means that we have
-    // to call 'force_init' for every tree. This will use maximum amount of memory
-    // but will increase performance in many cases, because we wan't need to read
-    // anything from disk before writing. In this mode every nbtree instance is
-    // always loaded into memory.
-    // If WAL is enabled we don't need to call 'force_init' because in this case
-    // every nbtree instance is not loaded into memory until something have to be
-    // written into it. In this case it gets loaded into memory. When the data that
-    // belongs to this nbtee instance gets evicted from WAL we will have to close
-    // the tree (and write it's content to disk). It can slow down things a bit
-    // but the data will be safe.
+    // Trees are not loaded into memory during open (except the ones that need
+    // to be repaired). Every nbtree instance gets loaded on first write or query.
+    // This makes open time independent of the number of series.
+    // If WAL is enabled, the tree gets closed (and it's content is written to disk)
+    // when the data that belongs to this nbtree instance gets evicted from WAL.
+    // If memory budget is set the trees that are not written for a while are closed
+    // by the unload worker. Warm-up worker loads the series that were written most
+    // recently to avoid disk reads on first access.
+    // Rollup tiers of the columns are restored from the raw data by the rollup
+    // worker after the column gets loaded (not by the write path).
+    if (has_tiers) {
+        start_rollup_worker();
+    }
     run_recovery(params, &mapping);
     start_sync_worker();
+    if (max_tree_memory_ != 0) {
+        start_unload_worker();
+    }
+    if (params.warmup_series != 0) {
+        start_warmup_worker(select_warmup_ids(mapping, params.warmup_series));
+    }
 }
 
 void Storage::run_recovery(const aku_FineTuneParams &params,
@@ -524,7 +741,7 @@ void Storage::run_recovery(const aku_FineTuneParams &params,
     }
     aku_Status restore_status;
     std::vector<aku_ParamId> restored_ids;
-    std::tie(restore_status, restored_ids) = cstore_->open_or_restore(*mapping, params.input_log_path == nullptr);
+    std::tie(restore_status, restored_ids) = cstore_->open_or_restore(*mapping);
     std::copy(new_ids.begin(), new_ids.end(), std::back_inserter(restored_ids));
     if (run_wal_recovery) {
         auto ilog = std::make_shared<ShardedInputLog>(ccr, params.input_log_path);
@@ -546,6 +763,7 @@ void Storage::initialize_input_log(const aku_FineTuneParams &params) {
                                             params.input_log_volume_size));
 
         input_log_path_ = params.input_log_path;
+        start_eviction_workers();
     }
 }
 
@@ -1169,6 +1387,25 @@ Storage::Storage(std::shared_ptr<MetadataStorage>                  meta,
     , done_{0}
     , close_barrier_(2)
     , metadata_(meta)
+    , eviction_stop_(false)
+    , eviction_queue_max_(0)
+    , eviction_requests_(0)
+    , eviction_columns_(0)
+    , eviction_stalls_{0}
+    , eviction_stall_us_{0}
+    , query_count_{0}
+    , query_parse_ns_{0}
+    , query_plan_ns_{0}
+    , query_exec_ns_{0}
+    , warmup_stop_{false}
+    , warmup_total_{0}
+    , warmup_loaded_{0}
+    , max_tree_memory_(0)
+    , columns_loaded_{0}
+    , columns_memory_{0}
+    , columns_unloaded_{0}
+    , unload_stop_(false)
+    , rollup_stop_{false}
 {
     if (start_worker) {
         start_sync_worker();
@@ -1181,17 +1418,30 @@ void Storage::start_sync_worker() {
     // if something needs to be synced.
     // This order guarantees that metadata storage always contains correct rescue points and
     // other metadata.
+    // Index segment is rewritten when enough new names are synced or periodically,
+    // otherwise names added since the last close are read from the metadata storage
+    // on startup.
     enum {
-        SYNC_REQUEST_TIMEOUT = 10000,
+        SYNC_REQUEST_TIMEOUT = 10000,  // usec
+        SEGMENT_WRITE_NAMES = 0x10000,
     };
-    auto sync_worker = [this]() {
-        auto get_names = [this](std::vector<PlainSeriesMatcher::SeriesNameT>* names) {
-            std::lock_guard<std::mutex> guard(lock_);
+    const auto segment_write_interval = std::chrono::minutes(10);
+    auto sync_worker = [this, segment_write_interval]() {
+        size_t unsaved_names = 0;
+        auto get_names = [this, &unsaved_names](std::vector<PlainSeriesMatcher::SeriesNameT>* names) {
             global_matcher_.pull_new_names(names);
+            unsaved_names += names->size();
         };
 
+        auto last_segment = std::chrono::steady_clock::now();
         while(done_.load() == 0) {
+            // Names of the new series are added to the index in batches
+            global_matcher_.update_index();
             auto status = metadata_->wait_for_sync_request(SYNC_REQUEST_TIMEOUT);
+            // Rescue points of the rollup tiers are not returned by the write path
+            for (auto& kv: cstore_->pull_rescue_points()) {
+                metadata_->add_rescue_point(kv.first, std::move(kv.second));
+            }
             if (status == AKU_SUCCESS) {
                 bstore_->flush();
                 metadata_->sync_with_metadata_storage(get_names);
@@ -1201,6 +1451,15 @@ void Storage::start_sync_worker() {
                 }
                 sessions_await_list_.clear();
             }
+            auto now = std::chrono::steady_clock::now();
+            if (unsaved_names != 0 && (unsaved_names >= SEGMENT_WRITE_NAMES ||
+                                       now - last_segment >= segment_write_interval))
+            {
+                // New names are already in the metadata storage
+                write_index_segment();
+                unsaved_names = 0;
+                last_segment = now;
+            }
         }
 
         close_barrier_.wait();
@@ -1209,6 +1468,106 @@ void Storage::start_sync_worker() {
     sync_worker_thread.detach();
 }
 
+void Storage::write_index_segment() {
+    if (index_path_.empty()) {
+        return;
+    }
+    auto status = global_matcher_.write_segment(index_path_);
+    if (status != AKU_SUCCESS) {
+        Logger::msg(AKU_LOG_ERROR, "Can't write series index " + index_path_ + ", error: " +
+                                   StatusUtil::str(status));
+    }
+}
+
+void Storage::start_rollup_worker() {
+    enum {
+        ROLLUP_POLL_TIMEOUT_MS = 100,
+    };
+    cstore_->enable_async_rollup();
+    auto rollup_worker = [this]() {
+        while (!rollup_stop_.load()) {
+            auto ids = cstore_->wait_rollup_requests(ROLLUP_POLL_TIMEOUT_MS);
+            for (auto id: ids) {
+                if (rollup_stop_.load()) {
+                    break;
+                }
+                cstore_->catch_up_rollup(id);
+            }
+        }
+    };
+    rollup_worker_ = std::thread(rollup_worker);
+}
+
+void Storage::stop_rollup_worker() {
+    rollup_stop_.store(true);
+    if (rollup_worker_.joinable()) {
+        rollup_worker_.join();
+    }
+}
+
+void Storage::start_warmup_worker(std::vector<aku_ParamId>&& ids) {
+    warmup_total_ = ids.size();
+    Logger::msg(AKU_LOG_INFO, "Warm-up started, " + std::to_string(ids.size()) + " series will be loaded");
+    auto warmup_worker = [this](std::vector<aku_ParamId> const& ids) {
+        for (auto id: ids) {
+            if (warmup_stop_.load()) {
+                break;
+            }
+            if (cstore_->preload(id) == AKU_SUCCESS) {
+                warmup_loaded_++;
+            }
+        }
+        Logger::msg(AKU_LOG_INFO, "Warm-up completed, " + std::to_string(warmup_loaded_.load()) + " series loaded");
+    };
+    warmup_worker_ = std::thread(warmup_worker, std::move(ids));
+}
+
+void Storage::stop_warmup_worker() {
+    warmup_stop_.store(true);
+    if (warmup_worker_.joinable()) {
+        warmup_worker_.join();
+    }
+}
+
+void Storage::start_unload_worker() {
+    // Closing a column writes its leaf nodes so this can't be done by the sync worker,
+    // rescue points of the unloaded columns are written by the sync worker on next iteration.
+    const auto unload_interval = std::chrono::seconds(10);
+    auto unload_worker = [this, unload_interval]() {
+        std::unique_lock<std::mutex> lock(unload_lock_);
+        while (!unload_cvar_.wait_for(lock, unload_interval, [this] { return unload_stop_; })) {
+            lock.unlock();
+            unload_idle_columns();
+            lock.lock();
+        }
+    };
+    unload_worker_ = std::thread(unload_worker);
+}
+
+void Storage::stop_unload_worker() {
+    {
+        std::lock_guard<std::mutex> lock(unload_lock_);
+        unload_stop_ = true;
+    }
+    unload_cvar_.notify_all();
+    if (unload_worker_.joinable()) {
+        unload_worker_.join();
+    }
+}
+
+void Storage::unload_idle_columns() {
+    size_t nloaded = 0, nbytes = 0;
+    auto ids = cstore_->select_idle(max_tree_memory_, &nloaded, &nbytes);
+    columns_loaded_ = nloaded;
+    columns_memory_ = nbytes;
+    if (!ids.empty()) {
+        Logger::msg(AKU_LOG_INFO, "Memory budget exceeded (" + std::to_string(nbytes) + " bytes used), unload " +
+                                  std::to_string(ids.size()) + " idle columns");
+        close_specific_columns(ids);
+        columns_unloaded_ += ids.size();
+    }
+}
+
 void Storage::add_metadata_sync_barrier(std::promise<void>&& barrier) {
     std::lock_guard<std::mutex> lock(session_lock_);
     if (done_.load() != 0) {
@@ -1218,11 +1577,119 @@ void Storage::add_metadata_sync_barrier(std::promise<void>&& barrier) {
     }
 }
 
+void Storage::start_eviction_workers() {
+    // These threads close stale columns when the input log overflows. Ingestion
+    // threads are not blocked while this happens, they only wait if the queue is
+    // full or if the previous eviction of the same WAL shard is still in progress.
+    auto eviction_worker = [this]() {
+        while (true) {
+            EvictionRequest req;
+            {
+                std::unique_lock<std::mutex> lock(eviction_lock_);
+                eviction_cvar_.wait(lock, [this]() {
+                    return eviction_stop_ || !eviction_queue_.empty();
+                });
+                if (eviction_queue_.empty()) {
+                    // Stop flag is set and the queue is drained
+                    break;
+                }
+                req = std::move(eviction_queue_.front());
+                eviction_queue_.pop_front();
+            }
+            // Notify ingestion threads blocked by the full queue
+            eviction_cvar_.notify_all();
+            try {
+                evict_columns(req.ids);
+                req.done.set_value();
+            } catch (...) {
+                Logger::msg(AKU_LOG_ERROR, "Can't evict stale columns: " + boost::current_exception_diagnostic_information());
+                req.done.set_exception(std::current_exception());
+            }
+        }
+    };
+    for (int i = 0; i < EVICTION_THREADS; i++) {
+        eviction_workers_.push_back(std::thread(eviction_worker));
+    }
+}
+
+void Storage::stop_eviction_workers() {
+    {
+        std::lock_guard<std::mutex> lock(eviction_lock_);
+        eviction_stop_ = true;
+    }
+    eviction_cvar_.notify_all();
+    for (auto& worker: eviction_workers_) {
+        worker.join();
+    }
+    eviction_workers_.clear();
+}
+
+void Storage::evict_columns(const std::vector<u64>& ids) {
+    Logger::msg(AKU_LOG_TRACE, "Going to evict " + std::to_string(ids.size()) + " ids");
+    auto mapping = cstore_->close(ids);
+    if (mapping.empty()) {
+        return;
+    }
+    // Barrier should be added after rescue points so the next sync will
+    // write them to disk before the barrier is released.
+    std::promise<void> barrier;
+    std::future<void> future = barrier.get_future();
+    for (auto kv: mapping) {
+        u64 id;
+        std::vector<u64> vals;
+        std::tie(id, vals) = kv;
+        _update_rescue_points(id, std::move(vals));
+    }
+    add_metadata_sync_barrier(std::move(barrier));
+    metadata_->force_sync();
+    future.wait();
+    Logger::msg(AKU_LOG_TRACE, std::to_string(ids.size()) + " ids were evicted");
+}
+
+std::future<void> Storage::close_specific_columns_async(std::vector<u64>&& ids) {
+    EvictionRequest req;
+    req.ids = std::move(ids);
+    std::future<void> future = req.done.get_future();
+    std::unique_lock<std::mutex> lock(eviction_lock_);
+    if (eviction_workers_.empty() || eviction_stop_) {
+        // No background workers, evict in the caller's thread
+        lock.unlock();
+        evict_columns(req.ids);
+        req.done.set_value();
+        return future;
+    }
+    if (eviction_queue_.size() >= EVICTION_QUEUE_CAPACITY) {
+        auto start = std::chrono::steady_clock::now();
+        eviction_cvar_.wait(lock, [this]() {
+            return eviction_queue_.size() < EVICTION_QUEUE_CAPACITY;
+        });
+        auto stall = std::chrono::steady_clock::now() - start;
+        _report_eviction_stall(static_cast<u64>(
+            std::chrono::duration_cast<std::chrono::microseconds>(stall).count()));
+    }
+    eviction_requests_++;
+    eviction_columns_ += req.ids.size();
+    eviction_queue_.push_back(std::move(req));
+    eviction_queue_max_ = std::max(eviction_queue_max_, eviction_queue_.size());
+    lock.unlock();
+    eviction_cvar_.notify_all();
+    return future;
+}
+
+void Storage::_report_eviction_stall(u64 usec) {
+    eviction_stalls_++;
+    eviction_stall_us_ += usec;
+}
+
 void Storage::_kill() {
     Logger::msg(AKU_LOG_ERROR, "Kill storage");
+    stop_rollup_worker();
+    stop_warmup_worker();
+    stop_unload_worker();
     done_.store(1);
     metadata_->force_sync();
     close_barrier_.wait();
+    stop_eviction_workers();
 }
 
 void Storage::close() {
@@ -1230,11 +1697,19 @@ void Storage::close() {
     // TODO: remove
     Logger::msg(AKU_LOG_INFO, "Index memory usage: " + std::to_string(global_matcher_.memory_use()));
     // END
+    // Finish background eviction while the sync worker is still running
+    stop_rollup_worker();
+    stop_warmup_worker();
+    stop_unload_worker();
+    stop_eviction_workers();
     done_.store(1);
     metadata_->force_sync();
     close_barrier_.wait();
-    // Close column store
+    // Close column store, rescue points returned by `close` supersede the pending ones
     auto mapping = cstore_->close();
+    for (auto& kv: cstore_->pull_rescue_points()) {
+        mapping.insert(std::move(kv));
+    }
     if (!mapping.empty()) {
         for (auto kv: mapping) {
             u64 id;
@@ -1242,11 +1717,15 @@ void Storage::close() {
             std::tie(id, vals) = kv;
             metadata_->add_rescue_point(id, std::move(vals));
         }
-        // Save finall mapping (should contain all affected columns)
-        metadata_->sync_with_metadata_storage(boost::bind(&SeriesMatcher::pull_new_names, &global_matcher_, _1));
     }
+    // Save finall mapping (should contain all affected columns) and the names
+    // that weren't synced yet, otherwise they can't be written to the segment
+    metadata_->sync_with_metadata_storage(boost::bind(&SeriesMatcher::pull_new_names, &global_matcher_, _1));
     bstore_->flush();
 
+    // All names are synced with metadata storage at this point
+    write_index_segment();
+
     // Delete WAL volumes
     inputlog_.reset();
     if (!input_log_path_.empty()) {
@@ -1279,6 +1758,10 @@ void Storage::_update_rescue_points(aku_ParamId id, std::vector<StorageEngine::L
     metadata_->add_rescue_point(id, std::move(rpoints));
 }
 
+void Storage::_update_rescue_points(aku_ParamId id, std::vector<StorageEngine::LogicAddr> const& rpoints) {
+    metadata_->add_rescue_point(id, rpoints);
+}
+
 std::shared_ptr<StorageSession> Storage::create_write_session() {
     std::shared_ptr<StorageEngine::CStoreSession> session =
             std::make_shared<StorageEngine::CStoreSession>(cstore_);
@@ -1288,16 +1771,17 @@ std::shared_ptr<StorageSession> Storage::create_write_session() {
 }
 
 std::tuple<aku_Status, bool> Storage::init_series_id(const char* begin, const char* end, aku_Sample *sample, PlainSeriesMatcher *local_matcher) {
-    u64 id = 0;
     bool create_new = false;
-    {
-        std::lock_guard<std::mutex> guard(lock_);
-        id = global_matcher_.match(begin, end);
+    // Fast path, lookup is lock-free and doesn't contend with other sessions
+    u64 id = global_matcher_.match(begin, end);
+    if (id == 0) {
+        // Only the shard of the series name is locked, exactly one caller gets 'create_new' flag
+        std::tie(id, create_new) = global_matcher_.match_or_add(begin, end);
         if (id == 0) {
-            // create new series
-            id = global_matcher_.add(begin, end);
+            return std::make_tuple(AKU_EBAD_DATA, false);
+        }
+        if (create_new) {
             metadata_->add_rescue_point(id, std::vector<u64>());
-            create_new = true;
         }
     }
     if (create_new) {
@@ -1372,8 +1856,15 @@ std::tuple<aku_Status, std::string>
     return std::make_tuple(AKU_SUCCESS, ErrorMsg());
 }
 
+static u64 elapsed_ns(std::chrono::steady_clock::time_point start) {
+    auto delta = std::chrono::steady_clock::now() - start;
+    return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(delta).count());
+}
+
 void Storage::query(StorageSession const* session, InternalCursor* cur, const char* query) const {
     using namespace QP;
+    query_count_.fetch_add(1, std::memory_order_relaxed);
+    auto parse_start = std::chrono::steady_clock::now();
     boost::property_tree::ptree ptree;
     aku_Status status;
     ErrorMsg error_msg;
@@ -1406,6 +1897,7 @@ void Storage::query(StorageSession const* session, InternalCursor* cur, const ch
             return;
         }
         proc = std::make_shared<MetadataQueryProcessor>(nodes.front(), std::move(ids));
+        query_parse_ns_.fetch_add(elapsed_ns(parse_start), std::memory_order_relaxed);
         if (proc->start()) {
             proc->stop();
         }
@@ -1438,16 +1930,23 @@ void Storage::query(StorageSession const* session, InternalCursor* cur, const ch
             cur->set_error(AKU_ENOT_FOUND);
             return;
         }
+        query_parse_ns_.fetch_add(elapsed_ns(parse_start), std::memory_order_relaxed);
+        auto plan_start = std::chrono::steady_clock::now();
         std::unique_ptr<QP::IQueryPlan> query_plan;
         std::tie(status, query_plan) = QP::QueryPlanBuilder::create(req);
+        query_plan_ns_.fetch_add(elapsed_ns(plan_start), std::memory_order_relaxed);
         if (status != AKU_SUCCESS) {
             cur->set_error(status);
             return;
         }
         // TODO: log query plan if required
         if (proc->start()) {
+            auto exec_start = std::chrono::steady_clock::now();
             QueryPlanExecutor executor;
             executor.execute(*cstore_, std::move(query_plan), *proc);
+            // Execution time includes the time spent waiting for the cursor
+            // consumer. Metrics are updated before the cursor is completed.
+            query_exec_ns_.fetch_add(elapsed_ns(exec_start), std::memory_order_relaxed);
             proc->stop();
         }
     }
@@ -1571,6 +2070,8 @@ aku_Status Storage::new_database( const char     *base_file_name
         Logger::msg(AKU_LOG_ERROR, "Database is already exists");
         return AKU_EBAD_ARG;
     }
+    // Index segment can be left by the previously deleted database
+    boost::filesystem::remove(get_index_segment_path(sqlitepath.string()));
 
     i32 actual_nvols = (num_volumes == 0) ? 1 : num_volumes;
     std::vector<std::tuple<u32, std::string>> paths;
@@ -1676,6 +2177,11 @@ aku_Status Storage::remove_storage(const char* file_name, const char* wal_path,
 
     std::for_each(volume_names.begin(), volume_names.end(), delete_file);
 
+    auto index_path = get_index_segment_path(file_name);
+    if (boost::filesystem::exists(index_path)) {
+        delete_file(index_path);
+    }
+
     int card;
     std::tie(status, card) = ShardedInputLog::find_logs(wal_path);
     if (status == AKU_SUCCESS && card > 0) {
@@ -1700,6 +2206,35 @@ boost::property_tree::ptree Storage::get_stats() {
         result.put(path + ".free_space", free_vol);
         result.put(path + ".file_name", name);
     }
+    auto cachestats = bstore_->get_cache_stats();
+    result.put("block_cache.capacity", cachestats.capacity);
+    result.put("block_cache.nblocks", cachestats.nblocks);
+    result.put("block_cache.hits", cachestats.hits);
+    result.put("block_cache.misses", cachestats.misses);
+    {
+        std::lock_guard<std::mutex> lock(eviction_lock_);
+        result.put("wal_eviction.queue_depth", eviction_queue_.size());
+        result.put("wal_eviction.max_queue_depth", eviction_queue_max_);
+        result.put("wal_eviction.requests", eviction_requests_);
+        result.put("wal_eviction.columns", eviction_columns_);
+    }
+    result.put("wal_eviction.stalls", eviction_stalls_.load());
+    result.put("wal_eviction.stall_time_us", eviction_stall_us_.load());
+    result.put("query.count", query_count_.load());
+    result.put("query.parse_ns", query_parse_ns_.load());
+    result.put("query.plan_ns", query_plan_ns_.load());
+    result.put("query.exec_ns", query_exec_ns_.load());
+    result.put("warmup.total", warmup_total_.load());
+    result.put("warmup.loaded", warmup_loaded_.load());
+    result.put("column_store.memory_budget", max_tree_memory_);
+    result.put("column_store.loaded", columns_loaded_.load());
+    result.put("column_store.memory", columns_memory_.load());
+    result.put("column_store.unloaded", columns_unloaded_.load());
+    auto poolstats = StorageEngine::IOVecBlock::get_pool_stats();
+    result.put("block_pool.allocated", poolstats.allocated);
+    result.put("block_pool.reused", poolstats.reused);
+    result.put("block_pool.recycled", poolstats.recycled);
+    result.put("block_pool.dropped", poolstats.dropped);
     return result;
 }
 
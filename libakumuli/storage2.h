@@ -17,7 +17,9 @@
 
 #pragma once
 #include <atomic>
+#include <condition_variable>
 #include <cstddef>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -51,6 +53,29 @@ class StorageSession : public std::enable_shared_from_this<StorageSession> {
     mutable std::shared_ptr<PlainSeriesMatcher> matcher_substitute_;
     ShardedInputLog* slog_;
     InputLog* ilog_;
+    //! Completion of the background eviction that holds retired WAL volume
+    std::future<void> pending_eviction_;
+    //! Scratch buffers reused by the write path (session is used by one thread at a time)
+    std::vector<u64> rpoints_;
+    std::vector<u64> staleids_;
+    //! Scratch buffers of `write_batch`, samples grouped by series
+    std::vector<u32> order_;
+    std::vector<aku_Timestamp> runts_;
+    std::vector<double> runxs_;
+    //! Scratch buffers of `write_batch`, accepted samples (for the input log)
+    std::vector<u64> logids_;
+    std::vector<u64> logts_;
+    std::vector<double> logxs_;
+    //! Updated rescue points (for the input log), series id and number of addresses followed by addresses
+    std::vector<u64> logrpoints_;
+
+    /** Schedule eviction of the stale columns and rotate input log. The oldest
+      * volume is retired and deleted only after the eviction completes.
+      */
+    void handle_log_overflow(std::vector<u64>* staleids);
+
+    //! Wait for the pending eviction (if any) and delete retired WAL volume
+    void complete_pending_eviction();
 
 public:
     StorageSession(std::shared_ptr<Storage> storage,
@@ -61,6 +86,13 @@ public:
 
     aku_Status write(aku_Sample const& sample);
 
+    /** Write batch of samples. Samples are grouped by series and every group
+      * is written to the column using single lock acquisition. Samples that
+      * can't be written are skipped.
+      * @return AKU_SUCCESS or error code if some samples were rejected
+      */
+    aku_Status write_batch(const aku_ParamId* ids, const aku_Timestamp* tss, const double* xss, size_t size);
+
     /** Match series name. If series with such name doesn't exists - create it.
       * This method should be called for each sample to init its `paramid` field.
       */
@@ -100,18 +132,92 @@ class Storage : public std::enable_shared_from_this<Storage> {
     std::shared_ptr<StorageEngine::ColumnStore> cstore_;
     std::atomic<int> done_;
     boost::barrier close_barrier_;
-    mutable std::mutex lock_;
     SeriesMatcher global_matcher_;
     std::shared_ptr<MetadataStorage> metadata_;
     std::shared_ptr<ShardedInputLog> inputlog_;
     std::string input_log_path_;
+    std::string index_path_;  //! Series index segment (not used if empty)
 
     // Await support
     std::vector<std::promise<void>> sessions_await_list_;
     std::mutex session_lock_;
 
+    // Background eviction of the stale columns (WAL overflow)
+    enum {
+        EVICTION_THREADS = 2,
+        EVICTION_QUEUE_CAPACITY = 8,
+    };
+    struct EvictionRequest {
+        std::vector<u64>   ids;
+        std::promise<void> done;
+    };
+    std::deque<EvictionRequest> eviction_queue_;
+    std::vector<std::thread> eviction_workers_;
+    std::mutex eviction_lock_;
+    std::condition_variable eviction_cvar_;
+    bool eviction_stop_;
+    // Eviction metrics
+    size_t eviction_queue_max_;
+    u64 eviction_requests_;
+    u64 eviction_columns_;
+    std::atomic<u64> eviction_stalls_;
+    std::atomic<u64> eviction_stall_us_;
+    // Query metrics (number of queries and cumulative time spent in every stage)
+    mutable std::atomic<u64> query_count_;
+    mutable std::atomic<u64> query_parse_ns_;
+    mutable std::atomic<u64> query_plan_ns_;
+    mutable std::atomic<u64> query_exec_ns_;
+    // Lazy loading of the columns (background warm-up and unloading of the idle columns)
+    std::thread warmup_worker_;
+    std::atomic<bool> warmup_stop_;
+    std::atomic<u64> warmup_total_;
+    std::atomic<u64> warmup_loaded_;
+    const u64 max_tree_memory_;
+    std::atomic<u64> columns_loaded_;
+    std::atomic<u64> columns_memory_;
+    std::atomic<u64> columns_unloaded_;
+    std::thread unload_worker_;
+    std::mutex unload_lock_;
+    std::condition_variable unload_cvar_;
+    bool unload_stop_;
+    // Background catch-up of the rollup tiers
+    std::thread rollup_worker_;
+    std::atomic<bool> rollup_stop_;
+
     void start_sync_worker();
 
+    //! Save all series names to the index segment (no-op if the segment is not used)
+    void write_index_segment();
+
+    //! Restore rollup tiers of the columns in background (requested by the column store)
+    void start_rollup_worker();
+
+    //! Stop catch-up and join the worker thread
+    void stop_rollup_worker();
+
+    //! Load columns in background (in the given order)
+    void start_warmup_worker(std::vector<aku_ParamId>&& ids);
+
+    //! Interrupt warm-up and join the worker thread
+    void stop_warmup_worker();
+
+    //! Close idle columns if memory budget is exceeded (called by the unload worker)
+    void unload_idle_columns();
+
+    //! Periodically unload idle columns (leaf nodes are written outside of the sync worker)
+    void start_unload_worker();
+
+    //! Interrupt unloading and join the worker thread
+    void stop_unload_worker();
+
+    void start_eviction_workers();
+
+    //! Drain eviction queue and join worker threads
+    void stop_eviction_workers();
+
+    //! Close columns and wait until their rescue points are written to metadata storage
+    void evict_columns(const std::vector<u64>& ids);
+
     std::tuple<aku_Status, std::string> parse_query(const boost::property_tree::ptree &ptree,
                                                     QP::ReshapeRequest* req) const;
 
@@ -173,6 +279,9 @@ public:
 
     void _update_rescue_points(aku_ParamId id, std::vector<StorageEngine::LogicAddr>&& rpoints);
 
+    //! Same as above but copies `rpoints` so the caller can reuse the vector
+    void _update_rescue_points(aku_ParamId id, std::vector<StorageEngine::LogicAddr> const& rpoints);
+
     /** This method should be called before object destructor.
       * All ingestion sessions should be stopped first.
       */
@@ -185,6 +294,18 @@ public:
      */
     void close_specific_columns(const std::vector<u64>& ids);
 
+    /**
+     * @brief Close columns in the background
+     * Blocks if the eviction queue is full.
+     * @param ids list of column ids
+     * @return future that becomes ready when columns are closed and rescue
+     *         points are synced with metadata storage
+     */
+    std::future<void> close_specific_columns_async(std::vector<u64>&& ids);
+
+    //! Report time spent by ingestion thread waiting for the background eviction
+    void _report_eviction_stall(u64 usec);
+
     /** Create empty database from scratch.
       * @param base_file_name is database name (excl suffix)
       * @param metadata_path is a path to metadata storage
@@ -29,74 +29,152 @@
 namespace Akumuli {
 namespace StorageEngine {
 
-static u64 hash32(u32 value, u32 bits, u64 seed) {
-    // hashes x strongly universally into N bits
-    // using the random seed.
-    static const u64 a = (1ul << 32) - 1;
-    return (a * value + seed) >> (64-bits);
-}
-
 static u64 hash(u64 value, u32 bits) {
-    auto a = hash32(value & 0xFFFFFFFF, bits, 277);
-    auto b = hash32(value >> 32, bits, 337);
-    return a ^ b;
+    // Fibonacci hashing, consecutive addresses are spread
+    // evenly across the sets.
+    static const u64 a = 11400714819323198485ull;
+    return (a * value) >> (64 - bits);
 }
 
 BlockCache::BlockCache(u32 Nbits)
-    : block_cache_(1 << Nbits, PBlock())
+    : slots_(new Slot[static_cast<size_t>(NWAYS) << Nbits])
+    , hands_(new u8[1ul << Nbits])
+    , shards_(new Shard[NSHARDS])
     , bits_(Nbits)
-    , gen_(dev_())
-    , dist_(0, 1 << Nbits)
+    , nsets_(1u << Nbits)
 {
+    for (size_t i = 0; i < capacity(); i++) {
+        slots_[i].addr.store(EMPTY_ADDR);
+        slots_[i].referenced.store(0);
+    }
+    std::fill(hands_.get(), hands_.get() + nsets_, 0);
+    for (int i = 0; i < NSHARDS; i++) {
+        shards_[i].hits.store(0);
+        shards_[i].misses.store(0);
+        shards_[i].size.store(0);
+    }
 }
 
-int BlockCache::probe(LogicAddr addr) {
-    auto h = hash(addr, bits_);
-    auto b = block_cache_.at(h);
-    if (b) {
-        return b->get_addr() == addr ? 2 : 1;
+u32 BlockCache::get_set(LogicAddr addr) const {
+    return static_cast<u32>(hash(addr, bits_) & (nsets_ - 1));
+}
+
+BlockCache::Shard& BlockCache::get_shard(u32 set) const {
+    return shards_[set % NSHARDS];
+}
+
+void BlockCache::insert(LogicAddr addr, PBlock block) {
+    auto set = get_set(addr);
+    auto& shard = get_shard(set);
+    Slot* ways = slots_.get() + static_cast<size_t>(set) * NWAYS;
+    std::lock_guard<std::mutex> guard(shard.lock); AKU_UNUSED(guard);
+    int victim = -1;
+    for (int i = 0; i < NWAYS; i++) {
+        auto hint = ways[i].addr.load(std::memory_order_relaxed);
+        if (hint == addr) {
+            // No need to insert, addr already sits in the cache.
+            return;
+        }
+        if (hint == EMPTY_ADDR && victim < 0) {
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        // CLOCK eviction. Every slot is visited at most twice.
+        u8& hand = hands_[set];
+        while (true) {
+            Slot& slot = ways[hand];
+            hand = static_cast<u8>((hand + 1) % NWAYS);
+            if (slot.referenced.exchange(0, std::memory_order_relaxed) == 0) {
+                victim = static_cast<int>(&slot - ways);
+                break;
+            }
+        }
+    } else {
+        shard.size++;
     }
-    return 0;
+    auto entry = std::make_shared<Entry>();
+    entry->addr = addr;
+    entry->block = std::move(block);
+    Slot& slot = ways[victim];
+    slot.addr.store(EMPTY_ADDR);
+    std::atomic_store(&slot.entry, entry);
+    slot.referenced.store(0, std::memory_order_relaxed);
+    slot.addr.store(addr);
+}
+
+BlockCache::PBlock BlockCache::lookup(LogicAddr addr) {
+    auto set = get_set(addr);
+    Slot* ways = slots_.get() + static_cast<size_t>(set) * NWAYS;
+    for (int i = 0; i < NWAYS; i++) {
+        if (ways[i].addr.load() != addr) {
+            continue;
+        }
+        // Slot can be overwritten concurrently, the entry is checked again
+        auto entry = std::atomic_load(&ways[i].entry);
+        if (entry && entry->addr == addr) {
+            ways[i].referenced.store(1, std::memory_order_relaxed);
+            get_shard(set).hits.fetch_add(1, std::memory_order_relaxed);
+            return entry->block;
+        }
+    }
+    get_shard(set).misses.fetch_add(1, std::memory_order_relaxed);
+    return PBlock();
 }
 
-void BlockCache::insert(PBlock block) {
-    auto addr = block->get_addr();
-    auto pr = probe(addr);
-    if (pr == 2) {
-        // No need to insert, addr already sits in the cache.
-        return;
+bool BlockCache::contains(LogicAddr addr) const {
+    auto set = get_set(addr);
+    Slot* ways = slots_.get() + static_cast<size_t>(set) * NWAYS;
+    for (int i = 0; i < NWAYS; i++) {
+        if (ways[i].addr.load() == addr) {
+            return true;
+        }
     }
-    if (pr == 0) {
-        // Eviction. Generate two random hashes. Evict least accessed.
-        auto h1 = dist_(gen_);
-        auto h2 = dist_(gen_);
-        auto p1 = block_cache_.at(h1);
-        auto p2 = block_cache_.at(h2);
-        if (p1 && p2) {
-            if (p1.use_count() > p2.use_count()) {
-                block_cache_.at(h2).reset();
-            } else if (p1.use_count() < p2.use_count()) {
-                block_cache_.at(h1).reset();
-            } else {
-                if (p1->get_addr() < p2->get_addr()) {
-                    block_cache_.at(h1).reset();
-                } else {
-                    block_cache_.at(h2).reset();
-                }
+    return false;
+}
+
+void BlockCache::invalidate(std::function<bool(LogicAddr)> const& pred) {
+    for (u32 set = 0; set < nsets_; set++) {
+        auto& shard = get_shard(set);
+        Slot* ways = slots_.get() + static_cast<size_t>(set) * NWAYS;
+        std::lock_guard<std::mutex> guard(shard.lock); AKU_UNUSED(guard);
+        for (int i = 0; i < NWAYS; i++) {
+            auto hint = ways[i].addr.load(std::memory_order_relaxed);
+            if (hint != EMPTY_ADDR && pred(hint)) {
+                ways[i].addr.store(EMPTY_ADDR);
+                std::atomic_store(&ways[i].entry, std::shared_ptr<Entry>());
+                shard.size--;
             }
         }
     }
-    auto h = hash(addr, bits_);
-    block_cache_.at(h) = block;
 }
 
-BlockCache::PBlock BlockCache::loockup(LogicAddr addr) {
-    auto it = hash(addr, bits_);
-    auto p = block_cache_.at(it);
-    if (p->get_addr() != addr) {
-        p.reset();
+size_t BlockCache::capacity() const {
+    return static_cast<size_t>(NWAYS) * nsets_;
+}
+
+size_t BlockCache::size() const {
+    size_t res = 0;
+    for (int i = 0; i < NSHARDS; i++) {
+        res += shards_[i].size.load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+u64 BlockCache::hits() const {
+    u64 res = 0;
+    for (int i = 0; i < NSHARDS; i++) {
+        res += shards_[i].hits.load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+u64 BlockCache::misses() const {
+    u64 res = 0;
+    for (int i = 0; i < NSHARDS; i++) {
+        res += shards_[i].misses.load(std::memory_order_relaxed);
     }
-    return p;
+    return res;
 }
 
 
@@ -107,9 +185,10 @@ Block::Block(LogicAddr addr, std::vector<u8>&& data)
 {
 }
 
-Block::Block(LogicAddr addr, const u8* ptr)
+Block::Block(LogicAddr addr, const u8* ptr, VolumePin pin)
     : addr_(addr)
     , zptr_(ptr)
+    , pin_(std::move(pin))
 {
 }
 
@@ -134,6 +213,10 @@ bool Block::is_readonly() const {
 
 u8* Block::get_data() {
     assert(is_readonly() == false);
+    if (zptr_ != nullptr) {
+        // Zero-copy block references the read-only mapping of the volume
+        AKU_PANIC("Zero-copy block can't be modified");
+    }
     return data_.data();
 }
 
@@ -151,11 +234,16 @@ void Block::set_addr(LogicAddr addr) {
 
 
 
+//! Log2 of the number of sets in the block cache (NWAYS*1024 blocks, 32MB per cache)
+static const u32 BLOCK_CACHE_BITS = 10;
+
 FileStorage::FileStorage(std::shared_ptr<VolumeRegistry> meta)
     : meta_(MetaVolume::open_existing(meta))
     , current_volume_(0)
     , current_gen_(0)
     , total_size_(0)
+    , cache_(BLOCK_CACHE_BITS)
+    , prefetch_stop_(false)
 {
     typedef VolumeRegistry::VolumeDesc TVol;
     auto volumes = meta->get_volumes();
@@ -218,6 +306,147 @@ void FileStorage::create(std::vector<std::tuple<u32, std::string>> vols)
     }
 }
 
+static u32 extract_gen(LogicAddr addr) {
+    return addr >> 32;
+}
+
+static BlockAddr extract_vol(LogicAddr addr) {
+    return addr & 0xFFFFFFFF;
+}
+
+static LogicAddr make_logic(u32 gen, BlockAddr addr) {
+    return static_cast<u64>(gen) << 32 | addr;
+}
+
+FileStorage::~FileStorage() {
+    {
+        std::lock_guard<std::mutex> guard(prefetch_lock_); AKU_UNUSED(guard);
+        prefetch_stop_ = true;
+    }
+    prefetch_cond_.notify_all();
+    if (prefetch_thread_.joinable()) {
+        prefetch_thread_.join();
+    }
+}
+
+aku_Status FileStorage::check_volume_block(LogicAddr addr, u32 volix) const {
+    aku_Status status;
+    auto gen = extract_gen(addr);
+    auto vol = extract_vol(addr);
+    u32 actual_gen;
+    u32 nblocks;
+    std::tie(status, actual_gen) = meta_->get_generation(volix);
+    if (status != AKU_SUCCESS) {
+        return AKU_EBAD_ARG;
+    }
+    std::tie(status, nblocks) = meta_->get_nblocks(volix);
+    if (status != AKU_SUCCESS) {
+        return AKU_EBAD_ARG;
+    }
+    if (actual_gen != gen || vol >= nblocks || volix >= volumes_.size()) {
+        return AKU_EUNAVAILABLE;
+    }
+    return AKU_SUCCESS;
+}
+
+std::tuple<aku_Status, std::shared_ptr<Block>> FileStorage::read_volume_block(LogicAddr addr, u32 volix) {
+    auto status = check_volume_block(addr, volix);
+    if (status != AKU_SUCCESS) {
+        return std::make_tuple(status, std::unique_ptr<Block>());
+    }
+    auto vol = extract_vol(addr);
+    // Try to use zero-copy if possible
+    const u8* mptr = nullptr;
+    VolumePin pin;
+    if (is_recycled_next(volix)) {
+        status = AKU_EUNAVAILABLE;
+    } else {
+        std::tie(status, mptr, pin) = volumes_[volix]->read_block_zero_copy(vol);
+    }
+    if (status == AKU_SUCCESS) {
+        std::shared_ptr<Block> zblock = std::make_shared<Block>(addr, mptr, std::move(pin));
+        cache_.insert(addr, zblock);
+        return std::make_tuple(status, std::move(zblock));
+    } else if (status == AKU_EUNAVAILABLE) {
+        // Fallback to copying if not possible
+        std::vector<u8> dest(AKU_BLOCK_SIZE, 0);
+        status = volumes_[volix]->read_block(vol, dest.data());
+        if (status != AKU_SUCCESS) {
+            return std::make_tuple(status, std::unique_ptr<Block>());
+        }
+        auto block = std::make_shared<Block>(addr, std::move(dest));
+        cache_.insert(addr, block);
+        return std::make_tuple(status, std::move(block));
+    }
+    return std::make_tuple(status, std::unique_ptr<Block>());
+}
+
+void FileStorage::schedule_prefetch(LogicAddr addr, u32 volix) {
+    if (cache_.contains(addr)) {
+        return;
+    }
+    // Let the kernel start reading while the request waits in the queue
+    volumes_[volix]->prefetch(extract_vol(addr));
+    {
+        std::lock_guard<std::mutex> guard(prefetch_lock_); AKU_UNUSED(guard);
+        if (prefetch_stop_ || prefetch_queue_.size() >= PREFETCH_QUEUE_SIZE) {
+            return;
+        }
+        prefetch_queue_.push_back(std::make_pair(addr, volix));
+        if (!prefetch_thread_.joinable()) {
+            prefetch_thread_ = std::thread(&FileStorage::prefetch_worker, this);
+        }
+    }
+    prefetch_cond_.notify_one();
+}
+
+void FileStorage::prefetch_worker() {
+    while (true) {
+        std::pair<LogicAddr, u32> req;
+        {
+            std::unique_lock<std::mutex> guard(prefetch_lock_);
+            prefetch_cond_.wait(guard, [this] {
+                return prefetch_stop_ || !prefetch_queue_.empty();
+            });
+            if (prefetch_stop_) {
+                return;
+            }
+            req = prefetch_queue_.front();
+            prefetch_queue_.pop_front();
+        }
+        if (cache_.contains(req.first)) {
+            continue;
+        }
+        // The address is validated again under the lock, the volume can be
+        // recycled after the request was queued. The block is read outside
+        // of the lock, the pin keeps the mapping alive.
+        std::shared_ptr<Block> block;
+        {
+            std::lock_guard<std::mutex> guard(lock_); AKU_UNUSED(guard);
+            if (check_volume_block(req.first, req.second) != AKU_SUCCESS) {
+                continue;
+            }
+            aku_Status status = AKU_EUNAVAILABLE;
+            const u8* mptr = nullptr;
+            VolumePin pin;
+            if (!is_recycled_next(req.second)) {
+                std::tie(status, mptr, pin) = volumes_[req.second]->read_block_zero_copy(extract_vol(req.first));
+            }
+            if (status != AKU_SUCCESS) {
+                // Volume is not mapped (or can't be pinned), copy the block under the lock
+                read_volume_block(req.first, req.second);
+                continue;
+            }
+            block = std::make_shared<Block>(req.first, mptr, std::move(pin));
+        }
+        prefetch_mem(block->get_cdata(), AKU_BLOCK_SIZE);
+        std::lock_guard<std::mutex> guard(lock_); AKU_UNUSED(guard);
+        if (check_volume_block(req.first, req.second) == AKU_SUCCESS) {
+            cache_.insert(req.first, block);
+        }
+    }
+}
+
 void FileStorage::handle_volume_transition() {
     Logger::msg(AKU_LOG_INFO, "Advance volume called, current gen:" + std::to_string(current_gen_));
     adjust_current_volume();
@@ -235,6 +464,7 @@ void FileStorage::handle_volume_transition() {
         AKU_PANIC("Can't read nblocks of the next volume, " + StatusUtil::str(status));
     }
     if (nblocks != 0) {
+        auto stale_gen = current_gen_;
         current_gen_ += volumes_.size();
         auto status = meta_->set_generation(current_volume_, current_gen_);
         if (status != AKU_SUCCESS) {
@@ -247,32 +477,44 @@ void FileStorage::handle_volume_transition() {
             Logger::msg(AKU_LOG_ERROR, "Can't reset nblocks on volume, " + StatusUtil::str(status));
             AKU_PANIC("Invalid BlockStore state, can't reset volume's nblocks, " + StatusUtil::str(status));
         }
+        // Blocks from the previous generation can't be read anymore. Cache
+        // should be cleared first, otherwise cached zero-copy blocks would
+        // keep the volume's mapping pinned.
+        auto is_stale = [stale_gen](LogicAddr addr) {
+            return extract_gen(addr) == stale_gen;
+        };
+        cache_.invalidate(is_stale);
         volumes_[current_volume_]->reset();
         dirty_[current_volume_]++;
     }
-}
-
-static u32 extract_gen(LogicAddr addr) {
-    return addr >> 32;
-}
-
-static BlockAddr extract_vol(LogicAddr addr) {
-    return addr & 0xFFFFFFFF;
-}
-
-static LogicAddr make_logic(u32 gen, BlockAddr addr) {
-    return static_cast<u64>(gen) << 32 | addr;
+    // Cached blocks of the volume that will be recycled next are dropped, new
+    // reads of this volume are copied. Mapping of the volume is unpinned long
+    // before the volume gets recycled (unless some reader holds the block
+    // until then), so `reset` doesn't need to replace the file.
+    for (u32 ix = 0; ix < volumes_.size(); ix++) {
+        if (ix == current_volume_ || !is_recycled_next(ix)) {
+            continue;
+        }
+        u32 next_gen;
+        std::tie(status, next_gen) = meta_->get_generation(ix);
+        if (status != AKU_SUCCESS) {
+            continue;
+        }
+        cache_.invalidate([next_gen](LogicAddr addr) {
+            return extract_gen(addr) == next_gen;
+        });
+    }
 }
 
 std::tuple<aku_Status, LogicAddr> FileStorage::append_block(std::shared_ptr<Block> data) {
     std::lock_guard<std::mutex> guard(lock_); AKU_UNUSED(guard);
     BlockAddr block_addr;
     aku_Status status;
-    std::tie(status, block_addr) = volumes_[current_volume_]->append_block(data->get_data());
+    std::tie(status, block_addr) = volumes_[current_volume_]->append_block(data->get_cdata());
     if (status == AKU_EOVERFLOW) {
       // transition to new/next volume
       handle_volume_transition();
-      std::tie(status, block_addr) = volumes_.at(current_volume_)->append_block(data->get_data());
+      std::tie(status, block_addr) = volumes_.at(current_volume_)->append_block(data->get_cdata());
       if (status != AKU_SUCCESS) {
         return std::make_tuple(status, 0ull);
       }
@@ -365,6 +607,14 @@ PerVolumeStats FileStorage::get_volume_stats() const {
     return result;
 }
 
+BlockCacheStats FileStorage::get_cache_stats() const {
+    BlockCacheStats stats = {};
+    stats.capacity = cache_.capacity();
+    stats.nblocks  = cache_.size();
+    stats.hits     = cache_.hits();
+    stats.misses   = cache_.misses();
+    return stats;
+}
 
 LogicAddr FileStorage::get_top_address() const {
     auto off = volumes_.at(current_volume_)->get_size();
@@ -428,41 +678,14 @@ bool FixedSizeFileStorage::exists(LogicAddr addr) const {
 }
 
 std::tuple<aku_Status, std::shared_ptr<Block>> FixedSizeFileStorage::read_block(LogicAddr addr) {
+    auto cached = cache_.lookup(addr);
+    if (cached) {
+        return std::make_tuple(AKU_SUCCESS, std::move(cached));
+    }
     std::lock_guard<std::mutex> guard(lock_); AKU_UNUSED(guard);
-    aku_Status status;
     auto gen = extract_gen(addr);
-    auto vol = extract_vol(addr);
     auto volix = gen % static_cast<u32>(volumes_.size());
-    u32 actual_gen;
-    u32 nblocks;
-    std::tie(status, actual_gen) = meta_->get_generation(volix);
-    if (status != AKU_SUCCESS) {
-        return std::make_tuple(AKU_EBAD_ARG, std::unique_ptr<Block>());
-    }
-    std::tie(status, nblocks) = meta_->get_nblocks(volix);
-    if (status != AKU_SUCCESS) {
-        return std::make_tuple(AKU_EBAD_ARG, std::unique_ptr<Block>());
-    }
-    if (actual_gen != gen || vol >= nblocks) {
-        return std::make_tuple(AKU_EUNAVAILABLE, std::unique_ptr<Block>());
-    }
-    // Try to use zero-copy if possible
-    const u8* mptr;
-    std::tie(status, mptr) = volumes_[volix]->read_block_zero_copy(vol);
-    if (status == AKU_SUCCESS) {
-        std::shared_ptr<Block> zblock = std::make_shared<Block>(addr, mptr);
-        return std::make_tuple(status, std::move(zblock));
-    } else if (status == AKU_EUNAVAILABLE) {
-        // Fallback to copying if not possible
-        std::vector<u8> dest(AKU_BLOCK_SIZE, 0);
-        status = volumes_[volix]->read_block(vol, dest.data());
-        if (status != AKU_SUCCESS) {
-            return std::make_tuple(status, std::unique_ptr<Block>());
-        }
-        auto block = std::make_shared<Block>(addr, std::move(dest));
-        return std::make_tuple(status, std::move(block));
-    }
-    return std::make_tuple(status, std::unique_ptr<Block>());
+    return read_volume_block(addr, volix);
 }
 
 std::tuple<aku_Status, std::shared_ptr<IOVecBlock>> FixedSizeFileStorage::read_iovec_block(LogicAddr addr) {
@@ -493,10 +716,30 @@ std::tuple<aku_Status, std::shared_ptr<IOVecBlock>> FixedSizeFileStorage::read_i
     return std::make_tuple(status, std::unique_ptr<IOVecBlock>());
 }
 
+void FixedSizeFileStorage::prefetch(LogicAddr addr) {
+    if (cache_.contains(addr)) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock_); AKU_UNUSED(guard);
+    auto gen = extract_gen(addr);
+    auto volix = gen % static_cast<u32>(volumes_.size());
+    aku_Status status;
+    u32 actual_gen;
+    std::tie(status, actual_gen) = meta_->get_generation(volix);
+    if (status != AKU_SUCCESS || actual_gen != gen) {
+        return;
+    }
+    schedule_prefetch(addr, volix);
+}
+
 void FixedSizeFileStorage::adjust_current_volume() {
     current_volume_ = (current_volume_ + 1) % volumes_.size();
 }
 
+bool FixedSizeFileStorage::is_recycled_next(u32 volix) const {
+    return volix == (current_volume_ + 1) % volumes_.size();
+}
+
 // ExpandableFileStorage
 
 ExpandableFileStorage::ExpandableFileStorage(std::shared_ptr<VolumeRegistry> meta)
@@ -530,40 +773,13 @@ bool ExpandableFileStorage::exists(LogicAddr addr) const {
 }
 
 std::tuple<aku_Status, std::shared_ptr<Block>> ExpandableFileStorage::read_block(LogicAddr addr) {
+    auto cached = cache_.lookup(addr);
+    if (cached) {
+        return std::make_tuple(AKU_SUCCESS, std::move(cached));
+    }
     std::lock_guard<std::mutex> guard(lock_); AKU_UNUSED(guard);
-    aku_Status status;
     auto gen = extract_gen(addr);
-    auto vol = extract_vol(addr);
-    u32 actual_gen;
-    u32 nblocks;
-    std::tie(status, actual_gen) = meta_->get_generation(gen);
-    if (status != AKU_SUCCESS) {
-      return std::make_tuple(AKU_EBAD_ARG, std::unique_ptr<Block>());
-    }
-    std::tie(status, nblocks) = meta_->get_nblocks(gen);
-    if (status != AKU_SUCCESS) {
-        return std::make_tuple(AKU_EBAD_ARG, std::unique_ptr<Block>());
-    }
-    if (actual_gen != gen || vol >= nblocks) {
-      return std::make_tuple(AKU_EUNAVAILABLE, std::unique_ptr<Block>());
-    }
-    // Try to use zero-copy if possible
-    const u8* mptr;
-    std::tie(status, mptr) = volumes_[gen]->read_block_zero_copy(vol);
-    if (status == AKU_SUCCESS) {
-        std::shared_ptr<Block> zblock = std::make_shared<Block>(addr, mptr);
-        return std::make_tuple(status, std::move(zblock));
-    } else if (status == AKU_EUNAVAILABLE) {
-        // Fallback to copying if not possible
-        std::vector<u8> dest(AKU_BLOCK_SIZE, 0);
-        status = volumes_[gen]->read_block(vol, dest.data());
-        if (status != AKU_SUCCESS) {
-            return std::make_tuple(status, std::unique_ptr<Block>());
-        }
-        auto block = std::make_shared<Block>(addr, std::move(dest));
-        return std::make_tuple(status, std::move(block));
-    }
-    return std::make_tuple(status, std::unique_ptr<Block>());
+    return read_volume_block(addr, gen);
 }
 
 std::tuple<aku_Status, std::shared_ptr<IOVecBlock>> ExpandableFileStorage::read_iovec_block(LogicAddr addr) {
@@ -586,13 +802,28 @@ std::tuple<aku_Status, std::shared_ptr<IOVecBlock>> ExpandableFileStorage::read_
     }
     // Read the volume
     std::unique_ptr<IOVecBlock> block;
-    std::tie(status, block) = volumes_[vol]->read_block(vol);
+    std::tie(status, block) = volumes_[gen]->read_block(vol);
     if (status == AKU_SUCCESS) {
         return std::make_tuple(status, std::move(block));
     }
     return std::make_tuple(status, std::unique_ptr<IOVecBlock>());
 }
 
+void ExpandableFileStorage::prefetch(LogicAddr addr) {
+    if (cache_.contains(addr)) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock_); AKU_UNUSED(guard);
+    auto gen = extract_gen(addr);
+    aku_Status status;
+    u32 actual_gen;
+    std::tie(status, actual_gen) = meta_->get_generation(gen);
+    if (status != AKU_SUCCESS || actual_gen != gen || gen >= volumes_.size()) {
+        return;
+    }
+    schedule_prefetch(addr, gen);
+}
+
 std::unique_ptr<Volume> ExpandableFileStorage::create_new_volume(u32 id) {
     u32 prev_id = current_volume_ - 1;
     boost::filesystem::path prev_path(volumes_[prev_id]->get_path());
@@ -603,6 +834,11 @@ std::unique_ptr<Volume> ExpandableFileStorage::create_new_volume(u32 id) {
     return Volume::open_existing(new_path.c_str(), 0);
 }
 
+bool ExpandableFileStorage::is_recycled_next(u32) const {
+    // Volumes are never recycled
+    return false;
+}
+
 void ExpandableFileStorage::adjust_current_volume() {
     current_volume_ = current_volume_ + 1;
     if (current_volume_ >= volumes_.size()) {
@@ -725,7 +961,7 @@ std::tuple<aku_Status, std::shared_ptr<IOVecBlock>> MemStore::read_iovec_block(L
 std::tuple<aku_Status, LogicAddr> MemStore::append_block(std::shared_ptr<Block> data) {
     std::lock_guard<std::mutex> guard(lock_); AKU_UNUSED(guard);
     assert(data->get_size() == AKU_BLOCK_SIZE);
-    std::copy(data->get_data(), data->get_data() + AKU_BLOCK_SIZE, std::back_inserter(buffer_));
+    std::copy(data->get_cdata(), data->get_cdata() + AKU_BLOCK_SIZE, std::back_inserter(buffer_));
     if (append_callback_) {
         append_callback_(write_pos_ + MEMSTORE_BASE);
     }
@@ -766,6 +1002,11 @@ BlockStoreStats MemStore::get_stats() const {
     return s;
 }
 
+BlockCacheStats MemStore::get_cache_stats() const {
+    BlockCacheStats stats = {};
+    return stats;
+}
+
 PerVolumeStats MemStore::get_volume_stats() const {
     PerVolumeStats result;
     BlockStoreStats s;
@@ -776,6 +1017,10 @@ PerVolumeStats MemStore::get_volume_stats() const {
     return result;
 }
 
+void MemStore::prefetch(LogicAddr) {
+    // Data is already in memory
+}
+
 bool MemStore::exists(LogicAddr addr) const {
     addr -= MEMSTORE_BASE;
     std::lock_guard<std::mutex> guard(lock_); AKU_UNUSED(guard);
@@ -18,10 +18,14 @@
 #pragma once
 #include "volumeregistry.h"
 #include "volume.h"
-#include <random>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <mutex>
 #include <map>
 #include <string>
+#include <thread>
 
 namespace Akumuli {
 namespace StorageEngine {
@@ -29,29 +33,95 @@ namespace StorageEngine {
 
 class Block;
 
-struct BlockCache {
+/** Concurrent cache of the immutable blocks.
+  * Cache is set-associative. Each set contains NWAYS slots and uses
+  * CLOCK algorithm to pick eviction candidate. Sets are grouped into
+  * shards, every shard has its own lock that is used only by writers
+  * (insert and invalidate). Lookups don't take any locks.
+  * Cache is keyed by LogicAddr. Block's content can't change while its
+  * LogicAddr is valid, so there is no need to check for staleness on
+  * lookup. Entries should be invalidated when the volume is recycled
+  * (generation changes).
+  */
+class BlockCache {
+public:
     typedef std::shared_ptr<Block> PBlock;
-    std::vector<PBlock> block_cache_;
-    const u32 bits_;
-    // RNG
-    std::random_device dev_;
-    std::mt19937 gen_;
-    std::uniform_int_distribution<u32> dist_;
-
-    /** Check status of the cache cell.
-      * Return 0 if there is no such addr in the cache and slot is free.
-      * Return 1 if addr is not present in the cache but slot is occupied by the other block.
-      * Return 2 if addr is already present in the cache.
-      */
-    int probe(LogicAddr addr);
 
+    enum {
+        NWAYS = 8,
+        NSHARDS = 16,
+    };
+
+private:
+    struct Entry {
+        LogicAddr addr;
+        PBlock    block;
+    };
+
+    struct Slot {
+        //! Address hint, used to skip non-matching slots without touching the entry
+        std::atomic<LogicAddr>  addr;
+        //! CLOCK reference bit
+        std::atomic<int>        referenced;
+        //! Should be accessed only through atomic_load/atomic_store
+        std::shared_ptr<Entry>  entry;
+    };
+
+    struct Shard {
+        std::mutex          lock;
+        std::atomic<u64>    hits;
+        std::atomic<u64>    misses;
+        std::atomic<u64>    size;
+        char                pad[64];
+    };
+
+    std::unique_ptr<Slot[]>   slots_;
+    std::unique_ptr<u8[]>     hands_;  //< CLOCK hand for every set, protected by shard lock
+    std::unique_ptr<Shard[]>  shards_;
+    const u32                 bits_;
+    const u32                 nsets_;
+
+    u32 get_set(LogicAddr addr) const;
+
+    Shard& get_shard(u32 set) const;
+
+public:
+    /** Create cache.
+      * @param Nbits is a log2 of the number of sets, capacity of the cache is `NWAYS << Nbits` blocks.
+      */
     BlockCache(u32 Nbits);
 
-    void insert(PBlock block);
+    //! Insert block into the cache
+    void insert(LogicAddr addr, PBlock block);
+
+    //! Find block in cache, return empty pointer if there is no such block
+    PBlock lookup(LogicAddr addr);
+
+    //! Check that the block is in the cache, doesn't affect hit/miss counters
+    bool contains(LogicAddr addr) const;
 
-    PBlock loockup(LogicAddr addr);
+    //! Remove all entries that satisfy the predicate
+    void invalidate(std::function<bool(LogicAddr)> const& pred);
+
+    //! Get total number of slots
+    size_t capacity() const;
+
+    //! Get number of occupied slots
+    size_t size() const;
+
+    //! Get number of cache hits
+    u64 hits() const;
+
+    //! Get number of cache misses
+    u64 misses() const;
 };
 
+struct BlockCacheStats {
+    size_t capacity;
+    size_t nblocks;
+    u64 hits;
+    u64 misses;
+};
 
 struct BlockStoreStats {
     size_t block_size;
@@ -75,6 +145,11 @@ struct BlockStore {
 
     virtual std::tuple<aku_Status, std::shared_ptr<IOVecBlock>> read_iovec_block(LogicAddr addr) = 0;
 
+    /** Hint that the block will be read soon. Doesn't block, the
+      * implementation can start asynchronous read or ignore the hint.
+      */
+    virtual void prefetch(LogicAddr addr) = 0;
+
     /** Add block to blockstore.
       * @param data Pointer to buffer.
       * @return Status and block's logic address.
@@ -99,6 +174,8 @@ struct BlockStore {
 
     virtual PerVolumeStats get_volume_stats() const = 0;
 
+    virtual BlockCacheStats get_cache_stats() const = 0;
+
     virtual LogicAddr get_top_address() const = 0;
 };
 
@@ -120,6 +197,20 @@ protected:
     mutable std::mutex lock_;
     //! Volume names (for nice statistics)
     std::vector<std::string> volume_names_;
+    //! Cache for blocks returned by `read_block`
+    BlockCache cache_;
+
+    // Read-ahead. Addresses passed to `prefetch` are read into `cache_`
+    // by the background thread. The thread is started on first use.
+    enum {
+        PREFETCH_QUEUE_SIZE = 64,
+    };
+    //! Pending requests (logic address and volume index)
+    std::deque<std::pair<LogicAddr, u32>> prefetch_queue_;
+    std::mutex prefetch_lock_;
+    std::condition_variable prefetch_cond_;
+    std::thread prefetch_thread_;
+    bool prefetch_stop_;
 
     //! Secret c-tor.
     FileStorage(std::shared_ptr<VolumeRegistry> meta);
@@ -127,7 +218,38 @@ protected:
     virtual void adjust_current_volume() = 0;
     void handle_volume_transition();
 
+    /** Check if the volume will be recycled by the next volume transition.
+      * Blocks of this volume are never read using zero-copy, otherwise the
+      * pinned mapping would force `Volume::reset` to replace the file.
+      * Caller should hold `lock_`.
+      */
+    virtual bool is_recycled_next(u32 volix) const = 0;
+
+    /** Check that the block is still present in the volume (volume wasn't
+      * recycled since the address was issued). Caller should hold `lock_`.
+      * @return AKU_SUCCESS if the block can be read
+      */
+    aku_Status check_volume_block(LogicAddr addr, u32 volix) const;
+
+    /** Read block from the volume and put it into the cache.
+      * Caller should hold `lock_`.
+      * @param addr is a logic address of the block
+      * @param volix is an index of the volume that should contain the block
+      */
+    std::tuple<aku_Status, std::shared_ptr<Block>> read_volume_block(LogicAddr addr, u32 volix);
+
+    /** Schedule asynchronous read of the block. Request is dropped if the
+      * block is already cached or the queue is full.
+      * Caller should hold `lock_`.
+      */
+    void schedule_prefetch(LogicAddr addr, u32 volix);
+
+    //! Background thread that serves `prefetch_queue_`
+    void prefetch_worker();
+
 public:
+    virtual ~FileStorage();
+
     static void create(std::vector<std::tuple<u32, std::string>> vols);
 
     /** Add block to blockstore.
@@ -148,6 +270,8 @@ public:
 
     virtual PerVolumeStats get_volume_stats() const;
 
+    virtual BlockCacheStats get_cache_stats() const;
+
     virtual LogicAddr get_top_address() const;
 };
 
@@ -158,6 +282,7 @@ class FixedSizeFileStorage : public FileStorage,
 
 protected:
     virtual void adjust_current_volume();
+    virtual bool is_recycled_next(u32 volix) const;
 
 public:
     /** Create BlockStore instance (can be created only on heap).
@@ -170,6 +295,7 @@ public:
       */
     virtual std::tuple<aku_Status, std::shared_ptr<Block>> read_block(LogicAddr addr);
     virtual std::tuple<aku_Status, std::shared_ptr<IOVecBlock>> read_iovec_block(LogicAddr addr);
+    virtual void prefetch(LogicAddr addr);
 };
 
 class ExpandableFileStorage : public FileStorage,
@@ -182,6 +308,7 @@ class ExpandableFileStorage : public FileStorage,
     std::unique_ptr<Volume> create_new_volume(u32 id);
 protected:
     virtual void adjust_current_volume();
+    virtual bool is_recycled_next(u32 volix) const;
 
 public:
     /**
@@ -199,6 +326,7 @@ public:
      */
     virtual std::tuple<aku_Status, std::shared_ptr<Block>> read_block(LogicAddr addr);
     virtual std::tuple<aku_Status, std::shared_ptr<IOVecBlock>> read_iovec_block(LogicAddr addr);
+    virtual void prefetch(LogicAddr addr);
 };
 
 
@@ -220,6 +348,7 @@ struct MemStore : BlockStore, std::enable_shared_from_this<MemStore> {
 
     virtual std::tuple<aku_Status, std::shared_ptr<Block> > read_block(LogicAddr addr);
     virtual std::tuple<aku_Status, std::shared_ptr<IOVecBlock>> read_iovec_block(LogicAddr addr);
+    virtual void prefetch(LogicAddr addr);
     virtual std::tuple<aku_Status, LogicAddr> append_block(std::shared_ptr<Block> data);
     virtual std::tuple<aku_Status, LogicAddr> append_block(std::shared_ptr<IOVecBlock> data);
     virtual void flush();
@@ -228,6 +357,7 @@ struct MemStore : BlockStore, std::enable_shared_from_this<MemStore> {
     virtual u32 checksum(const u8* data, size_t size) const;
     virtual BlockStoreStats get_stats() const;
     virtual PerVolumeStats get_volume_stats() const;
+    virtual BlockCacheStats get_cache_stats() const;
     virtual LogicAddr get_top_address() const;
 
     /**
@@ -246,12 +376,14 @@ class Block {
     std::vector<u8>           data_;
     LogicAddr                 addr_;
     const u8*                 zptr_;
+    //! Keeps `zptr_` valid
+    VolumePin                 pin_;
 
 public:
     Block(LogicAddr addr, std::vector<u8>&& data);
 
-    //! This c-tor is used in zero-copy mechanism, ptr should outlive the Block object
-    Block(LogicAddr addr, const u8* ptr);
+    //! This c-tor is used in zero-copy mechanism, `pin` keeps `ptr` valid while the Block object exists
+    Block(LogicAddr addr, const u8* ptr, VolumePin pin);
 
     Block();
 
@@ -261,6 +393,7 @@ public:
 
     const u8* get_cdata() const;
 
+    //! Get writable data (panics if the block is a zero-copy view of the volume)
     u8* get_data();
 
     size_t get_size() const;
@@ -8,6 +8,8 @@
 #include "operators/merge.h"
 
 #include <boost/property_tree/ptree.hpp>
+#include <algorithm>
+#include <functional>
 
 namespace Akumuli {
 namespace StorageEngine {
@@ -15,15 +17,123 @@ namespace StorageEngine {
 using namespace QP;
 
 
+// ////////////// //
+//  Column-table  //
+// ////////////// //
+
+ColumnTable::Shard& ColumnTable::get_shard(aku_ParamId id) {
+    return shards_[id % NSHARDS];
+}
+
+ColumnTable::Shard const& ColumnTable::get_shard(aku_ParamId id) const {
+    return shards_[id % NSHARDS];
+}
+
+ColumnTable::TreeT ColumnTable::find(aku_ParamId id) const {
+    auto const& shard = get_shard(id);
+    LockGuard<RWLock, &RWLock::rdlock> lock(shard.lock);
+    auto it = shard.columns.find(id);
+    if (it != shard.columns.end()) {
+        return it->second;
+    }
+    return TreeT();
+}
+
+bool ColumnTable::insert(aku_ParamId id, TreeT tree) {
+    auto& shard = get_shard(id);
+    UniqueLock lock(shard.lock);
+    return shard.columns.insert(std::make_pair(id, std::move(tree))).second;
+}
+
+ColumnTable::MapT ColumnTable::snapshot() const {
+    MapT result;
+    for (auto const& shard: shards_) {
+        LockGuard<RWLock, &RWLock::rdlock> lock(shard.lock);
+        result.insert(shard.columns.begin(), shard.columns.end());
+    }
+    return result;
+}
+
 // ////////////// //
 //  Column-store  //
 // ////////////// //
 
-ColumnStore::ColumnStore(std::shared_ptr<BlockStore> bstore)
+ColumnStore::ColumnStore(std::shared_ptr<BlockStore> bstore, std::vector<aku_Timestamp> rollup_tiers)
     : blockstore_(bstore)
+    , rollup_tiers_(std::move(rollup_tiers))
+    , async_rollup_(false)
 {
 }
 
+void ColumnStore::enable_async_rollup() {
+    std::lock_guard<std::mutex> guard(rollup_lock_);
+    async_rollup_ = true;
+}
+
+bool ColumnStore::on_catch_up_needed(aku_ParamId id) {
+    {
+        std::lock_guard<std::mutex> guard(rollup_lock_);
+        if (!async_rollup_) {
+            return false;
+        }
+        rollup_queue_.push_back(id);
+    }
+    rollup_cvar_.notify_one();
+    return true;
+}
+
+void ColumnStore::on_rescue_points(aku_ParamId id, std::vector<LogicAddr> const& rpoints) {
+    std::lock_guard<std::mutex> tl(rescue_points_lock_);
+    rescue_points_[id] = rpoints;
+}
+
+std::vector<aku_ParamId> ColumnStore::wait_rollup_requests(int timeout_ms) {
+    std::vector<aku_ParamId> result;
+    std::unique_lock<std::mutex> lock(rollup_lock_);
+    if (rollup_queue_.empty()) {
+        rollup_cvar_.wait_for(lock, std::chrono::milliseconds(timeout_ms));
+    }
+    std::swap(result, rollup_queue_);
+    return result;
+}
+
+void ColumnStore::catch_up_rollup(aku_ParamId id) {
+    auto tree = columns_.find(id);
+    if (tree) {
+        tree->catch_up_rollup();
+    }
+}
+
+std::unordered_map<aku_ParamId, std::vector<LogicAddr>> ColumnStore::pull_rescue_points() {
+    std::unordered_map<aku_ParamId, std::vector<LogicAddr>> result;
+    std::lock_guard<std::mutex> tl(rescue_points_lock_);
+    std::swap(result, rescue_points_);
+    return result;
+}
+
+void ColumnStore::attach_rollup(std::shared_ptr<NBTreeExtentsList> const& tree) {
+    if (rollup_tiers_.empty()) {
+        return;
+    }
+    // Every tier is a separate column in the column table (it has its own tree,
+    // rescue points and memory footprint)
+    std::vector<std::tuple<aku_Timestamp, std::shared_ptr<NBTreeExtentsList>>> tiers;
+    for (u32 ix = 0; ix < rollup_tiers_.size(); ix++) {
+        auto id = NBTreeRollup::get_tier_id(tree->get_id(), ix);
+        auto column = columns_.find(id);
+        if (!column) {
+            column = std::make_shared<NBTreeExtentsList>(id, std::vector<LogicAddr>(), blockstore_);
+            column->force_init();
+            if (!columns_.insert(id, column)) {
+                column = columns_.find(id);
+            }
+        }
+        tiers.push_back(std::make_tuple(rollup_tiers_.at(ix), column));
+    }
+    std::unique_ptr<NBTreeRollup> rollup(new NBTreeRollup(std::move(tiers), this));
+    tree->attach_rollup(std::move(rollup));
+}
+
 std::tuple<aku_Status, std::vector<aku_ParamId>> ColumnStore::open_or_restore(
         std::unordered_map<aku_ParamId,
         std::vector<StorageEngine::LogicAddr>> const& mapping,
@@ -42,34 +152,39 @@ std::tuple<aku_Status, std::vector<aku_ParamId>> ColumnStore::open_or_restore(
         }
         auto tree = std::make_shared<NBTreeExtentsList>(id, rescue_points, blockstore_);
 
-        std::lock_guard<std::mutex> tl(table_lock_);
-        if (columns_.count(id)) {
+        if (!columns_.insert(id, tree)) {
             Logger::msg(AKU_LOG_ERROR, "Can't open/repair " + std::to_string(id) + " (already exists)");
             return std::make_tuple(AKU_EBAD_ARG, std::vector<aku_ParamId>());
-        } else {
-            columns_[id] = std::move(tree);
         }
         if (force_init || status == NBTreeExtentsList::RepairStatus::REPAIR) {
             // Repair is performed on initialization. We don't want to postprone this process
             // since it will introduce runtime penalties.
-            columns_[id]->force_init();
+            tree->force_init();
             if (status == NBTreeExtentsList::RepairStatus::REPAIR) {
                 ids2recover.push_back(id);
             }
             if (force_init == false) {
                 // Close the tree until it will be acessed first
-                auto rplist = columns_[id]->close();
+                auto rplist = tree->close();
+                std::lock_guard<std::mutex> tl(rescue_points_lock_);
                 rescue_points_[id] = std::move(rplist);
             }
         }
     }
+    // Tier columns are opened in the loop above, missing ones are created here
+    for (auto it: mapping) {
+        if (!NBTreeRollup::is_tier_id(it.first)) {
+            attach_rollup(columns_.find(it.first));
+        }
+    }
     return std::make_tuple(AKU_SUCCESS, ids2recover);
 }
 
 std::unordered_map<aku_ParamId, std::vector<StorageEngine::LogicAddr>> ColumnStore::close() {
+    auto columns = columns_.snapshot();
     // TODO: remove
     size_t c1_mem = 0, c2_mem = 0;
-    for (auto it: columns_) {
+    for (auto it: columns) {
         if (it.second->is_initialized()) {
             size_t c1, c2;
             std::tie(c1, c2) = it.second->bytes_used();
@@ -82,9 +197,8 @@ std::unordered_map<aku_ParamId, std::vector<StorageEngine::LogicAddr>> ColumnSto
     Logger::msg(AKU_LOG_INFO, "SBlock memory usage: " + std::to_string(c2_mem));
     // end TODO remove
     std::unordered_map<aku_ParamId, std::vector<StorageEngine::LogicAddr>> result;
-    std::lock_guard<std::mutex> tl(table_lock_);
     Logger::msg(AKU_LOG_INFO, "Column-store commit called");
-    for (auto it: columns_) {
+    for (auto it: columns) {
         if (it.second->is_initialized()) {
             auto addrlist = it.second->close();
             result[it.first] = addrlist;
@@ -97,15 +211,28 @@ std::unordered_map<aku_ParamId, std::vector<StorageEngine::LogicAddr>> ColumnSto
 std::unordered_map<aku_ParamId, std::vector<StorageEngine::LogicAddr>> ColumnStore::close(const std::vector<u64>& ids) {
     std::unordered_map<aku_ParamId, std::vector<StorageEngine::LogicAddr>> result;
     Logger::msg(AKU_LOG_INFO, "Column-store close specific columns");
+    std::vector<aku_ParamId> all_ids(ids);
     for (auto id: ids) {
-        std::lock_guard<std::mutex> tl(table_lock_);
-        auto it = columns_.find(id);
-        if (it == columns_.end()) {
+        // Tier columns should be closed together with the series
+        for (u32 ix = 0; ix < rollup_tiers_.size(); ix++) {
+            all_ids.push_back(NBTreeRollup::get_tier_id(id, ix));
+        }
+    }
+    for (auto id: all_ids) {
+        auto tree = columns_.find(id);
+        if (!tree) {
             continue;
         }
-        if (it->second->is_initialized()) {
-            auto addrlist = it->second->close();
-            result[it->first] = addrlist;
+        if (tree->is_initialized()) {
+            auto addrlist = tree->close();
+            result[id] = addrlist;
+        }
+    }
+    {
+        // Pending rescue points of the closed columns are superseded by the result
+        std::lock_guard<std::mutex> tl(rescue_points_lock_);
+        for (auto const& kv: result) {
+            rescue_points_.erase(kv.first);
         }
     }
     Logger::msg(AKU_LOG_INFO, "Column-store close specific columns, operation completed");
@@ -115,22 +242,74 @@ std::unordered_map<aku_ParamId, std::vector<StorageEngine::LogicAddr>> ColumnSto
 aku_Status ColumnStore::create_new_column(aku_ParamId id) {
     std::vector<LogicAddr> empty;
     auto tree = std::make_shared<NBTreeExtentsList>(id, empty, blockstore_);
-    {
-        std::lock_guard<std::mutex> tl(table_lock_);
-        if (columns_.count(id)) {
-            return AKU_EBAD_ARG;
+    // Initialize the tree before it becomes visible to other threads
+    tree->force_init();
+    attach_rollup(tree);
+    if (!columns_.insert(id, std::move(tree))) {
+        return AKU_EBAD_ARG;
+    }
+    return AKU_SUCCESS;
+}
+
+aku_Status ColumnStore::preload(aku_ParamId id) {
+    auto tree = columns_.find(id);
+    if (!tree) {
+        return AKU_ENOT_FOUND;
+    }
+    tree->force_init();
+    return AKU_SUCCESS;
+}
+
+std::vector<aku_ParamId> ColumnStore::select_idle(size_t budget, size_t* nloaded, size_t* nbytes) {
+    std::vector<std::tuple<u32, size_t, aku_ParamId>> candidates;  // (idle passes, bytes, id)
+    size_t total_loaded = 0;
+    size_t total_bytes = 0;
+    for (auto const& kv: columns_.snapshot()) {
+        u64 write_count;
+        size_t bytes;
+        std::tie(write_count, bytes) = kv.second->get_activity();
+        if (!kv.second->is_initialized()) {
+            activity_.erase(kv.first);
+            continue;
+        }
+        total_loaded++;
+        total_bytes += bytes;
+        if (NBTreeRollup::is_tier_id(kv.first)) {
+            // Tier columns are closed together with the series
+            continue;
+        }
+        auto it = activity_.find(kv.first);
+        if (it == activity_.end()) {
+            activity_[kv.first] = { write_count, 0 };
+        } else if (it->second.write_count != write_count) {
+            it->second = { write_count, 0 };
         } else {
-            columns_[id] = std::move(tree);
-            columns_[id]->force_init();
-            return AKU_SUCCESS;
+            it->second.idle_passes++;
+            candidates.push_back(std::make_tuple(it->second.idle_passes, bytes, kv.first));
         }
     }
+    *nloaded = total_loaded;
+    *nbytes = total_bytes;
+    std::vector<aku_ParamId> result;
+    if (total_bytes <= budget) {
+        return result;
+    }
+    // Longest idle and largest columns go first
+    std::sort(candidates.begin(), candidates.end(), std::greater<std::tuple<u32, size_t, aku_ParamId>>());
+    for (auto const& c: candidates) {
+        if (total_bytes <= budget) {
+            break;
+        }
+        total_bytes -= std::min(total_bytes, std::get<1>(c));
+        result.push_back(std::get<2>(c));
+        activity_.erase(std::get<2>(c));
+    }
+    return result;
 }
 
 size_t ColumnStore::_get_uncommitted_memory() const {
-    std::lock_guard<std::mutex> guard(table_lock_);
     size_t total_size = 0;
-    for (auto const& p: columns_) {
+    for (auto const& p: columns_.snapshot()) {
         if (p.second->is_initialized()) {
             total_size += p.second->_get_uncommitted_size();
         }
@@ -141,15 +320,12 @@ size_t ColumnStore::_get_uncommitted_memory() const {
 NBTreeAppendResult ColumnStore::write(aku_Sample const& sample, std::vector<LogicAddr>* rescue_points,
                                std::unordered_map<aku_ParamId, std::shared_ptr<NBTreeExtentsList>>* cache_or_null)
 {
-    std::lock_guard<std::mutex> lock(table_lock_);
     aku_ParamId id = sample.paramid;
-    auto it = columns_.find(id);
-    if (it != columns_.end()) {
-        auto tree = it->second;
+    auto tree = columns_.find(id);
+    if (tree) {
         auto res = tree->append(sample.timestamp, sample.payload.float64);
         if (res == NBTreeAppendResult::OK_FLUSH_NEEDED) {
-            auto tmp = tree->get_roots();
-            rescue_points->swap(tmp);
+            tree->get_roots(rescue_points);
         }
         if (cache_or_null != nullptr) {
             // Tree is guaranteed to be initialized here, so all values in the cache
@@ -161,13 +337,31 @@ NBTreeAppendResult ColumnStore::write(aku_Sample const& sample, std::vector<Logi
     return NBTreeAppendResult::FAIL_BAD_ID;
 }
 
+NBTreeAppendResult ColumnStore::write(aku_ParamId id, aku_Timestamp const* tss, double const* xss, size_t size,
+                                      size_t* nwritten, std::vector<LogicAddr>* rescue_points,
+                                      std::unordered_map<aku_ParamId, std::shared_ptr<NBTreeExtentsList>>* cache_or_null)
+{
+    auto tree = columns_.find(id);
+    if (tree) {
+        NBTreeAppendResult res;
+        std::tie(res, *nwritten) = tree->append(tss, xss, size);
+        if (res == NBTreeAppendResult::OK_FLUSH_NEEDED) {
+            tree->get_roots(rescue_points);
+        }
+        if (cache_or_null != nullptr) {
+            cache_or_null->insert(std::make_pair(id, tree));
+        }
+        return res;
+    }
+    *nwritten = 0;
+    return NBTreeAppendResult::FAIL_BAD_ID;
+}
+
 NBTreeAppendResult ColumnStore::recovery_write(aku_Sample const& sample, bool allow_duplicates)
 {
-    std::lock_guard<std::mutex> lock(table_lock_);
     aku_ParamId id = sample.paramid;
-    auto it = columns_.find(id);
-    if (it != columns_.end()) {
-        auto tree = it->second;
+    auto tree = columns_.find(id);
+    if (tree) {
         return tree->append(sample.timestamp, sample.payload.float64, allow_duplicates);
     }
     return NBTreeAppendResult::FAIL_BAD_ID;
@@ -191,8 +385,7 @@ NBTreeAppendResult CStoreSession::write(aku_Sample const& sample, std::vector<Lo
     if (it != cache_.end()) {
         auto res = it->second->append(sample.timestamp, sample.payload.float64);
         if (res == NBTreeAppendResult::OK_FLUSH_NEEDED) {
-            auto tmp = it->second->get_roots();
-            rescue_points->swap(tmp);
+            it->second->get_roots(rescue_points);
         }
         return res;
     }
@@ -200,6 +393,23 @@ NBTreeAppendResult CStoreSession::write(aku_Sample const& sample, std::vector<Lo
     return cstore_->write(sample, rescue_points, &cache_);
 }
 
+NBTreeAppendResult CStoreSession::write(aku_ParamId id, aku_Timestamp const* tss, double const* xss, size_t size,
+                                        size_t* nwritten, std::vector<LogicAddr>* rescue_points)
+{
+    // Cache lookup
+    auto it = cache_.find(id);
+    if (it != cache_.end()) {
+        NBTreeAppendResult res;
+        std::tie(res, *nwritten) = it->second->append(tss, xss, size);
+        if (res == NBTreeAppendResult::OK_FLUSH_NEEDED) {
+            it->second->get_roots(rescue_points);
+        }
+        return res;
+    }
+    // Cache miss - access global registry
+    return cstore_->write(id, tss, xss, size, nwritten, rescue_points, &cache_);
+}
+
 void CStoreSession::close() {
     // This method can't be implemented yet, because it will waste space.
     // Leaf node recovery should be implemented first.
@@ -27,6 +27,7 @@
 
 // Stdlib
 #include <unordered_map>
+#include <array>
 #include <mutex>
 #include <tuple>
 
@@ -47,6 +48,47 @@ namespace Akumuli {
 namespace StorageEngine {
 
 
+/** Concurrent column table.
+  * Ids are distributed between NSHARDS shards and every shard is protected by
+  * its own read-write lock. Lookup takes the shared lock of a single shard, so
+  * readers never wait for each other and writers that create new columns only
+  * block lookups of ids that belong to the same shard.
+  */
+class ColumnTable {
+public:
+    typedef std::shared_ptr<NBTreeExtentsList> TreeT;
+    typedef std::unordered_map<aku_ParamId, TreeT> MapT;
+
+    enum {
+        NSHARDS = 64,
+    };
+
+private:
+    struct Shard {
+        mutable RWLock lock;
+        MapT columns;
+    };
+    std::array<Shard, NSHARDS> shards_;
+
+    Shard& get_shard(aku_ParamId id);
+    Shard const& get_shard(aku_ParamId id) const;
+
+public:
+    ColumnTable() = default;
+    ColumnTable(ColumnTable const&) = delete;
+    ColumnTable& operator = (ColumnTable const&) = delete;
+
+    //! Find column by id, returns empty pointer if not found
+    TreeT find(aku_ParamId id) const;
+
+    //! Add new column, returns false if column already exists
+    bool insert(aku_ParamId id, TreeT tree);
+
+    //! Copy content of the table (shards are locked one by one)
+    MapT snapshot() const;
+};
+
+
 /** Columns store.
   * Serve as a central data repository for series metadata and all individual columns.
   * Each column is addressed by the series name. Data can be written in through WriteSession
@@ -55,19 +97,41 @@ namespace StorageEngine {
   * Columns are built from NB+tree instances.
   * Instances of this class is thread-safe.
   */
-class ColumnStore : public std::enable_shared_from_this<ColumnStore> {
+class ColumnStore : public std::enable_shared_from_this<ColumnStore>, public NBTreeRollupListener {
     std::shared_ptr<StorageEngine::BlockStore> blockstore_;
-    std::unordered_map<aku_ParamId, std::shared_ptr<NBTreeExtentsList>> columns_;
+    ColumnTable columns_;
     PlainSeriesMatcher global_matcher_;
     //! List of metadata to update
     std::unordered_map<aku_ParamId, std::vector<StorageEngine::LogicAddr>> rescue_points_;
-    //! Mutex for table_ hashmap (shrink and resize)
-    mutable std::mutex table_lock_;
+    //! Mutex for rescue_points_ hashmap
+    mutable std::mutex rescue_points_lock_;
     //! Syncronization for watcher thread
     std::condition_variable cvar_;
+    //! Rollup tiers (sorted)
+    const std::vector<aku_Timestamp> rollup_tiers_;
+    //! Write activity of the loaded columns observed by `select_idle`
+    struct Activity {
+        u64 write_count;
+        u32 idle_passes;
+    };
+    std::unordered_map<aku_ParamId, Activity> activity_;
+    //! Raw columns waiting for the rollup catch-up
+    std::vector<aku_ParamId> rollup_queue_;
+    //! Set when the rollup catch-up is performed by the background worker
+    bool async_rollup_;
+    std::mutex rollup_lock_;
+    std::condition_variable rollup_cvar_;
+
+    //! Find or create tier columns of the tree and attach them to the tree
+    void attach_rollup(std::shared_ptr<NBTreeExtentsList> const& tree);
 
 public:
-    ColumnStore(std::shared_ptr<StorageEngine::BlockStore> bstore);
+    /** C-tor
+      * @param bstore is a block-store
+      * @param rollup_tiers is a sorted list of rollup tiers maintained for every column
+      */
+    ColumnStore(std::shared_ptr<StorageEngine::BlockStore> bstore,
+                std::vector<aku_Timestamp> rollup_tiers = std::vector<aku_Timestamp>());
 
     // No value semantics allowed.
     ColumnStore(ColumnStore const&) = delete;
@@ -93,6 +157,45 @@ public:
       */
     aku_Status create_new_column(aku_ParamId id);
 
+    /** Load column into memory (columns are loaded lazily on first write or query,
+      * this method can be used to warm up the column in advance).
+      * @return completion status
+      */
+    aku_Status preload(aku_ParamId id);
+
+    /** Select loaded columns that can be unloaded to fit into memory budget.
+      * Columns that wasn't written since the previous call are considered idle,
+      * the ones that stay idle longer are selected first. Nothing is selected
+      * if the loaded columns fit into the budget.
+      * Should be called periodically from the single thread.
+      * @param budget is a memory budget in bytes
+      * @param nloaded receives number of loaded columns
+      * @param nbytes receives memory used by loaded columns
+      * @return list of ids that should be closed
+      */
+    std::vector<aku_ParamId> select_idle(size_t budget, size_t* nloaded, size_t* nbytes);
+
+    /** Queue rollup catch-up requests instead of performing catch-up on first write.
+      * Requests should be read by `wait_rollup_requests` and processed by `catch_up_rollup`.
+      */
+    void enable_async_rollup();
+
+    /** Wait for rollup catch-up requests.
+      * @param timeout_ms is a timeout in milliseconds
+      * @return list of raw column ids (can be empty on timeout)
+      */
+    std::vector<aku_ParamId> wait_rollup_requests(int timeout_ms);
+
+    //! Restore rollup tiers of the column (can be called from any thread)
+    void catch_up_rollup(aku_ParamId id);
+
+    //! Take rescue points of the columns updated outside of the write path (e.g. tier columns)
+    std::unordered_map<aku_ParamId, std::vector<LogicAddr>> pull_rescue_points();
+
+    // NBTreeRollupListener
+    virtual bool on_catch_up_needed(aku_ParamId id);
+    virtual void on_rescue_points(aku_ParamId id, std::vector<LogicAddr> const& rpoints);
+
     /** Write sample to data-store.
       * @param sample to write
       * @param cache_or_null is a pointer to external cache, tree ref will be added there on success
@@ -100,6 +203,15 @@ public:
     NBTreeAppendResult write(aku_Sample const& sample, std::vector<LogicAddr> *rescue_points,
                      std::unordered_map<aku_ParamId, std::shared_ptr<NBTreeExtentsList> > *cache_or_null=nullptr);
 
+    /** Write run of values that belong to the same series (in timestamp order).
+      * @param nwritten receives number of written values, the value that follows
+      *        the last written one is a late write
+      * @param cache_or_null is a pointer to external cache, tree ref will be added there on success
+      */
+    NBTreeAppendResult write(aku_ParamId id, aku_Timestamp const* tss, double const* xss, size_t size,
+                             size_t* nwritten, std::vector<LogicAddr> *rescue_points,
+                             std::unordered_map<aku_ParamId, std::shared_ptr<NBTreeExtentsList> > *cache_or_null=nullptr);
+
     /**
      * @brief Write sample to data-store during crash recovery
      * @param sample to write
@@ -111,7 +223,7 @@ public:
 
     //! For debug reports
     std::unordered_map<aku_ParamId, std::shared_ptr<NBTreeExtentsList>> _get_columns() {
-        return columns_;
+        return columns_.snapshot();
     }
 
     // -------------
@@ -124,15 +236,14 @@ public:
                       const Fn& fn) const
     {
         for (auto id: ids) {
-            std::lock_guard<std::mutex> lg(table_lock_); AKU_UNUSED(lg);
-            auto it = columns_.find(id);
-            if (it != columns_.end()) {
-                if (!it->second->is_initialized()) {
-                    it->second->force_init();
+            auto tree = columns_.find(id);
+            if (tree) {
+                if (!tree->is_initialized()) {
+                    tree->force_init();
                 }
                 aku_Status s;
                 std::unique_ptr<IterType> iter;
-                std::tie(s, iter) = std::move(fn(*it->second));
+                std::tie(s, iter) = std::move(fn(*tree));
                 if (s != AKU_SUCCESS) {
                     return s;
                 }
@@ -239,6 +350,13 @@ public:
     //! Write sample
     NBTreeAppendResult write(const aku_Sample &sample, std::vector<LogicAddr>* rescue_points);
 
+    /** Write run of values that belong to the same series (in timestamp order).
+      * @param nwritten receives number of written values, the value that follows
+      *        the last written one is a late write
+      */
+    NBTreeAppendResult write(aku_ParamId id, aku_Timestamp const* tss, double const* xss, size_t size,
+                             size_t* nwritten, std::vector<LogicAddr>* rescue_points);
+
     /**
      * Closes the session. This method should unload all cached trees
      */
@@ -5,6 +5,11 @@
 #include <algorithm>
 #include <iostream>
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#define AKU_VBYTE_SIMD_DECODER
+#include <tmmintrin.h>
+#endif
+
 namespace Akumuli {
 
 SimplePredictor::SimplePredictor(size_t) : last_value(0) {}
@@ -54,6 +59,126 @@ void DfcmPredictor::update(u64 value) {
     last_value = value;
 }
 
+// ////////////////////////// //
+// VByteStreamReader decoders //
+// ////////////////////////// //
+
+/** Decode one pair of values. Control byte contains length of the
+  * first value in the lower nibble and length of the second value
+  * in the upper nibble.
+  */
+static inline const u8* vbyte_decode_pair(const u8* pos, const u8* end, u8 ctrl, u64* dest) {
+    int lens[] = { ctrl & 0xF, ctrl >> 4 };
+    for (int j = 0; j < 2; j++) {
+        if (lens[j] > 8 || end - pos < lens[j]) {
+            AKU_PANIC("can't read value, out of bounds");
+        }
+        u64 acc = 0;
+        for(int i = 0; i < lens[j]*8; i += 8) {
+            u64 byte = *pos;
+            acc |= (byte << i);
+            pos++;
+        }
+        dest[j] = acc;
+    }
+    return pos;
+}
+
+//! Decode 16 values (8 control bytes) using scalar code
+static const u8* vbyte_decode_chunk_scalar(const u8* pos, const u8* end, u8 ctrl, u64* dest) {
+    for (int i = 0; i < VByteStreamReader::CHUNK_SIZE; i += 2) {
+        if (i != 0) {
+            if (pos == end) {
+                AKU_PANIC("can't read value, out of bounds");
+            }
+            ctrl = *pos++;
+        }
+        pos = vbyte_decode_pair(pos, end, ctrl, dest + i);
+    }
+    return pos;
+}
+
+#ifdef AKU_VBYTE_SIMD_DECODER
+
+/** Shuffle masks for the SSSE3 decoder. Every control byte corresponds
+  * to the mask that moves bytes of both values of the pair into
+  * two 64-bit lanes of the xmm register.
+  */
+struct VByteShuffleTable {
+    union {
+        __m128i  vec;
+        u8       bytes[16];
+    } masks[256];
+
+    VByteShuffleTable() {
+        for (int ctrl = 0; ctrl < 256; ctrl++) {
+            int lo = ctrl & 0xF;
+            int hi = ctrl >> 4;
+            for (int i = 0; i < 8; i++) {
+                masks[ctrl].bytes[i]     = static_cast<u8>(i < lo ? i      : 0x80);
+                masks[ctrl].bytes[i + 8] = static_cast<u8>(i < hi ? lo + i : 0x80);
+            }
+        }
+    }
+};
+
+static const VByteShuffleTable VBYTE_SHUFFLE_TABLE;
+
+//! Decode 16 values (8 control bytes) using SSSE3 `pshufb` instruction
+__attribute__((target("ssse3")))
+static const u8* vbyte_decode_chunk_ssse3(const u8* pos, const u8* end, u8 ctrl, u64* dest) {
+    for (int i = 0; i < VByteStreamReader::CHUNK_SIZE; i += 2) {
+        if (i != 0) {
+            if (pos == end) {
+                AKU_PANIC("can't read value, out of bounds");
+            }
+            ctrl = *pos++;
+        }
+        int lo = ctrl & 0xF;
+        int hi = ctrl >> 4;
+        if (lo > 8 || hi > 8 || end - pos < 16) {
+            // Corrupted data or the end of the buffer is near, 16-byte load is not safe
+            pos = vbyte_decode_pair(pos, end, ctrl, dest + i);
+            continue;
+        }
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        __m128i res  = _mm_shuffle_epi8(data, VBYTE_SHUFFLE_TABLE.masks[ctrl].vec);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), res);
+        pos += lo + hi;
+    }
+    return pos;
+}
+
+#endif
+
+typedef const u8* (*vbyte_decode_chunk_t)(const u8* pos, const u8* end, u8 ctrl, u64* dest);
+
+static vbyte_decode_chunk_t choose_vbyte_decoder() {
+#ifdef AKU_VBYTE_SIMD_DECODER
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) {
+        return &vbyte_decode_chunk_ssse3;
+    }
+#endif
+    return &vbyte_decode_chunk_scalar;
+}
+
+static const vbyte_decode_chunk_t vbyte_decode_chunk = choose_vbyte_decoder();
+
+void VByteStreamReader::next_chunk(u64* dest) {
+    assert(cnt_ % CHUNK_SIZE == 0);
+    u8 ctrl = read_raw<u8>();
+    if ((ctrl >> 4) == 0xF) {
+        // Shortcut, all values are zero
+        std::fill(dest, dest + CHUNK_SIZE, 0ull);
+    } else {
+        pos_ = vbyte_decode_chunk(pos_, end_, ctrl, dest);
+    }
+    ctrl_ = ctrl;
+    scut_elements_ = 0;
+    cnt_ += CHUNK_SIZE;
+}
+
 
 namespace StorageEngine {
 
@@ -224,6 +349,37 @@ std::tuple<aku_Status, aku_Timestamp, double> DataBlockReader::next() {
     return std::make_tuple(AKU_ENO_DATA, 0ull, 0.0);
 }
 
+std::tuple<aku_Status, u32> DataBlockReader::read_chunk(aku_Timestamp* destts, double* destxs) {
+    u32 main_size = get_main_size(begin_);
+    if (read_index_ < main_size && (read_index_ & CHUNK_MASK) == 0) {
+        ts_stream_.read_chunk(destts);
+        val_stream_.read_chunk(destxs);
+        read_index_ += CHUNK_SIZE;
+        return std::make_tuple(AKU_SUCCESS, static_cast<u32>(CHUNK_SIZE));
+    }
+    // Unaligned position or tail elements
+    aku_Status status = AKU_SUCCESS;
+    u32 n = 0;
+    while (n < CHUNK_SIZE) {
+        aku_Timestamp ts;
+        double xs;
+        std::tie(status, ts, xs) = next();
+        if (status != AKU_SUCCESS) {
+            break;
+        }
+        destts[n] = ts;
+        destxs[n] = xs;
+        n++;
+        if (read_index_ < main_size && (read_index_ & CHUNK_MASK) == 0) {
+            break;
+        }
+    }
+    if (n != 0) {
+        status = AKU_SUCCESS;
+    }
+    return std::make_tuple(status, n);
+}
+
 size_t DataBlockReader::nelements() const {
     return get_total_size(begin_);
 }
@@ -704,6 +704,12 @@ struct VByteStreamReader {
         return acc;
     }
 
+    /** Decode CHUNK_SIZE values at once. Should be called only
+      * on chunk boundary (when all values of the previous chunk
+      * were read). Uses SIMD kernel if it's supported by the CPU.
+      */
+    void next_chunk(u64* dest);
+
     template <class TVal> TVal next_base128() {
         Base128Int<TVal> value;
         auto             p = value.get(pos_, end_);
@@ -793,6 +799,13 @@ struct IOVecVByteStreamReader {
         return acc;
     }
 
+    //! Decode CHUNK_SIZE values at once
+    void next_chunk(u64* dest) {
+        for (int i = 0; i < CHUNK_SIZE; i++) {
+            dest[i] = next<u64>();
+        }
+    }
+
     template <class TVal> TVal next_base128() {
         Base128Int<TVal> value;
         auto p = value.get(block_, pos_);
@@ -895,6 +908,22 @@ struct DeltaDeltaStreamReader {
         return value;
     }
 
+    /** Read `Step` values at once. Should be called only on chunk
+      * boundary (when all values of the previous chunk were read).
+      */
+    void read_chunk(TVal* dest) {
+        assert(counter_ % Step == 0);
+        min_ = stream_.template next_base128<TVal>();
+        stream_.next_chunk(dest);
+        TVal prev = prev_;
+        for (size_t i = 0; i < Step; i++) {
+            prev   += dest[i] + min_;
+            dest[i] = prev;
+        }
+        prev_     = prev;
+        counter_ += static_cast<int>(Step);
+    }
+
     const unsigned char* pos() const { return stream_.pos(); }
 };
 
@@ -1207,6 +1236,40 @@ struct FcmStreamReader {
         return curr.real;
     }
 
+    /** Read 16 values at once. Should be called only on chunk
+      * boundary (when all values of the previous chunk were read).
+      */
+    void read_chunk(double* dest) {
+        assert(iter_ % 2 == 0 && nzeroes_ == 0);
+        union {
+            u64 bits;
+            double real;
+        } curr = {};
+        u8 flags = stream_.template read_raw<u8>();
+        if (flags == 0xFF) {
+            // Shortcut, all diffs are zero
+            for (int i = 0; i < 16; i++) {
+                curr.bits = predictor_.predict_next();
+                predictor_.update(curr.bits);
+                dest[i] = curr.real;
+            }
+        } else {
+            for (int i = 0; i < 16; i += 2) {
+                if (i != 0) {
+                    flags = stream_.template read_raw<u8>();
+                }
+                curr.bits = predictor_.predict_next() ^ decode_value(stream_, flags >> 4);
+                predictor_.update(curr.bits);
+                dest[i] = curr.real;
+                curr.bits = predictor_.predict_next() ^ decode_value(stream_, flags & 0xF);
+                predictor_.update(curr.bits);
+                dest[i + 1] = curr.real;
+            }
+            flags_ = flags;
+        }
+        iter_ += 16;
+    }
+
     const u8* pos() const { return stream_.pos(); }
 
 };
@@ -1277,6 +1340,16 @@ struct DataBlockReader {
 
     std::tuple<aku_Status, aku_Timestamp, double> next();
 
+    /** Read up to CHUNK_SIZE elements at once.
+      * Whole chunk is decoded in one go if the reader is positioned
+      * at the chunk boundary, otherwise elements are read one by one
+      * until the next chunk boundary is reached or the block ends.
+      * @param destts is a buffer that can fit CHUNK_SIZE timestamps
+      * @param destxs is a buffer that can fit CHUNK_SIZE values
+      * @return status and number of elements being read
+      */
+    std::tuple<aku_Status, u32> read_chunk(aku_Timestamp* destts, double* destxs);
+
     size_t nelements() const;
 
     aku_ParamId get_id() const;
@@ -1545,6 +1618,37 @@ struct IOVecBlockReader {
         return std::make_tuple(AKU_ENO_DATA, 0ull, 0.0);
     }
 
+    //! Read up to CHUNK_SIZE elements at once (see DataBlockReader::read_chunk)
+    std::tuple<aku_Status, u32> read_chunk(aku_Timestamp* destts, double* destxs) {
+        u32 main_size = get_main_size(begin_);
+        if (read_index_ < main_size && (read_index_ & CHUNK_MASK) == 0) {
+            ts_stream_.read_chunk(destts);
+            val_stream_.read_chunk(destxs);
+            read_index_ += CHUNK_SIZE;
+            return std::make_tuple(AKU_SUCCESS, static_cast<u32>(CHUNK_SIZE));
+        }
+        aku_Status status = AKU_SUCCESS;
+        u32 n = 0;
+        while (n < CHUNK_SIZE) {
+            aku_Timestamp ts;
+            double xs;
+            std::tie(status, ts, xs) = next();
+            if (status != AKU_SUCCESS) {
+                break;
+            }
+            destts[n] = ts;
+            destxs[n] = xs;
+            n++;
+            if (read_index_ < main_size && (read_index_ & CHUNK_MASK) == 0) {
+                break;
+            }
+        }
+        if (n != 0) {
+            status = AKU_SUCCESS;
+        }
+        return std::make_tuple(status, n);
+    }
+
     size_t nelements() const {
         return get_total_size(begin_);
     }
@@ -7,6 +7,7 @@
 #include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
 #include <chrono>
+#include <algorithm>
 
 namespace Akumuli {
 
@@ -291,6 +292,38 @@ aku_Status LZ4Volume::append(u64 id, u64 timestamp, double value) {
     return AKU_SUCCESS;
 }
 
+aku_Status LZ4Volume::append(const u64* ids, const u64* tss, const double* xss, u32 size) {
+    u32 pos = 0;
+    while (pos < size) {
+        auto status = require_frame_type(FrameType::DATA_ENTRY);
+        if (status != AKU_SUCCESS) {
+            return status;
+        }
+        Frame& frame = frames_[pos_];
+        u32 nitems = std::min(size - pos, static_cast<u32>(NUM_TUPLES) - frame.data_points.size);
+        std::copy(ids + pos, ids + pos + nitems, frame.data_points.ids + frame.data_points.size);
+        std::copy(tss + pos, tss + pos + nitems, frame.data_points.tss + frame.data_points.size);
+        std::copy(xss + pos, xss + pos + nitems, frame.data_points.xss + frame.data_points.size);
+        for (u32 i = pos; i < pos + nitems; i++) {
+            bitmap_->add(ids[i]);
+        }
+        frame.data_points.size += nitems;
+        pos += nitems;
+        if (frame.data_points.size == NUM_TUPLES) {
+            status = write(pos_);
+            if (status != AKU_SUCCESS) {
+                return status;
+            }
+            pos_ = (pos_ + 1) % 2;
+            clear(pos_);
+        }
+    }
+    if(file_size_ >= max_file_size_) {
+        return AKU_EOVERFLOW;
+    }
+    return AKU_SUCCESS;
+}
+
 struct MutableEntry : LZ4Volume::Frame::FlexibleEntry {
     union Bits {
         u64 value;
@@ -671,6 +704,7 @@ void InputLog::delete_files() {
         Logger::msg(AKU_LOG_INFO, std::string("Delete ") + it->get_path());
         it->delete_file();
     }
+    release_retired();
 }
 
 void InputLog::detect_stale_ids(std::vector<u64>* stale_ids) {
@@ -696,6 +730,14 @@ aku_Status InputLog::append(u64 id, u64 timestamp, double value, std::vector<u64
     return result;
 }
 
+aku_Status InputLog::append(const u64* ids, const u64* tss, const double* xss, u32 size, std::vector<u64>* stale_ids) {
+    aku_Status result = volumes_.front()->append(ids, tss, xss, size);
+    if (result == AKU_EOVERFLOW && volumes_.size() == max_volumes_) {
+        detect_stale_ids(stale_ids);
+    }
+    return result;
+}
+
 aku_Status InputLog::append(u64 id, const char* sname, u32 len, std::vector<u64>* stale_ids) {
     aku_Status result = volumes_.front()->append(id, sname, len);
     if (result == AKU_EOVERFLOW && volumes_.size() == max_volumes_) {
@@ -782,6 +824,33 @@ void InputLog::rotate() {
     }
 }
 
+void InputLog::rotate_deferred() {
+    if (volumes_.size() >= max_volumes_) {
+        auto volume = std::move(volumes_.back());
+        volumes_.pop_back();
+        Logger::msg(AKU_LOG_INFO, std::string("Retire volume ") + volume->get_path());
+        retired_.push_back(std::move(volume));
+    }
+    std::string path = get_volume_name();
+    add_volume(path);
+    if (volumes_.size() > 1) {
+        volumes_.at(1)->close();
+    }
+}
+
+void InputLog::release_retired() {
+    while (!retired_.empty()) {
+        auto volume = std::move(retired_.front());
+        retired_.pop_front();
+        volume->delete_file();
+        Logger::msg(AKU_LOG_INFO, std::string("Remove volume ") + volume->get_path());
+    }
+}
+
+size_t InputLog::retired_count() const {
+    return retired_.size();
+}
+
 aku_Status InputLog::flush(std::vector<u64>* stale_ids) {
     if (volumes_.empty()) {
         return AKU_SUCCESS;
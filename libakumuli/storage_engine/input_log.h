@@ -192,6 +192,7 @@ public:
     size_t file_size() const;
 
     aku_Status append(u64 id, u64 timestamp, double value);
+    aku_Status append(const u64* ids, const u64* tss, const double* xss, u32 size);
     aku_Status append(u64 id, const char* sname, u32 len);
     aku_Status append(u64 id, const u64* recovery_array, u32 len);
 
@@ -227,6 +228,8 @@ public:
 class InputLog {
     typedef boost::filesystem::path Path;
     std::deque<std::unique_ptr<LZ4Volume>> volumes_;
+    //! Volumes that left the log but can't be deleted yet
+    std::deque<std::unique_ptr<LZ4Volume>> retired_;
     Path root_dir_;
     size_t volume_counter_;
     const size_t max_volumes_;
@@ -274,6 +277,8 @@ public:
       * input log on next rotation. Rotation should be triggered manually.
       */
     aku_Status append(u64 id, u64 timestamp, double value, std::vector<u64>* stale_ids);
+    //! Append several data points at once (same as calling `append` for every data point)
+    aku_Status append(const u64* ids, const u64* tss, const double* xss, u32 size, std::vector<u64>* stale_ids);
     aku_Status append(u64 id, const char* sname, u32 len, std::vector<u64> *stale_ids);
     aku_Status append(u64 id, const u64* rescue_points, u32 len, std::vector<u64> *stale_ids);
 
@@ -296,6 +301,18 @@ public:
 
     void rotate();
 
+    /** Rotate the log but keep the oldest volume on disk until `release_retired`
+      * is called. Retired volume is not used for stale ids detection but will be
+      * picked up by recovery if the process crashes before it gets released.
+      */
+    void rotate_deferred();
+
+    //! Delete volumes retired by `rotate_deferred`
+    void release_retired();
+
+    //! Return number of retired volumes
+    size_t retired_count() const;
+
     /** Write current frame to disk if it has any data.
      */
     aku_Status flush(std::vector<u64>* stale_ids);
@@ -542,10 +542,17 @@ struct NBTreeSBlockIteratorBase : SeriesOperator<TVal> {
     std::unique_ptr<SeriesOperator<TVal>> iter_;
     u32 fsm_pos_;
     i32 refs_pos_;
+    //! Position of the next ref that should be prefetched
+    i32 prefetch_pos_;
 
     typedef std::unique_ptr<SeriesOperator<TVal>> TIter;
     typedef typename SeriesOperator<TVal>::Direction Direction;
 
+    enum {
+        //! Number of child nodes that should be read ahead
+        PREFETCH_DEPTH = 4,
+    };
+
     NBTreeSBlockIteratorBase(std::shared_ptr<BlockStore> bstore, LogicAddr addr, aku_Timestamp begin, aku_Timestamp end)
         : begin_(begin)
         , end_(end)
@@ -553,6 +560,7 @@ struct NBTreeSBlockIteratorBase : SeriesOperator<TVal> {
         , bstore_(bstore)
         , fsm_pos_(0)
         , refs_pos_(0)
+        , prefetch_pos_(0)
     {
     }
 
@@ -563,6 +571,7 @@ struct NBTreeSBlockIteratorBase : SeriesOperator<TVal> {
         , bstore_(bstore)
         , fsm_pos_(1)  // FSM will bypass `init` step.
         , refs_pos_(0)
+        , prefetch_pos_(0)
     {
         aku_Status status = sblock.read_all(&refs_);
         if (status != AKU_SUCCESS) {
@@ -571,6 +580,8 @@ struct NBTreeSBlockIteratorBase : SeriesOperator<TVal> {
         } else {
             refs_pos_ = begin_ < end_ ? 0 : static_cast<i32>(refs_.size()) - 1;
         }
+        prefetch_pos_ = refs_pos_;
+        prefetch_next();
     }
 
     aku_Status init() {
@@ -583,9 +594,38 @@ struct NBTreeSBlockIteratorBase : SeriesOperator<TVal> {
         NBTreeSuperblock current(block);
         status = current.read_all(&refs_);
         refs_pos_ = begin_ < end_ ? 0 : static_cast<i32>(refs_.size()) - 1;
+        prefetch_pos_ = refs_pos_;
+        if (status == AKU_SUCCESS) {
+            prefetch_next();
+        }
         return status;
     }
 
+    /** Ask blockstore to read ahead PREFETCH_DEPTH child nodes that follow
+      * the current one in iteration order. Nodes that are not in the
+      * search range are skipped. Called when the superblock is opened and
+      * every time the iterator moves to the next child.
+      * Direction is derived from the range directly because the method is
+      * also called from the c-tor.
+      */
+    void prefetch_next() {
+        auto min = std::min(begin_, end_);
+        auto max = std::max(begin_, end_);
+        const i32 step = begin_ < end_ ? 1 : -1;
+        if ((prefetch_pos_ - refs_pos_) * step < 0) {
+            prefetch_pos_ = refs_pos_;
+        }
+        while ((prefetch_pos_ - refs_pos_) * step < PREFETCH_DEPTH &&
+               prefetch_pos_ >= 0 && prefetch_pos_ < static_cast<i32>(refs_.size()))
+        {
+            SubtreeRef const& ref = refs_.at(static_cast<size_t>(prefetch_pos_));
+            if (subtree_in_range(ref, min, max)) {
+                bstore_->prefetch(ref.addr);
+            }
+            prefetch_pos_ += step;
+        }
+    }
+
     //! Create leaf iterator (used by `get_next_iter` template method).
     virtual std::tuple<aku_Status, TIter> make_leaf_iterator(const SubtreeRef &ref) = 0;
 
@@ -615,6 +655,7 @@ struct NBTreeSBlockIteratorBase : SeriesOperator<TVal> {
             ref = refs_.at(static_cast<size_t>(refs_pos_));
             refs_pos_--;
         }
+        prefetch_next();
         std::tuple<aku_Status, TIter> result;
         if (!bstore_->exists(ref.addr)) {
             return std::make_tuple(AKU_EUNAVAILABLE, std::move(empty));
@@ -1191,35 +1232,7 @@ std::tuple<aku_Status, size_t> NBTreeLeafGroupAggregator::read(aku_Timestamp *de
             return std::make_tuple(AKU_ENO_DATA, 0);
         }
         assert(out_size == size_hint);
-        int valcnt = 0;
-        AggregationResult outval = INIT_AGGRES;
-        const bool forward = begin_ < end_;
-        u64 bin = 0;
-        for (size_t ix = 0; ix < out_size; ix++) {
-            aku_Timestamp normts = forward ? ts[ix] - begin_
-                                           : begin_ - ts[ix];
-            if (valcnt == 0) {
-                bin = normts / step_;
-            } else if (normts / step_ != bin) {
-                bin = normts / step_;
-                destxs[outix] = outval;
-                destts[outix] = outval._begin;
-                outix++;
-                outval = INIT_AGGRES;
-            }
-            valcnt++;
-            outval.add(ts[ix], xs[ix], forward);
-            // Check invariant
-            auto delta = outval._end - outval._begin;
-            if (delta > step_) {
-                assert(delta <= step_);
-            }
-        }
-        if (outval.cnt > 0) {
-            destxs[outix] = outval;
-            destts[outix] = outval._begin;
-            outix++;
-        }
+        outix = aggregate_by_step(ts.data(), xs.data(), out_size, begin_, end_, step_, destts, destxs);
     }
     assert(outix <= size);
     return std::make_tuple(AKU_SUCCESS, outix);
@@ -1727,18 +1740,20 @@ aku_Status NBTreeLeaf::read_all(std::vector<aku_Timestamp>* timestamps,
     int windex = writer_.get_write_index();
     DataBlockReader reader(block_->get_cdata() + sizeof(SubtreeRef), block_->get_size());
     size_t sz = reader.nelements();
-    timestamps->reserve(sz);
-    values->reserve(sz);
-    for (size_t ix = 0; ix < sz; ix++) {
+    size_t pos = timestamps->size();
+    timestamps->resize(pos + sz);
+    values->resize(pos + sz);
+    // Decode data chunk by chunk
+    while (pos < timestamps->size()) {
         aku_Status status;
-        aku_Timestamp ts;
-        double value;
-        std::tie(status, ts, value) = reader.next();
+        u32 nread;
+        std::tie(status, nread) = reader.read_chunk(timestamps->data() + pos, values->data() + pos);
         if (status != AKU_SUCCESS) {
+            timestamps->resize(pos);
+            values->resize(pos);
             return status;
         }
-        timestamps->push_back(ts);
-        values->push_back(value);
+        pos += nread;
     }
     // Read tail elements from `writer_`
     if (windex != 0) {
@@ -2060,18 +2075,20 @@ aku_Status IOVecLeaf::read_all(std::vector<aku_Timestamp>* timestamps,
     int windex = writer_.get_write_index();
     IOVecBlockReader<IOVecBlock> reader(block_.get(), static_cast<u32>(sizeof(SubtreeRef)));
     size_t sz = reader.nelements();
-    timestamps->reserve(sz);
-    values->reserve(sz);
-    for (size_t ix = 0; ix < sz; ix++) {
+    size_t pos = timestamps->size();
+    timestamps->resize(pos + sz);
+    values->resize(pos + sz);
+    // Decode data chunk by chunk
+    while (pos < timestamps->size()) {
         aku_Status status;
-        aku_Timestamp ts;
-        double value;
-        std::tie(status, ts, value) = reader.next();
+        u32 nread;
+        std::tie(status, nread) = reader.read_chunk(timestamps->data() + pos, values->data() + pos);
         if (status != AKU_SUCCESS) {
+            timestamps->resize(pos);
+            values->resize(pos);
             return status;
         }
-        timestamps->push_back(ts);
-        values->push_back(value);
+        pos += nread;
     }
     // Read tail elements from `writer_`
     if (windex != 0) {
@@ -3530,6 +3547,17 @@ std::tuple<size_t, size_t> NBTreeExtentsList::bytes_used() const {
     return std::make_tuple(c1, c2);
 }
 
+std::tuple<u64, size_t> NBTreeExtentsList::get_activity() const {
+    SharedLock lock(lock_);
+    size_t bytes = 0;
+    if (initialized_) {
+        size_t c1, c2;
+        std::tie(c1, c2) = bytes_used();
+        bytes = c1 + c2;
+    }
+    return std::make_tuple(write_count_, bytes);
+}
+
 void NBTreeExtentsList::force_init() {
     UniqueLock lock(lock_);
     if (!initialized_) {
@@ -3537,6 +3565,24 @@ void NBTreeExtentsList::force_init() {
     }
 }
 
+void NBTreeExtentsList::attach_rollup(std::unique_ptr<NBTreeRollup> rollup) {
+    UniqueLock lock(lock_);
+    rollup_ = std::move(rollup);
+}
+
+void NBTreeExtentsList::catch_up_rollup() {
+    UniqueLock lock(lock_);
+    if (!initialized_) {
+        init();
+    }
+    if (!rollup_ || rollup_->is_ready()) {
+        return;
+    }
+    rollup_->catch_up([this](aku_Timestamp begin, aku_Timestamp end, aku_Timestamp step) {
+        return _group_aggregate(begin, end, step);
+    }, id_, AKU_MAX_TIMESTAMP);
+}
+
 size_t NBTreeExtentsList::_get_uncommitted_size() const {
     if (!extents_.empty()) {
         auto leaf = dynamic_cast<NBTreeLeafExtent const*>(extents_.front().get());
@@ -3736,9 +3782,35 @@ NBTreeAppendResult NBTreeExtentsList::append(aku_Timestamp ts, double value, boo
     if (!initialized_) {
         init();
     }
+    return append_nolock(ts, value, allow_duplicate_timestamps);
+}
+
+std::tuple<NBTreeAppendResult, size_t> NBTreeExtentsList::append(aku_Timestamp const* tss, double const* xss, size_t size) {
+    UniqueLock lock(lock_);
+    if (!initialized_) {
+        init();
+    }
+    auto result = NBTreeAppendResult::OK;
+    size_t i = 0;
+    for (; i < size; i++) {
+        auto res = append_nolock(tss[i], xss[i], true);
+        if (res == NBTreeAppendResult::FAIL_LATE_WRITE) {
+            break;
+        }
+        if (res == NBTreeAppendResult::OK_FLUSH_NEEDED) {
+            result = res;
+        }
+    }
+    return std::make_tuple(result, i);
+}
+
+NBTreeAppendResult NBTreeExtentsList::append_nolock(aku_Timestamp ts, double value, bool allow_duplicate_timestamps) {
     if (allow_duplicate_timestamps ? ts < last_ : ts <= last_) {
         return NBTreeAppendResult::FAIL_LATE_WRITE;
     }
+    if (rollup_) {
+        rollup_->append(*this, ts, value);
+    }
     last_ = ts;
     write_count_++;
     if (extents_.size() == 0) {
@@ -4095,6 +4167,16 @@ std::unique_ptr<AggregateOperator> NBTreeExtentsList::group_aggregate(aku_Timest
         const_cast<NBTreeExtentsList*>(this)->force_init();
     }
     SharedLock lock(lock_);
+    if (rollup_) {
+        auto result = rollup_->group_aggregate(*this, begin, end, step);
+        if (result) {
+            return result;
+        }
+    }
+    return _group_aggregate(begin, end, step);
+}
+
+std::unique_ptr<AggregateOperator> NBTreeExtentsList::_group_aggregate(aku_Timestamp begin, aku_Timestamp end, aku_Timestamp step) const {
     std::vector<std::unique_ptr<AggregateOperator>> iterators;
     if (begin < end) {
         for (auto it = extents_.rbegin(); it != extents_.rend(); it++) {
@@ -4189,6 +4271,11 @@ std::vector<LogicAddr> NBTreeExtentsList::get_roots() const {
     return rescue_points_;
 }
 
+void NBTreeExtentsList::get_roots(std::vector<LogicAddr>* out) const {
+    SharedLock lock(lock_);
+    out->assign(rescue_points_.begin(), rescue_points_.end());
+}
+
 std::vector<LogicAddr> NBTreeExtentsList::_get_roots() const {
     return rescue_points_;
 }
@@ -4249,4 +4336,520 @@ void NBTreeExtentsList::debug_print(LogicAddr root, std::shared_ptr<BlockStore>
     }
 }
 
+// ////////////// //
+//  NBTreeRollup  //
+// ////////////// //
+
+/** Group-aggregate operator that combines closed buckets of the rollup tier
+  * with the group-aggregate computed from the raw series. Raw series is used
+  * for the range that isn't covered by the tier yet and for the tier buckets
+  * that cross the boundary of the output bucket (if the query range is not
+  * aligned to the tier). Both inputs are ordered by time, every element is
+  * contained by one output bucket.
+  */
+class NBTreeRollupGroupAggregator : public AggregateOperator {
+public:
+    enum {
+        RDBUF_SIZE = 0x100,
+    };
+private:
+    const aku_Timestamp tier_;
+    const aku_Timestamp begin_;
+    const aku_Timestamp step_;
+    //! Offset of the output buckets inside the tier buckets
+    const aku_Timestamp offset_;
+    //! Encoded buckets read from the tier column
+    std::unique_ptr<RealValuedOperator> fields_;
+    //! Parts of the range computed from the raw series (ordered by time)
+    std::vector<std::unique_ptr<AggregateOperator>> raw_;
+    size_t raw_ix_;
+    std::vector<aku_Timestamp> fieldts_;
+    std::vector<double> fieldxs_;
+    std::vector<aku_Timestamp> rawts_;
+    std::vector<AggregationResult> rawxs_;
+    size_t fieldpos_;
+    size_t fieldsize_;
+    size_t rawpos_;
+    size_t rawsize_;
+    bool fields_done_;
+    // Bucket that is being decoded
+    aku_Timestamp curr_;
+    int nfields_;
+    double curr_fields_[NBTreeRollup::NFIELDS];
+    // Output bucket
+    bool has_bucket_;
+    u64 bucket_ix_;
+    AggregationResult bucket_;
+    // Lookahead
+    bool has_tier_;
+    aku_Timestamp tier_ts_;
+    AggregationResult tier_agg_;
+    bool has_raw_;
+    aku_Timestamp raw_ts_;
+    AggregationResult raw_agg_;
+    bool has_next_;
+    aku_Timestamp next_ts_;
+    AggregationResult next_;
+
+    AggregationResult decode() const {
+        AggregationResult res;
+        res.cnt    = curr_fields_[NBTreeRollup::CNT];
+        res.sum    = curr_fields_[NBTreeRollup::SUM];
+        res.min    = curr_fields_[NBTreeRollup::MIN];
+        res.max    = curr_fields_[NBTreeRollup::MAX];
+        res.first  = curr_fields_[NBTreeRollup::FIRST];
+        res.last   = curr_fields_[NBTreeRollup::LAST];
+        res.mints  = curr_ + static_cast<aku_Timestamp>(curr_fields_[NBTreeRollup::MINTS]);
+        res.maxts  = curr_ + static_cast<aku_Timestamp>(curr_fields_[NBTreeRollup::MAXTS]);
+        res._begin = curr_ + static_cast<aku_Timestamp>(curr_fields_[NBTreeRollup::BEGIN]);
+        res._end   = curr_ + static_cast<aku_Timestamp>(curr_fields_[NBTreeRollup::END]);
+        return res;
+    }
+
+    //! Check if the tier bucket contains the boundary of the output bucket
+    bool is_split(aku_Timestamp bucket) const {
+        return offset_ != 0 && (bucket + offset_ - begin_) % step_ == 0;
+    }
+
+    //! Read next tier bucket
+    aku_Status fetch_tier(aku_Timestamp* ts, AggregationResult* agg) {
+        while (!fields_done_) {
+            if (fieldpos_ == fieldsize_) {
+                aku_Status status;
+                size_t size;
+                std::tie(status, size) = fields_->read(fieldts_.data(), fieldxs_.data(), RDBUF_SIZE);
+                if (status != AKU_SUCCESS && status != AKU_ENO_DATA) {
+                    return status;
+                }
+                fieldpos_  = 0;
+                fieldsize_ = size;
+                if (size == 0) {
+                    fields_done_ = true;
+                    break;
+                }
+                continue;
+            }
+            auto fieldts = fieldts_[fieldpos_];
+            auto fieldxs = fieldxs_[fieldpos_];
+            fieldpos_++;
+            auto field  = fieldts % tier_;
+            auto bucket = fieldts - field;
+            if (field == 0) {
+                curr_    = bucket;
+                nfields_ = 0;
+            }
+            if (bucket != curr_ || field != static_cast<aku_Timestamp>(nfields_)) {
+                // Incomplete bucket (tier column was not closed properly), skip it
+                nfields_ = -1;
+                continue;
+            }
+            curr_fields_[nfields_++] = fieldxs;
+            if (nfields_ == NBTreeRollup::NFIELDS) {
+                nfields_ = -1;
+                if (is_split(curr_)) {
+                    // Computed from the raw series
+                    continue;
+                }
+                *ts  = curr_;
+                *agg = decode();
+                return AKU_SUCCESS;
+            }
+        }
+        return AKU_ENO_DATA;
+    }
+
+    //! Read next element computed from the raw series
+    aku_Status fetch_raw(aku_Timestamp* ts, AggregationResult* agg) {
+        while (raw_ix_ < raw_.size()) {
+            if (rawpos_ == rawsize_) {
+                aku_Status status;
+                size_t size;
+                std::tie(status, size) = raw_[raw_ix_]->read(rawts_.data(), rawxs_.data(), RDBUF_SIZE);
+                if (status != AKU_SUCCESS && status != AKU_ENO_DATA) {
+                    return status;
+                }
+                rawpos_  = 0;
+                rawsize_ = size;
+                if (size == 0) {
+                    raw_[raw_ix_].reset();
+                    raw_ix_++;
+                }
+                continue;
+            }
+            *ts  = rawts_[rawpos_];
+            *agg = rawxs_[rawpos_];
+            rawpos_++;
+            return AKU_SUCCESS;
+        }
+        return AKU_ENO_DATA;
+    }
+
+    //! Read next element from any of the inputs (in time order)
+    aku_Status fetch(aku_Timestamp* ts, AggregationResult* agg) {
+        if (!has_tier_) {
+            auto status = fetch_tier(&tier_ts_, &tier_agg_);
+            if (status != AKU_SUCCESS && status != AKU_ENO_DATA) {
+                return status;
+            }
+            has_tier_ = status == AKU_SUCCESS;
+        }
+        if (!has_raw_) {
+            auto status = fetch_raw(&raw_ts_, &raw_agg_);
+            if (status != AKU_SUCCESS && status != AKU_ENO_DATA) {
+                return status;
+            }
+            has_raw_ = status == AKU_SUCCESS;
+        }
+        if (has_tier_ && (!has_raw_ || tier_ts_ < raw_ts_)) {
+            *ts  = tier_ts_;
+            *agg = tier_agg_;
+            has_tier_ = false;
+            return AKU_SUCCESS;
+        }
+        if (has_raw_) {
+            *ts  = raw_ts_;
+            *agg = raw_agg_;
+            has_raw_ = false;
+            return AKU_SUCCESS;
+        }
+        return AKU_ENO_DATA;
+    }
+
+public:
+    NBTreeRollupGroupAggregator(aku_Timestamp tier,
+                                aku_Timestamp begin,
+                                aku_Timestamp step,
+                                std::unique_ptr<RealValuedOperator>&& fields,
+                                std::vector<std::unique_ptr<AggregateOperator>>&& raw)
+        : tier_(tier)
+        , begin_(begin)
+        , step_(step)
+        , offset_(begin % tier)
+        , fields_(std::move(fields))
+        , raw_(std::move(raw))
+        , raw_ix_(0)
+        , fieldts_(RDBUF_SIZE)
+        , fieldxs_(RDBUF_SIZE)
+        , rawts_(RDBUF_SIZE)
+        , rawxs_(RDBUF_SIZE)
+        , fieldpos_(0)
+        , fieldsize_(0)
+        , rawpos_(0)
+        , rawsize_(0)
+        , fields_done_(false)
+        , curr_(0)
+        , nfields_(-1)
+        , has_bucket_(false)
+        , bucket_ix_(0)
+        , bucket_(INIT_AGGRES)
+        , has_tier_(false)
+        , tier_ts_(0)
+        , tier_agg_(INIT_AGGRES)
+        , has_raw_(false)
+        , raw_ts_(0)
+        , raw_agg_(INIT_AGGRES)
+        , has_next_(false)
+        , next_ts_(0)
+        , next_(INIT_AGGRES)
+    {
+    }
+
+    virtual std::tuple<aku_Status, size_t> read(aku_Timestamp *destts, AggregationResult *destval, size_t size) {
+        if (size == 0) {
+            return std::make_tuple(AKU_EBAD_ARG, 0);
+        }
+        size_t outsz = 0;
+        while (outsz < size) {
+            if (!has_next_) {
+                auto status = fetch(&next_ts_, &next_);
+                if (status == AKU_ENO_DATA) {
+                    if (has_bucket_) {
+                        destts[outsz]  = begin_ + bucket_ix_ * step_;
+                        destval[outsz] = bucket_;
+                        outsz++;
+                        has_bucket_ = false;
+                    }
+                    break;
+                }
+                if (status != AKU_SUCCESS) {
+                    return std::make_tuple(status, outsz);
+                }
+                has_next_ = true;
+            }
+            u64 ix = (next_ts_ - begin_) / step_;
+            if (has_bucket_ && ix != bucket_ix_) {
+                destts[outsz]  = begin_ + bucket_ix_ * step_;
+                destval[outsz] = bucket_;
+                outsz++;
+                has_bucket_ = false;
+                continue;
+            }
+            if (has_bucket_) {
+                bucket_.combine(next_);
+            } else {
+                bucket_     = next_;
+                bucket_ix_  = ix;
+                has_bucket_ = true;
+            }
+            has_next_ = false;
+        }
+        return std::make_tuple(outsz == 0 ? AKU_ENO_DATA : AKU_SUCCESS, outsz);
+    }
+
+    virtual Direction get_direction() {
+        return Direction::FORWARD;
+    }
+};
+
+
+NBTreeRollup::NBTreeRollup(std::vector<std::tuple<aku_Timestamp, std::shared_ptr<NBTreeExtentsList>>> tiers,
+                           NBTreeRollupListener* listener)
+    : ready_(false)
+    , requested_(false)
+    , listener_(listener)
+{
+    for (auto const& it: tiers) {
+        Tier tier;
+        tier.step      = std::get<0>(it);
+        tier.column    = std::get<1>(it);
+        tier.watermark = 0;
+        tier.bucket    = 0;
+        tier.acc       = INIT_AGGRES;
+        if (tier.step < NFIELDS) {
+            AKU_PANIC("Rollup tier is too small");
+        }
+        tiers_.push_back(std::move(tier));
+    }
+}
+
+aku_ParamId NBTreeRollup::get_tier_id(aku_ParamId id, u32 tier) {
+    return id | (static_cast<aku_ParamId>(tier + 1) << TIER_ID_SHIFT);
+}
+
+bool NBTreeRollup::is_tier_id(aku_ParamId id) {
+    return (id >> TIER_ID_SHIFT) != 0;
+}
+
+void NBTreeRollup::write_bucket(Tier& tier, aku_Timestamp bucket, AggregationResult const& agg, int first_field) {
+    const double fields[NFIELDS] = {
+        agg.cnt,
+        agg.sum,
+        agg.min,
+        agg.max,
+        agg.first,
+        agg.last,
+        static_cast<double>(agg.mints  - bucket),
+        static_cast<double>(agg.maxts  - bucket),
+        static_cast<double>(agg._begin - bucket),
+        static_cast<double>(agg._end   - bucket),
+    };
+    bool flush_needed = false;
+    for (int i = first_field; i < NFIELDS; i++) {
+        auto res = tier.column->append(bucket + static_cast<aku_Timestamp>(i), fields[i]);
+        if (res == NBTreeAppendResult::FAIL_LATE_WRITE) {
+            Logger::msg(AKU_LOG_ERROR, "Can't write rollup bucket " + std::to_string(bucket) +
+                                       " to column " + std::to_string(tier.column->get_id()));
+            break;
+        }
+        if (res == NBTreeAppendResult::OK_FLUSH_NEEDED) {
+            flush_needed = true;
+        }
+    }
+    if (flush_needed && listener_ != nullptr) {
+        // Rescue points of the tier column should be saved the same way as
+        // rescue points of the raw series
+        std::vector<LogicAddr> rpoints;
+        tier.column->get_roots(&rpoints);
+        listener_->on_rescue_points(tier.column->get_id(), rpoints);
+    }
+    tier.watermark = bucket + tier.step;
+}
+
+std::tuple<aku_Timestamp, int> NBTreeRollup::last_bucket(Tier const& tier) {
+    auto it = tier.column->search(AKU_MAX_TIMESTAMP, 0);
+    aku_Timestamp ts;
+    double xs;
+    aku_Status status;
+    size_t size;
+    std::tie(status, size) = it->read(&ts, &xs, 1);
+    if (size == 0) {
+        return std::make_tuple(0ull, 0);
+    }
+    auto field = ts % tier.step;
+    if (field >= NFIELDS) {
+        // Tier column can't contain this value, treat the last bucket as complete
+        return std::make_tuple(ts - field, static_cast<int>(NFIELDS));
+    }
+    return std::make_tuple(ts - field, static_cast<int>(field + 1));
+}
+
+aku_Timestamp NBTreeRollup::stored_watermark(Tier const& tier) {
+    aku_Timestamp bucket;
+    int nfields;
+    std::tie(bucket, nfields) = last_bucket(tier);
+    if (nfields == 0) {
+        return 0;
+    }
+    return nfields == NFIELDS ? bucket + tier.step : bucket;
+}
+
+bool NBTreeRollup::is_ready() const {
+    return ready_;
+}
+
+void NBTreeRollup::catch_up(AggregateFn const& aggregate, aku_ParamId id, aku_Timestamp end) {
+    const bool final = end == AKU_MAX_TIMESTAMP;
+    for (auto& tier: tiers_) {
+        aku_Timestamp last;
+        int nfields;
+        std::tie(last, nfields) = last_bucket(tier);
+        const bool resume = nfields != 0 && nfields != NFIELDS;
+        aku_Timestamp start = 0;
+        if (nfields == NFIELDS) {
+            start = last + tier.step;
+        } else if (resume) {
+            start = last;
+        }
+        // Bucket that contains `end` is not closed yet
+        const aku_Timestamp stop = final ? end : end - end % tier.step;
+        if (start >= stop) {
+            continue;
+        }
+        tier.watermark = start;
+        tier.acc       = INIT_AGGRES;
+        // Every bucket except the last one is closed and should be written
+        // to the tier column, the last one becomes the open bucket.
+        auto it = aggregate(start, stop, tier.step);
+        std::vector<aku_Timestamp> tss(NBTreeRollupGroupAggregator::RDBUF_SIZE);
+        std::vector<AggregationResult> xss(NBTreeRollupGroupAggregator::RDBUF_SIZE);
+        bool has_prev = false;
+        aku_Timestamp prevts = 0;
+        AggregationResult prev = INIT_AGGRES;
+        while (true) {
+            aku_Status status;
+            size_t size;
+            std::tie(status, size) = it->read(tss.data(), xss.data(), tss.size());
+            if (status != AKU_SUCCESS && status != AKU_ENO_DATA) {
+                Logger::msg(AKU_LOG_ERROR, "Can't restore rollup of column " + std::to_string(id) +
+                                           ", error: " + StatusUtil::str(status));
+                break;
+            }
+            for (size_t i = 0; i < size; i++) {
+                if (has_prev) {
+                    write_bucket(tier, prevts, prev, resume && prevts == last ? nfields : 0);
+                }
+                prevts   = tss[i];
+                prev     = xss[i];
+                has_prev = true;
+            }
+            if (size == 0) {
+                break;
+            }
+        }
+        if (has_prev) {
+            if ((resume && prevts == last) || !final) {
+                write_bucket(tier, prevts, prev, resume && prevts == last ? nfields : 0);
+            } else {
+                tier.bucket = prevts;
+                tier.acc    = prev;
+            }
+        } else if (resume && final) {
+            // Raw data of the partially written bucket is not available
+            tier.watermark = last + tier.step;
+        }
+    }
+    if (final) {
+        ready_ = true;
+    }
+}
+
+void NBTreeRollup::append(NBTreeExtentsList const& raw, aku_Timestamp ts, double value) {
+    if (!ready_) {
+        if (!requested_ && listener_ != nullptr) {
+            requested_ = listener_->on_catch_up_needed(raw.get_id());
+        }
+        if (requested_) {
+            // Value will be added to the tiers by the catch-up
+            return;
+        }
+        catch_up([&raw](aku_Timestamp begin, aku_Timestamp end, aku_Timestamp step) {
+            return raw._group_aggregate(begin, end, step);
+        }, raw.get_id(), AKU_MAX_TIMESTAMP);
+    }
+    for (auto& tier: tiers_) {
+        auto bucket = ts - ts % tier.step;
+        if (bucket < tier.watermark) {
+            // Bucket is already written
+            continue;
+        }
+        if (tier.acc.cnt != 0 && bucket != tier.bucket) {
+            write_bucket(tier, tier.bucket, tier.acc, 0);
+            tier.acc = INIT_AGGRES;
+        }
+        if (tier.acc.cnt == 0) {
+            tier.bucket = bucket;
+        }
+        tier.acc.add(ts, value, true);
+    }
+}
+
+std::unique_ptr<AggregateOperator> NBTreeRollup::group_aggregate(NBTreeExtentsList const& raw,
+                                                                 aku_Timestamp begin,
+                                                                 aku_Timestamp end,
+                                                                 aku_Timestamp step) const
+{
+    std::unique_ptr<AggregateOperator> result;
+    if (begin >= end || step == 0) {
+        // Only forward direction is supported
+        return result;
+    }
+    // Tiers are sorted so the last suitable one is the largest. If the range is not
+    // aligned to the tier every output bucket boundary splits one tier bucket, such
+    // buckets are computed from the raw series (the tier should be smaller than the step).
+    Tier const* tier = nullptr;
+    for (auto const& it: tiers_) {
+        if (step % it.step == 0 && (begin % it.step == 0 || step > it.step)) {
+            tier = &it;
+        }
+    }
+    if (tier == nullptr) {
+        return result;
+    }
+    const aku_Timestamp offset = begin % tier->step;
+    if (offset != 0 && (end - begin) / step > MAX_SPLIT_BUCKETS) {
+        return result;
+    }
+    // First tier bucket that starts inside the range
+    const aku_Timestamp first = offset == 0 ? begin : begin - offset + tier->step;
+    auto watermark = ready_ ? tier->watermark : stored_watermark(*tier);
+    auto split = std::min(watermark, end - end % tier->step);
+    if (split <= first) {
+        return result;
+    }
+    auto fields = tier->column->search(first, split);
+    std::vector<std::unique_ptr<AggregateOperator>> rawops;
+    if (begin < first) {
+        rawops.push_back(raw._group_aggregate(begin, first, step));
+    }
+    if (offset != 0) {
+        // Tier buckets that contain the boundary `b` of the output bucket
+        for (aku_Timestamp b = begin + step; b - offset + tier->step <= split; b += step) {
+            rawops.push_back(raw._group_aggregate(b - offset, b, step));
+            rawops.push_back(raw._group_aggregate(b, b - offset + tier->step, step));
+        }
+    }
+    if (split < end) {
+        // The range that is not covered by the tier, split by the output buckets
+        aku_Timestamp next = begin + (split - begin + step - 1) / step * step;
+        if (split < next) {
+            rawops.push_back(raw._group_aggregate(split, std::min(next, end), step));
+        }
+        if (next < end) {
+            rawops.push_back(raw._group_aggregate(next, end, step));
+        }
+    }
+    result.reset(new NBTreeRollupGroupAggregator(tier->step, begin, step, std::move(fields), std::move(rawops)));
+    return result;
+}
+
 }}
@@ -75,6 +75,7 @@
 
 // C++ headers
 #include <deque>
+#include <functional>
 
 // App headers
 #include "nbtree_def.h"
@@ -595,6 +596,8 @@ enum class NBTreeAppendResult {
 };
 
 
+class NBTreeRollup;
+
 /** @brief This class represents set of roots of the NBTree.
   * It serves two purposes:
   * @li store all roots of the NBTree
@@ -610,6 +613,8 @@ class NBTreeExtentsList : public std::enable_shared_from_this<NBTreeExtentsList>
     bool initialized_;
     //! Number of write operations performed on object
     u64 write_count_;
+    //! Pre-computed group-aggregate tiers (can be empty)
+    std::unique_ptr<NBTreeRollup> rollup_;
 
     void open();
 
@@ -634,6 +639,9 @@ class NBTreeExtentsList : public std::enable_shared_from_this<NBTreeExtentsList>
 
     std::tuple<aku_Status, AggregationResult> get_aggregates(u32 ixnode) const;
 
+    //! Append value without locking
+    NBTreeAppendResult append_nolock(aku_Timestamp ts, double value, bool allow_duplicate_timestamps);
+
     void check_rescue_points(u32 i) const;
 public:
 
@@ -660,6 +668,14 @@ public:
       */
     NBTreeAppendResult append(aku_Timestamp ts, double value, bool allow_duplicate_timestamps=true);
 
+    /** Append run of values (in timestamp order) under single lock acquisition.
+      * Values are appended until the first out of order value.
+      * Result is OK or OK_FLUSH_NEEDED (if rescue points list was changed) and the
+      * number of appended values. If this number is less than `size` the value that
+      * follows the last appended one is a late write.
+      */
+    std::tuple<NBTreeAppendResult, size_t> append(aku_Timestamp const* tss, double const* xss, size_t size);
+
     /**
      * @brief search function
      * @param begin is a start of the search interval
@@ -695,6 +711,9 @@ public:
      */
     std::unique_ptr<AggregateOperator> group_aggregate(aku_Timestamp begin, aku_Timestamp end, aku_Timestamp step) const;
 
+    //! Group-aggregate that doesn't use rollup tiers and doesn't lock the tree (only for internal use)
+    std::unique_ptr<AggregateOperator> _group_aggregate(aku_Timestamp begin, aku_Timestamp end, aku_Timestamp step) const;
+
     /**
      * @brief Group values into buckets and return aggregate from each one of them
      * @param begin start of the search interval
@@ -714,6 +733,9 @@ public:
     //! Get roots of the tree
     std::vector<LogicAddr> get_roots() const;
 
+    //! Copy roots of the tree into `out` (reuses the capacity of the vector)
+    void get_roots(std::vector<LogicAddr>* out) const;
+
     //! Get roots of the tree (only for internal use)
     std::vector<LogicAddr> _get_roots() const;
 
@@ -726,6 +748,18 @@ public:
     //! Force lazy initialization process.
     void force_init();
 
+    /** Attach rollup tiers to the tree. All values appended after this
+      * call will be added to the tiers and `group_aggregate` will use
+      * them when possible.
+      */
+    void attach_rollup(std::unique_ptr<NBTreeRollup> rollup);
+
+    /** Restore rollup tiers from the raw series (see NBTreeRollupListener).
+      * Performed under the tree lock, appends to the series wait until
+      * the tiers are restored.
+      */
+    void catch_up_rollup();
+
     bool is_initialized() const;
 
     enum class RepairStatus {
@@ -746,6 +780,154 @@ public:
      *  component is a number of bytes used by inner other nodes.
      */
     std::tuple<size_t, size_t> bytes_used() const;
+
+    /** Report activity of the tree. First component of the tuple is a number of write operations
+      * performed on the object (monotonic), second is a number of bytes used by in-memory nodes
+      * (zero if the tree is not initialized). Thread-safe.
+      */
+    std::tuple<u64, size_t> get_activity() const;
+};
+
+
+/** @brief Receives events of the rollup tiers (implemented by the column store).
+  */
+struct NBTreeRollupListener {
+    virtual ~NBTreeRollupListener() = default;
+
+    /** Called on first append if the tiers are not restored from the raw series.
+      * If the request is accepted `NBTreeExtentsList::catch_up_rollup` should be
+      * called later, values are not added to the tiers until then. Otherwise
+      * the tiers are restored by the append call.
+      * @return true if the request is accepted
+      */
+    virtual bool on_catch_up_needed(aku_ParamId id) = 0;
+
+    //! Called when rescue points of the tier column are changed and should be saved
+    virtual void on_rescue_points(aku_ParamId id, std::vector<LogicAddr> const& rpoints) = 0;
+};
+
+
+/** @brief Pre-computed group-aggregate results (rollup tiers) of the single series.
+  * Every tier splits the time axis into fixed-size buckets aligned to the epoch
+  * (e.g. 1m, 1h, 1d). Aggregate of every bucket is stored in the separate NB+tree
+  * column (one column per tier, so the series with N tiers uses N+1 trees and
+  * every tier has its own rescue points and memory footprint).
+  *
+  * Tier column encoding: the bucket that starts at `bucket` is stored as NFIELDS
+  * values with timestamps `bucket + field`, where `field` is the index in the
+  * Field enum (CNT, SUM, MIN, MAX, FIRST, LAST, MINTS, MAXTS, BEGIN, END). The
+  * timestamp fields are stored as offsets from `bucket`. Because of that the tier
+  * should be larger than NFIELDS. Fields are written in order, so the bucket is
+  * complete only if all NFIELDS values are present, the incomplete bucket (crash
+  * in the middle of the write) is finished by `catch_up` and skipped by readers.
+  *
+  * Tiers are updated by `NBTreeExtentsList::append`. The open bucket of every tier
+  * lives in memory and gets written when the first value of the next bucket arrives.
+  * The open bucket is not persisted, after restart it's recomputed from the raw
+  * series by `catch_up` (called by the background worker if the listener accepts
+  * the request or by the first append otherwise).
+  */
+class NBTreeRollup {
+public:
+    enum Field {
+        CNT,
+        SUM,
+        MIN,
+        MAX,
+        FIRST,
+        LAST,
+        MINTS,
+        MAXTS,
+        BEGIN,
+        END,
+        NFIELDS,
+    };
+
+    //! Column id of the rollup tier stored in the high byte of the id
+    enum {
+        TIER_ID_SHIFT = 56,
+    };
+
+    //! Max number of output buckets if the query range is not aligned to the tier
+    enum {
+        MAX_SPLIT_BUCKETS = 0x1000,
+    };
+
+private:
+    struct Tier {
+        //! Bucket size
+        aku_Timestamp step;
+        //! Column that stores closed buckets
+        std::shared_ptr<NBTreeExtentsList> column;
+        //! End of the last bucket stored in the column
+        aku_Timestamp watermark;
+        //! Open bucket (empty if `acc.cnt == 0`)
+        aku_Timestamp bucket;
+        AggregationResult acc;
+    };
+    std::vector<Tier> tiers_;
+    //! Set when the open buckets are recomputed from the raw series
+    bool ready_;
+    //! Set when catch-up request is accepted by the listener
+    bool requested_;
+    NBTreeRollupListener* listener_;
+
+    void write_bucket(Tier& tier, aku_Timestamp bucket, AggregationResult const& agg, int first_field);
+
+    //! Read the last bucket stored in the tier column, return bucket and number of stored fields
+    static std::tuple<aku_Timestamp, int> last_bucket(Tier const& tier);
+
+    //! Compute watermark from the content of the tier column
+    static aku_Timestamp stored_watermark(Tier const& tier);
+
+public:
+    //! Creates raw group-aggregate operator (begin, end, step)
+    typedef std::function<std::unique_ptr<AggregateOperator>(aku_Timestamp, aku_Timestamp, aku_Timestamp)> AggregateFn;
+
+    /** C-tor
+      * @param tiers is a list of (bucket size, tier column) pairs sorted by bucket size
+      * @param listener receives catch-up requests and rescue points of the tier columns
+      *        (can be null, should outlive the object)
+      */
+    NBTreeRollup(std::vector<std::tuple<aku_Timestamp, std::shared_ptr<NBTreeExtentsList>>> tiers,
+                 NBTreeRollupListener* listener = nullptr);
+
+    /** Write buckets that are missing from the tier columns.
+      * @param aggregate is used to read the raw series
+      * @param id is an id of the raw series
+      * @param end is an end of the restored range, buckets that end before it are
+      *        written. If `end` is AKU_MAX_TIMESTAMP the last bucket becomes open
+      *        and the rollup becomes ready (this call should be serialized with
+      *        `append` by the raw series lock).
+      */
+    void catch_up(AggregateFn const& aggregate, aku_ParamId id, aku_Timestamp end);
+
+    //! Check if the open buckets are restored
+    bool is_ready() const;
+
+    /** Add value to all tiers. Should be called by `raw.append` under the lock
+      * before the value is added to the raw series.
+      */
+    void append(NBTreeExtentsList const& raw, aku_Timestamp ts, double value);
+
+    /** Create group-aggregate operator that reads closed buckets from the
+      * largest suitable tier and the rest of the range from the raw series.
+      * If `begin` is not aligned to the tier, the head of the range and the
+      * tier buckets that contain the boundaries of the output buckets are
+      * read from the raw series.
+      * Should be called by `raw.group_aggregate` under the lock.
+      * @return empty pointer if none of the tiers can be used
+      */
+    std::unique_ptr<AggregateOperator> group_aggregate(NBTreeExtentsList const& raw,
+                                                       aku_Timestamp begin,
+                                                       aku_Timestamp end,
+                                                       aku_Timestamp step) const;
+
+    //! Get column id of the tier
+    static aku_ParamId get_tier_id(aku_ParamId id, u32 tier);
+
+    //! Check if column id belongs to rollup tier
+    static bool is_tier_id(aku_ParamId id);
 };
 
 
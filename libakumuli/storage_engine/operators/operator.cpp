@@ -2,9 +2,132 @@
 
 #include <cassert>
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#define AKU_AGGREGATE_SIMD_KERNELS
+#include <immintrin.h>
+#endif
+
 namespace Akumuli {
 namespace StorageEngine {
 
+// ///////////////// //
+// Reduction kernels //
+// ///////////////// //
+
+/** Compute sum, min and max of the array. Initial values of `min` and `max`
+  * should be set by the caller. NaN values doesn't affect min and max (same
+  * as in comparisons used by `AggregationResult::add`).
+  */
+typedef void (*reduce_kernel_t)(double const* xss, size_t size, double* sum, double* min, double* max);
+
+static void reduce_lanes(double const* sums, double const* mins, double const* maxs, int nlanes,
+                         double* sum, double* min, double* max)
+{
+    for (int i = 0; i < nlanes; i++) {
+        *sum += sums[i];
+        if (*min > mins[i]) {
+            *min = mins[i];
+        }
+        if (*max < maxs[i]) {
+            *max = maxs[i];
+        }
+    }
+}
+
+static void reduce_scalar(double const* xss, size_t size, double* sum, double* min, double* max) {
+    for (size_t i = 0; i < size; i++) {
+        reduce_lanes(xss + i, xss + i, xss + i, 1, sum, min, max);
+    }
+}
+
+#ifdef AKU_AGGREGATE_SIMD_KERNELS
+
+//! SSE2 is always available on x86_64
+static void reduce_sse2(double const* xss, size_t size, double* sum, double* min, double* max) {
+    __m128d vsum = _mm_setzero_pd();
+    __m128d vmin = _mm_set1_pd(*min);
+    __m128d vmax = _mm_set1_pd(*max);
+    size_t i = 0;
+    for (; i + 2 <= size; i += 2) {
+        __m128d x = _mm_loadu_pd(xss + i);
+        vsum = _mm_add_pd(vsum, x);
+        // Second operand is returned if the first one is NaN
+        vmin = _mm_min_pd(x, vmin);
+        vmax = _mm_max_pd(x, vmax);
+    }
+    double sums[2], mins[2], maxs[2];
+    _mm_storeu_pd(sums, vsum);
+    _mm_storeu_pd(mins, vmin);
+    _mm_storeu_pd(maxs, vmax);
+    reduce_lanes(sums, mins, maxs, 2, sum, min, max);
+    reduce_scalar(xss + i, size - i, sum, min, max);
+}
+
+__attribute__((target("avx2")))
+static void reduce_avx2(double const* xss, size_t size, double* sum, double* min, double* max) {
+    __m256d vsum = _mm256_setzero_pd();
+    __m256d vmin = _mm256_set1_pd(*min);
+    __m256d vmax = _mm256_set1_pd(*max);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m256d x = _mm256_loadu_pd(xss + i);
+        vsum = _mm256_add_pd(vsum, x);
+        // Second operand is returned if the first one is NaN
+        vmin = _mm256_min_pd(x, vmin);
+        vmax = _mm256_max_pd(x, vmax);
+    }
+    double sums[4], mins[4], maxs[4];
+    _mm256_storeu_pd(sums, vsum);
+    _mm256_storeu_pd(mins, vmin);
+    _mm256_storeu_pd(maxs, vmax);
+    reduce_lanes(sums, mins, maxs, 4, sum, min, max);
+    reduce_scalar(xss + i, size - i, sum, min, max);
+}
+
+#endif
+
+static reduce_kernel_t choose_reduce_kernel() {
+#ifdef AKU_AGGREGATE_SIMD_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &reduce_avx2;
+    }
+    return &reduce_sse2;
+#else
+    return &reduce_scalar;
+#endif
+}
+
+static const reduce_kernel_t reduce_kernel = choose_reduce_kernel();
+
+//! Update sum, min and max components of the aggregate
+static void reduce(AggregationResult* res, aku_Timestamp const* tss, double const* xss, size_t size) {
+    double sum = .0;
+    double min = res->min;
+    double max = res->max;
+    reduce_kernel(xss, size, &sum, &min, &max);
+    res->sum += sum;
+    // Kernel doesn't track positions, find first occurrence of the new min/max
+    if (res->min > min) {
+        for (size_t i = 0; i < size; i++) {
+            if (xss[i] == min) {
+                res->min = xss[i];
+                res->mints = tss[i];
+                break;
+            }
+        }
+    }
+    if (res->max < max) {
+        for (size_t i = 0; i < size; i++) {
+            if (xss[i] == max) {
+                res->max = xss[i];
+                res->maxts = tss[i];
+                break;
+            }
+        }
+    }
+}
+
 void AggregationResult::copy_from(SubtreeRef const& r) {
     cnt = r.count;
     sum = r.sum;
@@ -21,17 +144,7 @@ void AggregationResult::copy_from(SubtreeRef const& r) {
 void AggregationResult::do_the_math(aku_Timestamp* tss, double const* xss, size_t size, bool inverted) {
     assert(size);
     cnt += size;
-    for (size_t i = 0; i < size; i++) {
-        sum += xss[i];
-        if (min > xss[i]) {
-            min = xss[i];
-            mints = tss[i];
-        }
-        if (max < xss[i]) {
-            max = xss[i];
-            maxts = tss[i];
-        }
-    }
+    reduce(this, tss, xss, size);
     if (!inverted) {
         first = xss[0];
         last = xss[size - 1];
@@ -72,6 +185,26 @@ void AggregationResult::add(aku_Timestamp ts, double xs, bool forward) {
     cnt += 1;
 }
 
+void AggregationResult::add_range(aku_Timestamp const* tss, double const* xss, size_t size, bool forward) {
+    assert(size);
+    reduce(this, tss, xss, size);
+    if (cnt == 0) {
+        first = xss[0];
+        if (forward) {
+            _begin = tss[0];
+        } else {
+            _end = tss[0];
+        }
+    }
+    last = xss[size - 1];
+    if (forward) {
+        _end = tss[size - 1];
+    } else {
+        _begin = tss[size - 1];
+    }
+    cnt += size;
+}
+
 void AggregationResult::combine(const AggregationResult& other) {
     sum += other.sum;
     cnt += other.cnt;
@@ -95,6 +228,44 @@ void AggregationResult::combine(const AggregationResult& other) {
     }
 }
 
+size_t aggregate_by_step(aku_Timestamp const* tss,
+                         double const* xss,
+                         size_t size,
+                         aku_Timestamp begin,
+                         aku_Timestamp end,
+                         u64 step,
+                         aku_Timestamp* destts,
+                         AggregationResult* destxs)
+{
+    const bool forward = begin < end;
+    auto normalize = [forward, begin](aku_Timestamp ts) {
+        return forward ? ts - begin : begin - ts;
+    };
+    size_t outix = 0;
+    size_t ix = 0;
+    while (ix < size) {
+        // Find the end of the current bucket without division
+        u64 lower = normalize(tss[ix]);
+        lower -= lower % step;
+        u64 upper = lower + step;
+        if (upper < lower) {
+            upper = std::numeric_limits<u64>::max();
+        }
+        size_t bucket_end = ix + 1;
+        while (bucket_end < size && normalize(tss[bucket_end]) < upper) {
+            bucket_end++;
+        }
+        AggregationResult outval = INIT_AGGRES;
+        outval.add_range(tss + ix, xss + ix, bucket_end - ix, forward);
+        assert(outval._end - outval._begin <= step);
+        destxs[outix] = outval;
+        destts[outix] = outval._begin;
+        outix++;
+        ix = bucket_end;
+    }
+    return outix;
+}
+
 // ----------- //
 // ValueFilter //
 // ----------- //
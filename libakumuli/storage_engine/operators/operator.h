@@ -55,6 +55,16 @@ struct AggregationResult {
      * @param forward is used to indicate external order of added elements
      */
     void add(aku_Timestamp ts, double xs, bool forward);
+    /**
+     * Add several values to aggregate. The result is the same as if `add`
+     * was called for every element but vectorized kernel is used to compute
+     * sum/min/max.
+     * @param tss is an array of timestamps
+     * @param xss is an array of values
+     * @param size is a number of elements (should be gt 0)
+     * @param forward is used to indicate external order of added elements
+     */
+    void add_range(aku_Timestamp const* tss, double const* xss, size_t size, bool forward);
     //! Combine this value with the other one (inplace update).
     void combine(const AggregationResult& other);
 };
@@ -73,6 +83,28 @@ static const AggregationResult INIT_AGGRES = {
     std::numeric_limits<aku_Timestamp>::lowest(),
 };
 
+/** Split data into `step`-sized buckets and compute aggregate for every bucket.
+  * Bucket boundaries are found in one pass over timestamps, every bucket is
+  * then aggregated using `AggregationResult::add_range`.
+  * @param tss is an array of timestamps (in `begin` to `end` order)
+  * @param xss is an array of values
+  * @param size is a number of elements
+  * @param begin is a beginning of the query range (origin of the first bucket)
+  * @param end is an end of the query range
+  * @param step is a bucket width
+  * @param destts is an output array of bucket timestamps (should fit `size` elements)
+  * @param destxs is an output array of aggregates (should fit `size` elements)
+  * @return number of buckets
+  */
+size_t aggregate_by_step(aku_Timestamp const* tss,
+                         double const* xss,
+                         size_t size,
+                         aku_Timestamp begin,
+                         aku_Timestamp end,
+                         u64 step,
+                         aku_Timestamp* destts,
+                         AggregationResult* destxs);
+
 
 /** Single series operator.
   * @note all ranges is semi-open. This means that if we're
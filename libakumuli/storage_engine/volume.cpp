@@ -19,7 +19,17 @@
 #include <apr.h>
 #include <apr_general.h>
 #include <apr_file_io.h>
+#include <apr_portable.h>
 #include <set>
+#include <atomic>
+#include <algorithm>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include <boost/exception/all.hpp>
 
@@ -29,6 +39,22 @@
 namespace Akumuli {
 namespace StorageEngine {
 
+//! Per-thread cache of free IOVecBlock components
+struct ComponentPool {
+    std::vector<std::vector<u8>> free_;
+
+    ComponentPool() {
+        free_.reserve(IOVecBlock::POOL_CAPACITY);
+    }
+};
+
+static thread_local ComponentPool s_component_pool;
+
+static std::atomic<u64> s_pool_allocated{0};
+static std::atomic<u64> s_pool_reused{0};
+static std::atomic<u64> s_pool_recycled{0};
+static std::atomic<u64> s_pool_dropped{0};
+
 IOVecBlock::IOVecBlock()
     : data_{}
     , pos_(0)
@@ -44,6 +70,46 @@ IOVecBlock::IOVecBlock(bool)
     data_[0].resize(AKU_BLOCK_SIZE);
 }
 
+IOVecBlock::~IOVecBlock() {
+    auto& pool = s_component_pool.free_;
+    for (int i = 0; i < NCOMPONENTS; i++) {
+        // Only regular components can be reused, blocks read from the
+        // volume store everything in a single large component.
+        if (data_[i].size() != COMPONENT_SIZE) {
+            continue;
+        }
+        if (pool.size() < POOL_CAPACITY) {
+            pool.push_back(std::move(data_[i]));
+            s_pool_recycled.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            s_pool_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+IOVecBlock::PoolStats IOVecBlock::get_pool_stats() {
+    PoolStats stats;
+    stats.allocated = s_pool_allocated.load(std::memory_order_relaxed);
+    stats.reused    = s_pool_reused.load(std::memory_order_relaxed);
+    stats.recycled  = s_pool_recycled.load(std::memory_order_relaxed);
+    stats.dropped   = s_pool_dropped.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void IOVecBlock::alloc_component(int c) {
+    auto& pool = s_component_pool.free_;
+    if (!pool.empty()) {
+        data_[c].swap(pool.back());
+        pool.pop_back();
+        // Recycled component can contain data from the previous block
+        std::fill(data_[c].begin(), data_[c].end(), 0);
+        s_pool_reused.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        data_[c].resize(COMPONENT_SIZE);
+        s_pool_allocated.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
 void IOVecBlock::set_addr(LogicAddr addr) {
     addr_ = addr;
 }
@@ -59,7 +125,7 @@ bool IOVecBlock::is_readonly() const {
 int IOVecBlock::add() {
     for (int i = 0; i < NCOMPONENTS; i++) {
         if (data_[i].size() == 0) {
-            data_[i].resize(COMPONENT_SIZE);
+            alloc_component(i);
             return i;
         }
     }
@@ -82,7 +148,7 @@ void IOVecBlock::put(u8 val) {
     int c = pos_ / COMPONENT_SIZE;
     int i = pos_ % COMPONENT_SIZE;
     if (data_[c].empty()) {
-        data_[c].resize(COMPONENT_SIZE);
+        alloc_component(c);
     }
     data_[c][static_cast<size_t>(i)] = val;
     pos_++;
@@ -95,7 +161,7 @@ u8* IOVecBlock::allocate(u32 size) {
         return nullptr;
     }
     if (data_[c].empty()) {
-        data_[c].resize(COMPONENT_SIZE);
+        alloc_component(c);
     }
     if ((data_[c].size() - static_cast<u32>(i)) < size) {
         return nullptr;
@@ -128,7 +194,7 @@ bool IOVecBlock::safe_put(u8 val) {
         return false;
     }
     if (data_[c].empty()) {
-        data_[c].resize(COMPONENT_SIZE);
+        alloc_component(c);
     }
     data_[c][static_cast<size_t>(i)] = val;
     pos_++;
@@ -196,6 +262,82 @@ static AprFilePtr _open_file(const char* file_name, apr_pool_t* pool) {
 }
 
 
+static int _get_file_descriptor(apr_file_t* file) {
+    apr_os_file_t fd;
+    apr_status_t status = apr_os_file_get(&fd, file);
+    panic_on_error(status, "Can't get file descriptor");
+    return fd;
+}
+
+/** Positional write, doesn't change the file offset and
+  * doesn't need seek syscall.
+  */
+static void _pwrite_full(int fd, const u8* source, size_t size, off_t offset) {
+    while (size != 0) {
+        ssize_t nbytes = pwrite(fd, source, size, offset);
+        if (nbytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            panic_on_error(APR_FROM_OS_ERROR(errno), "Volume write error");
+        }
+        source += nbytes;
+        offset += nbytes;
+        size   -= static_cast<size_t>(nbytes);
+    }
+}
+
+//! Positional vectored write, `vec` array is modified in case of partial write
+static void _pwritev_full(int fd, struct iovec* vec, int nvec, off_t offset) {
+#ifdef __linux__
+    while (nvec != 0) {
+        ssize_t nbytes = pwritev(fd, vec, nvec, offset);
+        if (nbytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            panic_on_error(APR_FROM_OS_ERROR(errno), "Volume write error");
+        }
+        offset += nbytes;
+        // Skip fully written buffers
+        size_t written = static_cast<size_t>(nbytes);
+        while (nvec != 0 && written >= vec->iov_len) {
+            written -= vec->iov_len;
+            vec++;
+            nvec--;
+        }
+        if (nvec != 0) {
+            vec->iov_base = static_cast<u8*>(vec->iov_base) + written;
+            vec->iov_len -= written;
+        }
+    }
+#else
+    for (int i = 0; i < nvec; i++) {
+        _pwrite_full(fd, static_cast<const u8*>(vec[i].iov_base), vec[i].iov_len, offset);
+        offset += static_cast<off_t>(vec[i].iov_len);
+    }
+#endif
+}
+
+//! Positional read, can be used from many threads concurrently
+static void _pread_full(int fd, u8* dest, size_t size, off_t offset) {
+    while (size != 0) {
+        ssize_t nbytes = pread(fd, dest, size, offset);
+        if (nbytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            panic_on_error(APR_FROM_OS_ERROR(errno), "Volume read error");
+        }
+        if (nbytes == 0) {
+            panic_on_error(APR_EOF, "Volume read error");
+        }
+        dest   += nbytes;
+        offset += nbytes;
+        size   -= static_cast<size_t>(nbytes);
+    }
+}
+
 static size_t _get_file_size(apr_file_t* file) {
     apr_finfo_t info;
     auto status = apr_file_info_get(&info, APR_FINFO_SIZE, file);
@@ -421,36 +563,88 @@ aku_Status MetaVolume::flush(u32 id) {
 
 //--------------------------- Volume -----------------------------------//
 
+VolumeMapping::VolumeMapping(const u8* ptr, size_t size)
+    : ptr_(ptr)
+    , size_(size)
+{
+}
+
+VolumeMapping::~VolumeMapping() {
+    munmap(const_cast<u8*>(ptr_), size_);
+}
+
+const u8* VolumeMapping::get_pointer() const {
+    return ptr_;
+}
+
+size_t VolumeMapping::get_size() const {
+    return size_;
+}
+
 Volume::Volume(const char* path, size_t write_pos)
     : apr_pool_(_make_apr_pool())
     , apr_file_handle_(_open_file(path, apr_pool_.get()))
+    , fd_(_get_file_descriptor(apr_file_handle_.get()))
     , file_size_(static_cast<u32>(_get_file_size(apr_file_handle_.get())/AKU_BLOCK_SIZE))
     , write_pos_(static_cast<u32>(write_pos))
     , path_(path)
     , mmap_ptr_(nullptr)
 {
-#if UINTPTR_MAX == 0xFFFFFFFFFFFFFFF0
+    map_file();
+}
+
+void Volume::map_file() {
+#if UINTPTR_MAX == 0xFFFFFFFFFFFFFFFF
     // 64-bit architecture, we can use mmap for speed
-    mmap_.reset(new MemoryMappedFile(path, false));
-    if (mmap_->is_bad()) {
-        // Fallback on error
-        Logger::msg(AKU_LOG_ERROR, path_ + " memory mapping error: '" + mmap_->error_message() + "', fallback to `fopen`");
-        mmap_.reset();
-        mmap_ptr_ = nullptr;
+    size_t size = static_cast<size_t>(file_size_) * AKU_BLOCK_SIZE;
+    if (size == 0) {
         return;
     }
-    mmap_->protect_all();
-    mmap_ptr_ = static_cast<const u8*>(mmap_->get_pointer());
-    if (mmap_->get_size() != file_size_*AKU_BLOCK_SIZE) {
-        Logger::msg(AKU_LOG_ERROR, path_ + " memory mapping error, fallback to `fopen`");
-        mmap_ptr_ = nullptr;
-        mmap_.reset();
+    void* ptr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+    if (ptr == MAP_FAILED) {
+        // Fallback on error
+        Logger::msg(AKU_LOG_ERROR, path_ + " memory mapping error: '" + std::strerror(errno) + "', fallback to `pread`");
+        return;
     }
+    mmap_ = std::make_shared<VolumeMapping>(static_cast<const u8*>(ptr), size);
+    mmap_ptr_ = mmap_->get_pointer();
 #endif
 }
 
+void Volume::replace_file() {
+    Logger::msg(AKU_LOG_INFO, path_ + " is pinned by readers, replacing the file");
+    // New file is created under temporary name and renamed over the old one,
+    // the volume file is never missing or partially created after a crash.
+    std::string tmp_path = path_ + ".tmp";
+    _create_file(tmp_path.c_str(), static_cast<u64>(file_size_) * AKU_BLOCK_SIZE);
+    AprPoolPtr pool = _make_apr_pool();
+    AprFilePtr file = _open_file(tmp_path.c_str(), pool.get());
+    int fd = _get_file_descriptor(file.get());
+    if (fsync(fd) != 0) {
+        panic_on_error(APR_FROM_OS_ERROR(errno), "Can't sync volume file");
+    }
+    // Old file stays accessible through the pinned mapping, its space is
+    // released when the last zero-copy block is destroyed.
+    apr_status_t status = apr_file_rename(tmp_path.c_str(), path_.c_str(), pool.get());
+    panic_on_error(status, "Can't replace volume file");
+    status = sync_parent_directory(path_);
+    panic_on_error(status, "Can't sync volume directory");
+    mmap_.reset();
+    mmap_ptr_ = nullptr;
+    apr_file_handle_.reset();
+    apr_pool_ = std::move(pool);
+    apr_file_handle_ = std::move(file);
+    fd_ = fd;
+    map_file();
+}
+
 void Volume::reset() {
     write_pos_ = 0;
+    if (mmap_ && mmap_.use_count() > 1) {
+        // Blocks from the previous generation are still in use and will
+        // be overwritten by the next `append_block` call otherwise.
+        replace_file();
+    }
 }
 
 void Volume::create_new(const char* path, size_t capacity) {
@@ -469,12 +663,8 @@ std::tuple<aku_Status, BlockAddr> Volume::append_block(const u8* source) {
     if (write_pos_ >= file_size_) {
         return std::make_tuple(AKU_EOVERFLOW, 0u);
     }
-    apr_off_t seek_off = write_pos_ * AKU_BLOCK_SIZE;
-    apr_status_t status = apr_file_seek(apr_file_handle_.get(), APR_SET, &seek_off);
-    panic_on_error(status, "Volume seek error");
-    apr_size_t bytes_written = 0;
-    status = apr_file_write_full(apr_file_handle_.get(), source, AKU_BLOCK_SIZE, &bytes_written);
-    panic_on_error(status, "Volume write error");
+    off_t offset = static_cast<off_t>(write_pos_) * AKU_BLOCK_SIZE;
+    _pwrite_full(fd_, source, AKU_BLOCK_SIZE, offset);
     auto result = write_pos_++;
     return std::make_tuple(AKU_SUCCESS, result);
 }
@@ -484,12 +674,9 @@ std::tuple<aku_Status, BlockAddr> Volume::append_block(const IOVecBlock *source)
     if (write_pos_ >= file_size_) {
         return std::make_tuple(AKU_EOVERFLOW, 0u);
     }
-    apr_off_t seek_off = write_pos_ * AKU_BLOCK_SIZE;
-    apr_status_t status = apr_file_seek(apr_file_handle_.get(), APR_SET, &seek_off);
-    panic_on_error(status, "Volume seek error");
-    apr_size_t bytes_written = 0;
+    off_t offset = static_cast<off_t>(write_pos_) * AKU_BLOCK_SIZE;
     struct iovec vec[IOVecBlock::NCOMPONENTS] = {};
-    apr_size_t nvec = 0;
+    int nvec = 0;
     for (int i = 0; i < IOVecBlock::NCOMPONENTS; i++) {
         if (source->get_size(i) != 0) {
             vec[i].iov_base = const_cast<u8*>(source->get_data(i));
@@ -500,8 +687,7 @@ std::tuple<aku_Status, BlockAddr> Volume::append_block(const IOVecBlock *source)
         }
         nvec++;
     }
-    status = apr_file_writev_full(apr_file_handle_.get(), vec, nvec, &bytes_written);
-    panic_on_error(status, "Volume write error");
+    _pwritev_full(fd_, vec, nvec, offset);
     auto result = write_pos_++;
     return std::make_tuple(AKU_SUCCESS, result);
 }
@@ -513,19 +699,34 @@ aku_Status Volume::read_block(u32 ix, u8* dest) const {
     }
     if (mmap_ptr_) {
         // Fast path
-        size_t offset = ix * AKU_BLOCK_SIZE;
+        size_t offset = static_cast<size_t>(ix) * AKU_BLOCK_SIZE;
         memcpy(dest, mmap_ptr_ + offset, AKU_BLOCK_SIZE);
         return AKU_SUCCESS;
     }
-    apr_off_t offset = ix * AKU_BLOCK_SIZE;
-    apr_status_t status = apr_file_seek(apr_file_handle_.get(), APR_SET, &offset);
-    panic_on_error(status, "Volume seek error");
-    apr_size_t outsize = 0;
-    status = apr_file_read_full(apr_file_handle_.get(), dest, AKU_BLOCK_SIZE, &outsize);
-    panic_on_error(status, "Volume read error");
+    off_t offset = static_cast<off_t>(ix) * AKU_BLOCK_SIZE;
+    _pread_full(fd_, dest, AKU_BLOCK_SIZE, offset);
     return AKU_SUCCESS;
 }
 
+void Volume::prefetch(u32 ix) const {
+    if (ix >= write_pos_) {
+        return;
+    }
+    // Kernel starts asynchronous read, the hint can be ignored
+    if (mmap_ptr_) {
+#ifdef MADV_WILLNEED
+        // Block size is a multiple of the page size so the address is page aligned
+        void* addr = const_cast<u8*>(mmap_ptr_ + static_cast<size_t>(ix) * AKU_BLOCK_SIZE);
+        madvise(addr, AKU_BLOCK_SIZE, MADV_WILLNEED);
+#endif
+        return;
+    }
+#ifdef POSIX_FADV_WILLNEED
+    off_t offset = static_cast<off_t>(ix) * AKU_BLOCK_SIZE;
+    posix_fadvise(fd_, offset, AKU_BLOCK_SIZE, POSIX_FADV_WILLNEED);
+#endif
+}
+
 std::tuple<aku_Status, std::unique_ptr<IOVecBlock>> Volume::read_block(u32 ix) const {
     std::unique_ptr<IOVecBlock> block;
     block.reset(new IOVecBlock(true));
@@ -538,17 +739,17 @@ std::tuple<aku_Status, std::unique_ptr<IOVecBlock>> Volume::read_block(u32 ix) c
     return std::make_tuple(status, std::move(block));
 }
 
-std::tuple<aku_Status, const u8*> Volume::read_block_zero_copy(u32 ix) const {
+std::tuple<aku_Status, const u8*, VolumePin> Volume::read_block_zero_copy(u32 ix) const {
     if (ix >= write_pos_) {
-        return std::make_tuple(AKU_EBAD_ARG, nullptr);
+        return std::make_tuple(AKU_EBAD_ARG, nullptr, VolumePin());
     }
     if (mmap_ptr_) {
         // Fast path
-        size_t offset = ix * AKU_BLOCK_SIZE;
+        size_t offset = static_cast<size_t>(ix) * AKU_BLOCK_SIZE;
         auto ptr = mmap_ptr_ + offset;
-        return std::make_tuple(AKU_SUCCESS, ptr);
+        return std::make_tuple(AKU_SUCCESS, ptr, VolumePin(mmap_));
     }
-    return std::make_tuple(AKU_EUNAVAILABLE, nullptr);
+    return std::make_tuple(AKU_EUNAVAILABLE, nullptr, VolumePin());
 }
 
 void Volume::flush() {
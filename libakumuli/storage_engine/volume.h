@@ -48,6 +48,16 @@ struct IOVecBlock {
     enum {
         NCOMPONENTS = 4,
         COMPONENT_SIZE = AKU_BLOCK_SIZE / NCOMPONENTS,
+        //! Max number of free components cached by every thread
+        POOL_CAPACITY = 256,
+    };
+
+    //! Component buffer pool counters (summed over all threads)
+    struct PoolStats {
+        u64 allocated;  //! components allocated from the heap
+        u64 reused;     //! components taken from the pool
+        u64 recycled;   //! components returned to the pool
+        u64 dropped;    //! components freed because the pool was full
     };
 
     std::vector<u8>  data_[NCOMPONENTS];
@@ -70,6 +80,18 @@ struct IOVecBlock {
      */
     IOVecBlock(bool);
 
+    /**
+     * @brief Return storage components to the per-thread pool
+     * Components are reused by the next block created on the same thread.
+     */
+    ~IOVecBlock();
+
+    //! Read pool counters
+    static PoolStats get_pool_stats();
+
+    //! Allocate storage component (taken from the per-thread pool if possible)
+    void alloc_component(int c);
+
     /** Add component if block is less than NCOMPONENTS in size.
      *  Return index of the component or -1 if block is full.
      */
@@ -126,7 +148,7 @@ struct IOVecBlock {
             return nullptr;
         }
         if (data_[c].empty()) {
-            data_[c].resize(COMPONENT_SIZE);
+            alloc_component(c);
         }
         if ((data_[c].size() - static_cast<u32>(i)) < sizeof(POD)) {
             return nullptr;
@@ -224,17 +246,45 @@ public:
 };
 
 
+/** Read-only memory mapping of the volume file.
+  * Zero-copy blocks hold a reference to the mapping (a pin) and read the data
+  * directly from it. Pinned mapping is never written to, see `Volume::reset`.
+  */
+class VolumeMapping {
+    const u8* ptr_;
+    size_t    size_;
+public:
+    VolumeMapping(const u8* ptr, size_t size);
+    ~VolumeMapping();
+    VolumeMapping(VolumeMapping const&) = delete;
+    VolumeMapping& operator = (VolumeMapping const&) = delete;
+
+    const u8* get_pointer() const;
+    size_t get_size() const;
+};
+
+typedef std::shared_ptr<const VolumeMapping> VolumePin;
+
+
 class Volume {
     AprPoolPtr  apr_pool_;
     AprFilePtr  apr_file_handle_;
+    //! Native file descriptor (used for positional I/O)
+    int         fd_;
     u32         file_size_;
     u32         write_pos_;
     std::string path_;
-    // Optional mmap
-    std::unique_ptr<MemoryMappedFile> mmap_;
+    // Optional mmap, shared with zero-copy blocks
+    std::shared_ptr<VolumeMapping> mmap_;
     const u8* mmap_ptr_;
 
     Volume(const char* path, size_t write_pos);
+
+    //! Map the file into memory (if possible)
+    void map_file();
+
+    //! Replace volume's file with the new empty file of the same size
+    void replace_file();
     
 public:
     /** Create new volume.
@@ -254,6 +304,13 @@ public:
 
     // Mutators
 
+    /** Reset write position. If the mapping is pinned by zero-copy blocks
+      * the file gets replaced with the new one and the pinned mapping keeps
+      * the old content until the last block is released. FileStorage doesn't
+      * create zero-copy blocks for the volume that will be recycled next, so
+      * this slow path is taken only if some reader holds the block for the
+      * whole time it takes to fill the current volume.
+      */
     void reset();
 
     //! Append block to file (source size should be 4 at least BLOCK_SIZE)
@@ -275,9 +332,16 @@ public:
     /**
      * @brief Read block without copying the data (only works if mmap available)
      * @param ix is an index of the page
-     * @return status (AKU_EUNAVAILABLE if mmap is not present and the caller should use `read_block` instead)
+     * @return status (AKU_EUNAVAILABLE if mmap is not present and the caller should use `read_block` instead),
+     *         pointer to the data and the pin that keeps the pointer valid
+     */
+    std::tuple<aku_Status, const u8*, VolumePin> read_block_zero_copy(u32 ix) const;
+
+    /**
+     * @brief Hint the OS that the block will be read soon (doesn't block)
+     * @param ix is an index of the page
      */
-    std::tuple<aku_Status, const u8*> read_block_zero_copy(u32 ix) const;
+    void prefetch(u32 ix) const;
 
     //! Return size in blocks
     u32 get_size() const;
@@ -23,7 +23,9 @@
 #include <sstream>
 #include <iostream>
 
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 #include "log_iface.h"
 
@@ -60,7 +62,7 @@ void invoke_panic_handler(std::string const& message) {
     invoke_panic_handler(message.c_str());
 }
 
-MemoryMappedFile::MemoryMappedFile(const char* file_name, bool enable_huge_tlb)
+MemoryMappedFile::MemoryMappedFile(const char* file_name, bool enable_huge_tlb, bool read_only)
     : mem_pool_()
     , mmap_()
     , fp_()
@@ -68,6 +70,7 @@ MemoryMappedFile::MemoryMappedFile(const char* file_name, bool enable_huge_tlb)
     , status_(APR_EINIT)
     , path_(file_name)
     , enable_huge_tlb_(enable_huge_tlb)
+    , read_only_(read_only)
 {
     map_file();
 }
@@ -95,16 +98,17 @@ apr_status_t MemoryMappedFile::map_file() {
     status_ = apr_pool_create(&mem_pool_, NULL);
     if (status_ == APR_SUCCESS) {
         success_count++;
-        status_ = apr_file_open(&fp_, path_.c_str(), APR_WRITE|APR_READ, APR_OS_DEFAULT, mem_pool_);
+        apr_int32_t open_flags = read_only_ ? APR_READ : APR_WRITE|APR_READ;
+        status_ = apr_file_open(&fp_, path_.c_str(), open_flags, APR_OS_DEFAULT, mem_pool_);
         if (status_ == APR_SUCCESS) {
             success_count++;
-            status_ = apr_file_lock(fp_, APR_FLOCK_EXCLUSIVE);
+            status_ = apr_file_lock(fp_, read_only_ ? APR_FLOCK_SHARED : APR_FLOCK_EXCLUSIVE);
             if (status_ == APR_SUCCESS) {
                 // No need to increment success_count, no cleanup needed for apr_file_lock
                 status_ = apr_file_info_get(&finfo_, APR_FINFO_SIZE, fp_);
                 if (status_ == APR_SUCCESS) {
                     success_count++;
-                    apr_int32_t flags = APR_MMAP_WRITE | APR_MMAP_READ;
+                    apr_int32_t flags = read_only_ ? APR_MMAP_READ : APR_MMAP_WRITE | APR_MMAP_READ;
                     if (enable_huge_tlb_) {
 #if defined MAP_HUGETLB
 						flags |= MAP_HUGETLB;
@@ -326,6 +330,21 @@ void prefetch_mem(const void* ptr, size_t mem_size) {
     }
 }
 
+apr_status_t sync_parent_directory(std::string const& path) {
+    auto pos = path.find_last_of('/');
+    std::string dir = pos == std::string::npos ? "." : pos == 0 ? "/" : path.substr(0, pos);
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return APR_FROM_OS_ERROR(errno);
+    }
+    apr_status_t status = APR_SUCCESS;
+    if (fsync(fd) != 0) {
+        status = APR_FROM_OS_ERROR(errno);
+    }
+    close(fd);
+    return status;
+}
+
 size_t get_page_size() {
     auto page_size = sysconf(_SC_PAGESIZE);
     if (AKU_UNLIKELY(page_size < 0)) {
@@ -355,6 +374,23 @@ RWLock::RWLock()
     }
 }
 
+RWLock::RWLock(bool prefer_writers)
+    : rwlock_ PTHREAD_RWLOCK_INITIALIZER
+{
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    if (prefer_writers) {
+        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    }
+#endif
+    int error = pthread_rwlock_init(&rwlock_, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    if (error) {
+        AKU_PANIC("pthread_rwlock_init error");
+    }
+}
+
 RWLock::~RWLock() {
     pthread_rwlock_destroy(&rwlock_);
 }
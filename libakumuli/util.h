@@ -56,9 +56,16 @@ class MemoryMappedFile {
     apr_status_t status_;
     std::string  path_;
     const bool   enable_huge_tlb_;
+    const bool   read_only_;
 
 public:
-    MemoryMappedFile(const char* file_name, bool enable_huge_tlb);
+    /** C-tor
+      * @param file_name is a name of the file to map
+      * @param enable_huge_tlb enables huge pages if supported
+      * @param read_only if set the file is opened for reading, mapped read-only
+      *        and locked in shared mode (many readers can map the same file)
+      */
+    MemoryMappedFile(const char* file_name, bool enable_huge_tlb, bool read_only = false);
     ~MemoryMappedFile();
     void move_file(const char* new_name);
     void   delete_file();
@@ -96,6 +103,12 @@ const void* align_to_page(const void* ptr, size_t get_page_size);
 void* align_to_page(void* ptr, size_t get_page_size);
 
 void prefetch_mem(const void* ptr, size_t mem_size);
+
+/** Flush directory that contains the file (makes rename or
+  * creation of the file durable).
+  * @return APR status
+  */
+apr_status_t sync_parent_directory(std::string const& path);
     
 class Rand {
     std::ranlux48_base rand_;
@@ -115,6 +128,11 @@ class RWLock {
 public:
     RWLock();
 
+    /** Create lock that doesn't let new readers in while writer is waiting
+      * (readers can't starve writers). Recursive read locking is not allowed.
+      */
+    explicit RWLock(bool prefer_writers);
+
     RWLock(RWLock const&) = delete;
     RWLock(RWLock &&) = delete;
     RWLock& operator = (RWLock const&) = delete;
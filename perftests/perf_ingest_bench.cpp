@@ -0,0 +1,322 @@
+/**
+ * Ingestion benchmark.
+ *
+ * Writes synthetic data into the database using several sessions (one thread
+ * per session) and records per-write and per-batch latency histograms. The
+ * report is written in JSON format so it can be stored and compared against
+ * the previous runs to catch tail-latency regressions (e.g. stalls caused by
+ * the input log rotation).
+ *
+ * Example:
+ *     perf_ingest_bench --cardinality 100000 --points 100 --sessions 4 --wal --output report.json
+ */
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "akumuli.h"
+#include "perftest_tools.h"
+
+using namespace Akumuli;
+namespace po = boost::program_options;
+
+struct BenchParams {
+    u64 cardinality;
+    u64 points;
+    double out_of_order;
+    bool wal;
+    u32 sessions;
+    u32 batch_size;
+    u64 volume_size;
+    bool use_batch_api;
+    std::string path;
+    std::string output;
+};
+
+struct SessionResult {
+    LatencyHistogram write_latency;   //! aku_write latency (point mode only)
+    LatencyHistogram batch_latency;   //! latency of the batch (aku_write_batch or batch_size writes)
+    u64 nwritten = 0;
+    u64 nlate = 0;
+    u64 nerrors = 0;
+    double elapsed = 0;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static u64 elapsed_ns(Clock::time_point start, Clock::time_point end) {
+    return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+static void logger(aku_LogLevel level, const char* msg) {
+    if (level == AKU_LOG_ERROR) {
+        aku_console_logger(level, msg);
+    }
+}
+
+static void check_status(aku_Status status, SessionResult* result) {
+    if (status == AKU_ELATE_WRITE) {
+        result->nlate++;
+    } else if (status != AKU_SUCCESS) {
+        result->nerrors++;
+    }
+}
+
+/** Write data for series in range [first, last).
+  * Every step writes one point to every series of the range (round-robin),
+  * out-of-order points get timestamp below the last accepted timestamp of
+  * the series and are rejected as late writes (duplicate timestamps are
+  * accepted, so the timestamp of the previous step is not enough).
+  */
+static void run_session(aku_Database* db, BenchParams const& params, u64 first, u64 last, SessionResult* result) {
+    auto session = aku_create_session(db);
+    std::vector<aku_ParamId> ids;
+    for (u64 i = first; i < last; i++) {
+        char buffer[0x100];
+        int nchars = sprintf(buffer, "bench.metric key=%d group=%d", static_cast<int>(i), static_cast<int>(i % 100));
+        aku_Sample sample;
+        auto status = aku_series_to_param_id(session, buffer, buffer + nchars, &sample);
+        if (status != AKU_SUCCESS) {
+            std::cerr << "Can't create series: " << aku_error_message(status) << std::endl;
+            std::terminate();
+        }
+        ids.push_back(sample.paramid);
+    }
+    std::mt19937 generator(static_cast<u32>(first));
+    std::uniform_real_distribution<double> ooo(0.0, 1.0);
+    std::normal_distribution<double> walk(0.0, 1.0);
+    std::vector<double> values(ids.size(), 100.0);
+    std::vector<aku_Timestamp> accepted(ids.size(), 0);  // last accepted timestamp of every series
+
+    std::vector<aku_ParamId> bids;
+    std::vector<aku_Timestamp> btss;
+    std::vector<double> bxss;
+    bids.reserve(params.batch_size);
+    btss.reserve(params.batch_size);
+    bxss.reserve(params.batch_size);
+
+    const aku_Timestamp step = 1000000000ull;  // 1s
+    const aku_Timestamp base = 1500000000ull * step;
+    auto flush = [&]() {
+        if (bids.empty()) {
+            return;
+        }
+        auto start = Clock::now();
+        if (params.use_batch_api) {
+            check_status(aku_write_batch(session, bids.data(), btss.data(), bxss.data(), bids.size()), result);
+            result->batch_latency.record(elapsed_ns(start, Clock::now()));
+        } else {
+            aku_Sample sample = {};
+            sample.payload.type = AKU_PAYLOAD_FLOAT;
+            auto prev = start;
+            for (size_t i = 0; i < bids.size(); i++) {
+                sample.paramid = bids[i];
+                sample.timestamp = btss[i];
+                sample.payload.float64 = bxss[i];
+                check_status(aku_write(session, &sample), result);
+                auto now = Clock::now();
+                result->write_latency.record(elapsed_ns(prev, now));
+                prev = now;
+            }
+            result->batch_latency.record(elapsed_ns(start, prev));
+        }
+        result->nwritten += bids.size();
+        bids.clear();
+        btss.clear();
+        bxss.clear();
+    };
+
+    PerfTimer timer;
+    for (u64 p = 0; p < params.points; p++) {
+        for (size_t i = 0; i < ids.size(); i++) {
+            aku_Timestamp ts = base + p * step;
+            if (p > 0 && params.out_of_order > 0 && ooo(generator) < params.out_of_order) {
+                ts = accepted[i] - step / 2;
+            } else {
+                accepted[i] = ts;
+            }
+            values[i] += walk(generator);
+            bids.push_back(ids[i]);
+            btss.push_back(ts);
+            bxss.push_back(values[i]);
+            if (bids.size() == params.batch_size) {
+                flush();
+            }
+        }
+    }
+    flush();
+    result->elapsed = timer.elapsed();
+    aku_destroy_session(session);
+}
+
+static std::string get_storage_stats(aku_Database* db) {
+    std::vector<char> buffer(0x10000);
+    while (true) {
+        int len = aku_json_stats(db, buffer.data(), buffer.size());
+        if (len > 0) {
+            return std::string(buffer.data(), static_cast<size_t>(len));
+        }
+        if (buffer.size() > 0x1000000) {
+            return "{}";
+        }
+        buffer.resize(buffer.size() * 2);
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchParams params;
+    po::options_description desc("Ingestion benchmark options");
+    desc.add_options()
+        ("help", "Produce help message")
+        ("cardinality", po::value<u64>(&params.cardinality)->default_value(10000), "Number of series")
+        ("points", po::value<u64>(&params.points)->default_value(1000), "Number of points per series")
+        ("out-of-order", po::value<double>(&params.out_of_order)->default_value(0.0), "Fraction of out-of-order points")
+        ("wal", po::bool_switch(&params.wal), "Enable write-ahead log")
+        ("sessions", po::value<u32>(&params.sessions)->default_value(1), "Number of sessions (one thread per session)")
+        ("batch-size", po::value<u32>(&params.batch_size)->default_value(1000), "Number of points in one batch")
+        ("batch-api", po::bool_switch(&params.use_batch_api), "Use aku_write_batch instead of aku_write")
+        ("volume-size", po::value<u64>(&params.volume_size)->default_value(1024ull*1024*1024), "Size of the volume in bytes (4 volumes are created)")
+        ("path", po::value<std::string>(&params.path)->default_value("/tmp/akumuli-ingest-bench"), "Database directory")
+        ("output", po::value<std::string>(&params.output), "Output file (JSON report is written to stdout if not set)")
+    ;
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (po::error const& err) {
+        std::cerr << err.what() << std::endl << desc << std::endl;
+        return 1;
+    }
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    if (params.sessions == 0 || params.batch_size == 0 || params.cardinality < params.sessions) {
+        std::cerr << "Invalid parameters" << std::endl << desc << std::endl;
+        return 1;
+    }
+
+    aku_initialize(nullptr, &logger);
+
+    // Create database
+    boost::filesystem::remove_all(params.path);
+    boost::filesystem::create_directories(params.path);
+    std::string walpath = params.path + "/wal";
+    if (params.wal) {
+        boost::filesystem::create_directories(walpath);
+    }
+    auto status = aku_create_database_ex("bench", params.path.c_str(), params.path.c_str(), 4, params.volume_size, false);
+    if (status != AKU_SUCCESS) {
+        std::cerr << "Can't create database: " << aku_error_message(status) << std::endl;
+        return 1;
+    }
+    aku_FineTuneParams fparams = {};
+    if (params.wal) {
+        fparams.input_log_path = walpath.c_str();
+        fparams.input_log_concurrency = params.sessions;
+        fparams.input_log_volume_numb = 4;
+        fparams.input_log_volume_size = 16*1024*1024;
+    }
+    std::string dbpath = params.path + "/bench.akumuli";
+    auto db = aku_open_database(dbpath.c_str(), fparams);
+    size_t rss_before = get_current_rss();
+
+    // Run the load
+    std::vector<SessionResult> results(params.sessions);
+    std::vector<std::thread> threads;
+    std::atomic<size_t> rss_high_water(rss_before);
+    std::atomic<bool> done(false);
+    std::thread sampler([&]() {
+        // Sample memory usage while the load is running
+        while (!done.load()) {
+            size_t rss = get_current_rss();
+            if (rss > rss_high_water.load()) {
+                rss_high_water.store(rss);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    });
+    PerfTimer timer;
+    u64 per_session = params.cardinality / params.sessions;
+    for (u32 i = 0; i < params.sessions; i++) {
+        u64 first = i * per_session;
+        u64 last = i + 1 == params.sessions ? params.cardinality : first + per_session;
+        threads.emplace_back(&run_session, db, std::cref(params), first, last, &results[i]);
+    }
+    for (auto& th: threads) {
+        th.join();
+    }
+    double elapsed = timer.elapsed();
+    done.store(true);
+    sampler.join();
+
+    std::string storage_stats = get_storage_stats(db);
+    PerfTimer close_timer;
+    aku_close_database(db);
+    double close_time = close_timer.elapsed();
+
+    // Report
+    LatencyHistogram write_latency;
+    LatencyHistogram batch_latency;
+    u64 nwritten = 0, nlate = 0, nerrors = 0;
+    for (auto const& res: results) {
+        write_latency.merge(res.write_latency);
+        batch_latency.merge(res.batch_latency);
+        nwritten += res.nwritten;
+        nlate += res.nlate;
+        nerrors += res.nerrors;
+    }
+    std::ofstream file;
+    if (!params.output.empty()) {
+        file.open(params.output);
+    }
+    std::ostream& out = params.output.empty() ? std::cout : file;
+    out << "{\n";
+    out << "  \"params\": { \"cardinality\": " << params.cardinality
+        << ", \"points\": " << params.points
+        << ", \"out_of_order\": " << params.out_of_order
+        << ", \"wal\": " << (params.wal ? "true" : "false")
+        << ", \"sessions\": " << params.sessions
+        << ", \"batch_size\": " << params.batch_size
+        << ", \"volume_size\": " << params.volume_size
+        << ", \"batch_api\": " << (params.use_batch_api ? "true" : "false") << " },\n";
+    out << "  \"elapsed_s\": " << elapsed << ",\n";
+    out << "  \"close_time_s\": " << close_time << ",\n";
+    out << "  \"points_written\": " << nwritten << ",\n";
+    out << "  \"late_writes\": " << nlate << ",\n";
+    out << "  \"errors\": " << nerrors << ",\n";
+    out << "  \"throughput_pps\": " << (elapsed > 0 ? static_cast<double>(nwritten) / elapsed : 0.0) << ",\n";
+    out << "  \"write_latency_ns\": ";
+    write_latency.to_json(out);
+    out << ",\n";
+    out << "  \"batch_latency_ns\": ";
+    batch_latency.to_json(out);
+    out << ",\n";
+    out << "  \"sessions_elapsed_s\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        out << (i ? ", " : "") << results[i].elapsed;
+    }
+    out << "],\n";
+    out << "  \"memory\": { \"rss_before\": " << rss_before
+        << ", \"rss_high_water\": " << rss_high_water.load()
+        << ", \"peak_rss\": " << get_peak_rss() << " },\n";
+    out << "  \"storage_stats\": " << (storage_stats.empty() ? "{}" : storage_stats) << "\n";
+    out << "}" << std::endl;
+
+    boost::filesystem::remove_all(params.path);
+    if (params.out_of_order > 0 && params.points > 1 && nlate == 0) {
+        // Every out-of-order point should be rejected
+        std::cerr << "Out-of-order points were not rejected as late writes" << std::endl;
+        return 2;
+    }
+    return nerrors == 0 ? 0 : 2;
+}
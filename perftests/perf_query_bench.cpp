@@ -0,0 +1,319 @@
+/**
+ * Query benchmark.
+ *
+ * Generates reproducible dataset (two metrics per host, hosts are spread
+ * across regions) and runs every query class through the regular query path
+ * (QueryParser -> QueryPlanBuilder -> QueryPlanExecutor). Every query is
+ * executed once after the database is reopened (cold run, block cache is
+ * empty) and then several times in a row (warm runs).
+ *
+ * The JSON report contains rows/s, number of blocks read from the blockstore
+ * (block cache hits + misses) and time spent in the parse, plan and execute
+ * stages (taken from the `query.*` storage stats).
+ *
+ * Example:
+ *     perf_query_bench --cardinality 1000 --points 10000 --repeat 5 --output report.json
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "akumuli.h"
+#include "perftest_tools.h"
+
+using namespace Akumuli;
+namespace po = boost::program_options;
+
+struct BenchParams {
+    u64 cardinality;
+    u64 points;
+    u64 step;
+    u32 regions;
+    u32 repeat;
+    u64 volume_size;
+    std::string path;
+    std::string output;
+};
+
+struct QueryClass {
+    std::string name;
+    std::string query;
+};
+
+//! Counters that are sampled before and after the query
+struct Counters {
+    u64 block_hits;
+    u64 block_misses;
+    u64 parse_ns;
+    u64 plan_ns;
+    u64 exec_ns;
+};
+
+struct RunResult {
+    u64 rows;
+    u64 bytes;         //! size of the returned samples
+    double elapsed;    //! total time in seconds
+    double first_row;  //! time to the first row in seconds
+    Counters delta;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static const aku_Timestamp BASE_TS = 1500000000000000000ull;
+
+static void logger(aku_LogLevel level, const char* msg) {
+    if (level == AKU_LOG_ERROR) {
+        aku_console_logger(level, msg);
+    }
+}
+
+static std::string series_name(std::string const& metric, u64 host, u32 regions) {
+    return metric + " host=h" + std::to_string(host) + " region=r" + std::to_string(host % regions);
+}
+
+static void generate_dataset(aku_Database* db, BenchParams const& params) {
+    auto session = aku_create_session(db);
+    std::vector<aku_ParamId> ids;
+    for (auto metric: { "cpu.user", "cpu.syst" }) {
+        for (u64 host = 0; host < params.cardinality; host++) {
+            auto name = series_name(metric, host, params.regions);
+            aku_Sample sample;
+            auto status = aku_series_to_param_id(session, name.data(), name.data() + name.size(), &sample);
+            if (status != AKU_SUCCESS) {
+                std::cerr << "Can't create series: " << aku_error_message(status) << std::endl;
+                std::terminate();
+            }
+            ids.push_back(sample.paramid);
+        }
+    }
+    // Fixed seed, the dataset should be the same every time
+    std::mt19937 generator(42);
+    std::normal_distribution<double> walk(0.0, 1.0);
+    std::vector<double> values(ids.size(), 100.0);
+    std::vector<aku_ParamId> bids;
+    std::vector<aku_Timestamp> btss;
+    std::vector<double> bxss;
+    for (u64 p = 0; p < params.points; p++) {
+        for (size_t i = 0; i < ids.size(); i++) {
+            values[i] += walk(generator);
+            bids.push_back(ids[i]);
+            btss.push_back(BASE_TS + p * params.step);
+            bxss.push_back(values[i]);
+        }
+        if (bids.size() >= 0x10000 || p + 1 == params.points) {
+            auto status = aku_write_batch(session, bids.data(), btss.data(), bxss.data(), bids.size());
+            if (status != AKU_SUCCESS) {
+                std::cerr << "Write error: " << aku_error_message(status) << std::endl;
+                std::terminate();
+            }
+            bids.clear();
+            btss.clear();
+            bxss.clear();
+        }
+    }
+    aku_destroy_session(session);
+}
+
+static std::vector<QueryClass> make_queries(BenchParams const& params) {
+    aku_Timestamp begin = BASE_TS;
+    aku_Timestamp end = BASE_TS + params.points * params.step;
+    std::stringstream range;
+    range << "\"range\": { \"from\": " << begin << ", \"to\": " << end << " }";
+    std::stringstream grp;
+    grp << std::max(params.step, (end - begin) / 100);
+    std::vector<QueryClass> queries = {
+        { "select",          "{ \"select\": \"cpu.user\", " + range.str() + " }" },
+        { "select-order-by-time",
+                             "{ \"select\": \"cpu.user\", \"order-by\": \"time\", " + range.str() + " }" },
+        { "aggregate",       "{ \"aggregate\": { \"cpu.user\": \"max\" }, " + range.str() + " }" },
+        { "group-aggregate", "{ \"group-aggregate\": { \"metric\": \"cpu.user\", \"step\": " + grp.str() +
+                             ", \"func\": [ \"min\", \"max\", \"cnt\" ] }, " + range.str() + " }" },
+        { "join",            "{ \"join\": [ \"cpu.user\", \"cpu.syst\" ], " + range.str() + " }" },
+        { "where",           "{ \"select\": \"cpu.user\", \"where\": { \"region\": [ \"r0\" ] }, " + range.str() + " }" },
+        { "filter",          "{ \"select\": \"cpu.user\", \"filter\": { \"gt\": 100 }, " + range.str() + " }" },
+    };
+    return queries;
+}
+
+static Counters read_counters(aku_Database* db) {
+    std::vector<char> buffer(0x10000);
+    int len = 0;
+    while ((len = aku_json_stats(db, buffer.data(), buffer.size())) < 0) {
+        if (len == -1) {
+            // Stats can't be read, all counters are zero
+            return Counters();
+        }
+        // Negative value is the size of the stats document (without terminating zero)
+        buffer.resize(static_cast<size_t>(-len) + 1);
+    }
+    std::stringstream stream(std::string(buffer.data(), static_cast<size_t>(len)));
+    boost::property_tree::ptree ptree;
+    boost::property_tree::json_parser::read_json(stream, ptree);
+    Counters res;
+    res.block_hits   = ptree.get<u64>("block_cache.hits", 0);
+    res.block_misses = ptree.get<u64>("block_cache.misses", 0);
+    res.parse_ns     = ptree.get<u64>("query.parse_ns", 0);
+    res.plan_ns      = ptree.get<u64>("query.plan_ns", 0);
+    res.exec_ns      = ptree.get<u64>("query.exec_ns", 0);
+    return res;
+}
+
+static RunResult run_query(aku_Database* db, std::string const& query) {
+    RunResult result = {};
+    Counters before = read_counters(db);
+    auto session = aku_create_session(db);
+    auto start = Clock::now();
+    auto cursor = aku_query(session, query.c_str());
+    const size_t NUM_SAMPLES = 0x1000;
+    std::vector<aku_Sample> samples(NUM_SAMPLES);
+    bool first = true;
+    while (!aku_cursor_is_done(cursor)) {
+        aku_Status err = AKU_SUCCESS;
+        if (aku_cursor_is_error(cursor, &err)) {
+            std::cerr << "Query error: " << aku_error_message(err) << std::endl << query << std::endl;
+            break;
+        }
+        size_t nbytes = aku_cursor_read(cursor, samples.data(), samples.size() * sizeof(aku_Sample));
+        if (nbytes && first) {
+            result.first_row = std::chrono::duration<double>(Clock::now() - start).count();
+            first = false;
+        }
+        // Samples have variable size (tuples from group-aggregate and join)
+        size_t pos = 0;
+        const char* data = reinterpret_cast<const char*>(samples.data());
+        while (pos < nbytes) {
+            auto sample = reinterpret_cast<const aku_Sample*>(data + pos);
+            pos += std::max(static_cast<size_t>(sample->payload.size), sizeof(aku_Sample));
+            result.rows++;
+        }
+        result.bytes += nbytes;
+    }
+    aku_cursor_close(cursor);
+    result.elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    aku_destroy_session(session);
+    Counters after = read_counters(db);
+    result.delta.block_hits   = after.block_hits   - before.block_hits;
+    result.delta.block_misses = after.block_misses - before.block_misses;
+    result.delta.parse_ns     = after.parse_ns     - before.parse_ns;
+    result.delta.plan_ns      = after.plan_ns      - before.plan_ns;
+    result.delta.exec_ns      = after.exec_ns      - before.exec_ns;
+    return result;
+}
+
+static void write_run(std::ostream& out, RunResult const& res) {
+    out << "{ \"rows\": " << res.rows
+        << ", \"bytes\": " << res.bytes
+        << ", \"elapsed_s\": " << res.elapsed
+        << ", \"first_row_s\": " << res.first_row
+        << ", \"rows_per_sec\": " << (res.elapsed > 0 ? static_cast<double>(res.rows) / res.elapsed : 0.0)
+        << ", \"blocks_read\": " << res.delta.block_hits + res.delta.block_misses
+        << ", \"blocks_read_from_disk\": " << res.delta.block_misses
+        << ", \"bytes_read\": " << (res.delta.block_hits + res.delta.block_misses) * 4096
+        << ", \"parse_ns\": " << res.delta.parse_ns
+        << ", \"plan_ns\": " << res.delta.plan_ns
+        << ", \"exec_ns\": " << res.delta.exec_ns
+        << " }";
+}
+
+int main(int argc, char** argv) {
+    BenchParams params;
+    po::options_description desc("Query benchmark options");
+    desc.add_options()
+        ("help", "Produce help message")
+        ("cardinality", po::value<u64>(&params.cardinality)->default_value(1000), "Number of hosts (every host has two series)")
+        ("points", po::value<u64>(&params.points)->default_value(10000), "Number of points per series")
+        ("step", po::value<u64>(&params.step)->default_value(10000000000ull), "Time between points in nanoseconds")
+        ("regions", po::value<u32>(&params.regions)->default_value(10), "Number of distinct `region` tag values")
+        ("repeat", po::value<u32>(&params.repeat)->default_value(5), "Number of warm runs")
+        ("volume-size", po::value<u64>(&params.volume_size)->default_value(1024ull*1024*1024), "Size of the volume in bytes (4 volumes are created)")
+        ("path", po::value<std::string>(&params.path)->default_value("/tmp/akumuli-query-bench"), "Database directory")
+        ("output", po::value<std::string>(&params.output), "Output file (JSON report is written to stdout if not set)")
+    ;
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (po::error const& err) {
+        std::cerr << err.what() << std::endl << desc << std::endl;
+        return 1;
+    }
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    if (params.cardinality == 0 || params.points == 0 || params.regions == 0 || params.step == 0) {
+        std::cerr << "Invalid parameters" << std::endl << desc << std::endl;
+        return 1;
+    }
+
+    aku_initialize(nullptr, &logger);
+
+    boost::filesystem::remove_all(params.path);
+    boost::filesystem::create_directories(params.path);
+    auto status = aku_create_database_ex("bench", params.path.c_str(), params.path.c_str(), 4, params.volume_size, false);
+    if (status != AKU_SUCCESS) {
+        std::cerr << "Can't create database: " << aku_error_message(status) << std::endl;
+        return 1;
+    }
+    std::string dbpath = params.path + "/bench.akumuli";
+    aku_FineTuneParams fparams = {};
+
+    // Generate the dataset and reopen the database to start with empty cache
+    PerfTimer timer;
+    auto db = aku_open_database(dbpath.c_str(), fparams);
+    generate_dataset(db, params);
+    aku_close_database(db);
+    double load_time = timer.elapsed();
+
+    std::ofstream file;
+    if (!params.output.empty()) {
+        file.open(params.output);
+    }
+    std::ostream& out = params.output.empty() ? std::cout : file;
+    out << "{\n";
+    out << "  \"params\": { \"cardinality\": " << params.cardinality
+        << ", \"points\": " << params.points
+        << ", \"step\": " << params.step
+        << ", \"regions\": " << params.regions
+        << ", \"repeat\": " << params.repeat << " },\n";
+    out << "  \"load_time_s\": " << load_time << ",\n";
+    out << "  \"queries\": {\n";
+    auto queries = make_queries(params);
+    for (size_t i = 0; i < queries.size(); i++) {
+        auto const& qc = queries[i];
+        // Cold run, the database is reopened before every query class
+        db = aku_open_database(dbpath.c_str(), fparams);
+        auto cold = run_query(db, qc.query);
+        std::vector<RunResult> warm;
+        for (u32 r = 0; r < params.repeat; r++) {
+            warm.push_back(run_query(db, qc.query));
+        }
+        aku_close_database(db);
+
+        out << "    \"" << qc.name << "\": {\n";
+        out << "      \"cold\": ";
+        write_run(out, cold);
+        out << ",\n      \"warm\": [";
+        for (size_t r = 0; r < warm.size(); r++) {
+            out << (r ? ",\n                " : "\n                ");
+            write_run(out, warm[r]);
+        }
+        out << " ]\n    }" << (i + 1 == queries.size() ? "\n" : ",\n");
+    }
+    out << "  },\n";
+    out << "  \"memory\": { \"peak_rss\": " << get_peak_rss() << " }\n";
+    out << "}" << std::endl;
+
+    boost::filesystem::remove_all(params.path);
+    return 0;
+}
@@ -3,6 +3,11 @@
 #include <chrono>
 #include <cstdlib>
 #include <time.h>
+#include <fstream>
+#include <limits>
+#include <cmath>
+#include <sys/resource.h>
+#include <unistd.h>
 #include "perftest_tools.h"
 
 namespace Akumuli {
@@ -67,4 +72,117 @@ void push_metric_to_graphite(std::string metric, double value) {
     sock.close();
 }
 
+// //////////////// //
+// LatencyHistogram //
+// //////////////// //
+
+LatencyHistogram::LatencyHistogram()
+    : counts_(static_cast<size_t>(NBUCKETS) * SUB_BUCKETS, 0)
+    , count_(0)
+    , min_(std::numeric_limits<u64>::max())
+    , max_(0)
+    , sum_(0)
+{
+}
+
+size_t LatencyHistogram::index_of(u64 value) {
+    if (value < SUB_BUCKETS) {
+        return static_cast<size_t>(value);
+    }
+    // Values in range [2^n, 2^(n+1)) are mapped to the same bucket,
+    // the bucket is divided into SUB_BUCKETS/2 linear sub-buckets.
+    int msb = 63 - __builtin_clzll(value);
+    int bucket = msb - SUB_BUCKET_BITS + 1;
+    u64 sub = value >> bucket;
+    return static_cast<size_t>(bucket) * SUB_BUCKETS + static_cast<size_t>(sub);
+}
+
+u64 LatencyHistogram::value_at(size_t index) {
+    size_t bucket = index / SUB_BUCKETS;
+    u64 sub = index % SUB_BUCKETS;
+    if (bucket == 0) {
+        return sub;
+    }
+    // Highest value that can be mapped to the sub-bucket
+    return ((sub + 1) << bucket) - 1;
+}
+
+void LatencyHistogram::record(u64 value) {
+    counts_[index_of(value)]++;
+    count_++;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+    sum_ += static_cast<double>(value);
+}
+
+void LatencyHistogram::merge(LatencyHistogram const& other) {
+    for (size_t i = 0; i < counts_.size(); i++) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+}
+
+u64 LatencyHistogram::percentile(double q) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    u64 target = static_cast<u64>(std::ceil(q * static_cast<double>(count_)));
+    target = std::max(target, static_cast<u64>(1));
+    u64 total = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+        total += counts_[i];
+        if (total >= target) {
+            return std::min(value_at(i), max_);
+        }
+    }
+    return max_;
+}
+
+u64 LatencyHistogram::count() const {
+    return count_;
+}
+
+u64 LatencyHistogram::min() const {
+    return count_ ? min_ : 0;
+}
+
+u64 LatencyHistogram::max() const {
+    return max_;
+}
+
+double LatencyHistogram::mean() const {
+    return count_ ? sum_ / static_cast<double>(count_) : 0.0;
+}
+
+void LatencyHistogram::to_json(std::ostream& stream) const {
+    stream << "{ \"count\": " << count()
+           << ", \"min\": " << min()
+           << ", \"max\": " << max()
+           << ", \"mean\": " << mean()
+           << ", \"p50\": " << percentile(0.5)
+           << ", \"p90\": " << percentile(0.9)
+           << ", \"p99\": " << percentile(0.99)
+           << ", \"p999\": " << percentile(0.999)
+           << " }";
+}
+
+size_t get_peak_rss() {
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    // ru_maxrss is in kilobytes on Linux
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
+
+size_t get_current_rss() {
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    if (statm >> size >> resident) {
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+    return 0;
+}
+
 }
@@ -16,6 +16,11 @@
 
 #pragma once
 #include <time.h>
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "akumuli_def.h"
 
 namespace Akumuli {
 
@@ -33,4 +38,51 @@ private:
  * `GRAPHITE_HOST` environment variable.
  */
 void push_metric_to_graphite(std::string metric, double value);
+
+/** Latency histogram with logarithmic buckets (HDR style).
+  * Values below 2^SUB_BUCKET_BITS are counted exactly, every power of two
+  * range above that is divided into 2^(SUB_BUCKET_BITS-1) linear sub-buckets,
+  * so the relative error of the reported values is below 2^-(SUB_BUCKET_BITS-1).
+  * Not thread safe, use one histogram per thread and merge the results.
+  */
+class LatencyHistogram {
+    enum {
+        SUB_BUCKET_BITS = 7,
+        SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+        NBUCKETS = 64 - SUB_BUCKET_BITS + 1,
+    };
+    std::vector<u64> counts_;
+    u64 count_;
+    u64 min_;
+    u64 max_;
+    double sum_;
+
+    static size_t index_of(u64 value);
+    static u64 value_at(size_t index);
+public:
+    LatencyHistogram();
+
+    //! Add value to histogram
+    void record(u64 value);
+
+    //! Add all values from another histogram
+    void merge(LatencyHistogram const& other);
+
+    //! Get value at quantile `q` (0 < q <= 1), returns 0 if histogram is empty
+    u64 percentile(double q) const;
+
+    u64 count() const;
+    u64 min() const;
+    u64 max() const;
+    double mean() const;
+
+    //! Write summary (count, min, max, mean, p50, p90, p99, p999) as JSON object
+    void to_json(std::ostream& stream) const;
+};
+
+//! Get peak resident set size of the current process in bytes
+size_t get_peak_rss();
+
+//! Get resident set size of the current process in bytes (0 if not available)
+size_t get_current_rss();
 }
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <thread>
 
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE Main
@@ -261,3 +262,228 @@ BOOST_AUTO_TEST_CASE(Test_blockstore_4) {
     boost::filesystem::remove(expected_path);
     delete_expandable_storage();
 }
+
+BOOST_AUTO_TEST_CASE(Test_blockstore_cache_0) {
+    delete_blockstore();
+    create_blockstore();
+    auto bstore = open_blockstore();
+    aku_Status status;
+    LogicAddr addr;
+
+    auto buffer = std::make_shared<Block>();
+    buffer->get_data()[0] = 42;
+    std::tie(status, addr) = bstore->append_block(buffer);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+
+    std::shared_ptr<Block> first, second;
+    std::tie(status, first) = bstore->read_block(addr);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    std::tie(status, second) = bstore->read_block(addr);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+
+    // Second read should be served from cache
+    BOOST_REQUIRE(first == second);
+    BOOST_REQUIRE_EQUAL(second->get_cdata()[0], 42);
+
+    std::shared_ptr<IOVecBlock> iovec;
+    std::tie(status, iovec) = bstore->read_iovec_block(addr);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(iovec->get_cdata(0)[0], 42);
+
+    // IOVec blocks are not cached
+    auto stats = bstore->get_cache_stats();
+    BOOST_REQUIRE_EQUAL(stats.hits, 1);
+    BOOST_REQUIRE_EQUAL(stats.misses, 1);
+    BOOST_REQUIRE_EQUAL(stats.nblocks, 1);
+
+    delete_blockstore();
+}
+
+BOOST_AUTO_TEST_CASE(Test_blockstore_cache_1) {
+    delete_blockstore();
+    create_blockstore();
+    auto bstore = open_blockstore();
+    aku_Status status;
+    LogicAddr addr;
+
+    auto buffer = std::make_shared<Block>();
+    buffer->get_data()[0] = 1;
+    std::tie(status, addr) = bstore->append_block(buffer);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(addr, 0);
+
+    std::shared_ptr<Block> block;
+    std::tie(status, block) = bstore->read_block(0);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+
+    // Overwrite both volumes, first volume gets recycled
+    for (int i = 0; i < 16; i++) {
+        auto buffer = std::make_shared<Block>();
+        buffer->get_data()[0] = static_cast<u8>(i);
+        std::tie(status, addr) = bstore->append_block(buffer);
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    }
+    BOOST_REQUIRE_EQUAL(addr, (2ull << 32));
+
+    // Cached block from the previous generation shouldn't be accessible
+    std::tie(status, block) = bstore->read_block(0);
+    BOOST_REQUIRE_EQUAL(status, AKU_EUNAVAILABLE);
+    BOOST_REQUIRE_EQUAL(bstore->get_cache_stats().nblocks, 0);
+
+    delete_blockstore();
+}
+
+BOOST_AUTO_TEST_CASE(Test_blockstore_iovec_roundtrip) {
+    delete_blockstore();
+    create_blockstore();
+    auto bstore = open_blockstore();
+    aku_Status status;
+    LogicAddr addr;
+
+    // Fill all components of the block
+    auto buffer = std::make_shared<IOVecBlock>();
+    for (u32 i = 0; i < AKU_BLOCK_SIZE; i++) {
+        buffer->put(static_cast<u8>(i % 251));
+    }
+    std::tie(status, addr) = bstore->append_block(buffer);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+
+    // Prefetch is a hint, invalid address should be ignored
+    bstore->prefetch(addr);
+    bstore->prefetch(addr + 100);
+
+    std::shared_ptr<Block> block;
+    std::tie(status, block) = bstore->read_block(addr);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    for (u32 i = 0; i < AKU_BLOCK_SIZE; i++) {
+        BOOST_REQUIRE_EQUAL(block->get_cdata()[i], static_cast<u8>(i % 251));
+    }
+
+    delete_blockstore();
+}
+
+BOOST_AUTO_TEST_CASE(Test_iovec_block_component_pool) {
+    {
+        // Warm up the pool of the current thread
+        IOVecBlock block;
+        for (u32 i = 0; i < AKU_BLOCK_SIZE; i++) {
+            block.put(static_cast<u8>(0xFF));
+        }
+    }
+    auto before = IOVecBlock::get_pool_stats();
+    {
+        IOVecBlock block;
+        for (u32 i = 0; i < AKU_BLOCK_SIZE; i++) {
+            auto ptr = block.allocate<u8>();
+            BOOST_REQUIRE(ptr != nullptr);
+            // Recycled components should be zeroed
+            BOOST_REQUIRE_EQUAL(*ptr, 0);
+            *ptr = static_cast<u8>(i % 251);
+        }
+        BOOST_REQUIRE_EQUAL(block.add(), -1);
+    }
+    auto after = IOVecBlock::get_pool_stats();
+    BOOST_REQUIRE_EQUAL(after.allocated, before.allocated);
+    BOOST_REQUIRE_EQUAL(after.reused - before.reused, IOVecBlock::NCOMPONENTS);
+    BOOST_REQUIRE_EQUAL(after.recycled - before.recycled, IOVecBlock::NCOMPONENTS);
+
+    // Blocks read from the volume are not pooled
+    {
+        IOVecBlock block(true);
+    }
+    auto last = IOVecBlock::get_pool_stats();
+    BOOST_REQUIRE_EQUAL(last.recycled, after.recycled);
+    BOOST_REQUIRE_EQUAL(last.dropped, after.dropped);
+}
+
+BOOST_AUTO_TEST_CASE(Test_blockstore_prefetch_fills_cache) {
+    delete_blockstore();
+    create_blockstore();
+    auto bstore = open_blockstore();
+    aku_Status status;
+    const u32 N = 8;
+    std::vector<LogicAddr> addrlist;
+    for (u32 i = 0; i < N; i++) {
+        auto buffer = std::make_shared<Block>();
+        buffer->get_data()[0] = static_cast<u8>(i);
+        LogicAddr addr;
+        std::tie(status, addr) = bstore->append_block(buffer);
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        addrlist.push_back(addr);
+    }
+    BOOST_REQUIRE_EQUAL(bstore->get_cache_stats().nblocks, 0);
+
+    for (auto addr: addrlist) {
+        bstore->prefetch(addr);
+    }
+    // Blocks are read by the background thread
+    for (int i = 0; i < 500 && bstore->get_cache_stats().nblocks < N; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    auto stats = bstore->get_cache_stats();
+    BOOST_REQUIRE_EQUAL(stats.nblocks, N);
+    BOOST_REQUIRE_EQUAL(stats.misses, 0);
+
+    for (u32 i = 0; i < N; i++) {
+        std::shared_ptr<Block> block;
+        std::tie(status, block) = bstore->read_block(addrlist.at(i));
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        BOOST_REQUIRE_EQUAL(block->get_cdata()[0], static_cast<u8>(i));
+    }
+    stats = bstore->get_cache_stats();
+    BOOST_REQUIRE_EQUAL(stats.hits, N);
+    BOOST_REQUIRE_EQUAL(stats.misses, 0);
+
+    delete_blockstore();
+}
+
+BOOST_AUTO_TEST_CASE(Test_blockstore_pinned_block_survives_recycling) {
+    delete_blockstore();
+    create_blockstore();
+    auto bstore = open_blockstore();
+    aku_Status status;
+    LogicAddr first;
+    auto buffer = std::make_shared<Block>();
+    std::fill(buffer->get_data(), buffer->get_data() + AKU_BLOCK_SIZE, 0xAA);
+    std::tie(status, first) = bstore->append_block(buffer);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+
+    std::shared_ptr<Block> pinned;
+    std::tie(status, pinned) = bstore->read_block(first);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+
+    // Wrap around, the first volume gets recycled and overwritten
+    u32 nblocks = CAPACITIES[0] + CAPACITIES[1];
+    std::vector<LogicAddr> addrlist;
+    for (u32 i = 0; i < nblocks; i++) {
+        auto next = std::make_shared<Block>();
+        std::fill(next->get_data(), next->get_data() + AKU_BLOCK_SIZE, static_cast<u8>(i));
+        LogicAddr addr;
+        std::tie(status, addr) = bstore->append_block(next);
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        addrlist.push_back(addr);
+    }
+    BOOST_REQUIRE(!bstore->exists(first));
+    std::shared_ptr<Block> block;
+    std::tie(status, block) = bstore->read_block(first);
+    BOOST_REQUIRE_EQUAL(status, AKU_EUNAVAILABLE);
+
+    // Block that was read before recycling should keep its content
+    for (u32 i = 0; i < AKU_BLOCK_SIZE; i++) {
+        BOOST_REQUIRE_EQUAL(pinned->get_cdata()[i], 0xAA);
+    }
+
+    // New blocks should be readable
+    for (u32 i = 0; i < nblocks; i++) {
+        std::tie(status, block) = bstore->read_block(addrlist.at(i));
+        if (status == AKU_EUNAVAILABLE) {
+            // Overwritten by the next generation
+            continue;
+        }
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        BOOST_REQUIRE_EQUAL(block->get_cdata()[0], static_cast<u8>(i));
+        BOOST_REQUIRE_EQUAL(block->get_cdata()[AKU_BLOCK_SIZE - 1], static_cast<u8>(i));
+    }
+
+    delete_blockstore();
+}
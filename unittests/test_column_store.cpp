@@ -1,4 +1,5 @@
 #include <iostream>
+#include <thread>
 
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE Main
@@ -81,6 +82,57 @@ BOOST_AUTO_TEST_CASE(Test_column_store_add_values_3) {
     BOOST_REQUIRE(status == NBTreeAppendResult::FAIL_BAD_ID);
 }
 
+BOOST_AUTO_TEST_CASE(Test_column_store_concurrent_writes) {
+    const u64 NTHREADS = 8;
+    const u64 NCOLUMNS = 100;
+    const u64 NVALUES = 100;
+    auto cstore = create_cstore();
+    auto worker = [cstore, NCOLUMNS, NVALUES](u64 thread_ix) {
+        auto session = create_session(cstore);
+        std::vector<u64> rpoints;
+        for (u64 i = 0; i < NCOLUMNS; i++) {
+            aku_ParamId id = thread_ix*NCOLUMNS + i;
+            if (cstore->create_new_column(id) != AKU_SUCCESS) {
+                return;
+            }
+            aku_Sample sample;
+            sample.payload.type = AKU_PAYLOAD_FLOAT;
+            sample.paramid = id;
+            for (u64 ts = 0; ts < NVALUES; ts++) {
+                sample.timestamp = ts;
+                sample.payload.float64 = ts;
+                session->write(sample, &rpoints);
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (u64 i = 0; i < NTHREADS; i++) {
+        threads.emplace_back(worker, i);
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    // Column ids are taken by the workers, second attempt should fail
+    BOOST_REQUIRE_EQUAL(cstore->create_new_column(0), AKU_EBAD_ARG);
+    BOOST_REQUIRE_EQUAL(cstore->_get_columns().size(), NTHREADS*NCOLUMNS);
+    std::vector<aku_ParamId> ids;
+    for (u64 id = 0; id < NTHREADS*NCOLUMNS; id++) {
+        ids.push_back(id);
+    }
+    std::vector<std::unique_ptr<AggregateOperator>> iters;
+    auto status = cstore->aggregate(ids, 0, NVALUES, &iters);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(iters.size(), ids.size());
+    for (auto& it: iters) {
+        aku_Timestamp ts;
+        AggregationResult res = INIT_AGGRES;
+        size_t outsz;
+        std::tie(status, outsz) = it->read(&ts, &res, 1);
+        BOOST_REQUIRE_EQUAL(outsz, 1);
+        BOOST_REQUIRE_EQUAL(res.cnt, NVALUES);
+    }
+}
+
 struct QueryProcessorMock : QP::IStreamProcessor {
     bool started = false;
     bool stopped = false;
@@ -465,12 +517,13 @@ BOOST_AUTO_TEST_CASE(Test_column_store_reopen_3) {
     test_reopen(1000, 11000);  // 10000 el.
 }
 
-void test_aggregation(aku_Timestamp begin, aku_Timestamp end) {
+void test_aggregation(aku_Timestamp begin, aku_Timestamp end, aku_ParamId nseries = 10) {
     auto cstore = create_cstore();
     auto session = create_session(cstore);
-    std::vector<aku_ParamId> ids = {
-        10,11,12,13,14,15,16,17,18,19
-    };
+    std::vector<aku_ParamId> ids;
+    for (aku_ParamId id = 10; id < 10 + nseries; id++) {
+        ids.push_back(id);
+    }
     std::vector<double> sums;
     for (auto id: ids) {
         double sum = fill_data_in(cstore, session, id, begin, end);
@@ -508,6 +561,11 @@ BOOST_AUTO_TEST_CASE(Test_column_store_aggregation_3) {
     test_aggregation(10000, 110000);
 }
 
+BOOST_AUTO_TEST_CASE(Test_column_store_aggregation_4) {
+    // Large number of series enables parallel execution of the query plan
+    test_aggregation(100, 1100, 100);
+}
+
 void test_aggregation_group_by(aku_Timestamp begin, aku_Timestamp end) {
     auto cstore = create_cstore();
     auto session = create_session(cstore);
@@ -695,12 +753,13 @@ BOOST_AUTO_TEST_CASE(Test_column_store_join_1) {
     test_join(100, 1100);
 }
 
-void test_group_aggregate(aku_Timestamp begin, aku_Timestamp end) {
+void test_group_aggregate(aku_Timestamp begin, aku_Timestamp end, aku_ParamId nseries = 10) {
     auto cstore = create_cstore();
     auto session = create_session(cstore);
-    std::vector<aku_ParamId> col = {
-        10,11,12,13,14,15,16,17,18,19
-    };
+    std::vector<aku_ParamId> col;
+    for (aku_ParamId id = 10; id < 10 + nseries; id++) {
+        col.push_back(id);
+    }
     std::vector<aku_Timestamp> timestamps;
     for (aku_Timestamp ix = begin; ix < end; ix++) {
         timestamps.push_back(ix);
@@ -791,6 +850,10 @@ BOOST_AUTO_TEST_CASE(Test_column_store_group_aggregate_2) {
     test_group_aggregate(1000, 11000);
 }
 
+BOOST_AUTO_TEST_CASE(Test_column_store_group_aggregate_3) {
+    test_group_aggregate(100, 1100, 100);
+}
+
 //! Tests aggregate query in conjunction with group-by clause
 void test_aggregate_and_group_by(aku_Timestamp begin, aku_Timestamp end) {
     auto cstore = create_cstore();
@@ -1412,3 +1475,68 @@ BOOST_AUTO_TEST_CASE(Test_restored_column_safety_2) {
     test_restored_column_safety(1000, 11000);
 }
 
+
+BOOST_AUTO_TEST_CASE(Test_column_store_lazy_open_and_unload) {
+    auto bstore = BlockStoreBuilder::create_memstore();
+    std::shared_ptr<ColumnStore> cstore;
+    cstore.reset(new ColumnStore(bstore));
+    auto session = create_session(cstore);
+    std::vector<aku_ParamId> ids = {
+        10,11,12,13,14,15,16,17,18,19
+    };
+    for (auto id: ids) {
+        fill_data_in(cstore, session, id, 100, 1000);
+    }
+    session.reset();
+    auto mapping = cstore->close();
+    cstore.reset(new ColumnStore(bstore));
+    cstore->open_or_restore(mapping);
+
+    // Columns should be loaded on first access
+    for (auto const& kv: cstore->_get_columns()) {
+        BOOST_REQUIRE(!kv.second->is_initialized());
+    }
+    BOOST_REQUIRE_EQUAL(cstore->preload(ids[0]), AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(cstore->preload(1000), AKU_ENOT_FOUND);
+    session = create_session(cstore);
+    fill_data_in(cstore, session, ids[1], 1000, 1010);
+    auto columns = cstore->_get_columns();
+    BOOST_REQUIRE(columns[ids[0]]->is_initialized());
+    BOOST_REQUIRE(columns[ids[1]]->is_initialized());
+    BOOST_REQUIRE(!columns[ids[2]]->is_initialized());
+
+    // First pass only records write activity
+    size_t nloaded = 0, nbytes = 0;
+    auto idle = cstore->select_idle(0, &nloaded, &nbytes);
+    BOOST_REQUIRE(idle.empty());
+    BOOST_REQUIRE_EQUAL(nloaded, 2);
+    BOOST_REQUIRE(nbytes != 0);
+
+    // Nothing should be selected if memory budget is not exceeded
+    idle = cstore->select_idle(nbytes, &nloaded, &nbytes);
+    BOOST_REQUIRE(idle.empty());
+
+    // Column that is written between passes is not idle
+    fill_data_in(cstore, session, ids[1], 1010, 1020);
+    idle = cstore->select_idle(0, &nloaded, &nbytes);
+    BOOST_REQUIRE_EQUAL(idle.size(), 1);
+    BOOST_REQUIRE_EQUAL(idle.front(), ids[0]);
+
+    // Unloaded column can be loaded again
+    auto rpoints = cstore->close(idle);
+    BOOST_REQUIRE_EQUAL(rpoints.count(ids[0]), 1);
+    BOOST_REQUIRE(!columns[ids[0]]->is_initialized());
+    std::vector<std::unique_ptr<AggregateOperator>> iters;
+    auto status = cstore->aggregate(std::vector<aku_ParamId>{ ids[0], ids[1] }, 0, 2000, &iters);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(iters.size(), 2);
+    u64 expected[] = { 900, 920 };
+    for (size_t i = 0; i < iters.size(); i++) {
+        aku_Timestamp ts;
+        AggregationResult res = INIT_AGGRES;
+        size_t outsz;
+        std::tie(status, outsz) = iters[i]->read(&ts, &res, 1);
+        BOOST_REQUIRE_EQUAL(outsz, 1);
+        BOOST_REQUIRE_EQUAL(res.cnt, expected[i]);
+    }
+}
@@ -250,6 +250,59 @@ BOOST_AUTO_TEST_CASE(Test_float_compression_5) {
     test_float_compression(0, &samples);
 }
 
+/** Read block using `read_chunk` method and compare results with expected values.
+  * First `nskip` elements are read using `next` method to check unaligned reads.
+  */
+template<class ReaderT>
+void test_chunked_read(ReaderT& reader,
+                       std::vector<aku_Timestamp> const& timestamps,
+                       std::vector<double> const& values,
+                       size_t nskip)
+{
+    std::vector<aku_Timestamp> out_timestamps;
+    std::vector<double> out_values;
+    for (size_t ix = 0; ix < nskip && ix < reader.nelements(); ix++) {
+        aku_Status status;
+        aku_Timestamp ts;
+        double value;
+        std::tie(status, ts, value) = reader.next();
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        out_timestamps.push_back(ts);
+        out_values.push_back(value);
+    }
+    aku_Timestamp tsbuf[ReaderT::CHUNK_SIZE];
+    double xsbuf[ReaderT::CHUNK_SIZE];
+    while (true) {
+        aku_Status status;
+        u32 nread;
+        std::fill(tsbuf, tsbuf + ReaderT::CHUNK_SIZE, ~0ull);
+        std::tie(status, nread) = reader.read_chunk(tsbuf, xsbuf);
+        // Elements after the last one being read shouldn't be touched
+        for (u32 i = nread; i < ReaderT::CHUNK_SIZE; i++) {
+            BOOST_REQUIRE_EQUAL(tsbuf[i], ~0ull);
+        }
+        if (status == AKU_ENO_DATA) {
+            BOOST_REQUIRE_EQUAL(nread, 0);
+            break;
+        }
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        BOOST_REQUIRE(nread > 0 && nread <= ReaderT::CHUNK_SIZE);
+        std::copy(tsbuf, tsbuf + nread, std::back_inserter(out_timestamps));
+        std::copy(xsbuf, xsbuf + nread, std::back_inserter(out_values));
+    }
+    BOOST_REQUIRE_EQUAL(out_timestamps.size(), reader.nelements());
+    for (size_t i = 0; i < out_timestamps.size(); i++) {
+        if (timestamps.at(i) != out_timestamps.at(i)) {
+            BOOST_FAIL("Bad timestamp at " << i << ", expected: " << timestamps.at(i) <<
+                       ", actual: " << out_timestamps.at(i));
+        }
+        if (values.at(i) != out_values.at(i)) {
+            BOOST_FAIL("Bad value at " << i << ", expected: " << values.at(i) <<
+                       ", actual: " << out_values.at(i));
+        }
+    }
+}
+
 void test_block_compression(double start, unsigned N=10000, bool regullar=false) {
     RandomWalk rwalk(start, 1., .11);
     std::vector<aku_Timestamp> timestamps;
@@ -335,6 +388,12 @@ void test_block_compression(double start, unsigned N=10000, bool regullar=false)
                        ", actual: " << out_values.at(i));
         }
     }
+
+    // decompress chunk by chunk
+    for (size_t nskip: { 0, 3 }) {
+        StorageEngine::DataBlockReader chunk_reader(block.data(), size_used);
+        test_chunked_read(chunk_reader, timestamps, values, nskip);
+    }
 }
 
 BOOST_AUTO_TEST_CASE(Test_block_compression_00) {
@@ -646,6 +705,14 @@ void test_block_iovec_compression(double start, unsigned N=10000, bool regullar=
                        ", actual: " << out_values.at(i));
         }
     }
+
+    // decompress chunk by chunk
+    for (size_t nskip: { 0, 3 }) {
+        StorageEngine::IOVecBlockReader<StorageEngine::IOVecBlock> chunk_reader(&block);
+        test_chunked_read(chunk_reader, timestamps, values, nskip);
+        StorageEngine::IOVecBlockReader<StorageEngine::IOVecBlock> chunk_reader_cont(&cont_block);
+        test_chunked_read(chunk_reader_cont, timestamps, values, nskip);
+    }
 }
 
 BOOST_AUTO_TEST_CASE(Test_iovec_compression_00) {
@@ -85,6 +85,52 @@ void test_cursor_error(int n_iter, int buf_size) {
     }
 }
 
+void test_cursor_batch(int n_iter, int batch_size, int buf_size) {
+    ConcurrentCursor cursor;
+    std::vector<aku_Sample> expected;
+    auto generator = [n_iter, batch_size, &expected, &cursor]() {
+        SampleBatch batch;
+        for (u32 i = 0u; i < (u32)n_iter; i++) {
+            aku_Sample r = {};
+            r.paramid = i % 10;
+            r.timestamp = i;
+            r.payload.float64 = i;
+            r.payload.type = AKU_PAYLOAD_FLOAT;
+            r.payload.size = sizeof(aku_Sample);
+            batch.append(r);
+            expected.push_back(r);
+            if (batch.size() == (size_t)batch_size) {
+                cursor.put_batch(batch);
+                batch.clear();
+            }
+        }
+        cursor.put_batch(batch);
+        cursor.complete();
+    };
+    std::vector<aku_Sample> actual;
+    cursor.start(generator);
+    while(!cursor.is_done()) {
+        char results[buf_size*sizeof(aku_Sample)];
+        int n_read = cursor.read(results, buf_size*sizeof(aku_Sample));
+        int offset = 0;
+        while(offset < n_read) {
+            const aku_Sample* sample = reinterpret_cast<const aku_Sample*>(results + offset);
+            actual.push_back(*sample);
+            offset += std::max(sample->payload.size, (u16)sizeof(aku_Sample));
+        }
+    }
+    cursor.close();
+
+    BOOST_REQUIRE_EQUAL(expected.size(), actual.size());
+
+    for(size_t i = 0; i < actual.size(); i++) {
+        BOOST_REQUIRE_EQUAL(expected.at(i).paramid, actual.at(i).paramid);
+        BOOST_REQUIRE_EQUAL(expected.at(i).timestamp, actual.at(i).timestamp);
+        BOOST_REQUIRE_EQUAL(expected.at(i).payload.type, actual.at(i).payload.type);
+        BOOST_REQUIRE_EQUAL(expected.at(i).payload.float64, actual.at(i).payload.float64);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(Test_cursor_0_10)
 {
     test_cursor(0, 10);
@@ -135,3 +181,14 @@ BOOST_AUTO_TEST_CASE(Test_cursor_error_100_7)
     test_cursor_error(100, 7);
 }
 
+
+BOOST_AUTO_TEST_CASE(Test_cursor_batch_100_7_10)
+{
+    test_cursor_batch(100, 7, 10);
+}
+
+BOOST_AUTO_TEST_CASE(Test_cursor_batch_100000_1000_100)
+{
+    // Overflows the cursor queue, writer has to wait for the reader
+    test_cursor_batch(100000, 1000, 100);
+}
@@ -85,6 +85,60 @@ BOOST_AUTO_TEST_CASE(Test_input_roundtrip) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(Test_input_roundtrip_batch) {
+    std::vector<u64> stale_ids;
+    std::vector<std::tuple<u64, u64, double>> exp, act;
+    {
+        InputLog ilog(&sequencer, "./", 100, 4096, 0);
+        std::vector<u64> ids, tss;
+        std::vector<double> xss;
+        for (int i = 0; i < 10000; i++) {
+            double val = static_cast<double>(rand()) / RAND_MAX;
+            ids.push_back(static_cast<u64>(42 + i % 3));
+            tss.push_back(static_cast<u64>(i));
+            xss.push_back(val);
+            exp.push_back(std::make_tuple(42 + i % 3, i, val));
+            if (ids.size() == 333) {
+                aku_Status status = ilog.append(ids.data(), tss.data(), xss.data(), static_cast<u32>(ids.size()), &stale_ids);
+                if (status == AKU_EOVERFLOW) {
+                    ilog.rotate();
+                }
+                ids.clear();
+                tss.clear();
+                xss.clear();
+            }
+        }
+        ilog.append(ids.data(), tss.data(), xss.data(), static_cast<u32>(ids.size()), &stale_ids);
+    }
+    BOOST_REQUIRE(stale_ids.empty());
+    {
+        InputLog ilog("./", 0);
+        while(true) {
+            InputLogRow buffer[1024];
+            aku_Status status;
+            u32 outsz;
+            std::tie(status, outsz) = ilog.read_next(1024, buffer);
+            BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+            for(u32 i = 0; i < outsz; i++) {
+                auto id = buffer[i].id;
+                auto payload = boost::get<InputLogDataPoint>(buffer[i].payload);
+                act.push_back(std::make_tuple(id, payload.timestamp, payload.value));
+            }
+            if (outsz == 0) {
+                break;
+            }
+        }
+        ilog.reopen();
+        ilog.delete_files();
+    }
+    BOOST_REQUIRE_EQUAL(exp.size(), act.size());
+    for (u32 i = 0; i < exp.size(); i++) {
+        BOOST_REQUIRE_EQUAL(std::get<0>(exp.at(i)), std::get<0>(act.at(i)));
+        BOOST_REQUIRE_EQUAL(std::get<1>(exp.at(i)), std::get<1>(act.at(i)));
+        BOOST_REQUIRE_EQUAL(std::get<2>(exp.at(i)), std::get<2>(act.at(i)));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(Test_input_rotation) {
     u32 N = 10;
     InputLog ilog(&sequencer, "./", N, 4096, 0);
@@ -122,6 +176,50 @@ BOOST_AUTO_TEST_CASE(Test_input_rotation) {
 }
 
 
+static size_t count_volumes(u32 stream_id) {
+    size_t cnt = 0;
+    std::string suffix = "_" + std::to_string(stream_id) + ".ils";
+    for (auto it = boost::filesystem::directory_iterator("./");
+         it != boost::filesystem::directory_iterator(); it++) {
+        boost::filesystem::path path = *it;
+        auto name = path.filename().string();
+        if (boost::starts_with(name, "inputlog") && boost::ends_with(name, suffix)) {
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+BOOST_AUTO_TEST_CASE(Test_input_deferred_rotation) {
+    u32 N = 4;
+    u32 stream_id = 100;
+    InputLog ilog(&sequencer, "./", N, 4096, stream_id);
+
+    std::vector<u64> stale_ids;
+    int nretired = 0;
+    for (int i = 0; i < 10000; i++) {
+        double val = static_cast<double>(rand()) / RAND_MAX;
+        aku_Status status = ilog.append(42 + i % 2, i, val, &stale_ids);
+        if (status == AKU_EOVERFLOW) {
+            ilog.release_retired();
+            ilog.rotate_deferred();
+            nretired += ilog.retired_count();
+        }
+    }
+    BOOST_REQUIRE(nretired > 0);
+
+    // Retired volume should stay on disk until released
+    BOOST_REQUIRE_EQUAL(ilog.retired_count(), 1);
+    BOOST_REQUIRE_EQUAL(count_volumes(stream_id), N + 1);
+    ilog.release_retired();
+    BOOST_REQUIRE_EQUAL(ilog.retired_count(), 0);
+    BOOST_REQUIRE_EQUAL(count_volumes(stream_id), N);
+
+    ilog.delete_files();
+    BOOST_REQUIRE_EQUAL(count_volumes(stream_id), 0);
+}
+
+
 BOOST_AUTO_TEST_CASE(Test_input_volume_read_next_frame) {
     std::vector<std::tuple<u64, u64, double>> exp, act;
     const char* filename = "./tmp_test_vol.ilog";
@@ -7,6 +7,7 @@
 
 #include <apr.h>
 #include <queue>
+#include <cmath>
 #include <fstream>
 #include <stdlib.h>
 
@@ -1447,6 +1448,58 @@ BOOST_AUTO_TEST_CASE(Test_group_aggregate_backward) {
     }
 }
 
+void test_aggregate_by_step(aku_Timestamp begin, aku_Timestamp end, u64 step, size_t size) {
+    const bool forward = begin < end;
+    std::vector<aku_Timestamp> tss;
+    std::vector<double> xss;
+    for (size_t i = 0; i < size; i++) {
+        tss.push_back(forward ? begin + i : begin - i);
+        // Rounding produces repeated min/max values inside buckets
+        xss.push_back(std::round(std::sin(i*0.1)*10));
+    }
+    // Compute expected results using scalar code
+    std::vector<AggregationResult> expected;
+    AggregationResult acc = INIT_AGGRES;
+    u64 bucket = 0;
+    for (size_t i = 0; i < size; i++) {
+        u64 normts = forward ? tss[i] - begin : begin - tss[i];
+        if (acc.cnt > 0 && normts / step != bucket) {
+            expected.push_back(acc);
+            acc = INIT_AGGRES;
+        }
+        bucket = normts / step;
+        acc.add(tss[i], xss[i], forward);
+    }
+    if (acc.cnt > 0) {
+        expected.push_back(acc);
+    }
+    std::vector<aku_Timestamp> destts(size, 0);
+    std::vector<AggregationResult> destxs(size, INIT_AGGRES);
+    size_t nbuckets = aggregate_by_step(tss.data(), xss.data(), size, begin, end, step,
+                                        destts.data(), destxs.data());
+    BOOST_REQUIRE_EQUAL(nbuckets, expected.size());
+    for (size_t i = 0; i < nbuckets; i++) {
+        BOOST_REQUIRE_EQUAL(destts.at(i), expected.at(i)._begin);
+        BOOST_REQUIRE_EQUAL(destxs.at(i).cnt, expected.at(i).cnt);
+        BOOST_REQUIRE_CLOSE(destxs.at(i).sum, expected.at(i).sum, 1E-10);
+        BOOST_REQUIRE_EQUAL(destxs.at(i).min, expected.at(i).min);
+        BOOST_REQUIRE_EQUAL(destxs.at(i).max, expected.at(i).max);
+        BOOST_REQUIRE_EQUAL(destxs.at(i).mints, expected.at(i).mints);
+        BOOST_REQUIRE_EQUAL(destxs.at(i).maxts, expected.at(i).maxts);
+        BOOST_REQUIRE_EQUAL(destxs.at(i).first, expected.at(i).first);
+        BOOST_REQUIRE_EQUAL(destxs.at(i).last, expected.at(i).last);
+        BOOST_REQUIRE_EQUAL(destxs.at(i)._begin, expected.at(i)._begin);
+        BOOST_REQUIRE_EQUAL(destxs.at(i)._end, expected.at(i)._end);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_aggregate_by_step) {
+    for (u64 step: { 1, 3, 7, 16, 100, 1000 }) {
+        test_aggregate_by_step(1000, 10000, step, 1000);
+        test_aggregate_by_step(10000, 1000, step, 1000);
+    }
+}
+
 template<class Cont>
 static void fill_leaf(NBTreeLeaf* leaf, Cont tss) {
     for (auto ts: tss) {
@@ -2797,3 +2850,223 @@ void test_nbtree_summary(size_t nremoved, size_t nblocks) {
 BOOST_AUTO_TEST_CASE(Test_nbtree_summary_0) {
     test_nbtree_summary(10, 20);
 }
+
+static std::vector<std::tuple<aku_Timestamp, AggregationResult>> read_group_aggregate(NBTreeExtentsList const& tree,
+                                                                                      aku_Timestamp begin,
+                                                                                      aku_Timestamp end,
+                                                                                      aku_Timestamp step)
+{
+    std::vector<std::tuple<aku_Timestamp, AggregationResult>> result;
+    auto it = tree.group_aggregate(begin, end, step);
+    const size_t size = 7;  // read in small chunks to test the operator state
+    std::vector<aku_Timestamp> destts(size, 0);
+    std::vector<AggregationResult> destxs(size, INIT_AGGRES);
+    while (true) {
+        aku_Status status;
+        size_t out_size;
+        std::tie(status, out_size) = it->read(destts.data(), destxs.data(), size);
+        BOOST_REQUIRE(status == AKU_SUCCESS || status == AKU_ENO_DATA);
+        for (size_t i = 0; i < out_size; i++) {
+            result.push_back(std::make_tuple(destts.at(i), destxs.at(i)));
+        }
+        if (out_size == 0) {
+            break;
+        }
+    }
+    return result;
+}
+
+struct TestRollupListener : NBTreeRollupListener {
+    std::vector<aku_ParamId> requests;
+    std::map<aku_ParamId, std::vector<LogicAddr>> rescue_points;
+
+    virtual bool on_catch_up_needed(aku_ParamId id) {
+        requests.push_back(id);
+        return true;
+    }
+
+    virtual void on_rescue_points(aku_ParamId id, std::vector<LogicAddr> const& rpoints) {
+        rescue_points[id] = rpoints;
+    }
+};
+
+void test_nbtree_rollup(size_t npoints, aku_Timestamp ts_inc, bool reopen, bool async=false) {
+    auto bstore = BlockStoreBuilder::create_memstore();
+    const aku_ParamId id = 42;
+    const std::vector<aku_Timestamp> tiers = { 100, 1000 };
+    std::shared_ptr<NBTreeExtentsList> expected(new NBTreeExtentsList(1, std::vector<LogicAddr>(), bstore));
+    std::shared_ptr<NBTreeExtentsList> raw;
+    std::vector<std::shared_ptr<NBTreeExtentsList>> columns;
+    std::vector<LogicAddr> raw_roots;
+    std::vector<std::vector<LogicAddr>> tier_roots(tiers.size());
+    TestRollupListener listener;
+
+    auto open = [&]() {
+        raw.reset(new NBTreeExtentsList(id, raw_roots, bstore));
+        raw->force_init();
+        columns.clear();
+        std::vector<std::tuple<aku_Timestamp, std::shared_ptr<NBTreeExtentsList>>> rollup_tiers;
+        for (u32 i = 0; i < tiers.size(); i++) {
+            auto tier_id = NBTreeRollup::get_tier_id(id, i);
+            BOOST_REQUIRE(NBTreeRollup::is_tier_id(tier_id));
+            std::shared_ptr<NBTreeExtentsList> column(new NBTreeExtentsList(tier_id, tier_roots.at(i), bstore));
+            column->force_init();
+            columns.push_back(column);
+            rollup_tiers.push_back(std::make_tuple(tiers.at(i), column));
+        }
+        std::unique_ptr<NBTreeRollup> rollup(new NBTreeRollup(rollup_tiers, async ? &listener : nullptr));
+        raw->attach_rollup(std::move(rollup));
+    };
+    // Catch-up is requested on first append and performed later
+    auto catch_up = [&]() {
+        for (auto rid: listener.requests) {
+            BOOST_REQUIRE_EQUAL(rid, id);
+            raw->catch_up_rollup();
+        }
+        listener.requests.clear();
+    };
+    open();
+    BOOST_REQUIRE(!NBTreeRollup::is_tier_id(id));
+
+    RandomWalk rwalk(1.0, 0.1, 0.1);
+    const aku_Timestamp begin = 1000;
+    aku_Timestamp ts = begin;
+    for (size_t i = 0; i < npoints; i++) {
+        if (reopen && i == npoints / 2) {
+            raw_roots = raw->close();
+            for (u32 t = 0; t < tiers.size(); t++) {
+                tier_roots.at(t) = columns.at(t)->close();
+            }
+            open();
+        }
+        if (i % 1000 == 999) {
+            catch_up();
+        }
+        double value = rwalk.next();
+        BOOST_REQUIRE(raw->append(ts, value) != NBTreeAppendResult::FAIL_LATE_WRITE);
+        expected->append(ts, value);
+        ts += ts_inc;
+    }
+    catch_up();
+    const aku_Timestamp end = ts;
+
+    std::vector<std::tuple<aku_Timestamp, aku_Timestamp, aku_Timestamp>> queries = {
+        std::make_tuple(begin, end, 100),
+        std::make_tuple(begin, end, 1000),
+        std::make_tuple(begin, end, 3000),
+        std::make_tuple(0, end + 10000, 1000),
+        std::make_tuple(begin + 100, end - 1, 200),
+        std::make_tuple(begin + 500, end, 100),
+        std::make_tuple(begin + 1, end, 100),  // can't use rollup
+        std::make_tuple(begin + 1, end, 200),  // unaligned, tier buckets are split
+        std::make_tuple(begin + 37, end - 5, 3000),
+        std::make_tuple(begin + 250, end + 777, 1000),
+        std::make_tuple(3, end, 5000),
+        std::make_tuple(end, begin, 100),      // backward
+    };
+    for (auto q: queries) {
+        auto actual = read_group_aggregate(*raw, std::get<0>(q), std::get<1>(q), std::get<2>(q));
+        auto reference = read_group_aggregate(*expected, std::get<0>(q), std::get<1>(q), std::get<2>(q));
+        BOOST_REQUIRE_EQUAL(actual.size(), reference.size());
+        for (size_t i = 0; i < actual.size(); i++) {
+            auto const& xs = std::get<1>(actual.at(i));
+            auto const& ys = std::get<1>(reference.at(i));
+            BOOST_REQUIRE_EQUAL(std::get<0>(actual.at(i)), std::get<0>(reference.at(i)));
+            BOOST_REQUIRE_EQUAL(xs.cnt, ys.cnt);
+            BOOST_REQUIRE_CLOSE(xs.sum, ys.sum, 1E-10);
+            BOOST_REQUIRE_EQUAL(xs.min, ys.min);
+            BOOST_REQUIRE_EQUAL(xs.max, ys.max);
+            if (std::get<0>(q) < std::get<1>(q)) {
+                // In backward direction first/last depend on the leaf boundaries
+                BOOST_REQUIRE_EQUAL(xs.first, ys.first);
+                BOOST_REQUIRE_EQUAL(xs.last, ys.last);
+            }
+            BOOST_REQUIRE_EQUAL(xs.mints, ys.mints);
+            BOOST_REQUIRE_EQUAL(xs.maxts, ys.maxts);
+            BOOST_REQUIRE_EQUAL(xs._begin, ys._begin);
+            BOOST_REQUIRE_EQUAL(xs._end, ys._end);
+        }
+    }
+    // Tiers should contain closed buckets
+    for (u32 t = 0; t < tiers.size(); t++) {
+        auto it = columns.at(t)->search(begin, end);
+        aku_Timestamp destts;
+        double destxs;
+        aku_Status status;
+        size_t size;
+        std::tie(status, size) = it->read(&destts, &destxs, 1);
+        BOOST_REQUIRE_EQUAL(size, 1);
+        BOOST_REQUIRE_EQUAL(destts % tiers.at(t), 0);
+    }
+    if (async) {
+        // Tier columns are written by the rollup, their rescue points are reported
+        // to the listener when the leaf node gets flushed
+        auto rp = listener.rescue_points.find(NBTreeRollup::get_tier_id(id, 0));
+        BOOST_REQUIRE(rp != listener.rescue_points.end());
+        BOOST_REQUIRE(!rp->second.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_nbtree_rollup_0) {
+    test_nbtree_rollup(10000, 1, false);
+}
+
+BOOST_AUTO_TEST_CASE(Test_nbtree_rollup_1) {
+    test_nbtree_rollup(10000, 7, false);
+}
+
+BOOST_AUTO_TEST_CASE(Test_nbtree_rollup_2) {
+    test_nbtree_rollup(10000, 3, true);
+}
+
+BOOST_AUTO_TEST_CASE(Test_nbtree_rollup_3) {
+    test_nbtree_rollup(100000, 13, true);
+}
+
+BOOST_AUTO_TEST_CASE(Test_nbtree_rollup_async_0) {
+    test_nbtree_rollup(100000, 1, false, true);
+}
+
+BOOST_AUTO_TEST_CASE(Test_nbtree_rollup_async_1) {
+    test_nbtree_rollup(100000, 13, true, true);
+}
+
+BOOST_AUTO_TEST_CASE(Test_nbtree_append_run) {
+    auto bstore = BlockStoreBuilder::create_memstore();
+    std::shared_ptr<NBTreeExtentsList> extents(new NBTreeExtentsList(42, std::vector<LogicAddr>(), bstore));
+    extents->force_init();
+    const size_t N = 10000;
+    const size_t late = N / 2;
+    std::vector<aku_Timestamp> tss;
+    std::vector<double> xss;
+    RandomWalk rwalk(1.0, 0.1, 0.1);
+    for (size_t i = 0; i < N; i++) {
+        tss.push_back(i == late ? 10 : 1000 + i);
+        xss.push_back(rwalk.next());
+    }
+    NBTreeAppendResult result;
+    size_t nappended;
+    std::tie(result, nappended) = extents->append(tss.data(), xss.data(), N);
+    BOOST_REQUIRE_EQUAL(nappended, late);
+    BOOST_REQUIRE(result == NBTreeAppendResult::OK_FLUSH_NEEDED);
+
+    // Skip late write and append the rest
+    std::tie(result, nappended) = extents->append(tss.data() + late + 1, xss.data() + late + 1, N - late - 1);
+    BOOST_REQUIRE_EQUAL(nappended, N - late - 1);
+
+    auto it = extents->search(0, AKU_MAX_TIMESTAMP);
+    std::vector<aku_Timestamp> actts(N, 0);
+    std::vector<double> actxs(N, 0);
+    aku_Status status;
+    size_t size;
+    std::tie(status, size) = it->read(actts.data(), actxs.data(), N);
+    BOOST_REQUIRE_EQUAL(size, N - 1);
+    for (size_t i = 0, j = 0; i < N; i++) {
+        if (i == late) {
+            continue;
+        }
+        BOOST_REQUIRE_EQUAL(actts.at(j), tss.at(i));
+        BOOST_REQUIRE_EQUAL(actxs.at(j), xss.at(i));
+        j++;
+    }
+}
@@ -8,6 +8,11 @@
 #include "queryprocessor_framework.h"
 #include "datetime.h"
 #include <tuple>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+
+#include <unistd.h>
 
 using namespace Akumuli;
 using namespace Akumuli::QP;
@@ -468,3 +473,448 @@ BOOST_AUTO_TEST_CASE(Test_index_4) {
         i++;
     }
 }
+
+BOOST_AUTO_TEST_CASE(Test_index_5) {
+    u64 base_id = 10ul;
+    SeriesMatcher matcher(base_id);
+    std::vector<std::string> names;
+    for (int host = 0; host < 10; host++) {
+        for (int region = 0; region < 3; region++) {
+            for (auto metric: { "cpu", "mem" }) {
+                names.push_back(std::string(metric) + " host=h" + std::to_string(host) +
+                                " region=r" + std::to_string(region));
+            }
+        }
+    }
+    std::vector<u64> expected;
+    for (auto name: names) {
+        auto id = matcher.add(name.data(), name.data() + name.size());
+        if (id == 0) {
+            BOOST_FAIL("Bad id");
+        }
+        bool match = name.find("cpu ") == 0 &&
+                     (name.find("host=h1 ") != std::string::npos ||
+                      name.find("host=h3 ") != std::string::npos ||
+                      name.find("host=h5 ") != std::string::npos) &&
+                     name.find("region=r1") != std::string::npos;
+        if (match) {
+            expected.push_back(id);
+        }
+    }
+    std::map<std::string, std::vector<std::string>> tags = {
+        {"host", {"h1", "h3", "h5"}},
+        {"region", {"r1"}},
+    };
+    IncludeMany2Many query("cpu", tags);
+    auto res = matcher.search(query);
+    std::vector<u64> actual;
+    for (auto tup: res) {
+        actual.push_back(std::get<2>(tup));
+    }
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+
+    // No such tag value
+    tags["region"] = { "r5" };
+    IncludeMany2Many empty_query("cpu", tags);
+    BOOST_REQUIRE(matcher.search(empty_query).empty());
+}
+
+BOOST_AUTO_TEST_CASE(Test_index_6) {
+    u64 base_id = 10ul;
+    SeriesMatcher matcher(base_id);
+    std::vector<std::string> names = {
+        "foo tagA=1 tagB=1",
+        "foo tagA=10 tagB=1",
+        "foo tagA=2 tagB=1",
+        "foo tagA=1 tagB=2",
+        "foobar tagA=1 tagB=1",
+    };
+    for (auto name: names) {
+        auto id = matcher.add(name.data(), name.data() + name.size());
+        if (id == 0) {
+            BOOST_FAIL("Bad id");
+        }
+    }
+    auto get_ids = [&](IndexQueryNodeBase const& query) {
+        std::vector<u64> ids;
+        for (auto tup: matcher.search(query)) {
+            ids.push_back(std::get<2>(tup) - base_id);
+        }
+        return ids;
+    };
+    // Keys are matched exactly, "tagA=1" shouldn't match "tagA=10"
+    // and "foo" shouldn't match "foobar"
+    std::vector<TagValuePair> tags = {
+        TagValuePair("tagA=1"),
+    };
+    IncludeIfAllTagsMatch include(MetricName("foo"), tags.begin(), tags.end());
+    std::vector<u64> expected = { 0, 3 };
+    auto actual = get_ids(include);
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+
+    ExcludeTags exclude(MetricName("foo"), tags.begin(), tags.end());
+    expected = { 1, 2 };
+    actual = get_ids(exclude);
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+}
+
+BOOST_AUTO_TEST_CASE(Test_index_7) {
+    // Query results share posting lists with the index, they
+    // shouldn't change when new names are added
+    Index index;
+    std::vector<std::string> names = {
+        "foo tagA=1 tagB=1",
+        "foo tagA=1 tagB=2",
+    };
+    for (auto const& name: names) {
+        BOOST_REQUIRE_EQUAL(std::get<0>(index.append(name.data(), name.data() + name.size())), AKU_SUCCESS);
+    }
+    auto metric = index.metric_query(MetricName("foo"));
+    auto tagval = index.tagvalue_query(TagValuePair("tagA=1"));
+    auto missing = index.tagvalue_query(TagValuePair("tagA=2"));
+    std::string name = "foo tagA=1 tagB=3";
+    BOOST_REQUIRE_EQUAL(std::get<0>(index.append(name.data(), name.data() + name.size())), AKU_SUCCESS);
+    name = "foo tagA=2 tagB=3";
+    BOOST_REQUIRE_EQUAL(std::get<0>(index.append(name.data(), name.data() + name.size())), AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(metric.cardinality(), 2);
+    BOOST_REQUIRE_EQUAL(tagval.cardinality(), 2);
+    BOOST_REQUIRE_EQUAL(missing.cardinality(), 0);
+    BOOST_REQUIRE_EQUAL(index.metric_query(MetricName("foo")).cardinality(), 4);
+    BOOST_REQUIRE_EQUAL(index.tagvalue_query(TagValuePair("tagA=1")).cardinality(), 3);
+    BOOST_REQUIRE_EQUAL(index.tagvalue_query(TagValuePair("tagA=2")).cardinality(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(Test_series_name_table_0) {
+    // Table should grow and replace mappings
+    SeriesNameTable table(4);
+    std::vector<std::string> names;
+    for (int i = 0; i < 1000; i++) {
+        names.push_back("foo key=" + std::to_string(i));
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        table.insert(std::make_pair(names[i].data(), static_cast<int>(names[i].size())), 100 + i);
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        auto id = table.find(std::make_pair(names[i].data(), static_cast<int>(names[i].size())));
+        BOOST_REQUIRE_EQUAL(id, 100 + i);
+        auto str = table.find(static_cast<u64>(100 + i));
+        BOOST_REQUIRE_EQUAL(std::string(str.first, str.first + str.second), names[i]);
+    }
+    BOOST_REQUIRE_EQUAL(table.find(std::make_pair("bar", 3)), 0);
+    BOOST_REQUIRE(table.find(static_cast<u64>(99)).first == nullptr);
+
+    // Replace id of the existing name
+    table.insert(std::make_pair(names[0].data(), static_cast<int>(names[0].size())), 5000);
+    BOOST_REQUIRE_EQUAL(table.find(std::make_pair(names[0].data(), static_cast<int>(names[0].size()))), 5000);
+    auto ids = table.get_all_ids();
+    BOOST_REQUIRE_EQUAL(ids.size(), names.size() + 1);
+}
+
+BOOST_AUTO_TEST_CASE(Test_series_name_table_1) {
+    // Table can maintain only one mapping
+    SeriesNameTable by_name(4, SeriesNameTable::BY_NAME);
+    SeriesNameTable by_id(4, SeriesNameTable::BY_ID);
+    std::vector<std::string> names;
+    for (int i = 0; i < 100; i++) {
+        names.push_back("foo key=" + std::to_string(i));
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        auto name = std::make_pair(names[i].data(), static_cast<int>(names[i].size()));
+        by_name.insert(name, 100 + i);
+        by_id.insert(name, 100 + i);
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        auto name = std::make_pair(names[i].data(), static_cast<int>(names[i].size()));
+        BOOST_REQUIRE_EQUAL(by_name.find(name), 100 + i);
+        BOOST_REQUIRE(by_name.find(static_cast<u64>(100 + i)).first == nullptr);
+        auto str = by_id.find(static_cast<u64>(100 + i));
+        BOOST_REQUIRE_EQUAL(std::string(str.first, str.first + str.second), names[i]);
+        BOOST_REQUIRE_EQUAL(by_id.find(name), 0);
+    }
+    BOOST_REQUIRE(by_name.get_all_ids().empty());
+    BOOST_REQUIRE_EQUAL(by_id.get_all_ids().size(), names.size());
+}
+
+BOOST_AUTO_TEST_CASE(Test_seriesmatcher_concurrent_reads) {
+    // Readers should see either nothing or consistent mapping while new series are added
+    SeriesMatcher matcher(10ul);
+    const int N = 20000;
+    std::vector<std::string> names;
+    for (int i = 0; i < N; i++) {
+        names.push_back("cpu host=h" + std::to_string(i % 100) + " key=" + std::to_string(i));
+    }
+    std::atomic<int> nadded(0);
+    std::atomic<int> nerrors(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; r++) {
+        readers.emplace_back([&]() {
+            while (nadded.load() < N) {
+                int last = nadded.load();
+                for (int i = std::max(0, last - 100); i < last; i++) {
+                    auto const& name = names[static_cast<size_t>(i)];
+                    auto id = matcher.match(name.data(), name.data() + name.size());
+                    if (id != static_cast<u64>(10 + i)) {
+                        nerrors++;
+                    }
+                    auto str = matcher.id2str(id);
+                    if (std::string(str.first, str.first + str.second) != name) {
+                        nerrors++;
+                    }
+                }
+                std::vector<TagValuePair> tags;
+                IncludeIfAllTagsMatch query(MetricName("cpu"), tags.begin(), tags.end());
+                auto res = matcher.search(query);
+                if (res.size() < static_cast<size_t>(last)) {
+                    nerrors++;
+                }
+            }
+        });
+    }
+    for (auto const& name: names) {
+        matcher.add(name.data(), name.data() + name.size());
+        nadded++;
+    }
+    for (auto& th: readers) {
+        th.join();
+    }
+    BOOST_REQUIRE_EQUAL(nerrors.load(), 0);
+    BOOST_REQUIRE_EQUAL(matcher.get_all_ids().size(), static_cast<size_t>(N));
+}
+
+BOOST_AUTO_TEST_CASE(Test_seriesmatcher_concurrent_inserts) {
+    // Every name should get exactly one id even if it's added by several threads
+    SeriesMatcher matcher(10ul);
+    const int N = 10000;
+    const int NTHREADS = 4;
+    std::vector<std::string> names;
+    for (int i = 0; i < N; i++) {
+        names.push_back("cpu host=h" + std::to_string(i % 100) + " key=" + std::to_string(i));
+    }
+    std::vector<std::vector<u64>> ids(NTHREADS);
+    std::atomic<int> ncreated(0);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < NTHREADS; t++) {
+        writers.emplace_back([&, t]() {
+            for (int i = 0; i < N; i++) {
+                // Every thread walks the list in its own order
+                auto const& name = names[static_cast<size_t>((i + t*N/NTHREADS) % N)];
+                u64 id;
+                bool created;
+                std::tie(id, created) = matcher.match_or_add(name.data(), name.data() + name.size());
+                if (created) {
+                    ncreated++;
+                }
+                ids[static_cast<size_t>(t)].push_back(id);
+            }
+        });
+    }
+    for (auto& th: writers) {
+        th.join();
+    }
+    BOOST_REQUIRE_EQUAL(ncreated.load(), N);
+    for (int i = 0; i < N; i++) {
+        auto const& name = names[static_cast<size_t>(i)];
+        auto id = matcher.match(name.data(), name.data() + name.size());
+        BOOST_REQUIRE(id >= 10 && id < 10 + N);
+        auto str = matcher.id2str(id);
+        BOOST_REQUIRE_EQUAL(std::string(str.first, str.first + str.second), name);
+    }
+    auto all = matcher.get_all_ids();
+    BOOST_REQUIRE_EQUAL(all.size(), static_cast<size_t>(N));
+
+    // Index should contain all names in id order
+    std::vector<TagValuePair> tags = { TagValuePair("host=h7") };
+    IncludeIfAllTagsMatch query(MetricName("cpu"), tags.begin(), tags.end());
+    auto res = matcher.search(query);
+    BOOST_REQUIRE_EQUAL(res.size(), static_cast<size_t>(N / 100));
+    for (size_t i = 1; i < res.size(); i++) {
+        BOOST_REQUIRE(std::get<2>(res[i - 1]) < std::get<2>(res[i]));
+    }
+
+    std::vector<SeriesMatcher::SeriesNameT> newnames;
+    matcher.pull_new_names(&newnames);
+    BOOST_REQUIRE_EQUAL(newnames.size(), static_cast<size_t>(N));
+}
+
+BOOST_AUTO_TEST_CASE(Test_seriesmatcher_concurrent_pull_new_names) {
+    // Batches of new names shouldn't overlap, every batch contains all ids
+    // that are smaller than the largest id in the batch
+    SeriesMatcher matcher(10ul);
+    const int N = 20000;
+    const int NTHREADS = 4;
+    std::atomic<int> nrunning(NTHREADS);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < NTHREADS; t++) {
+        writers.emplace_back([&, t]() {
+            for (int i = t; i < N; i += NTHREADS) {
+                auto name = "cpu host=h" + std::to_string(i % 100) + " key=" + std::to_string(i);
+                matcher.add(name.data(), name.data() + name.size());
+            }
+            nrunning--;
+        });
+    }
+    u64 next_id = 10;
+    std::vector<SeriesMatcher::SeriesNameT> batch;
+    while (true) {
+        bool done = nrunning.load() == 0;
+        matcher.pull_new_names(&batch);
+        for (auto const& tup: batch) {
+            BOOST_REQUIRE_EQUAL(std::get<2>(tup), next_id);
+            next_id++;
+        }
+        if (done) {
+            break;
+        }
+    }
+    for (auto& th: writers) {
+        th.join();
+    }
+    BOOST_REQUIRE_EQUAL(next_id, 10ul + N);
+}
+
+BOOST_AUTO_TEST_CASE(Test_seriesmatcher_concurrent_index_update) {
+    // Index is updated in chunks, query that runs concurrently with the update
+    // should see all names added before the query
+    SeriesMatcher matcher(10ul);
+    const int N = 20000;
+    for (int i = 0; i < N; i++) {
+        auto name = "cpu host=h" + std::to_string(i % 100) + " key=" + std::to_string(i);
+        matcher.add(name.data(), name.data() + name.size());
+    }
+    std::thread updater([&]() {
+        matcher.update_index();
+    });
+    std::vector<TagValuePair> tags = { TagValuePair("host=h3") };
+    IncludeIfAllTagsMatch query(MetricName("cpu"), tags.begin(), tags.end());
+    auto res = matcher.search(query);
+    updater.join();
+    BOOST_REQUIRE_EQUAL(res.size(), static_cast<size_t>(N / 100));
+    for (size_t i = 1; i < res.size(); i++) {
+        BOOST_REQUIRE(std::get<2>(res[i - 1]) < std::get<2>(res[i]));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_seriesmatcher_segment) {
+    const char* path = "test_seriesmatcher_segment.idx";
+    const int N = 1000;
+    std::vector<std::string> names;
+    {
+        SeriesMatcher matcher(10ul);
+        for (int i = 0; i < N; i++) {
+            names.push_back("cpu host=h" + std::to_string(i % 10) + " key=" + std::to_string(i));
+            matcher.add(names.back().data(), names.back().data() + names.back().size());
+        }
+        // Names should be pulled (saved to the metadata storage) first
+        std::vector<SeriesMatcher::SeriesNameT> newnames;
+        matcher.pull_new_names(&newnames);
+        BOOST_REQUIRE_EQUAL(newnames.size(), static_cast<size_t>(N));
+        BOOST_REQUIRE_EQUAL(matcher.write_segment(path), AKU_SUCCESS);
+    }
+    {
+        SeriesMatcher matcher(10ul);
+        aku_Status status;
+        u64 watermark;
+        std::tie(status, watermark) = matcher.map_segment(path);
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        BOOST_REQUIRE_EQUAL(watermark, 10ul + N);
+        BOOST_REQUIRE_EQUAL(matcher.series_id.load(), 10ul + N);
+        for (int i = 0; i < N; i++) {
+            auto const& name = names[static_cast<size_t>(i)];
+            auto id = matcher.match(name.data(), name.data() + name.size());
+            BOOST_REQUIRE_EQUAL(id, 10ul + static_cast<u64>(i));
+            auto str = matcher.id2str(id);
+            BOOST_REQUIRE_EQUAL(std::string(str.first, str.first + str.second), name);
+        }
+        // Mapped names are already saved
+        std::vector<SeriesMatcher::SeriesNameT> newnames;
+        matcher.pull_new_names(&newnames);
+        BOOST_REQUIRE(newnames.empty());
+
+        // Names that were added after the segment was written
+        std::string name = "cpu host=h0 key=new";
+        auto id = matcher.add(name.data(), name.data() + name.size());
+        BOOST_REQUIRE_EQUAL(id, 10ul + N);
+        std::vector<TagValuePair> tags = { TagValuePair("host=h0") };
+        IncludeIfAllTagsMatch query(MetricName("cpu"), tags.begin(), tags.end());
+        auto res = matcher.search(query);
+        BOOST_REQUIRE_EQUAL(res.size(), static_cast<size_t>(N / 10 + 1));
+        BOOST_REQUIRE_EQUAL(std::get<2>(res.back()), id);
+
+        // Segment can be mapped only once
+        BOOST_REQUIRE_EQUAL(std::get<0>(matcher.map_segment(path)), AKU_EBUSY);
+
+        // Segment can be replaced while it's mapped
+        matcher.pull_new_names(&newnames);
+        BOOST_REQUIRE_EQUAL(newnames.size(), 1u);
+        BOOST_REQUIRE_EQUAL(matcher.write_segment(path), AKU_SUCCESS);
+        SeriesMatcher next(10ul);
+        std::tie(status, watermark) = next.map_segment(path);
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        BOOST_REQUIRE_EQUAL(watermark, 11ul + N);
+        BOOST_REQUIRE_EQUAL(next.get_all_ids().size(), static_cast<size_t>(N + 1));
+        BOOST_REQUIRE_EQUAL(next.match(name.data(), name.data() + name.size()), id);
+    }
+    {
+        // Segment is mapped read-only, many readers can map it at the same time
+        SeriesMatcher first(10ul), second(10ul);
+        BOOST_REQUIRE_EQUAL(std::get<0>(first.map_segment(path)), AKU_SUCCESS);
+        BOOST_REQUIRE_EQUAL(std::get<0>(second.map_segment(path)), AKU_SUCCESS);
+        BOOST_REQUIRE(first.get_all_ids() == second.get_all_ids());
+    }
+    // Truncated segment is rejected and moved out of the way
+    SeriesMatcher matcher(10ul);
+    BOOST_REQUIRE_EQUAL(truncate(path, 100), 0);
+    BOOST_REQUIRE_EQUAL(std::get<0>(matcher.map_segment(path)), AKU_EBAD_DATA);
+    BOOST_REQUIRE(matcher.get_all_ids().empty());
+    std::string bad_path = std::string(path) + ".bad";
+    BOOST_REQUIRE(access(path, F_OK) != 0);
+    BOOST_REQUIRE(access(bad_path.c_str(), F_OK) == 0);
+    std::remove(bad_path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(Test_seriesmatcher_segment_crash_before_sync) {
+    // Segment is written after some names were saved to the metadata storage
+    // but before the others were, then the process crashes. Every name that
+    // was saved should be recovered from the segment or from the metadata
+    // storage (names with ids above the watermark are read from it).
+    const char* path = "test_seriesmatcher_segment_crash.idx";
+    const int N = 100;
+    std::vector<SeriesMatcher::SeriesNameT> metadata;  // names saved to the metadata storage
+    std::vector<std::string> saved, unsaved;
+    {
+        SeriesMatcher matcher(10ul);
+        for (int i = 0; i < N; i++) {
+            saved.push_back("cpu host=h" + std::to_string(i));
+            matcher.add(saved.back().data(), saved.back().data() + saved.back().size());
+        }
+        std::vector<SeriesMatcher::SeriesNameT> newnames;
+        matcher.pull_new_names(&newnames);
+        metadata = newnames;
+        for (int i = 0; i < N; i++) {
+            unsaved.push_back("mem host=h" + std::to_string(i));
+            matcher.add(unsaved.back().data(), unsaved.back().data() + unsaved.back().size());
+        }
+        BOOST_REQUIRE_EQUAL(matcher.write_segment(path), AKU_SUCCESS);
+        // Crash, new names are never pulled
+    }
+    SeriesMatcher matcher(10ul);
+    aku_Status status;
+    u64 watermark;
+    std::tie(status, watermark) = matcher.map_segment(path);
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(watermark, 10ul + N);
+    for (auto const& tup: metadata) {
+        if (std::get<2>(tup) >= watermark) {
+            matcher._add(std::get<0>(tup), std::get<0>(tup) + std::get<1>(tup), std::get<2>(tup));
+        }
+    }
+    for (auto const& name: saved) {
+        BOOST_REQUIRE(matcher.match(name.data(), name.data() + name.size()) != 0);
+    }
+    // Unsaved names are not in the segment, so their ids can't be skipped
+    // by the metadata storage on next start
+    for (auto const& name: unsaved) {
+        BOOST_REQUIRE_EQUAL(matcher.match(name.data(), name.data() + name.size()), 0u);
+    }
+    std::remove(path);
+}
@@ -9,6 +9,7 @@
 #include "storage_api.h"
 #include "protocolparser.h"
 #include "resp.h"
+#include "lz4.h"
 
 using namespace Akumuli;
 
@@ -16,6 +17,7 @@ struct ConsumerMock : DbSession {
     std::vector<aku_ParamId>     param_;
     std::vector<aku_Timestamp>   ts_;
     std::vector<double>          data_;
+    int                          name_lookups_ = 0;
 
     virtual ~ConsumerMock() {}
 
@@ -53,6 +55,7 @@ struct ConsumerMock : DbSession {
     }
 
     virtual int name_to_param_id_list(const char* begin, const char* end, aku_ParamId* ids, u32 cap) override {
+        name_lookups_++;
         auto nelem = std::count(begin, end, '|') + 1;
         if (nelem > cap) {
             return -1*static_cast<int>(nelem);
@@ -125,6 +128,127 @@ BOOST_AUTO_TEST_CASE(Test_protocol_parser_bulk_1) {
     BOOST_REQUIRE_EQUAL(cons->data_[4], 1.6);
 }
 
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_no_autoflush) {
+    // Two datagrams, values should be written only after the flush
+    const char *messages[] = {
+        "+1\r\n:2\r\n+34.5\r\n",
+        "+6\r\n:7\r\n+8.9\r\n",
+    };
+    std::shared_ptr<ConsumerMock> cons(new ConsumerMock());
+    RESPProtocolParser parser(cons);
+    parser.set_autoflush(false);
+    for (auto msg: messages) {
+        auto buf = parser.get_next_buffer();
+        auto len = static_cast<u32>(strlen(msg));
+        memcpy(buf, msg, len);
+        parser.parse_next(buf, len);
+    }
+    BOOST_REQUIRE(cons->param_.empty());
+    parser.flush();
+    parser.close();
+
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), 2);
+    BOOST_REQUIRE_EQUAL(cons->param_[0], 1);
+    BOOST_REQUIRE_EQUAL(cons->param_[1], 6);
+    BOOST_REQUIRE_EQUAL(cons->ts_[0], 2);
+    BOOST_REQUIRE_EQUAL(cons->ts_[1], 7);
+    BOOST_REQUIRE_EQUAL(cons->data_[0], 34.5);
+    BOOST_REQUIRE_EQUAL(cons->data_[1], 8.9);
+}
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_name_cache) {
+    const char *messages = "+1|2\r\n:3\r\n*2\r\n+4.5\r\n+6.7\r\n"
+                           "+1|2\r\n:8\r\n*2\r\n+9.1\r\n+2.3\r\n"
+                           "+5\r\n:8\r\n+4.5\r\n"
+                           "+1|2\r\n:9\r\n*2\r\n+1.1\r\n+2.2\r\n";
+    std::shared_ptr<ConsumerMock> cons(new ConsumerMock());
+    RESPProtocolParser parser(cons);
+    auto buf = parser.get_next_buffer();
+    memcpy(buf, messages, strlen(messages));
+    parser.start();
+    parser.parse_next(buf, static_cast<u32>(strlen(messages)));
+    parser.close();
+
+    // Only distinct names should be resolved by the consumer
+    BOOST_REQUIRE_EQUAL(cons->name_lookups_, 2);
+    std::vector<aku_ParamId> expected_ids = { 1, 2, 1, 2, 5, 1, 2 };
+    std::vector<aku_Timestamp> expected_ts = { 3, 3, 8, 8, 8, 9, 9 };
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(cons->param_.begin(), cons->param_.end(), expected_ids.begin(), expected_ids.end());
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(cons->ts_.begin(), cons->ts_.end(), expected_ts.begin(), expected_ts.end());
+}
+
+BOOST_AUTO_TEST_CASE(Test_series_name_cache) {
+    SeriesNameCache cache;
+    const int N = 10000;
+    for (int i = 0; i < N; i++) {
+        auto name = "cpu.user host=" + std::to_string(i);
+        aku_ParamId ids[] = { static_cast<aku_ParamId>(i), static_cast<aku_ParamId>(i + N) };
+        auto hash = SeriesNameCache::hash(name.data(), name.data() + name.size());
+        cache.insert(hash, name.data(), name.data() + name.size(), ids, 1 + i % 2);
+    }
+    BOOST_REQUIRE_EQUAL(cache.size(), N);
+    for (int i = 0; i < N; i++) {
+        auto name = "cpu.user host=" + std::to_string(i);
+        aku_ParamId ids[2] = {};
+        auto hash = SeriesNameCache::hash(name.data(), name.data() + name.size());
+        int nids = cache.lookup(hash, name.data(), name.data() + name.size(), ids, 2);
+        BOOST_REQUIRE_EQUAL(nids, 1 + i % 2);
+        BOOST_REQUIRE_EQUAL(ids[0], i);
+        if (nids == 2) {
+            BOOST_REQUIRE_EQUAL(ids[1], i + N);
+        }
+    }
+    std::string unknown = "cpu.user host=foo";
+    aku_ParamId id;
+    auto hash = SeriesNameCache::hash(unknown.data(), unknown.data() + unknown.size());
+    BOOST_REQUIRE_EQUAL(cache.lookup(hash, unknown.data(), unknown.data() + unknown.size(), &id, 1), 0);
+    cache.clear();
+    BOOST_REQUIRE_EQUAL(cache.size(), 0);
+}
+
+//! Cycle through `nnames` names `npasses` times, return number of hits after the first pass
+static int cycle_name_cache(SeriesNameCache& cache, int nnames, int npasses) {
+    int hits = 0;
+    for (int pass = 0; pass < npasses; pass++) {
+        for (int i = 0; i < nnames; i++) {
+            // Typical name, 55-100 bytes
+            auto name = "cpu.user host=host" + std::to_string(i) + " region=eu-west-" + std::to_string(i % 7)
+                      + " rack=" + std::string(static_cast<size_t>(i % 45), 'r') + " dc=dc01";
+            aku_ParamId id = static_cast<aku_ParamId>(i);
+            aku_ParamId res = 0;
+            auto hash = SeriesNameCache::hash(name.data(), name.data() + name.size());
+            if (cache.lookup(hash, name.data(), name.data() + name.size(), &res, 1) == 1) {
+                BOOST_REQUIRE_EQUAL(res, id);
+                hits += pass == 0 ? 0 : 1;
+            } else {
+                cache.insert(hash, name.data(), name.data() + name.size(), &id, 1);
+            }
+        }
+    }
+    return hits;
+}
+
+BOOST_AUTO_TEST_CASE(Test_series_name_cache_working_set) {
+    // Working set of 10K names fits, all lookups after the first pass hit
+    SeriesNameCache cache;
+    const int N = 10000;
+    int hits = cycle_name_cache(cache, N, 4);
+    BOOST_REQUIRE_EQUAL(hits, 3*N);
+    BOOST_REQUIRE_EQUAL(cache.size(), N);
+}
+
+BOOST_AUTO_TEST_CASE(Test_series_name_cache_eviction) {
+    // Working set is larger than the cache and is accessed in cyclic order.
+    // Clearing the whole cache on overflow gives almost no hits in this case,
+    // with incremental eviction more than 20% of lookups should hit.
+    SeriesNameCache cache;
+    const int N = SeriesNameCache::MAX_ENTRIES + SeriesNameCache::MAX_ENTRIES / 4;
+    int hits = cycle_name_cache(cache, N, 6);
+    BOOST_REQUIRE_LE(cache.size(), static_cast<size_t>(SeriesNameCache::MAX_ENTRIES));
+    BOOST_TEST_MESSAGE("Hit rate: " << hits * 100 / (5*N) << "%");
+    BOOST_REQUIRE_GT(hits, N);
+}
+
 BOOST_AUTO_TEST_CASE(Test_protocol_parse_2) {
 
     const char *message1 = "+1\r\n:2\r\n+34.5\r\n+6\r\n:7\r\n+8.9";
@@ -174,6 +298,22 @@ BOOST_AUTO_TEST_CASE(Test_protocol_parse_error_format) {
     BOOST_REQUIRE_THROW(parser.parse_next(buf, 29), RESPError);
 }
 
+struct FailingConsumerMock : ConsumerMock {
+    virtual aku_Status write(const aku_Sample&) override {
+        return AKU_EBUSY;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(Test_protocol_parse_error_not_masked_by_write_error) {
+    const char *messages = "+1\r\n:2\r\n+34.5\r\n+2\r\n:d\r\n+8.9\r\n";
+    std::shared_ptr<FailingConsumerMock> cons(new FailingConsumerMock);
+    RESPProtocolParser parser(cons);
+    parser.start();
+    auto buf = parser.get_next_buffer();
+    memcpy(buf, messages, 29);
+    BOOST_REQUIRE_THROW(parser.parse_next(buf, 29), RESPError);
+}
+
 
 BOOST_AUTO_TEST_CASE(Test_protocol_parse_dictionary_error_format) {
     {
@@ -551,6 +691,42 @@ BOOST_AUTO_TEST_CASE(Test_opentsdb_protocol_parse_2) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(Test_opentsdb_protocol_parse_long_lines) {
+    // Elements are longer than the scanner's chunk size and delimiters
+    // are placed at different offsets inside the chunks.
+    std::vector<std::string> expected_names;
+    std::vector<double> expected_values;
+    std::string messages;
+    for (int i = 1; i < 70; i++) {
+        std::string metric = "metric." + std::string(static_cast<size_t>(i), 'm');
+        std::string tags = "host=" + std::string(static_cast<size_t>(i % 37 + 1), 'h') + " region=" + std::to_string(i);
+        std::string value = std::to_string(i) + ".5";
+        messages += "put " + metric + " " + std::to_string(i) + " " + value + " " + tags + "\n";
+        expected_names.push_back(metric + " " + tags);
+        expected_values.push_back(i + 0.5);
+    }
+    std::shared_ptr<NameCheckingConsumer> cons(new NameCheckingConsumer(expected_names, -1));
+    OpenTSDBProtocolParser parser(cons);
+    parser.start();
+    size_t pos = 0;
+    while (pos < messages.size()) {
+        // Feed the parser by small portions
+        size_t sz = std::min(static_cast<size_t>(1000), messages.size() - pos);
+        auto buf = parser.get_next_buffer();
+        memcpy(buf, messages.data() + pos, sz);
+        parser.parse_next(buf, static_cast<u32>(sz));
+        pos += sz;
+    }
+    parser.close();
+
+    BOOST_REQUIRE_EQUAL(cons->ids.size(), expected_names.size());
+    for (size_t i = 0; i < expected_names.size(); i++) {
+        BOOST_REQUIRE_EQUAL(cons->ids.at(i), cons->index[expected_names[i]]);
+        BOOST_REQUIRE_EQUAL(cons->ts.at(i), (i + 1)*NANOSECONDS);
+        BOOST_REQUIRE_EQUAL(cons->xs.at(i), expected_values.at(i));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(Test_open_tsdb_protocol_parser_framing) {
 
     const char *message = "put test 10001 34.57 tag1=1 tag2=1\n"
@@ -594,3 +770,193 @@ BOOST_AUTO_TEST_CASE(Test_open_tsdb_protocol_parser_framing) {
         find_framing_issues<OpenTSDBProtocolParser>(message, msglen, pivot1, pivot2, pred, cons);
     }
 }
+
+struct BinaryFrameBuilder {
+    std::vector<std::pair<u32, std::string>> dict;
+    std::vector<u32>           ids;
+    std::vector<aku_Timestamp> ts;
+    std::vector<double>        xs;
+
+    template<class T>
+    static void append(std::string* out, T value) {
+        out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    std::string build(bool compress) const {
+        std::string body;
+        append<u32>(&body, static_cast<u32>(dict.size()));
+        append<u32>(&body, static_cast<u32>(ids.size()));
+        for (auto const& kv: dict) {
+            append<u32>(&body, kv.first);
+            append<u16>(&body, static_cast<u16>(kv.second.size()));
+            body += kv.second;
+        }
+        u64 prev = 0;
+        for (auto id: ids) {
+            append<u64>(&body, id - prev);
+            prev = id;
+        }
+        prev = 0;
+        for (auto t: ts) {
+            append<u64>(&body, t - prev);
+            prev = t;
+        }
+        for (auto x: xs) {
+            append<double>(&body, x);
+        }
+        u32 raw_size = static_cast<u32>(body.size());
+        if (compress) {
+            std::vector<char> out(static_cast<size_t>(LZ4_compressBound(static_cast<int>(body.size()))));
+            int n = LZ4_compress_default(body.data(), out.data(), static_cast<int>(body.size()), static_cast<int>(out.size()));
+            body.assign(out.data(), static_cast<size_t>(n));
+        }
+        std::string frame;
+        append<u32>(&frame, BinaryProtocolParser::MAGIC);
+        append<u8>(&frame, BinaryProtocolParser::VERSION);
+        append<u8>(&frame, compress ? BinaryProtocolParser::FLAG_LZ4 : 0);
+        append<u16>(&frame, 0);
+        append<u32>(&frame, static_cast<u32>(body.size()));
+        append<u32>(&frame, raw_size);
+        return frame + body;
+    }
+};
+
+static void feed_binary(BinaryProtocolParser& parser, std::string const& data, size_t chunk) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t sz = std::min(chunk, data.size() - pos);
+        auto buf = parser.get_next_buffer();
+        memcpy(buf, data.data() + pos, sz);
+        parser.parse_next(buf, static_cast<u32>(sz));
+        pos += sz;
+    }
+}
+
+static BinaryFrameBuilder make_binary_frame(u32 npoints) {
+    BinaryFrameBuilder frame;
+    frame.dict = {{ 1, "100" }, { 2, "200" }, { 3, "300" }};
+    for (u32 i = 0; i < npoints; i++) {
+        frame.ids.push_back(1 + i % 3);
+        frame.ts.push_back(1000 + i);
+        frame.xs.push_back(i * 0.5);
+    }
+    return frame;
+}
+
+static void check_binary_frame(ConsumerMock const& cons, u32 npoints) {
+    BOOST_REQUIRE_EQUAL(cons.param_.size(), npoints);
+    for (u32 i = 0; i < npoints; i++) {
+        BOOST_REQUIRE_EQUAL(cons.param_.at(i), 100*(1 + i % 3));
+        BOOST_REQUIRE_EQUAL(cons.ts_.at(i), 1000 + i);
+        BOOST_REQUIRE_EQUAL(cons.data_.at(i), i * 0.5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_binary_protocol_parse_1) {
+    std::shared_ptr<ConsumerMock> cons(new ConsumerMock());
+    BinaryProtocolParser parser(cons);
+    parser.start();
+    feed_binary(parser, make_binary_frame(100).build(false), BinaryProtocolParser::RDBUF_SIZE);
+    parser.close();
+    check_binary_frame(*cons, 100);
+}
+
+BOOST_AUTO_TEST_CASE(Test_binary_protocol_parse_lz4) {
+    std::shared_ptr<ConsumerMock> cons(new ConsumerMock());
+    BinaryProtocolParser parser(cons);
+    parser.start();
+    auto frame = make_binary_frame(1000).build(true);
+    feed_binary(parser, frame, BinaryProtocolParser::RDBUF_SIZE);
+    parser.close();
+    check_binary_frame(*cons, 1000);
+}
+
+BOOST_AUTO_TEST_CASE(Test_binary_protocol_parser_framing) {
+    auto frame = make_binary_frame(500).build(false);
+    for (size_t chunk: { 1ul, 7ul, 16ul, 100ul, 4099ul }) {
+        std::shared_ptr<ConsumerMock> cons(new ConsumerMock());
+        BinaryProtocolParser parser(cons);
+        parser.start();
+        // Several frames back to back, split at arbitrary offsets
+        feed_binary(parser, frame + frame, chunk);
+        parser.close();
+        BOOST_REQUIRE_EQUAL(cons->param_.size(), 1000);
+        BOOST_REQUIRE_EQUAL(cons->param_.at(500), 100);
+        BOOST_REQUIRE_EQUAL(cons->ts_.at(999), 1499);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_binary_protocol_dictionary_reuse) {
+    std::shared_ptr<ConsumerMock> cons(new ConsumerMock());
+    BinaryProtocolParser parser(cons);
+    parser.start();
+    auto first = make_binary_frame(3);
+    auto second = make_binary_frame(3);
+    // Second frame refers to the entries defined by the first one
+    second.dict.clear();
+    feed_binary(parser, first.build(false) + second.build(true), BinaryProtocolParser::RDBUF_SIZE);
+    parser.close();
+    BOOST_REQUIRE_EQUAL(cons->param_.size(), 6);
+    BOOST_REQUIRE_EQUAL(cons->param_.at(3), 100);
+    BOOST_REQUIRE_EQUAL(cons->param_.at(5), 300);
+    BOOST_REQUIRE_EQUAL(cons->ts_.at(5), 1002);
+}
+
+BOOST_AUTO_TEST_CASE(Test_binary_protocol_large_local_ids) {
+    std::shared_ptr<ConsumerMock> cons(new ConsumerMock());
+    BinaryProtocolParser parser(cons);
+    parser.start();
+    // Large local ids don't grow the dense part of the dictionary
+    BinaryFrameBuilder frame;
+    frame.dict = {{ 1, "100" }, { 0xFFFFFF, "200" }, { 0xFFFFFFFF, "300" }};
+    frame.ids = { 1, 0xFFFFFF, 0xFFFFFFFF, 0xFFFFFF };
+    frame.ts = { 1000, 1001, 1002, 1003 };
+    frame.xs = { 0.0, 0.5, 1.0, 1.5 };
+    feed_binary(parser, frame.build(false), BinaryProtocolParser::RDBUF_SIZE);
+    parser.close();
+    std::vector<aku_ParamId> expected = { 100, 200, 300, 200 };
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(cons->param_.begin(), cons->param_.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(Test_binary_protocol_errors) {
+    {
+        // Unknown local id
+        std::shared_ptr<ConsumerMock> cons(new ConsumerMock());
+        BinaryProtocolParser parser(cons);
+        parser.start();
+        auto frame = make_binary_frame(3);
+        frame.dict.clear();
+        BOOST_REQUIRE_THROW(feed_binary(parser, frame.build(false), BinaryProtocolParser::RDBUF_SIZE), ProtocolParserError);
+        BOOST_REQUIRE_EQUAL(cons->param_.size(), 0);
+    }
+    {
+        // Bad magic
+        std::shared_ptr<ConsumerMock> cons(new ConsumerMock());
+        BinaryProtocolParser parser(cons);
+        parser.start();
+        auto frame = make_binary_frame(3).build(false);
+        frame[0] = 'X';
+        BOOST_REQUIRE_THROW(feed_binary(parser, frame, BinaryProtocolParser::RDBUF_SIZE), ProtocolParserError);
+    }
+    {
+        // Non-zero reserved field
+        std::shared_ptr<ConsumerMock> cons(new ConsumerMock());
+        BinaryProtocolParser parser(cons);
+        parser.start();
+        auto frame = make_binary_frame(3).build(false);
+        frame[6] = 1;
+        BOOST_REQUIRE_THROW(feed_binary(parser, frame, BinaryProtocolParser::RDBUF_SIZE), ProtocolParserError);
+    }
+    {
+        // Truncated body
+        std::shared_ptr<ConsumerMock> cons(new ConsumerMock());
+        BinaryProtocolParser parser(cons);
+        parser.start();
+        auto frame = make_binary_frame(3).build(false);
+        u32 body_size = static_cast<u32>(frame.size() - BinaryProtocolParser::HEADER_SIZE - 8);
+        memcpy(&frame[8], &body_size, 4);
+        memcpy(&frame[12], &body_size, 4);
+        frame.resize(frame.size() - 8);
+        BOOST_REQUIRE_THROW(feed_binary(parser, frame, BinaryProtocolParser::RDBUF_SIZE), ProtocolParserError);
+    }
+}
@@ -4,6 +4,7 @@
 #define BOOST_TEST_MODULE Main
 #include <boost/test/unit_test.hpp>
 #include <vector>
+#include <map>
 
 #include "queryprocessor_framework.h"
 #include "metadatastorage.h"
@@ -108,6 +109,22 @@ BOOST_AUTO_TEST_CASE(Test_metadata_storage_numeric_config) {
     BOOST_REQUIRE_EQUAL(db_name, actual_db_name);
 }
 
+BOOST_AUTO_TEST_CASE(Test_metadata_storage_set_config_param) {
+
+    MetadataStorage db(":memory:");
+    std::string value = "it's a '); DROP TABLE akumuli_configuration; --";
+    db.set_config_param("test_param", value, "Comment with a quote (')");
+    std::string actual;
+    bool success = db.get_config_param("test_param", &actual);
+    BOOST_REQUIRE(success);
+    BOOST_REQUIRE_EQUAL(value, actual);
+    // Existing value is replaced
+    db.set_config_param("test_param", "1m,1h", "");
+    success = db.get_config_param("test_param", &actual);
+    BOOST_REQUIRE(success);
+    BOOST_REQUIRE_EQUAL("1m,1h", actual);
+}
+
 BOOST_AUTO_TEST_CASE(Test_storage_add_series_1) {
     aku_Status status;
     const char* sname = "hello world=1";
@@ -473,6 +490,58 @@ BOOST_AUTO_TEST_CASE(Test_storage_query) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(Test_storage_write_batch) {
+    std::vector<std::string> series_names = {
+        "test key=0",
+        "test key=1",
+        "test key=2",
+    };
+    auto storage = create_storage();
+    auto session = storage->create_write_session();
+    std::vector<aku_ParamId> sids;
+    for (auto name: series_names) {
+        aku_Sample s;
+        auto status = session->init_series_id(name.data(), name.data() + name.size(), &s);
+        BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+        sids.push_back(s.paramid);
+    }
+    // Samples of different series are interleaved
+    std::vector<aku_ParamId> ids;
+    std::vector<aku_Timestamp> tss;
+    std::vector<double> xss;
+    for (aku_Timestamp ts = 100; ts < 200; ts++) {
+        for (auto id: sids) {
+            ids.push_back(id);
+            tss.push_back(ts);
+            xss.push_back(static_cast<double>(ts));
+        }
+    }
+    auto status = session->write_batch(ids.data(), tss.data(), xss.data(), ids.size());
+    BOOST_REQUIRE_EQUAL(status, AKU_SUCCESS);
+
+    // Late write should be skipped, the rest of the batch should be written
+    ids = { sids.at(0), sids.at(0), sids.at(1) };
+    tss = { 150, 200, 200 };
+    xss = { 150., 200., 200. };
+    status = session->write_batch(ids.data(), tss.data(), xss.data(), ids.size());
+    BOOST_REQUIRE_EQUAL(status, AKU_ELATE_WRITE);
+
+    CursorMock cursor;
+    auto query = make_scan_query(100, 201, OrderBy::SERIES);
+    session->query(&cursor, query.c_str());
+    BOOST_REQUIRE(cursor.done);
+    BOOST_REQUIRE_EQUAL(cursor.error, AKU_SUCCESS);
+    BOOST_REQUIRE_EQUAL(cursor.samples.size(), 100*sids.size() + 2);
+    std::map<aku_ParamId, aku_Timestamp> last;
+    for (auto const& sample: cursor.samples) {
+        BOOST_REQUIRE_EQUAL(sample.payload.float64, static_cast<double>(sample.timestamp));
+        last[sample.paramid] = sample.timestamp;
+    }
+    BOOST_REQUIRE_EQUAL(last[sids.at(0)], 200);
+    BOOST_REQUIRE_EQUAL(last[sids.at(1)], 200);
+    BOOST_REQUIRE_EQUAL(last[sids.at(2)], 199);
+}
+
 // Test metadata query
 
 static void test_metadata_query() {